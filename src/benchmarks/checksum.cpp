@@ -0,0 +1,242 @@
+/*
+ * Copyright 2016-2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *	* Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *	* Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *	* Neither the name of the copyright holder nor the names of its
+ *        contributors may be used to endorse or promote products derived
+ *        from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * checksum.cpp -- benchmark implementation for util_checksum
+ */
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <endian.h>
+
+#include "benchmark.hpp"
+#include "util.h"
+
+/*
+ * checksum_args -- benchmark specific arguments
+ */
+struct checksum_args {
+	bool scalar; /* use the reference scalar loop */
+	bool verify; /* check the checksum instead of inserting it */
+};
+
+/*
+ * checksum_bench -- benchmark context
+ */
+struct checksum_bench {
+	struct checksum_args *pargs; /* prog_args structure */
+
+	/* the actual benchmark operation */
+	int (*func_op)(void *addr, size_t len, uint64_t *csump, int insert);
+};
+
+/*
+ * checksum_scalar -- reference implementation, tests for the checksum
+ * field at every word
+ */
+static int
+checksum_scalar(void *addr, size_t len, uint64_t *csump, int insert)
+{
+	uint32_t *p32 = (uint32_t *)addr;
+	uint32_t *p32end = (uint32_t *)((char *)addr + len);
+	uint32_t lo32 = 0;
+	uint32_t hi32 = 0;
+	uint64_t csum;
+
+	while (p32 < p32end)
+		if (p32 == (uint32_t *)csump) {
+			p32++;
+			hi32 += lo32;
+			p32++;
+			hi32 += lo32;
+		} else {
+			lo32 += le32toh(*p32);
+			++p32;
+			hi32 += lo32;
+		}
+
+	csum = (uint64_t)hi32 << 32 | lo32;
+
+	if (insert) {
+		*csump = htole64(csum);
+		return 1;
+	}
+
+	return *csump == htole64(csum);
+}
+
+/*
+ * checksum_init -- benchmark initialization
+ */
+static int
+checksum_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	assert(bench != NULL);
+	assert(args != NULL);
+
+	if (args->dsize < sizeof(uint64_t) || args->dsize % 4 != 0) {
+		fprintf(stderr, "data size must be a multiple of 4 and at "
+				"least 8 bytes\n");
+		return -1;
+	}
+
+	struct checksum_bench *cb =
+		(struct checksum_bench *)malloc(sizeof(struct checksum_bench));
+	if (cb == NULL) {
+		perror("malloc");
+		return -1;
+	}
+
+	cb->pargs = (struct checksum_args *)args->opts;
+	cb->func_op = cb->pargs->scalar ? checksum_scalar : util_checksum;
+
+	/* select the implementation the libraries use */
+	util_init();
+
+	pmembench_set_priv(bench, cb);
+
+	return 0;
+}
+
+/*
+ * checksum_exit -- benchmark cleanup
+ */
+static int
+checksum_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct checksum_bench *cb =
+		(struct checksum_bench *)pmembench_get_priv(bench);
+	free(cb);
+	return 0;
+}
+
+/*
+ * checksum_init_worker -- allocate and fill the buffer of a worker, with
+ * its checksum at the end, like in the pool headers
+ */
+static int
+checksum_init_worker(struct benchmark *bench, struct benchmark_args *args,
+		     struct worker_info *worker)
+{
+	uint32_t *buf = (uint32_t *)malloc(args->dsize);
+	if (buf == NULL) {
+		perror("malloc");
+		return -1;
+	}
+
+	for (size_t i = 0; i < args->dsize / 4; ++i)
+		buf[i] = (uint32_t)(i * 2654435761u);
+
+	uint64_t *csump =
+		(uint64_t *)((char *)buf + args->dsize - sizeof(uint64_t));
+	util_checksum(buf, args->dsize, csump, 1);
+
+	worker->priv = buf;
+
+	return 0;
+}
+
+/*
+ * checksum_free_worker -- release the buffer of a worker
+ */
+static void
+checksum_free_worker(struct benchmark *bench, struct benchmark_args *args,
+		     struct worker_info *worker)
+{
+	free(worker->priv);
+}
+
+/*
+ * checksum_operation -- actual benchmark operation
+ */
+static int
+checksum_operation(struct benchmark *bench, struct operation_info *info)
+{
+	struct checksum_bench *cb =
+		(struct checksum_bench *)pmembench_get_priv(bench);
+
+	size_t len = info->args->dsize;
+	void *buf = info->worker->priv;
+	uint64_t *csump = (uint64_t *)((char *)buf + len - sizeof(uint64_t));
+
+	if (cb->pargs->verify) {
+		if (!cb->func_op(buf, len, csump, 0)) {
+			fprintf(stderr, "checksum mismatch\n");
+			return -1;
+		}
+	} else {
+		cb->func_op(buf, len, csump, 1);
+	}
+
+	return 0;
+}
+
+/* structure to define command line arguments */
+static struct benchmark_clo checksum_clo[2];
+/* Stores information about benchmark. */
+static struct benchmark_info checksum_bench;
+CONSTRUCTOR(checksum_costructor)
+void
+checksum_costructor(void)
+{
+	checksum_clo[0].opt_short = 0;
+	checksum_clo[0].opt_long = "scalar";
+	checksum_clo[0].descr = "Use the reference scalar implementation";
+	checksum_clo[0].type = CLO_TYPE_FLAG;
+	checksum_clo[0].off = clo_field_offset(struct checksum_args, scalar);
+
+	checksum_clo[1].opt_short = 0;
+	checksum_clo[1].opt_long = "verify";
+	checksum_clo[1].descr = "Verify the checksum instead of inserting it";
+	checksum_clo[1].type = CLO_TYPE_FLAG;
+	checksum_clo[1].off = clo_field_offset(struct checksum_args, verify);
+
+	checksum_bench.name = "util_checksum";
+	checksum_bench.brief = "Benchmark for util_checksum()";
+	checksum_bench.init = checksum_init;
+	checksum_bench.exit = checksum_exit;
+	checksum_bench.init_worker = checksum_init_worker;
+	checksum_bench.free_worker = checksum_free_worker;
+	checksum_bench.multithread = true;
+	checksum_bench.multiops = true;
+	checksum_bench.operation = checksum_operation;
+	checksum_bench.measure_time = true;
+	checksum_bench.clos = checksum_clo;
+	checksum_bench.nclos = ARRAY_SIZE(checksum_clo);
+	checksum_bench.opts_size = sizeof(struct checksum_args);
+	checksum_bench.rm_file = false;
+	checksum_bench.allow_poolset = false;
+	REGISTER_BENCHMARK(checksum_bench);
+}
@@ -36,6 +36,7 @@
 
 #include <cassert>
 #include <cerrno>
+#include <climits>
 #include <unistd.h>
 
 #include "benchmark.hpp"
@@ -44,6 +45,7 @@
 /* an internal libpmemobj code */
 extern "C" {
 #include "lane.h"
+#include "obj.h"
 }
 
 /*
@@ -58,6 +60,8 @@ extern "C" {
  */
 struct prog_args {
 	char *lane_section_name; /* lane section to be held */
+	unsigned nlanes;	 /* number of lanes available, 0 means all */
+	unsigned hold_ops;	 /* iterations of work while holding a lane */
 };
 
 /*
@@ -67,6 +71,7 @@ struct obj_bench {
 	PMEMobjpool *pop;		  /* persistent pool handle */
 	struct prog_args *pa;		  /* prog_args structure */
 	enum lane_section_type lane_type; /* lane section to be held */
+	unsigned runtime_nlanes;	  /* lanes available before the run */
 };
 
 /*
@@ -117,11 +122,26 @@ lanes_init(struct benchmark *bench, struct benchmark_args *args)
 	ob->lane_type = parse_lane_section(ob->pa->lane_section_name);
 	if (ob->lane_type == MAX_LANE_SECTION) {
 		fprintf(stderr, "wrong lane type\n");
-		goto err;
+		goto err_close;
+	}
+
+	/*
+	 * Limiting the number of lanes makes it possible to measure the
+	 * acquisition under contention without thousands of threads.
+	 */
+	ob->runtime_nlanes = ob->pop->lanes_desc.runtime_nlanes;
+	if (ob->pa->nlanes != 0) {
+		if (ob->pa->nlanes > ob->pop->lanes_desc.runtime_nlanes) {
+			fprintf(stderr, "too many lanes\n");
+			goto err_close;
+		}
+		ob->pop->lanes_desc.runtime_nlanes = ob->pa->nlanes;
 	}
 
 	return 0;
 
+err_close:
+	pmemobj_close(ob->pop);
 err:
 	free(ob);
 	return -1;
@@ -135,6 +155,8 @@ lanes_exit(struct benchmark *bench, struct benchmark_args *args)
 {
 	struct obj_bench *ob = (struct obj_bench *)pmembench_get_priv(bench);
 
+	/* all of the lanes booted with the pool have to be cleaned up */
+	ob->pop->lanes_desc.runtime_nlanes = ob->runtime_nlanes;
 	pmemobj_close(ob->pop);
 	free(ob);
 
@@ -153,12 +175,15 @@ lanes_op(struct benchmark *bench, struct operation_info *info)
 	for (int i = 0; i < OPERATION_REPEAT_COUNT; i++) {
 		lane_hold(ob->pop, &section, ob->lane_type);
 
+		for (volatile unsigned j = 0; j < ob->pa->hold_ops; j = j + 1)
+			;
+
 		lane_release(ob->pop);
 	}
 
 	return 0;
 }
-static struct benchmark_clo lanes_clo[1];
+static struct benchmark_clo lanes_clo[3];
 static struct benchmark_info lanes_info;
 
 CONSTRUCTOR(obj_lines_costructor)
@@ -174,6 +199,31 @@ obj_lines_costructor(void)
 		clo_field_offset(struct prog_args, lane_section_name);
 	lanes_clo[0].def = "allocator";
 
+	lanes_clo[1].opt_short = 'l';
+	lanes_clo[1].opt_long = "nlanes";
+	lanes_clo[1].descr = "The number of lanes available to the threads,"
+			     " 0 means all of the pool's lanes";
+	lanes_clo[1].type = CLO_TYPE_UINT;
+	lanes_clo[1].off = clo_field_offset(struct prog_args, nlanes);
+	lanes_clo[1].def = "0";
+	lanes_clo[1].type_uint.size = clo_field_size(struct prog_args, nlanes);
+	lanes_clo[1].type_uint.base = CLO_INT_BASE_DEC;
+	lanes_clo[1].type_uint.min = 0;
+	lanes_clo[1].type_uint.max = UINT_MAX;
+
+	lanes_clo[2].opt_short = 'w';
+	lanes_clo[2].opt_long = "hold_ops";
+	lanes_clo[2].descr = "The number of iterations of an empty loop"
+			     " executed while holding a lane";
+	lanes_clo[2].type = CLO_TYPE_UINT;
+	lanes_clo[2].off = clo_field_offset(struct prog_args, hold_ops);
+	lanes_clo[2].def = "0";
+	lanes_clo[2].type_uint.size =
+		clo_field_size(struct prog_args, hold_ops);
+	lanes_clo[2].type_uint.base = CLO_INT_BASE_DEC;
+	lanes_clo[2].type_uint.min = 0;
+	lanes_clo[2].type_uint.max = UINT_MAX;
+
 	lanes_info.name = "obj_lanes";
 	lanes_info.brief = "Benchmark for internal lanes "
 			   "operation";
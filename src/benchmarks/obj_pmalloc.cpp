@@ -73,6 +73,7 @@ struct prog_args {
 	size_t minsize;       /* minimum size for random allocation size */
 	bool use_random_size; /* if set, use random size allocations */
 	unsigned seed;	/* PRNG seed */
+	char *container;      /* block container used by run buckets */
 };
 
 POBJ_LAYOUT_BEGIN(pmalloc_layout);
@@ -114,6 +115,19 @@ obj_init(struct benchmark *bench, struct benchmark_args *args)
 		return -1;
 	}
 
+	char *container = ((struct prog_args *)(args->opts))->container;
+	if (strcmp(container, "ctree") != 0 &&
+	    strcmp(container, "seglists") != 0) {
+		fprintf(stderr, "unknown container: %s\n", container);
+		return -1;
+	}
+
+	/* the heap picks the container of run buckets when it's opened */
+	if (setenv("PMEMOBJ_RUN_CONTAINER", container, 1) != 0) {
+		perror("setenv");
+		return -1;
+	}
+
 	struct obj_bench *ob =
 		(struct obj_bench *)malloc(sizeof(struct obj_bench));
 	if (ob == NULL) {
@@ -314,7 +328,7 @@ pfree_op(struct benchmark *bench, struct operation_info *info)
 }
 
 /* command line options definition */
-static struct benchmark_clo pmalloc_clo[3];
+static struct benchmark_clo pmalloc_clo[4];
 /*
  * Stores information about pmalloc benchmark.
  */
@@ -360,6 +374,14 @@ obj_pmalloc_costructor(void)
 	pmalloc_clo[2].type_uint.min = 1;
 	pmalloc_clo[2].type_uint.max = UINT_MAX;
 
+	pmalloc_clo[3].opt_short = 'c';
+	pmalloc_clo[3].opt_long = "container";
+	pmalloc_clo[3].descr = "Block container of run buckets "
+			       "[ctree|seglists]";
+	pmalloc_clo[3].off = clo_field_offset(struct prog_args, container);
+	pmalloc_clo[3].def = "ctree";
+	pmalloc_clo[3].type = CLO_TYPE_STR;
+
 	pmalloc_info.name = "pmalloc",
 	pmalloc_info.brief = "Benchmark for internal pmalloc() "
 			     "operation";
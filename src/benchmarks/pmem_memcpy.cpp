@@ -45,7 +45,10 @@
 
 #include "benchmark.hpp"
 
-#define FLUSH_ALIGN 64
+extern "C" {
+#include "cpu.h"
+#include "movnt.h"
+}
 
 #define MAX_OFFSET (FLUSH_ALIGN - 1)
 
@@ -106,6 +109,32 @@ struct pmem_args {
 	 * function is used, otherwise pmem_flush() is performed.
 	 */
 	bool persist;
+
+	/*
+	 * Non-temporal copy variant used by libpmem: auto, sse2, avx2
+	 * or avx512f. Any value other than "auto" calls the selected
+	 * variant directly, bypassing the one chosen at pmem_init().
+	 */
+	char *movnt;
+
+	/*
+	 * When this flag is set to true, libpmem thresholds for using
+	 * non-temporal stores are measured on the benchmark file first.
+	 */
+	bool calibrate;
+
+	/*
+	 * When this flag is set to true, pmem_memcpy_async() is used
+	 * and the copy is overlapped with the simulated work.
+	 */
+	bool async;
+
+	/*
+	 * The number of bytes processed after each copy, simulating the
+	 * work (e.g. parsing the next record) an application does between
+	 * the copies.
+	 */
+	size_t work;
 };
 
 /*
@@ -266,6 +295,29 @@ assign_mode_func(char *option)
 	}
 }
 
+/*
+ * movnt_func -- non-temporal copy variant selected with "movnt" argument
+ */
+static void *(*movnt_func)(void *pmemdest, const void *src, size_t len);
+
+/*
+ * parse_movnt -- parses command line "--movnt" and returns the matching
+ * non-temporal copy variant, NULL for "auto" or when the variant is not
+ * supported by the platform
+ */
+static void *(*parse_movnt(const char *arg))(void *, const void *, size_t)
+{
+	if (strcmp(arg, "sse2") == 0)
+		return memmove_nodrain_movnt;
+	if (strcmp(arg, "avx2") == 0 && is_cpu_avx2_present())
+		return memmove_nodrain_movnt_avx2;
+#ifdef AVX512F_AVAILABLE
+	if (strcmp(arg, "avx512f") == 0 && is_cpu_avx512f_present())
+		return memmove_nodrain_movnt_avx512f;
+#endif
+	return NULL;
+}
+
 /*
  * libc_memcpy -- copy using libc memcpy() function
  * followed by pmem_flush().
@@ -317,6 +369,50 @@ libpmem_memcpy_persist(void *dest, void *source, size_t len)
 	return 0;
 }
 
+/*
+ * movnt_memcpy_nodrain -- copy using selected non-temporal variant
+ * without pmem_drain().
+ */
+static int
+movnt_memcpy_nodrain(void *dest, void *source, size_t len)
+{
+	movnt_func(dest, source, len);
+
+	return 0;
+}
+
+/*
+ * movnt_memcpy_persist -- copy using selected non-temporal variant
+ * followed by pmem_drain().
+ */
+static int
+movnt_memcpy_persist(void *dest, void *source, size_t len)
+{
+	movnt_func(dest, source, len);
+
+	pmem_drain();
+
+	return 0;
+}
+
+/*
+ * Work_result -- keeps the simulated work from being optimized out
+ */
+static volatile uint64_t Work_result;
+
+/*
+ * simulate_work -- (internal) processes len bytes of the buffer
+ */
+static void
+simulate_work(const unsigned char *buf, size_t len)
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i < len; ++i)
+		sum = sum * 31 + buf[i];
+
+	Work_result = sum;
+}
+
 /*
  * assign_size -- assigns file and buffer size
  * depending on the operation mode and type.
@@ -370,6 +466,30 @@ assign_size(struct pmem_bench *pmb, struct benchmark_args *args,
 	return 0;
 }
 
+/*
+ * calibrate_movnt -- measures the libpmem non-temporal store thresholds
+ * on the benchmark file and reports them
+ */
+static int
+calibrate_movnt(void *addr, size_t len)
+{
+	if (len < PMEM_CALIBRATE_MIN_LEN)
+		addr = NULL;
+
+	if (pmem_calibrate(addr, len) != 0) {
+		perror("pmem_calibrate");
+		return -1;
+	}
+
+	size_t memcpy_threshold;
+	size_t memset_threshold;
+	pmem_get_movnt_thresholds(&memcpy_threshold, &memset_threshold);
+	fprintf(stderr, "movnt threshold: memcpy %zu memset %zu\n",
+		memcpy_threshold, memset_threshold);
+
+	return 0;
+}
+
 /*
  * pmem_memcpy_init -- benchmark initialization
  *
@@ -438,6 +558,12 @@ pmem_memcpy_init(struct benchmark *bench, struct benchmark_args *args)
 		pmb->dest_addr = pmb->pmem_addr;
 	}
 
+	if (pmb->pargs->calibrate &&
+	    calibrate_movnt(pmb->pmem_addr, pmb->fsize) != 0) {
+		ret = -1;
+		goto err_unmap;
+	}
+
 	/* set proper func_src() and func_dest() depending on benchmark args */
 	if ((pmb->func_src = assign_mode_func(pmb->pargs->src_mode)) == NULL) {
 		fprintf(stderr, "wrong src_mode parameter -- '%s'",
@@ -454,9 +580,27 @@ pmem_memcpy_init(struct benchmark *bench, struct benchmark_args *args)
 		goto err_unmap;
 	}
 
+	if (pmb->pargs->async &&
+	    (pmb->pargs->memcpy || !pmb->pargs->persist ||
+	     strcmp(pmb->pargs->movnt, "auto") != 0)) {
+		fprintf(stderr, "async cannot be combined with libc-memcpy, "
+				"movnt or persist=false\n");
+		ret = -1;
+		goto err_unmap;
+	}
+
 	if (pmb->pargs->memcpy) {
 		pmb->func_op =
 			pmb->pargs->persist ? libc_memcpy_persist : libc_memcpy;
+	} else if (strcmp(pmb->pargs->movnt, "auto") != 0) {
+		if ((movnt_func = parse_movnt(pmb->pargs->movnt)) == NULL) {
+			fprintf(stderr, "unsupported movnt parameter -- '%s'\n",
+				pmb->pargs->movnt);
+			ret = -1;
+			goto err_unmap;
+		}
+		pmb->func_op = pmb->pargs->persist ? movnt_memcpy_persist
+						   : movnt_memcpy_nodrain;
 	} else {
 		pmb->func_op = pmb->pargs->persist ? libpmem_memcpy_persist
 						   : libpmem_memcpy_nodrain;
@@ -500,11 +644,63 @@ pmem_memcpy_operation(struct benchmark *bench, struct operation_info *info)
 	void *dest = pmb->dest_addr + dest_index * pmb->pargs->chunk_size +
 		pmb->pargs->dest_off;
 	size_t len = pmb->pargs->chunk_size;
+	unsigned char *work_buf = (unsigned char *)info->worker->priv;
+
+	if (!pmb->pargs->async) {
+		pmb->func_op(dest, source, len);
+		simulate_work(work_buf, pmb->pargs->work);
+		return 0;
+	}
 
-	pmb->func_op(dest, source, len);
+	struct pmem_async *req = pmem_memcpy_async(dest, source, len);
+	if (req == NULL) {
+		perror("pmem_memcpy_async");
+		return -1;
+	}
+
+	simulate_work(work_buf, pmb->pargs->work);
+
+	pmem_async_release(req);
 	return 0;
 }
 
+/*
+ * pmem_memcpy_init_worker -- allocates the buffer processed by the
+ * simulated work
+ */
+static int
+pmem_memcpy_init_worker(struct benchmark *bench, struct benchmark_args *args,
+			struct worker_info *worker)
+{
+	struct pmem_bench *pmb = (struct pmem_bench *)pmembench_get_priv(bench);
+
+	worker->priv = NULL;
+	if (pmb->pargs->work == 0)
+		return 0;
+
+	unsigned char *work_buf = (unsigned char *)malloc(pmb->pargs->work);
+	if (work_buf == NULL) {
+		perror("malloc");
+		return -1;
+	}
+
+	memset(work_buf, 0xa5, pmb->pargs->work);
+	worker->priv = work_buf;
+
+	return 0;
+}
+
+/*
+ * pmem_memcpy_free_worker -- frees the buffer processed by the simulated
+ * work
+ */
+static void
+pmem_memcpy_free_worker(struct benchmark *bench, struct benchmark_args *args,
+			struct worker_info *worker)
+{
+	free(worker->priv);
+}
+
 /*
  * pmem_memcpy_exit -- benchmark cleanup
  */
@@ -520,7 +716,7 @@ pmem_memcpy_exit(struct benchmark *bench, struct benchmark_args *args)
 }
 
 /* structure to define command line arguments */
-static struct benchmark_clo pmem_memcpy_clo[7];
+static struct benchmark_clo pmem_memcpy_clo[11];
 
 /* Stores information about benchmark. */
 static struct benchmark_info pmem_memcpy;
@@ -589,6 +785,42 @@ pmem_memcpy_costructor(void)
 	pmem_memcpy_clo[6].off = clo_field_offset(struct pmem_args, persist);
 	pmem_memcpy_clo[6].def = "true";
 
+	pmem_memcpy_clo[7].opt_short = 0;
+	pmem_memcpy_clo[7].opt_long = "movnt";
+	pmem_memcpy_clo[7].descr = "Non-temporal copy variant - auto, sse2, "
+				   "avx2, avx512f";
+	pmem_memcpy_clo[7].type = CLO_TYPE_STR;
+	pmem_memcpy_clo[7].off = clo_field_offset(struct pmem_args, movnt);
+	pmem_memcpy_clo[7].def = "auto";
+
+	pmem_memcpy_clo[8].opt_short = 0;
+	pmem_memcpy_clo[8].opt_long = "calibrate";
+	pmem_memcpy_clo[8].descr = "Calibrate non-temporal store thresholds";
+	pmem_memcpy_clo[8].type = CLO_TYPE_FLAG;
+	pmem_memcpy_clo[8].off = clo_field_offset(struct pmem_args, calibrate);
+	pmem_memcpy_clo[8].def = "false";
+
+	pmem_memcpy_clo[9].opt_short = 0;
+	pmem_memcpy_clo[9].opt_long = "async";
+	pmem_memcpy_clo[9].descr = "Use pmem_memcpy_async() overlapped with "
+				   "the simulated work";
+	pmem_memcpy_clo[9].type = CLO_TYPE_FLAG;
+	pmem_memcpy_clo[9].off = clo_field_offset(struct pmem_args, async);
+	pmem_memcpy_clo[9].def = "false";
+
+	pmem_memcpy_clo[10].opt_short = 0;
+	pmem_memcpy_clo[10].opt_long = "work";
+	pmem_memcpy_clo[10].descr = "Number of bytes processed after each "
+				    "copy to simulate work";
+	pmem_memcpy_clo[10].type = CLO_TYPE_UINT;
+	pmem_memcpy_clo[10].off = clo_field_offset(struct pmem_args, work);
+	pmem_memcpy_clo[10].def = "0";
+	pmem_memcpy_clo[10].type_uint.size =
+		clo_field_size(struct pmem_args, work);
+	pmem_memcpy_clo[10].type_uint.base = CLO_INT_BASE_DEC;
+	pmem_memcpy_clo[10].type_uint.min = 0;
+	pmem_memcpy_clo[10].type_uint.max = UINT_MAX;
+
 	pmem_memcpy.name = "pmem_memcpy";
 	pmem_memcpy.brief = "Benchmark for"
 			    "pmem_memcpy_persist() and "
@@ -596,6 +828,8 @@ pmem_memcpy_costructor(void)
 			    "operations";
 	pmem_memcpy.init = pmem_memcpy_init;
 	pmem_memcpy.exit = pmem_memcpy_exit;
+	pmem_memcpy.init_worker = pmem_memcpy_init_worker;
+	pmem_memcpy.free_worker = pmem_memcpy_free_worker;
 	pmem_memcpy.multithread = true;
 	pmem_memcpy.multiops = true;
 	pmem_memcpy.operation = pmem_memcpy_operation;
@@ -44,6 +44,11 @@
 
 #include "benchmark.hpp"
 
+extern "C" {
+#include "cpu.h"
+#include "movnt.h"
+}
+
 #define MAX_OFFSET 63
 #define CONST_B 0xFF
 
@@ -62,6 +67,8 @@ struct memset_args {
 	size_t chunk_size; /* elementary chunk size */
 	size_t dest_off;   /* destination address offset */
 	unsigned seed;     /* seed for random numbers */
+	char *movnt;       /* non-temporal variant: auto, sse2, avx2, avx512f */
+	bool calibrate;    /* calibrate non-temporal store thresholds */
 };
 
 /*
@@ -183,6 +190,55 @@ libpmem_memset_nodrain(void *dest, int c, size_t len)
 	return 0;
 }
 
+/*
+ * movnt_func -- non-temporal memset variant selected with "movnt" argument
+ */
+static void *(*movnt_func)(void *pmemdest, int c, size_t len);
+
+/*
+ * parse_movnt -- parses command line "--movnt" and returns the matching
+ * non-temporal memset variant, NULL for "auto" or when the variant is not
+ * supported by the platform
+ */
+static void *(*parse_movnt(const char *arg))(void *, int, size_t)
+{
+	if (strcmp(arg, "sse2") == 0)
+		return memset_nodrain_movnt;
+	if (strcmp(arg, "avx2") == 0 && is_cpu_avx2_present())
+		return memset_nodrain_movnt_avx2;
+#ifdef AVX512F_AVAILABLE
+	if (strcmp(arg, "avx512f") == 0 && is_cpu_avx512f_present())
+		return memset_nodrain_movnt_avx512f;
+#endif
+	return NULL;
+}
+
+/*
+ * movnt_memset_persist -- perform operation using selected non-temporal
+ * variant followed by pmem_drain().
+ */
+static int
+movnt_memset_persist(void *dest, int c, size_t len)
+{
+	movnt_func(dest, c, len);
+
+	pmem_drain();
+
+	return 0;
+}
+
+/*
+ * movnt_memset_nodrain -- perform operation using selected non-temporal
+ * variant without pmem_drain().
+ */
+static int
+movnt_memset_nodrain(void *dest, int c, size_t len)
+{
+	movnt_func(dest, c, len);
+
+	return 0;
+}
+
 /*
  * libc_memset_persist -- perform operation using libc memset() function
  * followed by pmem_persist().
@@ -239,6 +295,30 @@ memset_op(struct benchmark *bench, struct operation_info *info)
 	return 0;
 }
 
+/*
+ * calibrate_movnt -- measures the libpmem non-temporal store thresholds
+ * on the benchmark file and reports them
+ */
+static int
+calibrate_movnt(void *addr, size_t len)
+{
+	if (len < PMEM_CALIBRATE_MIN_LEN)
+		addr = NULL;
+
+	if (pmem_calibrate(addr, len) != 0) {
+		perror("pmem_calibrate");
+		return -1;
+	}
+
+	size_t memcpy_threshold;
+	size_t memset_threshold;
+	pmem_get_movnt_thresholds(&memcpy_threshold, &memset_threshold);
+	fprintf(stderr, "movnt threshold: memcpy %zu memset %zu\n",
+		memcpy_threshold, memset_threshold);
+
+	return 0;
+}
+
 /*
  * memset_init -- initialization function
  */
@@ -286,6 +366,14 @@ memset_init(struct benchmark *bench, struct benchmark_args *args)
 	/* initialize memset() value */
 	mb->const_b = CONST_B;
 
+	if (strcmp(mb->pargs->movnt, "auto") != 0 &&
+	    (movnt_func = parse_movnt(mb->pargs->movnt)) == NULL) {
+		fprintf(stderr, "unsupported movnt parameter -- '%s'\n",
+			mb->pargs->movnt);
+		ret = -1;
+		goto err_free_offsets;
+	}
+
 	/* create a pmem file and memory map it */
 	if ((mb->pmem_addr = pmem_map_file(args->fname, mb->fsize,
 					   PMEM_FILE_CREATE | PMEM_FILE_EXCL,
@@ -295,9 +383,18 @@ memset_init(struct benchmark *bench, struct benchmark_args *args)
 		goto err_free_offsets;
 	}
 
+	if (mb->pargs->calibrate &&
+	    calibrate_movnt(mb->pmem_addr, mb->fsize) != 0) {
+		ret = -1;
+		goto err_unmap;
+	}
+
 	if (mb->pargs->memset)
 		mb->func_op = (mb->pargs->persist) ? libc_memset_persist
 						   : libc_memset;
+	else if (strcmp(mb->pargs->movnt, "auto") != 0)
+		mb->func_op = (mb->pargs->persist) ? movnt_memset_persist
+						   : movnt_memset_nodrain;
 	else
 		mb->func_op = (mb->pargs->persist) ? libpmem_memset_persist
 						   : libpmem_memset_nodrain;
@@ -310,6 +407,8 @@ memset_init(struct benchmark *bench, struct benchmark_args *args)
 
 	return 0;
 
+err_unmap:
+	pmem_unmap(mb->pmem_addr, mb->fsize);
 err_free_offsets:
 	free(mb->offsets);
 err_free_mb:
@@ -332,7 +431,7 @@ memset_exit(struct benchmark *bench, struct benchmark_args *args)
 	return 0;
 }
 
-static struct benchmark_clo memset_clo[6];
+static struct benchmark_clo memset_clo[8];
 /* Stores information about benchmark. */
 static struct benchmark_info memset_info;
 CONSTRUCTOR(pmem_memset_costructor)
@@ -392,6 +491,21 @@ pmem_memset_costructor(void)
 	memset_clo[5].type_uint.min = 1;
 	memset_clo[5].type_uint.max = UINT_MAX;
 
+	memset_clo[6].opt_short = 0;
+	memset_clo[6].opt_long = "movnt";
+	memset_clo[6].descr = "Non-temporal memset variant - auto, sse2, "
+			      "avx2, avx512f";
+	memset_clo[6].def = "auto";
+	memset_clo[6].off = clo_field_offset(struct memset_args, movnt);
+	memset_clo[6].type = CLO_TYPE_STR;
+
+	memset_clo[7].opt_short = 0;
+	memset_clo[7].opt_long = "calibrate";
+	memset_clo[7].descr = "Calibrate non-temporal store thresholds";
+	memset_clo[7].def = "false";
+	memset_clo[7].off = clo_field_offset(struct memset_args, calibrate);
+	memset_clo[7].type = CLO_TYPE_FLAG;
+
 	memset_info.name = "pmem_memset";
 	memset_info.brief = "Benchmark for pmem_memset_persist() "
 			    "and pmem_memset_nodrain() operations";
@@ -95,6 +95,11 @@ enum type_mode {
  * obj_size	: Size of each allocated object
  *
  * n_ops	: Number of operations
+ *
+ * pool_size	: Size of the pool, if zero it's derived from number of objects
+ *
+ * zone_load_threads : Number of threads loading heap zones at pool open,
+ *		  zero means the zones are loaded lazily
  */
 struct pobj_args {
 	char *type_num;
@@ -105,6 +110,8 @@ struct pobj_args {
 	bool one_obj;
 	size_t obj_size;
 	size_t n_ops;
+	size_t pool_size;
+	unsigned zone_load_threads;
 };
 
 /*
@@ -325,9 +332,19 @@ pobj_init(struct benchmark *bench, struct benchmark_args *args)
 	if (bench_priv->n_pools == 1)
 		n_objs *= args->n_threads;
 	psize = n_objs * args->dsize * args->n_threads * FACTOR;
+	if (psize < bench_priv->args_priv->pool_size)
+		psize = bench_priv->args_priv->pool_size;
 	if (psize < PMEMOBJ_MIN_POOL)
 		psize = PMEMOBJ_MIN_POOL;
 
+	char zone_load_threads[sizeof("4294967295")];
+	snprintf(zone_load_threads, sizeof(zone_load_threads), "%u",
+		 bench_priv->args_priv->zone_load_threads);
+	if (setenv("PMEMOBJ_ZONE_LOAD_THREADS", zone_load_threads, 1) != 0) {
+		perror("setenv");
+		goto free_bench_priv;
+	}
+
 	/* assign type_number determining function */
 	bench_priv->type_mode =
 		parse_type_mode(bench_priv->args_priv->type_num);
@@ -574,7 +591,7 @@ static struct benchmark_info obj_direct;
 /* Array defining common command line arguments. */
 static struct benchmark_clo pobj_direct_clo[4];
 
-static struct benchmark_clo pobj_open_clo[3];
+static struct benchmark_clo pobj_open_clo[5];
 
 CONSTRUCTOR(pmemobj_gen_costructor)
 void
@@ -643,6 +660,32 @@ pmemobj_gen_costructor(void)
 	pobj_open_clo[2].type_uint.min = 1;
 	pobj_open_clo[2].type_uint.max = UINT_MAX;
 
+	pobj_open_clo[3].opt_short = 's';
+	pobj_open_clo[3].opt_long = "pool-size";
+	pobj_open_clo[3].type = CLO_TYPE_UINT;
+	pobj_open_clo[3].descr = "Minimum size of each pool";
+	pobj_open_clo[3].off = clo_field_offset(struct pobj_args, pool_size);
+	pobj_open_clo[3].def = "0";
+	pobj_open_clo[3].type_uint.size =
+		clo_field_size(struct pobj_args, pool_size);
+	pobj_open_clo[3].type_uint.base = CLO_INT_BASE_DEC | CLO_INT_BASE_HEX;
+	pobj_open_clo[3].type_uint.min = 0;
+	pobj_open_clo[3].type_uint.max = UINT64_MAX;
+
+	pobj_open_clo[4].opt_short = 'z';
+	pobj_open_clo[4].opt_long = "zone-load-threads";
+	pobj_open_clo[4].type = CLO_TYPE_UINT;
+	pobj_open_clo[4].descr = "Number of threads loading heap zones "
+				 "at open, 0 - lazy loading";
+	pobj_open_clo[4].off =
+		clo_field_offset(struct pobj_args, zone_load_threads);
+	pobj_open_clo[4].def = "0";
+	pobj_open_clo[4].type_uint.size =
+		clo_field_size(struct pobj_args, zone_load_threads);
+	pobj_open_clo[4].type_uint.base = CLO_INT_BASE_DEC;
+	pobj_open_clo[4].type_uint.min = 0;
+	pobj_open_clo[4].type_uint.max = UINT_MAX;
+
 	obj_open.name = "obj_open";
 	obj_open.brief = "pmemobj_open() benchmark";
 	obj_open.init = pobj_init;
@@ -423,6 +423,7 @@ util_unmap_part(struct pool_set_part *part)
 
 	if (part->addr != NULL && part->size != 0) {
 		LOG(4, "munmap: addr %p size %zu", part->addr, part->size);
+		_pmem_range_unregister(part->addr, part->size);
 		VALGRIND_REMOVE_PMEM_MAPPING(part->addr, part->size);
 		if (munmap(part->addr, part->size) != 0) {
 			ERR("!munmap: %s", part->path);
@@ -546,6 +547,9 @@ util_poolset_close(struct pool_set *set, int del)
 
 	int oerrno = errno;
 
+	/* sync the ranges of non-pmem replicas deferred by pmem_msync() */
+	(void) pmem_msync_barrier();
+
 	for (unsigned r = 0; r < set->nreplicas; r++) {
 		util_replica_close(set, r);
 
@@ -1882,6 +1886,8 @@ util_replica_create_local(struct pool_set *set, unsigned repidx, int flags,
 		}
 	} while (retry_for_contiguous_addr);
 
+	/* the whole replica is checked by the first pmem_is_pmem() call */
+	_pmem_range_register(rep->part[0].addr, rep->repsize);
 	rep->is_pmem = pmem_is_pmem(rep->part[0].addr, rep->part[0].size);
 
 	ASSERTeq(mapsize, rep->repsize);
@@ -2283,6 +2289,8 @@ util_replica_open_local(struct pool_set *set, unsigned repidx, int flags)
 		}
 	} while (retry_for_contiguous_addr);
 
+	/* the whole replica is checked by the first pmem_is_pmem() call */
+	_pmem_range_register(rep->part[0].addr, rep->repsize);
 	rep->is_pmem = pmem_is_pmem(rep->part[0].addr, rep->part[0].size);
 
 	ASSERTeq(mapsize, rep->repsize);
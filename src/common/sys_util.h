@@ -39,6 +39,7 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <stdint.h>
 
 /*
  * util_mutex_init -- pthread_mutex_init variant that never fails from
@@ -85,6 +86,26 @@ util_mutex_lock(pthread_mutex_t *m)
 	}
 }
 
+/*
+ * util_mutex_lock_count -- util_mutex_lock variant that increments the
+ * counter if the mutex was already locked by someone else.
+ */
+static inline void
+util_mutex_lock_count(pthread_mutex_t *m, uint64_t *contended)
+{
+	int tmp = pthread_mutex_trylock(m);
+	if (tmp == 0)
+		return;
+
+	if (tmp != EBUSY) {
+		errno = tmp;
+		FATAL("!pthread_mutex_trylock");
+	}
+
+	__sync_fetch_and_add(contended, 1);
+	util_mutex_lock(m);
+}
+
 /*
  * util_mutex_unlock -- pthread_mutex_unlock variant that never fails from
  * caller perspective. If pthread_mutex_unlock failed, this function aborts
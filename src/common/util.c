@@ -40,6 +40,7 @@
 #include <unistd.h>
 #include <endian.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "util.h"
 #include "valgrind_internal.h"
@@ -89,6 +90,136 @@ util_is_zeroed(const void *addr, size_t len)
 	return 1;
 }
 
+#if defined(__x86_64__) || defined(__amd64__) ||\
+	defined(_M_X64) || defined(_M_AMD64)
+#define FLETCHER64_SIMD
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define ATTR_TARGET_AVX2
+#else
+#define ATTR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/*
+ * Fletcher64 running sums
+ *
+ * The sums of a block of n words, computed from zero, are combined with
+ * the sums of the data preceding the block as:
+ *	lo' = lo + blo
+ *	hi' = hi + n * lo + bhi
+ * so the range can be checksummed in pieces, with the checksum field
+ * handled between them instead of being tested for in the inner loop.
+ */
+struct fletcher64 {
+	uint32_t lo;
+	uint32_t hi;
+};
+
+typedef void (*fletcher64_func)(struct fletcher64 *f, const uint32_t *p,
+		size_t n);
+
+/*
+ * fletcher64_scalar -- (internal) add n words to the sums, one at a time
+ */
+static void
+fletcher64_scalar(struct fletcher64 *f, const uint32_t *p, size_t n)
+{
+	uint32_t lo = f->lo;
+	uint32_t hi = f->hi;
+
+	for (size_t i = 0; i < n; ++i) {
+		lo += le32toh(p[i]);
+		hi += lo;
+	}
+
+	f->lo = lo;
+	f->hi = hi;
+}
+
+#ifdef FLETCHER64_SIMD
+/*
+ * fletcher64_lanes -- (internal) add the sums of nrows rows of nlanes words
+ * kept by the vector versions to the sums
+ *
+ * For every lane j, a[j] is the sum of its words and s[j] is the sum of
+ * a[j] taken after every row, so the word in row r contributes
+ * (nrows - r) * nlanes - j times to hi.
+ */
+static void
+fletcher64_lanes(struct fletcher64 *f, const uint32_t *a, const uint32_t *s,
+	uint32_t nlanes, size_t nrows)
+{
+	uint32_t blo = 0;
+	uint32_t bhi = 0;
+
+	for (uint32_t j = 0; j < nlanes; ++j) {
+		blo += a[j];
+		bhi += nlanes * s[j] - j * a[j];
+	}
+
+	f->hi += (uint32_t)(nrows * nlanes) * f->lo + bhi;
+	f->lo += blo;
+}
+
+/*
+ * fletcher64_sse2 -- (internal) add n words to the sums, four at a time
+ */
+static void
+fletcher64_sse2(struct fletcher64 *f, const uint32_t *p, size_t n)
+{
+	size_t nrows = n / 4;
+	const __m128i *row = (const __m128i *)p;
+	__m128i a = _mm_setzero_si128();
+	__m128i s = _mm_setzero_si128();
+
+	for (size_t r = 0; r < nrows; ++r) {
+		a = _mm_add_epi32(a, _mm_loadu_si128(row + r));
+		s = _mm_add_epi32(s, a);
+	}
+
+	uint32_t av[4];
+	uint32_t sv[4];
+	_mm_storeu_si128((__m128i *)av, a);
+	_mm_storeu_si128((__m128i *)sv, s);
+	fletcher64_lanes(f, av, sv, 4, nrows);
+
+	fletcher64_scalar(f, p + nrows * 4, n % 4);
+}
+
+/*
+ * fletcher64_avx2 -- (internal) add n words to the sums, eight at a time
+ */
+ATTR_TARGET_AVX2
+static void
+fletcher64_avx2(struct fletcher64 *f, const uint32_t *p, size_t n)
+{
+	size_t nrows = n / 8;
+	const __m256i *row = (const __m256i *)p;
+	__m256i a = _mm256_setzero_si256();
+	__m256i s = _mm256_setzero_si256();
+
+	for (size_t r = 0; r < nrows; ++r) {
+		a = _mm256_add_epi32(a, _mm256_loadu_si256(row + r));
+		s = _mm256_add_epi32(s, a);
+	}
+
+	uint32_t av[8];
+	uint32_t sv[8];
+	_mm256_storeu_si256((__m256i *)av, a);
+	_mm256_storeu_si256((__m256i *)sv, s);
+	fletcher64_lanes(f, av, sv, 8, nrows);
+
+	fletcher64_scalar(f, p + nrows * 8, n % 8);
+}
+
+/* selected by util_init */
+static fletcher64_func Fletcher64 = fletcher64_sse2;
+#else
+static fletcher64_func Fletcher64 = fletcher64_scalar;
+#endif
+
 /*
  * util_checksum -- compute Fletcher64 checksum
  *
@@ -106,27 +237,28 @@ util_checksum(void *addr, size_t len, uint64_t *csump, int insert)
 	if (len % 4 != 0)
 		abort();
 
-	uint32_t *p32 = addr;
-	uint32_t *p32end = (uint32_t *)((char *)addr + len);
-	uint32_t lo32 = 0;
-	uint32_t hi32 = 0;
+	const uint32_t *p32 = addr;
+	size_t nwords = len / 4;
+	struct fletcher64 f = { 0, 0 };
 	uint64_t csum;
 
-	while (p32 < p32end)
-		if (p32 == (uint32_t *)csump) {
-			/* lo32 += 0; treat first 32-bits as zero */
-			p32++;
-			hi32 += lo32;
-			/* lo32 += 0; treat second 32-bits as zero */
-			p32++;
-			hi32 += lo32;
-		} else {
-			lo32 += le32toh(*p32);
-			++p32;
-			hi32 += lo32;
-		}
+	/* the checksum is only skipped if it starts at one of the words */
+	uintptr_t off = (uintptr_t)csump - (uintptr_t)addr;
+	if (off < len && off % 4 == 0) {
+		size_t first = off / 4;
+
+		Fletcher64(&f, p32, first);
 
-	csum = (uint64_t)hi32 << 32 | lo32;
+		/* treat both 32-bit halves of the checksum as zero */
+		f.hi += 2 * f.lo;
+
+		if (first + 2 < nwords)
+			Fletcher64(&f, p32 + first + 2, nwords - first - 2);
+	} else {
+		Fletcher64(&f, p32, nwords);
+	}
+
+	csum = (uint64_t)f.hi << 32 | f.lo;
 
 	if (insert) {
 		*csump = htole64(csum);
@@ -252,6 +384,11 @@ util_init(void)
 #ifdef ANY_VG_TOOL_ENABLED
 	_On_valgrind = RUNNING_ON_VALGRIND;
 #endif
+
+#ifdef FLETCHER64_SIMD
+	if (util_cpu_has_avx2())
+		Fletcher64 = fletcher64_avx2;
+#endif
 }
 
 /*
@@ -269,3 +406,36 @@ util_concat_str(const char *s1, const char *s2)
 
 	return result;
 }
+
+#ifndef NO_LIBPTHREAD
+/*
+ * util_run_parallel -- runs the worker with the same argument in the given
+ *	number of threads, including the calling one, and waits for all of them
+ *
+ * If some of the threads can't be created, fewer threads do the work, so
+ * the workers must take their shares of it from the shared argument instead
+ * of assuming a fixed split.
+ */
+void
+util_run_parallel(void *(*worker)(void *), void *arg, unsigned nthreads)
+{
+	pthread_t *threads = NULL;
+	unsigned n = 0;
+	if (nthreads > 1)
+		threads = Malloc(sizeof(pthread_t) * (nthreads - 1));
+
+	if (threads != NULL) {
+		for (; n < nthreads - 1; ++n) {
+			if (pthread_create(&threads[n], NULL, worker, arg) != 0)
+				break; /* fewer threads will do the work */
+		}
+	}
+
+	worker(arg);
+
+	for (unsigned i = 0; i < n; ++i)
+		pthread_join(threads[i], NULL);
+
+	Free(threads);
+}
+#endif /* NO_LIBPTHREAD */
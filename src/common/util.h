@@ -86,6 +86,13 @@ char *util_realpath(const char *path);
 int util_compare_file_inodes(const char *path1, const char *path2);
 void *util_aligned_malloc(size_t alignment, size_t size);
 void util_aligned_free(void *ptr);
+int util_cpu_has_avx2(void);
+void util_futex_wait(uint32_t *addr, uint32_t val);
+void util_futex_wake(uint32_t *addr, int nwake);
+#ifndef NO_LIBPTHREAD
+void util_run_parallel(void *(*worker)(void *), void *arg,
+	unsigned nthreads);
+#endif
 
 #define UTIL_MAX_ERR_MSG 128
 void util_strerror(int errnum, char *buff, size_t bufflen);
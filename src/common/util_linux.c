@@ -40,6 +40,9 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include "out.h"
 
 /* pass through for Linux */
@@ -110,3 +113,37 @@ util_aligned_free(void *ptr)
 {
 	free(ptr);
 }
+
+/*
+ * util_cpu_has_avx2 -- check whether AVX2 instructions can be used
+ */
+int
+util_cpu_has_avx2(void)
+{
+#if defined(__x86_64__) || defined(__amd64__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return 0;
+#endif
+}
+
+/*
+ * util_futex_wait -- sleeps as long as the value at addr is equal to val,
+ *	the caller has to recheck the condition it waits for, because the
+ *	function can return spuriously
+ */
+void
+util_futex_wait(uint32_t *addr, uint32_t val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+/*
+ * util_futex_wake -- wakes up to nwake threads sleeping on addr
+ */
+void
+util_futex_wake(uint32_t *addr, int nwake)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nwake, NULL, NULL, 0);
+}
@@ -36,10 +36,13 @@
 
 #include <string.h>
 #include <tchar.h>
+#include <intrin.h>
 #include "util.h"
 #include "out.h"
 #include "file.h"
 
+#pragma comment(lib, "Synchronization.lib")
+
 /* Windows CRT doesn't support all errors, add unmapped here */
 #define ENOTSUP_STR "Operation not supported"
 #define ECANCELED_STR "Operation canceled"
@@ -109,3 +112,54 @@ util_aligned_free(void *ptr)
 {
 	_aligned_free(ptr);
 }
+
+/*
+ * util_cpu_has_avx2 -- check whether AVX2 instructions can be used
+ *
+ * Both the CPU and the OS, which has to save the YMM registers, must
+ * support them.
+ */
+int
+util_cpu_has_avx2(void)
+{
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return 0;
+
+	/* OSXSAVE and AVX */
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+		return 0;
+
+	/* XMM and YMM state enabled */
+	if ((_xgetbv(0) & 0x6) != 0x6)
+		return 0;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+}
+
+/*
+ * util_futex_wait -- sleeps as long as the value at addr is equal to val,
+ *	the caller has to recheck the condition it waits for, because the
+ *	function can return spuriously
+ */
+void
+util_futex_wait(uint32_t *addr, uint32_t val)
+{
+	WaitOnAddress(addr, &val, sizeof(val), INFINITE);
+}
+
+/*
+ * util_futex_wake -- wakes up to nwake threads sleeping on addr
+ */
+void
+util_futex_wake(uint32_t *addr, int nwake)
+{
+	if (nwake == 1)
+		WakeByAddressSingle(addr);
+	else
+		WakeByAddressAll(addr);
+}
@@ -77,6 +77,63 @@ void *pmem_memmove_nodrain(void *pmemdest, const void *src, size_t len);
 void *pmem_memcpy_nodrain(void *pmemdest, const void *src, size_t len);
 void *pmem_memset_nodrain(void *pmemdest, int c, size_t len);
 
+/*
+ * range descriptors used by the vectored functions
+ */
+struct pmem_flush_vec {
+	const void *addr;
+	size_t len;
+};
+
+struct pmem_memcpy_vec {
+	void *pmemdest;
+	const void *src;
+	size_t len;
+};
+
+void pmem_flushv(const struct pmem_flush_vec *vec, size_t cnt);
+void pmem_persistv(const struct pmem_flush_vec *vec, size_t cnt);
+void pmem_memcpyv_nodrain(const struct pmem_memcpy_vec *vec, size_t cnt);
+void pmem_memcpyv_persist(const struct pmem_memcpy_vec *vec, size_t cnt);
+
+/*
+ * minimum length of the scratch range passed to pmem_calibrate()
+ */
+#define PMEM_CALIBRATE_MIN_LEN	(128 * 1024)
+
+int pmem_calibrate(void *pmemdest, size_t len);
+void pmem_get_movnt_thresholds(size_t *memcpy_thresholdp,
+	size_t *memset_thresholdp);
+
+void *pmem_memcpy_persist_mt(void *pmemdest, const void *src, size_t len,
+	unsigned nthreads);
+void *pmem_memset_persist_mt(void *pmemdest, int c, size_t len,
+	unsigned nthreads);
+
+/*
+ * handle of a request to the asynchronous copy engine
+ */
+struct pmem_async;
+
+struct pmem_async *pmem_memcpy_async(void *pmemdest, const void *src,
+	size_t len);
+struct pmem_async *pmem_memset_async(void *pmemdest, int c, size_t len);
+struct pmem_async *pmem_persist_async(const void *addr, size_t len);
+int pmem_async_poll(struct pmem_async *req);
+void pmem_async_wait(struct pmem_async *req);
+int pmem_async_wait_any(struct pmem_async *const *reqs, size_t nreqs,
+	size_t *idxp);
+void pmem_async_release(struct pmem_async *req);
+
+int pmem_msync_barrier(void);
+
+/*
+ * not part of the API -- used by the other NVM libraries to track the mappings
+ * of their pools in the cache of pmem_is_pmem() results
+ */
+void _pmem_range_register(const void *addr, size_t len);
+void _pmem_range_unregister(const void *addr, size_t len);
+
 /*
  * PMEM_MAJOR_VERSION and PMEM_MINOR_VERSION provide the current version of the
  * libpmem API as provided by this header file.  Applications can verify that
@@ -84,7 +141,7 @@ void *pmem_memset_nodrain(void *pmemdest, int c, size_t len);
  * compile-time by passing these defines to pmem_check_version().
  */
 #define PMEM_MAJOR_VERSION 1
-#define PMEM_MINOR_VERSION 0
+#define PMEM_MINOR_VERSION 1
 const char *pmem_check_version(
 		unsigned major_required,
 		unsigned minor_required);
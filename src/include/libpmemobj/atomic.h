@@ -67,6 +67,12 @@ pmemobj_zrealloc((pop), (PMEMoid *)(o), (size), TOID_TYPE_NUM(t))
 #define POBJ_FREE(o)\
 pmemobj_free((PMEMoid *)(o))
 
+#define POBJ_RESERVE_NEW(pop, t, act)\
+((TOID(t))pmemobj_reserve((pop), (act), sizeof(t), TOID_TYPE_NUM(t)))
+
+#define POBJ_RESERVE_ALLOC(pop, t, size, act)\
+((TOID(t))pmemobj_reserve((pop), (act), (size), TOID_TYPE_NUM(t)))
+
 #ifdef __cplusplus
 }
 #endif
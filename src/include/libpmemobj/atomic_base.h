@@ -65,6 +65,17 @@ int pmemobj_alloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 int pmemobj_zalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	uint64_t type_num);
 
+#define POBJ_XALLOC_CLASS_MASK	((((uint64_t)1 << 16) - 1) << 48)
+
+/*
+ * Allocates a new object from the pool using the provided flags:
+ *  - POBJ_FLAG_ZERO - zero the allocated object
+ *  - POBJ_CLASS_ID(id) - allocate from the given allocation class
+ */
+int pmemobj_xalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+	uint64_t type_num, uint64_t flags,
+	pmemobj_constr constructor, void *arg);
+
 /*
  * Resizes an existing object.
  */
@@ -88,6 +99,138 @@ int pmemobj_strdup(PMEMobjpool *pop, PMEMoid *oidp, const char *s,
  */
 void pmemobj_free(PMEMoid *oidp);
 
+/*
+ * Allocation classes
+ *
+ * An allocation class describes the size of a unit in which the objects
+ * are allocated and the number of units in a single run of the class.
+ * The heap creates its own classes at startup, the application can register
+ * additional ones tailored to its object sizes.
+ */
+struct pobj_alloc_class_desc {
+	size_t unit_size;		/* size of a single unit, in bytes */
+	unsigned units_per_block;	/* minimum units per run */
+	unsigned class_id;		/* set by pmemobj_alloc_class_new */
+};
+
+/*
+ * Registers a new allocation class in the volatile state of the heap.
+ */
+int pmemobj_alloc_class_new(PMEMobjpool *pop,
+	struct pobj_alloc_class_desc *desc);
+
+/*
+ * Heap statistics
+ *
+ * The statistics are read from counters which are updated whenever a block or
+ * a run changes its state, without stopping the allocator, so when other
+ * threads allocate or free memory concurrently, the result is only
+ * approximate.
+ */
+#define POBJ_MAX_ALLOC_CLASSES		255
+#define POBJ_RUN_OCCUPANCY_BINS		10
+#define POBJ_FREE_EXTENT_BINS		16
+
+struct pobj_alloc_class_stats {
+	size_t unit_size;	/* 0 if the class doesn't exist */
+	uint64_t runs;		/* number of active runs of the class */
+	uint64_t bytes_allocated; /* bytes of allocated units */
+	uint64_t bytes_free;	/* bytes of free units */
+
+	/*
+	 * number of runs with [i * 10%, (i + 1) * 10%) of units allocated,
+	 * the last bin also counts the completely full runs
+	 */
+	uint64_t run_occupancy[POBJ_RUN_OCCUPANCY_BINS];
+
+	uint64_t lock_contended; /* contended acquisitions of class locks */
+
+	uint64_t steals;	/* batches of blocks stolen between caches */
+	uint64_t bytes_stolen;	/* bytes of units stolen between caches */
+};
+
+struct pobj_heap_stats {
+	uint64_t huge_bytes_allocated;	/* bytes of allocated chunks */
+	uint64_t huge_bytes_free;	/* bytes of free chunks */
+
+	/* number of free extents of [2^i, 2^(i + 1)) chunks */
+	uint64_t free_extents[POBJ_FREE_EXTENT_BINS];
+
+	uint64_t runs;			/* number of runs of all classes */
+	uint64_t active_runs;		/* runs assigned to the classes */
+	uint64_t run_chunks;		/* chunks occupied by the runs */
+	uint64_t run_bytes_allocated;	/* bytes of allocated units */
+	uint64_t run_bytes_free;	/* bytes of free units */
+
+	uint64_t huge_lock_contended;	/* contended chunk lock acquisitions */
+	uint64_t run_lock_contended;	/* contended run lock acquisitions */
+
+	uint64_t steals;		/* batches stolen by all classes */
+	uint64_t bytes_stolen;		/* bytes stolen by all classes */
+
+	/* indexed by the allocation class id */
+	struct pobj_alloc_class_stats classes[POBJ_MAX_ALLOC_CLASSES];
+};
+
+/*
+ * Gathers the statistics of the heap of the given pool.
+ */
+int pmemobj_heap_stats(PMEMobjpool *pop, struct pobj_heap_stats *stats);
+
+/*
+ * Two-phase atomic allocations
+ *
+ * An object reserved with pmemobj_reserve can be used right away, but it
+ * isn't allocated in the persistent heap until its action is published. In
+ * case of a crash before that happens, the memory is automatically reclaimed.
+ * Publishing many actions at once amortizes the cost of the heap metadata
+ * modifications.
+ */
+
+enum pobj_action_type {
+	POBJ_ACTION_TYPE_HEAP,	/* reservation of a new object */
+	POBJ_ACTION_TYPE_MEM,	/* deferred 8-byte store */
+
+	POBJ_MAX_ACTION_TYPE
+};
+
+struct pobj_action_heap {
+	uint64_t offset;	/* offset of the reserved object */
+};
+
+struct pobj_action {
+	enum pobj_action_type type;
+	uint32_t data[3];
+
+	struct pobj_action_heap heap;	/* valid for POBJ_ACTION_TYPE_HEAP */
+
+	uint64_t data2[5];
+};
+
+/*
+ * Reserves a new object in the volatile state of the heap.
+ */
+PMEMoid pmemobj_reserve(PMEMobjpool *pop, struct pobj_action *act,
+	size_t size, uint64_t type_num);
+
+/*
+ * Creates an action that stores the value at the given location on publish.
+ */
+void pmemobj_set_value(PMEMobjpool *pop, struct pobj_action *act,
+	uint64_t *ptr, uint64_t value);
+
+/*
+ * Persistently commits all of the provided actions.
+ */
+int pmemobj_publish(PMEMobjpool *pop, struct pobj_action *actv,
+	size_t actvcnt);
+
+/*
+ * Releases the reservations made by the provided actions.
+ */
+void pmemobj_cancel(PMEMobjpool *pop, struct pobj_action *actv,
+	size_t actvcnt);
+
 #ifdef __cplusplus
 }
 #endif
@@ -57,6 +57,15 @@ typedef struct pmemobjpool PMEMobjpool;
 
 #define PMEMOBJ_MAX_ALLOC_SIZE ((size_t)0x3FFDFFFC0)
 
+#define POBJ_FLAG_ZERO		(((uint64_t)1) << 0)
+#define POBJ_FLAG_NO_FLUSH	(((uint64_t)1) << 1)
+
+/*
+ * The allocation class of an object can be passed in the flags argument
+ * of pmemobj_xalloc, class 0 stands for the default size-based selection.
+ */
+#define POBJ_CLASS_ID(id)	(((uint64_t)(id)) << 48)
+
 /*
  * Persistent memory object
  */
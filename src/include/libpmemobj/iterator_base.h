@@ -61,6 +61,58 @@ PMEMoid pmemobj_first(PMEMobjpool *pop);
  */
 PMEMoid pmemobj_next(PMEMoid oid);
 
+/*
+ * Returns the first object of the specified type number. When the type index
+ * is enabled, the objects of other types are not visited.
+ */
+PMEMoid pmemobj_first_type(PMEMobjpool *pop, uint64_t type_num);
+
+/*
+ * Returns the next object of the same type as the given one.
+ */
+PMEMoid pmemobj_next_type(PMEMoid oid);
+
+/*
+ * Returns the number of objects of the specified type number.
+ */
+uint64_t pmemobj_type_count(PMEMobjpool *pop, uint64_t type_num);
+
+/*
+ * The following functions iterate through the objects without looking them
+ * up from the beginning of the heap on every step.
+ */
+
+/*
+ * Matches the objects of every type.
+ */
+#define POBJ_ITER_ANY_TYPE	UINT64_MAX
+
+struct pobj_iter;
+
+/*
+ * Creates an iterator through the objects of the specified type number.
+ */
+struct pobj_iter *pmemobj_iter_new(PMEMobjpool *pop, uint64_t type_num);
+
+/*
+ * Returns the next object of the iterator, OID_NULL if there are no more.
+ */
+PMEMoid pmemobj_iter_next(struct pobj_iter *iter);
+
+/*
+ * Deletes the iterator.
+ */
+void pmemobj_iter_delete(struct pobj_iter *iter);
+
+/* iteration callback, stops the iteration if return value is non-zero */
+typedef int (*pmemobj_iter_cb)(PMEMoid oid, void *arg);
+
+/*
+ * Calls the callback for every object of the specified type number from
+ * the given number of threads.
+ */
+int pmemobj_iter_parallel(PMEMobjpool *pop, uint64_t type_num,
+	unsigned nthreads, pmemobj_iter_cb cb, void *arg);
 
 #ifdef __cplusplus
 }
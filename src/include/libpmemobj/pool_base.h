@@ -38,6 +38,7 @@
 #define LIBPMEMOBJ_POOL_BASE_H 1
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #include <libpmemobj/base.h>
@@ -81,6 +82,27 @@ PMEMoid pmemobj_root_construct(PMEMobjpool *pop, size_t size,
  */
 size_t pmemobj_root_size(PMEMobjpool *pop);
 
+/*
+ * Lane statistics
+ *
+ * Every thread that operates on a pool has to hold one of its lanes for the
+ * duration of a transaction or an atomic operation.
+ */
+struct pobj_lane_stats {
+	unsigned nlanes;	/* number of lanes available at runtime */
+	uint64_t waits;		/* acquisitions that found all lanes busy */
+	uint64_t wait_ns;	/* total time spent waiting for a lane */
+	uint64_t handoffs;	/* releases that woke up a waiting thread */
+	uint64_t migrations;	/* acquisitions of a non-preferred lane */
+	uint64_t recovery_ns;	/* time spent recovering the lanes at open */
+	unsigned recovery_threads; /* number of threads recovering the lanes */
+};
+
+/*
+ * Gathers the lane statistics of the given pool.
+ */
+int pmemobj_lane_stats(PMEMobjpool *pop, struct pobj_lane_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
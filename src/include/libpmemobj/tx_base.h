@@ -72,6 +72,7 @@ enum pobj_tx_param {
 	TX_PARAM_MUTEX,	 /* PMEMmutex */
 	TX_PARAM_RWLOCK, /* PMEMrwlock */
 	/* EXPERIMENTAL */ TX_PARAM_CB,	 /* pmemobj_tx_callback cb, void *arg */
+	/* EXPERIMENTAL */ TX_PARAM_REDO, /* no value */
 };
 
 #if !defined(_has_deprecated_with_message) && defined(__clang__)
@@ -103,9 +104,6 @@ enum tx_lock_deprecated pobj_tx_lock {
 typedef void (*pmemobj_tx_callback)(PMEMobjpool *pop, enum pobj_tx_stage stage,
 		void *);
 
-#define POBJ_FLAG_ZERO		(((uint64_t)1) << 0)
-#define POBJ_FLAG_NO_FLUSH	(((uint64_t)1) << 1)
-
 #define POBJ_XALLOC_ZERO	POBJ_FLAG_ZERO
 #define POBJ_XALLOC_NO_FLUSH	POBJ_FLAG_NO_FLUSH
 #define POBJ_XALLOC_VALID_FLAGS	(POBJ_XALLOC_ZERO | POBJ_XALLOC_NO_FLUSH)
@@ -218,6 +216,32 @@ int pmemobj_tx_xadd_range(PMEMoid oid, uint64_t off, size_t size,
  */
 int pmemobj_tx_xadd_range_direct(const void *ptr, size_t size, uint64_t flags);
 
+/*
+ * Writes 'len' bytes from 'src' to the persistent memory at 'dest'.
+ * In the redo mode the data is kept in the write set of the transaction and
+ * is written to the persistent memory on commit, otherwise the range is
+ * added to the undo log and modified immediately.
+ *
+ * If successful, returns zero.
+ * Otherwise, state changes to TX_STAGE_ONABORT and an error number is returned.
+ *
+ * This function must be called during TX_STAGE_WORK.
+ * This is EXPERIMENTAL API.
+ */
+int pmemobj_tx_write(void *dest, const void *src, size_t len);
+
+/*
+ * Reads 'len' bytes of the persistent memory at 'src' into 'dest', including
+ * the data written by pmemobj_tx_write in this transaction.
+ *
+ * If successful, returns zero.
+ * Otherwise, state changes to TX_STAGE_ONABORT and an error number is returned.
+ *
+ * This function must be called during TX_STAGE_WORK.
+ * This is EXPERIMENTAL API.
+ */
+int pmemobj_tx_read(void *dest, const void *src, size_t len);
+
 /*
  * Transactionally allocates a new object.
  *
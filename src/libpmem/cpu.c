@@ -69,6 +69,15 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 			cpuinfo[ECX_IDX], cpuinfo[EDX_IDX]);
 }
 
+static inline unsigned long long
+xgetbv(unsigned index)
+{
+	unsigned eax, edx;
+	asm volatile("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+
+	return ((unsigned long long)edx << 32) | eax;
+}
+
 #elif defined(_M_X64) || defined(_M_AMD64)
 
 #include <intrin.h>
@@ -79,11 +88,19 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 	__cpuidex(cpuinfo, func, subfunc);
 }
 
+static inline unsigned long long
+xgetbv(unsigned index)
+{
+	return _xgetbv(index);
+}
+
 #else /* not x86_64 */
 
 #define cpuid(func, subfunc, cpuinfo)\
 	do { (void)(func); (void)(subfunc); (void)(cpuinfo); } while (0)
 
+#define xgetbv(index) ((void)(index), 0ULL)
+
 #endif
 
 #ifndef bit_SSE2
@@ -102,6 +119,33 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 #define bit_CLWB	(1 << 24)
 #endif
 
+#ifndef bit_OSXSAVE
+#define bit_OSXSAVE	(1 << 27)
+#endif
+
+#ifndef bit_AVX
+#define bit_AVX		(1 << 28)
+#endif
+
+#ifndef bit_AVX2
+#define bit_AVX2	(1 << 5)
+#endif
+
+#ifndef bit_AVX512F
+#define bit_AVX512F	(1 << 16)
+#endif
+
+/* XCR0 state components which have to be enabled by the OS */
+#define XSTATE_SSE	(1 << 1)
+#define XSTATE_YMM	(1 << 2)
+#define XSTATE_OPMASK	(1 << 5)
+#define XSTATE_ZMM_HI256 (1 << 6)
+#define XSTATE_HI16_ZMM	(1 << 7)
+
+#define XSTATE_AVX_MASK	(XSTATE_SSE | XSTATE_YMM)
+#define XSTATE_AVX512_MASK\
+	(XSTATE_AVX_MASK | XSTATE_OPMASK | XSTATE_ZMM_HI256 | XSTATE_HI16_ZMM)
+
 /*
  * is_cpu_feature_present -- (internal) checks if CPU feature is supported
  */
@@ -186,3 +230,43 @@ is_cpu_clwb_present(void)
 
 	return ret;
 }
+
+/*
+ * is_os_xstate_enabled -- (internal) checks if the OS saves and restores
+ * all of the given extended register states on context switch
+ */
+static int
+is_os_xstate_enabled(unsigned long long mask)
+{
+	if (!is_cpu_feature_present(0x1, ECX_IDX, bit_OSXSAVE))
+		return 0;
+
+	return (xgetbv(0) & mask) == mask;
+}
+
+/*
+ * is_cpu_avx2_present -- checks if AVX2 instructions are supported
+ */
+int
+is_cpu_avx2_present(void)
+{
+	int ret = is_cpu_feature_present(0x1, ECX_IDX, bit_AVX) &&
+		is_cpu_feature_present(0x7, EBX_IDX, bit_AVX2) &&
+		is_os_xstate_enabled(XSTATE_AVX_MASK);
+	LOG(4, "AVX2 %ssupported", ret == 0 ? "not " : "");
+
+	return ret;
+}
+
+/*
+ * is_cpu_avx512f_present -- checks if AVX-512F instructions are supported
+ */
+int
+is_cpu_avx512f_present(void)
+{
+	int ret = is_cpu_feature_present(0x7, EBX_IDX, bit_AVX512F) &&
+		is_os_xstate_enabled(XSTATE_AVX512_MASK);
+	LOG(4, "AVX512F %ssupported", ret == 0 ? "not " : "");
+
+	return ret;
+}
@@ -36,6 +36,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include "libpmem.h"
 
@@ -55,6 +56,8 @@ libpmem_init(void)
 			PMEM_MAJOR_VERSION, PMEM_MINOR_VERSION);
 	LOG(3, NULL);
 	pmem_init();
+	async_init();
+	msync_defer_init();
 }
 
 /*
@@ -68,6 +71,9 @@ libpmem_fini(void)
 {
 	LOG(3, NULL);
 
+	msync_defer_fini();
+	async_fini();
+	pmem_fini();
 	common_fini();
 }
 
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * movnt.h -- definitions shared by the non-temporal memmove/memset variants
+ */
+
+#ifndef NVML_MOVNT_H
+#define NVML_MOVNT_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "libpmem.h"
+#include "valgrind_internal.h"
+
+#define FLUSH_ALIGN ((uintptr_t)64)
+
+#define ALIGN_MASK	(FLUSH_ALIGN - 1)
+
+#define DWORD_SIZE	4
+#define DWORD_SHIFT	2
+#define DWORD_MASK	(DWORD_SIZE - 1)
+
+#define MOVNT_SIZE	16
+#define MOVNT_MASK	(MOVNT_SIZE - 1)
+#define MOVNT_SHIFT	4
+
+extern size_t Movnt_threshold_memmove;
+extern size_t Movnt_threshold_memset;
+
+void predrain_fence_sfence(void);
+
+void *memmove_movnt_sse2(void *pmemdest, const void *src, size_t len);
+void *memset_movnt_sse2(void *pmemdest, int c, size_t len);
+void *memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len);
+void *memset_nodrain_movnt(void *pmemdest, int c, size_t len);
+
+void *memmove_movnt_avx2(void *pmemdest, const void *src, size_t len);
+void *memset_movnt_avx2(void *pmemdest, int c, size_t len);
+void *memmove_nodrain_movnt_avx2(void *pmemdest, const void *src, size_t len);
+void *memset_nodrain_movnt_avx2(void *pmemdest, int c, size_t len);
+
+#ifdef AVX512F_AVAILABLE
+void *memmove_movnt_avx512f(void *pmemdest, const void *src, size_t len);
+void *memset_movnt_avx512f(void *pmemdest, int c, size_t len);
+void *memmove_nodrain_movnt_avx512f(void *pmemdest, const void *src,
+	size_t len);
+void *memset_nodrain_movnt_avx512f(void *pmemdest, int c, size_t len);
+#endif
+
+/*
+ * nodrain_memmove_movnt -- (internal) memmove to pmem without hw drain,
+ * using the given non-temporal variant for long enough ranges
+ */
+static inline void *
+nodrain_memmove_movnt(void *(*memmove_movnt)(void *, const void *, size_t),
+	void *pmemdest, const void *src, size_t len)
+{
+	if (len == 0 || src == pmemdest)
+		return pmemdest;
+
+	if (len < Movnt_threshold_memmove) {
+		memmove(pmemdest, src, len);
+		pmem_flush(pmemdest, len);
+		return pmemdest;
+	}
+
+	memmove_movnt(pmemdest, src, len);
+
+	/* serialize non-temporal store instructions */
+	predrain_fence_sfence();
+
+	return pmemdest;
+}
+
+/*
+ * nodrain_memset_movnt -- (internal) memset to pmem without hw drain,
+ * using the given non-temporal variant for long enough ranges
+ */
+static inline void *
+nodrain_memset_movnt(void *(*memset_movnt)(void *, int, size_t),
+	void *pmemdest, int c, size_t len)
+{
+	if (len < Movnt_threshold_memset) {
+		memset(pmemdest, c, len);
+		pmem_flush(pmemdest, len);
+		return pmemdest;
+	}
+
+	memset_movnt(pmemdest, c, len);
+
+	/* serialize non-temporal store instructions */
+	predrain_fence_sfence();
+
+	return pmemdest;
+}
+
+/*
+ * movnt_head_fw -- (internal) copy up to the FLUSH_ALIGN boundary of the
+ * destination using regular stores, returns the number of bytes copied
+ */
+static inline size_t
+movnt_head_fw(char *dest, const char *src, size_t len)
+{
+	size_t cnt = (uintptr_t)dest & ALIGN_MASK;
+	if (cnt == 0)
+		return 0;
+
+	cnt = FLUSH_ALIGN - cnt;
+
+	/* never try to copy more the len bytes */
+	if (cnt > len)
+		cnt = len;
+
+	for (size_t i = 0; i < cnt; i++)
+		dest[i] = src[i];
+
+	pmem_flush(dest, cnt);
+
+	return cnt;
+}
+
+/*
+ * movnt_head_bw -- (internal) copy down to the FLUSH_ALIGN boundary of the
+ * destination end using regular stores, returns the number of bytes copied
+ *
+ * The dest and src point right past the end of the range.
+ */
+static inline size_t
+movnt_head_bw(char *dest, const char *src, size_t len)
+{
+	size_t cnt = (uintptr_t)dest & ALIGN_MASK;
+	if (cnt == 0)
+		return 0;
+
+	/* never try to copy more the len bytes */
+	if (cnt > len)
+		cnt = len;
+
+	for (size_t i = 1; i <= cnt; i++)
+		*(dest - i) = *(src - i);
+
+	pmem_flush(dest - cnt, cnt);
+
+	return cnt;
+}
+
+/*
+ * movnt_tail_fw -- (internal) copy the last bytes (<16) of the range,
+ * first dwords then bytes
+ */
+static inline void
+movnt_tail_fw(char *dest, const char *src, size_t len)
+{
+	size_t i;
+	size_t cnt = len >> DWORD_SHIFT;
+	int32_t *d32 = (int32_t *)dest;
+	int32_t *s32 = (int32_t *)src;
+
+	for (i = 0; i < cnt; i++) {
+		_mm_stream_si32(d32, *s32);
+		VALGRIND_DO_FLUSH(d32, sizeof(*d32));
+		d32++;
+		s32++;
+	}
+
+	cnt = len & DWORD_MASK;
+	uint8_t *d8 = (uint8_t *)d32;
+	const uint8_t *s8 = (uint8_t *)s32;
+
+	for (i = 0; i < cnt; i++) {
+		*d8 = *s8;
+		d8++;
+		s8++;
+	}
+	pmem_flush(d32, cnt);
+}
+
+/*
+ * movnt_tail_bw -- (internal) copy the first bytes (<16) of the range
+ * in the backward direction, first dwords then bytes
+ *
+ * The dest and src point right past the end of the remaining range.
+ */
+static inline void
+movnt_tail_bw(char *dest, const char *src, size_t len)
+{
+	size_t i;
+	size_t cnt = len >> DWORD_SHIFT;
+	int32_t *d32 = (int32_t *)dest;
+	int32_t *s32 = (int32_t *)src;
+
+	for (i = 0; i < cnt; i++) {
+		d32--;
+		s32--;
+		_mm_stream_si32(d32, *s32);
+		VALGRIND_DO_FLUSH(d32, sizeof(*d32));
+	}
+
+	cnt = len & DWORD_MASK;
+	uint8_t *d8 = (uint8_t *)d32;
+	const uint8_t *s8 = (uint8_t *)s32;
+
+	for (i = 0; i < cnt; i++) {
+		d8--;
+		s8--;
+		*d8 = *s8;
+	}
+	pmem_flush(d8, cnt);
+}
+
+/*
+ * movnt_head_set -- (internal) memset up to the next FLUSH_ALIGN boundary
+ * using regular stores, returns the number of bytes set
+ */
+static inline size_t
+movnt_head_set(char *dest, int c, size_t len)
+{
+	size_t cnt = (uintptr_t)dest & ALIGN_MASK;
+	if (cnt == 0)
+		return 0;
+
+	cnt = FLUSH_ALIGN - cnt;
+
+	if (cnt > len)
+		cnt = len;
+
+	memset(dest, c, cnt);
+	pmem_flush(dest, cnt);
+
+	return cnt;
+}
+
+/*
+ * movnt_tail_set -- (internal) memset the last bytes (<16) of the range,
+ * first dwords then bytes
+ */
+static inline void
+movnt_tail_set(char *dest, int c, size_t len)
+{
+	int32_t *d32 = (int32_t *)dest;
+	size_t cnt = len >> DWORD_SHIFT;
+	int32_t c32 = (int32_t)(0x01010101U * (uint8_t)c);
+
+	for (size_t i = 0; i < cnt; i++) {
+		_mm_stream_si32(d32, c32);
+		VALGRIND_DO_FLUSH(d32, sizeof(*d32));
+		d32++;
+	}
+
+	/* at this point the cnt < 4 so use memset */
+	cnt = len & DWORD_MASK;
+	if (cnt != 0) {
+		memset((void *)d32, c, cnt);
+		pmem_flush(d32, cnt);
+	}
+}
+
+#endif
@@ -134,6 +134,43 @@
  *	Calls the appropriate _nodrain() function followed by pmem_drain().
  *
  *
+ * VECTORED INTERFACES
+ *
+ * pmem_flushv()
+ * pmem_persistv()
+ *
+ *	Rounds every range out to cache line boundaries, sorts and merges
+ *	them, so each cache line is flushed once even if it belongs to
+ *	several ranges.  pmem_persistv() follows it by pmem_drain().
+ *
+ * pmem_memcpyv_nodrain()
+ * pmem_memcpyv_persist()
+ *
+ *	Copies each range using the non-temporal variant selected at
+ *	initialization time if it is at least Movnt_threshold_memmove bytes,
+ *	otherwise using memmove() and collecting the destination for a
+ *	single merged flush as in pmem_flushv().  The non-temporal variant
+ *	does not serialize its stores, so the whole vector costs exactly
+ *	one SFENCE (none for pmem_memcpyv_nodrain() if no range was copied
+ *	using non-temporal stores).
+ *
+ *
+ * MULTI-THREADED INTERFACES
+ *
+ * pmem_memcpy_persist_mt()
+ * pmem_memset_persist_mt()
+ *
+ *	Split the range into stripes aligned in the destination, which are
+ *	claimed one by one by the calling thread and by the workers of
+ *	a pool started on first use.  Each thread writes its stripes using
+ *	the unserialized movnt kernel (or the regular stores followed by
+ *	a flush) and issues a single fence when no stripe is left.
+ *	pmem_memcpy_persist() and pmem_memset_persist() do the same for
+ *	ranges of at least Mt_threshold bytes.  Since libpmem is not linked
+ *	against libpthread, the workers are started only if the application
+ *	has loaded it; otherwise the calling thread writes the whole range.
+ *
+ *
  * DECISIONS MADE AT INITIALIZATION TIME
  *
  * As much as possible, all decisions described above are made at library
@@ -152,10 +189,31 @@
  *	Func_memmove_nodrain is used by memmove_nodrain() to call one of:
  *		memmove_nodrain_normal()
  *		memmove_nodrain_movnt()
+ *		memmove_nodrain_movnt_avx2()
+ *		memmove_nodrain_movnt_avx512f()
  *
  *	Func_memset_nodrain is used by memset_nodrain() to call one of:
  *		memset_nodrain_normal()
  *		memset_nodrain_movnt()
+ *		memset_nodrain_movnt_avx2()
+ *		memset_nodrain_movnt_avx512f()
+ *
+ *	The movnt variants differ only in the width of the non-temporal
+ *	stores (128, 256 or 512 bits).  The widest one supported by both
+ *	the CPU and the OS is picked, see pmem_get_movnt_funcs().
+ *
+ *	Func_memmove_movnt is used by the vectored copy functions to call
+ *	the unserialized kernel of the chosen movnt variant, one of:
+ *		memmove_movnt_sse2()
+ *		memmove_movnt_avx2()
+ *		memmove_movnt_avx512f()
+ *	Func_memset_movnt is its memset counterpart, used by pmem_calibrate().
+ *	Both are NULL if movnt is not used.
+ *
+ *	The lengths from which movnt is used are Movnt_threshold_memmove
+ *	and Movnt_threshold_memset.  Both default to MOVNT_THRESHOLD and
+ *	may be measured by pmem_calibrate(), either on request or at
+ *	initialization time if PMEM_MOVNT_CALIBRATE is set.
  *
  * DEBUG LOGGING
  *
@@ -175,6 +233,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
+#include <time.h>
+#include <pthread.h>
 
 #ifdef _WIN32
 #include <memoryapi.h>
@@ -184,8 +244,10 @@
 
 #include "pmem.h"
 #include "cpu.h"
+#include "movnt.h"
 #include "out.h"
 #include "util.h"
+#include "sys_util.h"
 #include "mmap.h"
 #include "file.h"
 #include "valgrind_internal.h"
@@ -203,25 +265,36 @@
 
 #endif /* _MSC_VER */
 
-#define FLUSH_ALIGN ((uintptr_t)64)
-
-#define ALIGN_MASK	(FLUSH_ALIGN - 1)
-
 #define CHUNK_SIZE	128 /* 16*8 */
 #define CHUNK_SHIFT	7
 #define CHUNK_MASK	(CHUNK_SIZE - 1)
 
-#define DWORD_SIZE	4
-#define DWORD_SHIFT	2
-#define DWORD_MASK	(DWORD_SIZE - 1)
+#define MOVNT_THRESHOLD	256
 
-#define MOVNT_SIZE	16
-#define MOVNT_MASK	(MOVNT_SIZE - 1)
-#define MOVNT_SHIFT	4
+/*
+ * Ranges of at least Movnt_threshold_memmove (for memmove/memcpy) or
+ * Movnt_threshold_memset (for memset) bytes are written using movnt.
+ * Both can be measured at run time, see pmem_calibrate().
+ */
+size_t Movnt_threshold_memmove = MOVNT_THRESHOLD;
+size_t Movnt_threshold_memset = MOVNT_THRESHOLD;
 
-#define MOVNT_THRESHOLD	256
+#define MT_THRESHOLD	(32 * 1024 * 1024)
+#define MT_NTHREADS	4	/* default number of threads per bulk write */
+#define MT_MAX_THREADS	16	/* maximum number of threads per bulk write */
+
+/*
+ * pmem_memcpy_persist() and pmem_memset_persist() of at least Mt_threshold
+ * bytes are split between the calling thread and up to Mt_nthreads - 1
+ * worker threads, see pmem_memcpy_persist_mt().
+ */
+static size_t Mt_threshold = MT_THRESHOLD;
+static unsigned Mt_nthreads = MT_NTHREADS;
 
-static size_t Movnt_threshold = MOVNT_THRESHOLD;
+static int mt_memcpy_persist(void *pmemdest, const void *src, size_t len,
+	unsigned nthreads);
+static int mt_memset_persist(void *pmemdest, int c, size_t len,
+	unsigned nthreads);
 
 /*
  * pmem_has_hw_drain -- return whether or not HW drain was found
@@ -249,7 +322,7 @@ predrain_fence_empty(void)
 /*
  * predrain_fence_sfence -- (internal) issue the pre-drain fence instruction
  */
-static void
+void
 predrain_fence_sfence(void)
 {
 	LOG(15, NULL);
@@ -388,6 +461,8 @@ pmem_persist(const void *addr, size_t len)
  * Using msync() means this routine is less optimal for pmem (but it
  * still works) but it also works for any memory mapped file, unlike
  * pmem_persist() which is only safe where pmem_is_pmem() returns true.
+ *
+ * With PMEM_MSYNC_DEFER the range is only marked dirty, see pmem_msync.c.
  */
 int
 pmem_msync(const void *addr, size_t len)
@@ -414,6 +489,10 @@ pmem_msync(const void *addr, size_t len)
 	 * Msyncing such memory is not a bug, so as a workaround temporarily
 	 * disable error reporting.
 	 */
+	/* the range is synced later by the coalescer */
+	if (Msync_defer && msync_defer_record((void *)uptr, len) == 0)
+		return 0;
+
 	VALGRIND_DO_DISABLE_ERROR_REPORTING;
 
 	int ret;
@@ -671,6 +750,8 @@ pmem_map_file(const char *path, size_t len, int flags, mode_t mode,
 	if (mapped_lenp != NULL)
 		*mapped_lenp = len;
 
+	pmem_range_register(addr, len);
+
 	if (is_pmemp != NULL)
 		*is_pmemp = pmem_is_pmem(addr, len);
 
@@ -700,10 +781,32 @@ pmem_unmap(void *addr, size_t len)
 {
 	LOG(3, "addr %p len %zu", addr, len);
 
+	(void) pmem_msync_barrier();
+	pmem_range_unregister(addr, len);
+
 	VALGRIND_REMOVE_PMEM_MAPPING(addr, len);
 	return util_unmap(addr, len);
 }
 
+/*
+ * _pmem_range_register -- start tracking a mapping created outside of
+ *	libpmem, e.g. a replica of a pool set
+ */
+void
+_pmem_range_register(const void *addr, size_t len)
+{
+	pmem_range_register(addr, len);
+}
+
+/*
+ * _pmem_range_unregister -- stop tracking mappings overlapping given range
+ */
+void
+_pmem_range_unregister(const void *addr, size_t len)
+{
+	pmem_range_unregister(addr, len);
+}
+
 /*
  * memmove_nodrain_normal -- (internal) memmove to pmem without hw drain
  */
@@ -718,10 +821,11 @@ memmove_nodrain_normal(void *pmemdest, const void *src, size_t len)
 }
 
 /*
- * memmove_nodrain_movnt -- (internal) memmove to pmem without hw drain, movnt
+ * memmove_movnt_sse2 -- memmove to pmem using non-temporal stores
+ * (sse2), without serializing them
  */
-static void *
-memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
+void *
+memmove_movnt_sse2(void *pmemdest, const void *src, size_t len)
 {
 	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
 
@@ -729,19 +833,14 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 	size_t i;
 	__m128i *d;
 	__m128i *s;
-	void *dest1 = pmemdest;
+	char *dest1 = pmemdest;
+	const char *src1 = src;
 	size_t cnt;
 
 	if (len == 0 || src == pmemdest)
 		return pmemdest;
 
-	if (len < Movnt_threshold) {
-		memmove(pmemdest, src, len);
-		pmem_flush(pmemdest, len);
-		return pmemdest;
-	}
-
-	if ((uintptr_t)dest1 - (uintptr_t)src >= len) {
+	if ((uintptr_t)dest1 - (uintptr_t)src1 >= len) {
 		/*
 		 * Copy the range in the forward direction.
 		 *
@@ -750,29 +849,13 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 		 */
 
 		/* copy up to FLUSH_ALIGN boundary */
-		cnt = (uint64_t)dest1 & ALIGN_MASK;
-		if (cnt > 0) {
-			cnt = FLUSH_ALIGN - cnt;
-
-			/* never try to copy more the len bytes */
-			if (cnt > len)
-				cnt = len;
-
-			uint8_t *d8 = (uint8_t *)dest1;
-			const uint8_t *s8 = (uint8_t *)src;
-			for (i = 0; i < cnt; i++) {
-				*d8 = *s8;
-				d8++;
-				s8++;
-			}
-			pmem_flush(dest1, cnt);
-			dest1 = (char *)dest1 + cnt;
-			src = (char *)src + cnt;
-			len -= cnt;
-		}
+		cnt = movnt_head_fw(dest1, src1, len);
+		dest1 += cnt;
+		src1 += cnt;
+		len -= cnt;
 
 		d = (__m128i *)dest1;
-		s = (__m128i *)src;
+		s = (__m128i *)src1;
 
 		cnt = len >> CHUNK_SHIFT;
 		for (i = 0; i < cnt; i++) {
@@ -812,27 +895,8 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 
 		/* copy the last bytes (<16), first dwords then bytes */
 		len &= MOVNT_MASK;
-		if (len != 0) {
-			cnt = len >> DWORD_SHIFT;
-			int32_t *d32 = (int32_t *)d;
-			int32_t *s32 = (int32_t *)s;
-			for (i = 0; i < cnt; i++) {
-				_mm_stream_si32(d32, *s32);
-				VALGRIND_DO_FLUSH(d32, sizeof(*d32));
-				d32++;
-				s32++;
-			}
-			cnt = len & DWORD_MASK;
-			uint8_t *d8 = (uint8_t *)d32;
-			const uint8_t *s8 = (uint8_t *)s32;
-
-			for (i = 0; i < cnt; i++) {
-				*d8 = *s8;
-				d8++;
-				s8++;
-			}
-			pmem_flush(d32, cnt);
-		}
+		if (len != 0)
+			movnt_tail_fw((char *)d, (const char *)s, len);
 	} else {
 		/*
 		 * Copy the range in the backward direction.
@@ -841,30 +905,16 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 		 * overlapped destination range.
 		 */
 
-		dest1 = (char *)dest1 + len;
-		src = (char *)src + len;
-
-		cnt = (uint64_t)dest1 & ALIGN_MASK;
-		if (cnt > 0) {
-			/* never try to copy more the len bytes */
-			if (cnt > len)
-				cnt = len;
+		dest1 += len;
+		src1 += len;
 
-			uint8_t *d8 = (uint8_t *)dest1;
-			const uint8_t *s8 = (uint8_t *)src;
-			for (i = 0; i < cnt; i++) {
-				d8--;
-				s8--;
-				*d8 = *s8;
-			}
-			pmem_flush(d8, cnt);
-			dest1 = (char *)dest1 - cnt;
-			src = (char *)src - cnt;
-			len -= cnt;
-		}
+		cnt = movnt_head_bw(dest1, src1, len);
+		dest1 -= cnt;
+		src1 -= cnt;
+		len -= cnt;
 
 		d = (__m128i *)dest1;
-		s = (__m128i *)src;
+		s = (__m128i *)src1;
 
 		cnt = len >> CHUNK_SHIFT;
 		for (i = 0; i < cnt; i++) {
@@ -904,36 +954,22 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 
 		/* copy the last bytes (<16), first dwords then bytes */
 		len &= MOVNT_MASK;
-		if (len != 0) {
-			cnt = len >> DWORD_SHIFT;
-			int32_t *d32 = (int32_t *)d;
-			int32_t *s32 = (int32_t *)s;
-			for (i = 0; i < cnt; i++) {
-				d32--;
-				s32--;
-				_mm_stream_si32(d32, *s32);
-				VALGRIND_DO_FLUSH(d32, sizeof(*d32));
-			}
-
-			cnt = len & DWORD_MASK;
-			uint8_t *d8 = (uint8_t *)d32;
-			const uint8_t *s8 = (uint8_t *)s32;
-
-			for (i = 0; i < cnt; i++) {
-				d8--;
-				s8--;
-				*d8 = *s8;
-			}
-			pmem_flush(d8, cnt);
-		}
+		if (len != 0)
+			movnt_tail_bw((char *)d, (const char *)s, len);
 	}
 
-	/* serialize non-temporal store instructions */
-	predrain_fence_sfence();
-
 	return pmemdest;
 }
 
+/*
+ * memmove_nodrain_movnt -- memmove to pmem without hw drain, movnt (sse2)
+ */
+void *
+memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
+{
+	return nodrain_memmove_movnt(memmove_movnt_sse2, pmemdest, src, len);
+}
+
 /*
  * pmem_memmove_nodrain() calls through Func_memmove_nodrain to do the work.
  * Although initialized to memmove_nodrain_normal(), once the existence of the
@@ -944,6 +980,14 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 static void *(*Func_memmove_nodrain)
 	(void *pmemdest, const void *src, size_t len) = memmove_nodrain_normal;
 
+/*
+ * Func_memmove_movnt is the non-temporal copy kernel matching
+ * Func_memmove_nodrain, used by the vectored copy functions, which issue
+ * a single SFENCE for the whole vector.  NULL if movnt is not used.
+ */
+static void *(*Func_memmove_movnt)
+	(void *pmemdest, const void *src, size_t len);
+
 /*
  * pmem_memmove_nodrain -- memmove to pmem without hw drain
  */
@@ -985,6 +1029,10 @@ pmem_memcpy_persist(void *pmemdest, const void *src, size_t len)
 {
 	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
 
+	if (len >= Mt_threshold &&
+	    mt_memcpy_persist(pmemdest, src, len, Mt_nthreads) == 0)
+		return pmemdest;
+
 	pmem_memcpy_nodrain(pmemdest, src, len);
 	pmem_drain();
 	return pmemdest;
@@ -1004,38 +1052,24 @@ memset_nodrain_normal(void *pmemdest, int c, size_t len)
 }
 
 /*
- * memset_nodrain_movnt -- (internal) memset to pmem without hw drain, movnt
+ * memset_movnt_sse2 -- memset to pmem using non-temporal stores
+ * (sse2), without serializing them
  */
-static void *
-memset_nodrain_movnt(void *pmemdest, int c, size_t len)
+void *
+memset_movnt_sse2(void *pmemdest, int c, size_t len)
 {
 	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
 
 	size_t i;
-	void *dest1 = pmemdest;
+	char *dest1 = pmemdest;
 	size_t cnt;
 	__m128i xmm0;
 	__m128i *d;
 
-	if (len < Movnt_threshold) {
-		memset(pmemdest, c, len);
-		pmem_flush(pmemdest, len);
-		return pmemdest;
-	}
-
 	/* memset up to the next FLUSH_ALIGN boundary */
-	cnt = (uint64_t)dest1 & ALIGN_MASK;
-	if (cnt != 0) {
-		cnt = FLUSH_ALIGN - cnt;
-
-		if (cnt > len)
-			cnt = len;
-
-		memset(dest1, c, cnt);
-		pmem_flush(dest1, cnt);
-		len -= cnt;
-		dest1 = (char *)dest1 + cnt;
-	}
+	cnt = movnt_head_set(dest1, c, len);
+	dest1 += cnt;
+	len -= cnt;
 
 	xmm0 = _mm_set1_epi8((char)c);
 
@@ -1068,32 +1102,21 @@ memset_nodrain_movnt(void *pmemdest, int c, size_t len)
 
 	/* memset the last bytes (<16), first dwords then bytes */
 	len &= MOVNT_MASK;
-	if (len != 0) {
-		int32_t *d32 = (int32_t *)d;
-		cnt = len >> DWORD_SHIFT;
-		if (cnt != 0) {
-			for (i = 0; i < cnt; i++) {
-				_mm_stream_si32(d32,
-					_mm_cvtsi128_si32(xmm0));
-				VALGRIND_DO_FLUSH(d32, sizeof(*d32));
-				d32++;
-			}
-		}
-
-		/* at this point the cnt < 16 so use memset */
-		cnt = len & DWORD_MASK;
-		if (cnt != 0) {
-			memset((void *)d32, c, cnt);
-			pmem_flush(d32, cnt);
-		}
-	}
-
-	/* serialize non-temporal store instructions */
-	predrain_fence_sfence();
+	if (len != 0)
+		movnt_tail_set((char *)d, c, len);
 
 	return pmemdest;
 }
 
+/*
+ * memset_nodrain_movnt -- memset to pmem without hw drain, movnt (sse2)
+ */
+void *
+memset_nodrain_movnt(void *pmemdest, int c, size_t len)
+{
+	return nodrain_memset_movnt(memset_movnt_sse2, pmemdest, c, len);
+}
+
 /*
  * pmem_memset_nodrain() calls through Func_memset_nodrain to do the work.
  * Although initialized to memset_nodrain_normal(), once the existence of the
@@ -1104,6 +1127,12 @@ memset_nodrain_movnt(void *pmemdest, int c, size_t len)
 static void *(*Func_memset_nodrain)
 	(void *pmemdest, int c, size_t len) = memset_nodrain_normal;
 
+/*
+ * Func_memset_movnt is the non-temporal fill kernel matching
+ * Func_memset_nodrain.  NULL if movnt is not used.
+ */
+static void *(*Func_memset_movnt)(void *pmemdest, int c, size_t len);
+
 /*
  * pmem_memset_nodrain -- memset to pmem without hw drain
  */
@@ -1121,11 +1150,739 @@ pmem_memset_persist(void *pmemdest, int c, size_t len)
 {
 	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
 
+	if (len >= Mt_threshold &&
+	    mt_memset_persist(pmemdest, c, len, Mt_nthreads) == 0)
+		return pmemdest;
+
 	pmem_memset_nodrain(pmemdest, c, len);
 	pmem_drain();
 	return pmemdest;
 }
 
+/*
+ * The vectored functions collect the ranges to be flushed in batches of
+ * FLUSHV_BATCH entries kept on the stack.  Cache lines shared by ranges
+ * from different batches may be flushed more than once.
+ */
+#define FLUSHV_BATCH 64
+
+struct flushv_batch {
+	size_t cnt;
+	struct flushv_range {
+		uintptr_t start;	/* aligned down to FLUSH_ALIGN */
+		uintptr_t end;		/* aligned up to FLUSH_ALIGN */
+	} range[FLUSHV_BATCH];
+};
+
+/*
+ * flushv_range_cmp -- (internal) compare flushv ranges by start address
+ */
+static int
+flushv_range_cmp(const void *lhs, const void *rhs)
+{
+	const struct flushv_range *l = lhs;
+	const struct flushv_range *r = rhs;
+
+	if (l->start < r->start)
+		return -1;
+	if (l->start > r->start)
+		return 1;
+	return 0;
+}
+
+/*
+ * flushv_batch_flush -- (internal) flush every cache line covered by the
+ * ranges collected in the batch exactly once and empty the batch
+ */
+static void
+flushv_batch_flush(struct flushv_batch *b)
+{
+	if (b->cnt == 0)
+		return;
+
+	/* ranges usually come in ascending order, don't sort them then */
+	for (size_t i = 1; i < b->cnt; ++i) {
+		if (b->range[i].start < b->range[i - 1].start) {
+			qsort(b->range, b->cnt, sizeof(b->range[0]),
+					flushv_range_cmp);
+			break;
+		}
+	}
+
+	struct flushv_range cur = b->range[0];
+	for (size_t i = 1; i < b->cnt; ++i) {
+		struct flushv_range *r = &b->range[i];
+		if (r->start <= cur.end) {
+			if (r->end > cur.end)
+				cur.end = r->end;
+		} else {
+			Func_flush((void *)cur.start, cur.end - cur.start);
+			cur = *r;
+		}
+	}
+	Func_flush((void *)cur.start, cur.end - cur.start);
+
+	b->cnt = 0;
+}
+
+/*
+ * flushv_batch_add -- (internal) add a range to be flushed to the batch
+ */
+static void
+flushv_batch_add(struct flushv_batch *b, const void *addr, size_t len)
+{
+	if (len == 0)
+		return;
+
+	VALGRIND_DO_CHECK_MEM_IS_ADDRESSABLE(addr, len);
+
+	if (b->cnt == FLUSHV_BATCH)
+		flushv_batch_flush(b);
+
+	struct flushv_range *r = &b->range[b->cnt++];
+	r->start = (uintptr_t)addr & ~(FLUSH_ALIGN - 1);
+	r->end = ((uintptr_t)addr + len + FLUSH_ALIGN - 1) &
+			~(FLUSH_ALIGN - 1);
+}
+
+/*
+ * pmem_flushv -- flush processor cache for all ranges in the vector
+ */
+void
+pmem_flushv(const struct pmem_flush_vec *vec, size_t cnt)
+{
+	LOG(10, "vec %p cnt %zu", vec, cnt);
+
+	struct flushv_batch b;
+	b.cnt = 0;
+
+	for (size_t i = 0; i < cnt; ++i)
+		flushv_batch_add(&b, vec[i].addr, vec[i].len);
+
+	flushv_batch_flush(&b);
+}
+
+/*
+ * pmem_persistv -- make any cached changes to all ranges in the vector
+ * persistent
+ */
+void
+pmem_persistv(const struct pmem_flush_vec *vec, size_t cnt)
+{
+	LOG(15, "vec %p cnt %zu", vec, cnt);
+
+	pmem_flushv(vec, cnt);
+	pmem_drain();
+}
+
+/*
+ * memcpyv_nodrain -- (internal) copy all ranges in the vector to pmem
+ * without serializing non-temporal stores, returns 1 if any were issued
+ */
+static int
+memcpyv_nodrain(const struct pmem_memcpy_vec *vec, size_t cnt)
+{
+	struct flushv_batch b;
+	b.cnt = 0;
+	int movnt = 0;
+
+	for (size_t i = 0; i < cnt; ++i) {
+		const struct pmem_memcpy_vec *v = &vec[i];
+
+		if (Func_memmove_movnt != NULL &&
+				v->len >= Movnt_threshold_memmove) {
+			Func_memmove_movnt(v->pmemdest, v->src, v->len);
+			movnt = 1;
+		} else {
+			memmove(v->pmemdest, v->src, v->len);
+			flushv_batch_add(&b, v->pmemdest, v->len);
+		}
+	}
+
+	flushv_batch_flush(&b);
+
+	return movnt;
+}
+
+/*
+ * pmem_memcpyv_nodrain -- memcpy all ranges in the vector to pmem without
+ * hw drain
+ */
+void
+pmem_memcpyv_nodrain(const struct pmem_memcpy_vec *vec, size_t cnt)
+{
+	LOG(15, "vec %p cnt %zu", vec, cnt);
+
+	if (memcpyv_nodrain(vec, cnt)) {
+		/* serialize non-temporal store instructions */
+		predrain_fence_sfence();
+	}
+}
+
+/*
+ * pmem_memcpyv_persist -- memcpy all ranges in the vector to pmem
+ */
+void
+pmem_memcpyv_persist(const struct pmem_memcpy_vec *vec, size_t cnt)
+{
+	LOG(15, "vec %p cnt %zu", vec, cnt);
+
+	/*
+	 * The SFENCE which serializes non-temporal stores also completes
+	 * CLWB/CLFLUSHOPT, so it replaces the regular pre-drain fence.
+	 */
+	if (memcpyv_nodrain(vec, cnt))
+		predrain_fence_sfence();
+	else
+		Func_predrain_fence();
+
+	VALGRIND_DO_COMMIT;
+	VALGRIND_DO_FENCE;
+}
+
+/*
+ * Bulk writes are split into stripes of MT_STRIPE_LEN bytes, aligned to
+ * MT_STRIPE_LEN (and so to cache lines) in the destination, which the
+ * threads working on the write claim one by one.
+ */
+#define MT_STRIPE_LEN	(2 * 1024 * 1024)
+
+enum mt_op {
+	MT_MEMCPY,
+	MT_MEMSET,
+};
+
+struct mt_job {
+	enum mt_op op;
+	char *dest;
+	const char *src;
+	int c;
+	size_t len;
+	size_t head;		/* length of the first stripe */
+	uint32_t nstripes;
+	uint32_t next;		/* next stripe to be claimed */
+};
+
+/*
+ * Mt -- pool of worker threads for bulk writes, started on first use
+ *
+ * Only one job runs at a time, a thread which finds the pool busy does
+ * its bulk write on its own.  The thread which posted a job works on it
+ * as well and then waits for the workers which have joined it.
+ */
+static struct {
+	pthread_mutex_t lock;	/* protects the whole structure */
+	pthread_cond_t work;	/* a job was posted or the pool is exiting */
+	pthread_cond_t done;	/* all workers have finished the job */
+	int busy;		/* a job is running */
+	struct mt_job *job;
+	uint64_t gen;		/* incremented every time a job is posted */
+	unsigned wanted;	/* workers yet to join the job */
+	unsigned running;	/* workers yet to finish the job */
+	int exiting;
+	int no_threads;		/* worker threads cannot be started */
+	unsigned nworkers;
+	pthread_t workers[MT_MAX_THREADS - 1];
+} Mt;
+
+/*
+ * mt_job_run -- (internal) write the stripes of a job until none is left,
+ * then wait for the stores of the calling thread to complete
+ */
+static void
+mt_job_run(struct mt_job *job)
+{
+	int movnt = 0;
+	uint32_t i;
+
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->nstripes) {
+		size_t off = 0;
+		size_t len = job->head;
+		if (i != 0) {
+			off = job->head + (size_t)(i - 1) * MT_STRIPE_LEN;
+			len = job->len - off;
+			if (len > MT_STRIPE_LEN)
+				len = MT_STRIPE_LEN;
+		}
+
+		char *dest = job->dest + off;
+
+		if (job->op == MT_MEMCPY && Func_memmove_movnt != NULL) {
+			Func_memmove_movnt(dest, job->src + off, len);
+			movnt = 1;
+		} else if (job->op == MT_MEMSET && Func_memset_movnt != NULL) {
+			Func_memset_movnt(dest, job->c, len);
+			movnt = 1;
+		} else {
+			if (job->op == MT_MEMCPY)
+				memcpy(dest, job->src + off, len);
+			else
+				memset(dest, job->c, len);
+			Func_flush(dest, len);
+		}
+	}
+
+	/* non-temporal stores are per-CPU, so each thread has to fence */
+	if (movnt)
+		predrain_fence_sfence();
+	else
+		Func_predrain_fence();
+}
+
+/*
+ * mt_worker -- (internal) worker thread of the bulk write pool
+ */
+static void *
+mt_worker(void *arg)
+{
+	uint64_t gen = 0;
+
+	util_mutex_lock(&Mt.lock);
+	for (;;) {
+		while (!Mt.exiting && (Mt.wanted == 0 || Mt.gen == gen))
+			pthread_cond_wait(&Mt.work, &Mt.lock);
+
+		if (Mt.exiting)
+			break;
+
+		gen = Mt.gen;
+		Mt.wanted--;
+		struct mt_job *job = Mt.job;
+		util_mutex_unlock(&Mt.lock);
+
+		mt_job_run(job);
+
+		util_mutex_lock(&Mt.lock);
+		if (--Mt.running == 0)
+			pthread_cond_signal(&Mt.done);
+	}
+	util_mutex_unlock(&Mt.lock);
+
+	return NULL;
+}
+
+/*
+ * mt_start_workers -- (internal) start worker threads until there are
+ * at least nworkers of them, returns the number of workers available
+ * (up to nworkers)
+ */
+static unsigned
+mt_start_workers(unsigned nworkers)
+{
+	while (Mt.nworkers < nworkers && !Mt.no_threads) {
+		int ret = pmem_os_thread_create(&Mt.workers[Mt.nworkers],
+				mt_worker, NULL);
+		if (ret) {
+			LOG(3, "cannot start worker thread: %s",
+				strerror(ret));
+			if (ret == ENOTSUP)
+				Mt.no_threads = 1;
+			break;
+		}
+		Mt.nworkers++;
+	}
+
+	LOG(4, "%u worker threads running", Mt.nworkers);
+
+	return Mt.nworkers < nworkers ? Mt.nworkers : nworkers;
+}
+
+/*
+ * mt_run -- (internal) run a bulk write using up to nthreads threads,
+ * including the calling one
+ *
+ * Returns 0 if the range has been written and persisted, -1 if the pool
+ * cannot be used and the caller has to write it on its own.
+ */
+static int
+mt_run(struct mt_job *job, unsigned nthreads)
+{
+	size_t head = MT_STRIPE_LEN -
+		((uintptr_t)job->dest & (MT_STRIPE_LEN - 1));
+	if (head > job->len)
+		head = job->len;
+
+	size_t nstripes = 1 +
+		(job->len - head + MT_STRIPE_LEN - 1) / MT_STRIPE_LEN;
+
+	if (nthreads == 0)
+		nthreads = Mt_nthreads;
+	if (nthreads > MT_MAX_THREADS)
+		nthreads = MT_MAX_THREADS;
+	if (nthreads > nstripes)
+		nthreads = (unsigned)nstripes;
+
+	/* leave room for threads claiming past the last stripe */
+	if (nthreads < 2 || nstripes > UINT32_MAX / 2)
+		return -1;
+
+	job->head = head;
+	job->nstripes = (uint32_t)nstripes;
+	job->next = 0;
+
+	util_mutex_lock(&Mt.lock);
+
+	if (Mt.busy) {
+		util_mutex_unlock(&Mt.lock);
+		LOG(4, "bulk write pool busy");
+		return -1;
+	}
+
+	unsigned nworkers = mt_start_workers(nthreads - 1);
+	if (nworkers == 0) {
+		util_mutex_unlock(&Mt.lock);
+		return -1;
+	}
+
+	LOG(4, "len %zu stripes %zu workers %u", job->len, nstripes, nworkers);
+
+	Mt.busy = 1;
+	Mt.job = job;
+	Mt.wanted = nworkers;
+	Mt.running = nworkers;
+	Mt.gen++;
+	pthread_cond_broadcast(&Mt.work);
+	util_mutex_unlock(&Mt.lock);
+
+	mt_job_run(job);
+
+	util_mutex_lock(&Mt.lock);
+	while (Mt.running != 0)
+		pthread_cond_wait(&Mt.done, &Mt.lock);
+	Mt.job = NULL;
+	Mt.busy = 0;
+	util_mutex_unlock(&Mt.lock);
+
+	VALGRIND_DO_COMMIT;
+	VALGRIND_DO_FENCE;
+
+	return 0;
+}
+
+/*
+ * mt_memcpy_persist -- (internal) memcpy to pmem split between threads,
+ * returns -1 if the caller has to copy the range on its own
+ */
+static int
+mt_memcpy_persist(void *pmemdest, const void *src, size_t len,
+	unsigned nthreads)
+{
+	/* the stripes are written in no particular order */
+	if ((uintptr_t)pmemdest < (uintptr_t)src + len &&
+	    (uintptr_t)src < (uintptr_t)pmemdest + len)
+		return -1;
+
+	struct mt_job job = { MT_MEMCPY, pmemdest, src, 0, len, 0, 0, 0 };
+
+	return mt_run(&job, nthreads);
+}
+
+/*
+ * mt_memset_persist -- (internal) memset to pmem split between threads,
+ * returns -1 if the caller has to fill the range on its own
+ */
+static int
+mt_memset_persist(void *pmemdest, int c, size_t len, unsigned nthreads)
+{
+	struct mt_job job = { MT_MEMSET, pmemdest, NULL, c, len, 0, 0, 0 };
+
+	return mt_run(&job, nthreads);
+}
+
+/*
+ * pmem_memcpy_persist_mt -- memcpy to pmem using up to nthreads threads
+ */
+void *
+pmem_memcpy_persist_mt(void *pmemdest, const void *src, size_t len,
+	unsigned nthreads)
+{
+	LOG(3, "pmemdest %p src %p len %zu nthreads %u", pmemdest, src, len,
+		nthreads);
+
+	if (mt_memcpy_persist(pmemdest, src, len, nthreads) != 0) {
+		pmem_memmove_nodrain(pmemdest, src, len);
+		pmem_drain();
+	}
+
+	return pmemdest;
+}
+
+/*
+ * pmem_memset_persist_mt -- memset to pmem using up to nthreads threads
+ */
+void *
+pmem_memset_persist_mt(void *pmemdest, int c, size_t len, unsigned nthreads)
+{
+	LOG(3, "pmemdest %p c 0x%x len %zu nthreads %u", pmemdest, c, len,
+		nthreads);
+
+	if (mt_memset_persist(pmemdest, c, len, nthreads) != 0) {
+		pmem_memset_nodrain(pmemdest, c, len);
+		pmem_drain();
+	}
+
+	return pmemdest;
+}
+
+/*
+ * mt_init -- (internal) initialize the bulk write pool, no threads are
+ * started until the first bulk write
+ */
+static void
+mt_init(void)
+{
+	util_mutex_init(&Mt.lock, NULL);
+
+	int ret = pthread_cond_init(&Mt.work, NULL);
+	if (ret == 0)
+		ret = pthread_cond_init(&Mt.done, NULL);
+	if (ret) {
+		errno = ret;
+		FATAL("!pthread_cond_init");
+	}
+
+	Mt.busy = 0;
+	Mt.job = NULL;
+	Mt.wanted = 0;
+	Mt.running = 0;
+	Mt.exiting = 0;
+	Mt.nworkers = 0;
+}
+
+/*
+ * mt_atfork_child -- (internal) forget the worker threads of the parent
+ * process, the child starts its own ones when needed
+ */
+static void
+mt_atfork_child(void)
+{
+	mt_init();
+}
+
+/*
+ * mt_fini -- (internal) stop the worker threads
+ */
+static void
+mt_fini(void)
+{
+	util_mutex_lock(&Mt.lock);
+	Mt.exiting = 1;
+	pthread_cond_broadcast(&Mt.work);
+	util_mutex_unlock(&Mt.lock);
+
+	for (unsigned i = 0; i < Mt.nworkers; i++)
+		pmem_os_thread_join(Mt.workers[i]);
+
+	Mt.nworkers = 0;
+
+	pthread_cond_destroy(&Mt.done);
+	pthread_cond_destroy(&Mt.work);
+	util_mutex_destroy(&Mt.lock);
+}
+
+/*
+ * Calibration compares the time of persisting copies (or fills) of each
+ * power of two size from CALIBRATE_MIN_LEN to CALIBRATE_MAX_LEN made with
+ * regular stores followed by a flush and made with non-temporal stores.
+ * Each size is measured CALIBRATE_RUNS times by writing CALIBRATE_BYTES
+ * in total and the best time is taken.
+ */
+#define CALIBRATE_MIN_LEN	64
+#define CALIBRATE_MAX_LEN	(PMEM_CALIBRATE_MIN_LEN / 2)
+#define CALIBRATE_BYTES		(1 << 20)
+#define CALIBRATE_RUNS		3
+
+/* scratch buffer used when none is given, larger than most CPU caches */
+#define CALIBRATE_SCRATCH_LEN	(32 * 1024 * 1024)
+
+#define NSEC_IN_SEC		1000000000ULL
+
+enum calibrate_op {
+	CALIBRATE_MEMMOVE,
+	CALIBRATE_MEMSET,
+};
+
+struct calibrate_buf {
+	char *dest;		/* scratch destination */
+	size_t dest_len;
+	size_t dest_off;	/* where the next write goes */
+	const char *src;	/* CALIBRATE_MAX_LEN bytes of source data */
+};
+
+/*
+ * calibrate_time -- (internal) return monotonic time in nanoseconds
+ */
+static uint64_t
+calibrate_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * NSEC_IN_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * calibrate_run -- (internal) measure the time of persisting CALIBRATE_BYTES
+ * written in len-sized pieces, with or without non-temporal stores
+ *
+ * Consecutive pieces go to consecutive parts of the scratch buffer, so that
+ * they do not hit the cache more often than real writes would.
+ */
+static uint64_t
+calibrate_run(struct calibrate_buf *buf, enum calibrate_op op, size_t len,
+	int movnt)
+{
+	uint64_t start = calibrate_time();
+
+	for (size_t done = 0; done < CALIBRATE_BYTES; done += len) {
+		if (buf->dest_off + len > buf->dest_len)
+			buf->dest_off = 0;
+
+		char *dest = buf->dest + buf->dest_off;
+		buf->dest_off += len;
+
+		if (movnt) {
+			if (op == CALIBRATE_MEMMOVE)
+				Func_memmove_movnt(dest, buf->src, len);
+			else
+				Func_memset_movnt(dest, (int)done, len);
+			predrain_fence_sfence();
+		} else {
+			if (op == CALIBRATE_MEMMOVE)
+				memmove(dest, buf->src, len);
+			else
+				memset(dest, (int)done, len);
+			Func_flush(dest, len);
+			Func_predrain_fence();
+		}
+	}
+
+	return calibrate_time() - start;
+}
+
+/*
+ * calibrate_threshold -- (internal) find the smallest length from which
+ * non-temporal stores are faster for all the measured lengths
+ *
+ * If regular stores win even for CALIBRATE_MAX_LEN, movnt is still used
+ * for anything longer, where cache pollution makes regular stores costly.
+ */
+static size_t
+calibrate_threshold(struct calibrate_buf *buf, enum calibrate_op op)
+{
+	size_t threshold = CALIBRATE_MAX_LEN;
+
+	for (size_t len = CALIBRATE_MAX_LEN; len >= CALIBRATE_MIN_LEN;
+			len /= 2) {
+		uint64_t movnt = UINT64_MAX;
+		uint64_t normal = UINT64_MAX;
+
+		for (int i = 0; i < CALIBRATE_RUNS; ++i) {
+			uint64_t t = calibrate_run(buf, op, len, 1);
+			if (t < movnt)
+				movnt = t;
+
+			t = calibrate_run(buf, op, len, 0);
+			if (t < normal)
+				normal = t;
+		}
+
+		LOG(4, "%s len %zu movnt %lluns normal %lluns",
+			op == CALIBRATE_MEMMOVE ? "memmove" : "memset", len,
+			(unsigned long long)movnt, (unsigned long long)normal);
+
+		if (movnt > normal)
+			break;
+
+		threshold = len;
+	}
+
+	return threshold;
+}
+
+/*
+ * pmem_calibrate -- measure the lengths from which movnt is used
+ *
+ * The measurement writes to the given scratch range, so it reflects the
+ * kind of memory the range is on.  If pmemdest is NULL, a temporary buffer
+ * in regular memory is used instead.
+ */
+int
+pmem_calibrate(void *pmemdest, size_t len)
+{
+	LOG(3, "pmemdest %p len %zu", pmemdest, len);
+
+	if (Func_memmove_movnt == NULL) {
+		ERR("non-temporal stores are not used");
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	if (pmemdest != NULL && len < PMEM_CALIBRATE_MIN_LEN) {
+		ERR("scratch range too small %zu, minimum is %zu", len,
+			(size_t)PMEM_CALIBRATE_MIN_LEN);
+		errno = EINVAL;
+		return -1;
+	}
+
+	void *scratch = NULL;
+	if (pmemdest == NULL) {
+		scratch = Malloc(CALIBRATE_SCRATCH_LEN);
+		if (scratch == NULL) {
+			ERR("!Malloc");
+			return -1;
+		}
+		pmemdest = scratch;
+		len = CALIBRATE_SCRATCH_LEN;
+	}
+
+	char *src = Malloc(CALIBRATE_MAX_LEN);
+	if (src == NULL) {
+		ERR("!Malloc");
+		Free(scratch);
+		return -1;
+	}
+	memset(src, 0xa5, CALIBRATE_MAX_LEN);
+
+	/* page faults would dominate the first measurements */
+	if (len > CALIBRATE_SCRATCH_LEN)
+		len = CALIBRATE_SCRATCH_LEN;
+	memset(pmemdest, 0, len);
+
+	struct calibrate_buf buf = { pmemdest, len, 0, src };
+
+	size_t memmove_threshold = calibrate_threshold(&buf, CALIBRATE_MEMMOVE);
+	size_t memset_threshold = calibrate_threshold(&buf, CALIBRATE_MEMSET);
+
+	LOG(3, "movnt threshold memmove %zu memset %zu", memmove_threshold,
+		memset_threshold);
+
+	Movnt_threshold_memmove = memmove_threshold;
+	Movnt_threshold_memset = memset_threshold;
+
+	Free(src);
+	Free(scratch);
+
+	return 0;
+}
+
+/*
+ * pmem_get_movnt_thresholds -- return the lengths from which memcpy/memmove
+ * and memset use non-temporal stores
+ */
+void
+pmem_get_movnt_thresholds(size_t *memcpy_thresholdp,
+	size_t *memset_thresholdp)
+{
+	LOG(3, "memcpy_thresholdp %p memset_thresholdp %p", memcpy_thresholdp,
+		memset_thresholdp);
+
+	if (memcpy_thresholdp != NULL)
+		*memcpy_thresholdp = Movnt_threshold_memmove;
+	if (memset_thresholdp != NULL)
+		*memset_thresholdp = Movnt_threshold_memset;
+}
+
 /*
  * pmem_log_cpuinfo -- log the results of cpu dispatching decisions,
  * and verify them
@@ -1145,7 +1902,13 @@ pmem_log_cpuinfo(void)
 		FATAL("invalid flush function address");
 
 	if (Func_memmove_nodrain == memmove_nodrain_movnt)
-		LOG(3, "using movnt");
+		LOG(3, "using movnt (sse2)");
+	else if (Func_memmove_nodrain == memmove_nodrain_movnt_avx2)
+		LOG(3, "using movnt (avx2)");
+#ifdef AVX512F_AVAILABLE
+	else if (Func_memmove_nodrain == memmove_nodrain_movnt_avx512f)
+		LOG(3, "using movnt (avx512f)");
+#endif
 	else if (Func_memmove_nodrain == memmove_nodrain_normal)
 		LOG(3, "not using movnt");
 	else
@@ -1188,6 +1951,49 @@ pmem_get_cpuinfo(void)
 	}
 }
 
+/*
+ * pmem_get_movnt_funcs -- pick the widest non-temporal memmove/memset
+ * variants supported by the CPU
+ */
+static void
+pmem_get_movnt_funcs(void)
+{
+	Func_memmove_nodrain = memmove_nodrain_movnt;
+	Func_memset_nodrain = memset_nodrain_movnt;
+	Func_memmove_movnt = memmove_movnt_sse2;
+	Func_memset_movnt = memset_movnt_sse2;
+
+	if (is_cpu_avx2_present()) {
+		LOG(3, "avx2 supported");
+
+		char *e = getenv("PMEM_NO_AVX2");
+		if (e && strcmp(e, "1") == 0)
+			LOG(3, "PMEM_NO_AVX2 forced no avx2");
+		else {
+			Func_memmove_nodrain = memmove_nodrain_movnt_avx2;
+			Func_memset_nodrain = memset_nodrain_movnt_avx2;
+			Func_memmove_movnt = memmove_movnt_avx2;
+			Func_memset_movnt = memset_movnt_avx2;
+		}
+	}
+
+#ifdef AVX512F_AVAILABLE
+	if (is_cpu_avx512f_present()) {
+		LOG(3, "avx512f supported");
+
+		char *e = getenv("PMEM_NO_AVX512F");
+		if (e && strcmp(e, "1") == 0)
+			LOG(3, "PMEM_NO_AVX512F forced no avx512f");
+		else {
+			Func_memmove_nodrain = memmove_nodrain_movnt_avx512f;
+			Func_memset_nodrain = memset_nodrain_movnt_avx512f;
+			Func_memmove_movnt = memmove_movnt_avx512f;
+			Func_memset_movnt = memset_movnt_avx512f;
+		}
+	}
+#endif
+}
+
 /*
  * pmem_init -- load-time initialization for pmem.c
  */
@@ -1211,6 +2017,7 @@ pmem_init(void)
 	 * and pmem_memset_*().
 	 * It has no effect if movnt is not supported or disabled.
 	 */
+	int threshold_set = 0;
 	char *ptr = getenv("PMEM_MOVNT_THRESHOLD");
 	if (ptr) {
 		long long val = atoll(ptr);
@@ -1219,16 +2026,54 @@ pmem_init(void)
 			LOG(3, "Invalid PMEM_MOVNT_THRESHOLD");
 		else {
 			LOG(3, "PMEM_MOVNT_THRESHOLD set to %zu", (size_t)val);
-			Movnt_threshold = (size_t)val;
+			Movnt_threshold_memmove = (size_t)val;
+			Movnt_threshold_memset = (size_t)val;
+			threshold_set = 1;
 		}
 	}
 
 	ptr = getenv("PMEM_NO_MOVNT");
 	if (ptr && strcmp(ptr, "1") == 0)
 		LOG(3, "PMEM_NO_MOVNT forced no movnt");
-	else {
-		Func_memmove_nodrain = memmove_nodrain_movnt;
-		Func_memset_nodrain = memset_nodrain_movnt;
+	else
+		pmem_get_movnt_funcs();
+
+	/*
+	 * Optionally measure the thresholds instead of using the default,
+	 * unless they were set explicitly.
+	 */
+	ptr = getenv("PMEM_MOVNT_CALIBRATE");
+	if (ptr && strcmp(ptr, "1") == 0 && !threshold_set) {
+		LOG(3, "PMEM_MOVNT_CALIBRATE forced movnt calibration");
+		if (pmem_calibrate(NULL, 0) != 0)
+			LOG(3, "movnt calibration failed");
+	}
+
+	mt_init();
+	pmem_os_atfork_child(mt_atfork_child);
+
+	ptr = getenv("PMEM_MT_THREADS");
+	if (ptr) {
+		long val = atol(ptr);
+
+		if (val < 1 || val > MT_MAX_THREADS)
+			LOG(3, "Invalid PMEM_MT_THREADS");
+		else {
+			LOG(3, "PMEM_MT_THREADS set to %ld", val);
+			Mt_nthreads = (unsigned)val;
+		}
+	}
+
+	ptr = getenv("PMEM_MT_THRESHOLD");
+	if (ptr) {
+		long long val = atoll(ptr);
+
+		if (val < 0)
+			LOG(3, "Invalid PMEM_MT_THRESHOLD");
+		else {
+			LOG(3, "PMEM_MT_THRESHOLD set to %zu", (size_t)val);
+			Mt_threshold = (size_t)val;
+		}
 	}
 
 	pmem_log_cpuinfo();
@@ -1240,6 +2085,16 @@ pmem_init(void)
 #endif
 }
 
+/*
+ * pmem_fini -- cleanup for pmem.c
+ */
+void
+pmem_fini(void)
+{
+	LOG(3, NULL);
+
+	mt_fini();
+}
 
 #ifdef _MSC_VER
 /*
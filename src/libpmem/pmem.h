@@ -41,8 +41,24 @@
 extern unsigned long long Pagesize;
 
 void pmem_init(void);
+void pmem_fini(void);
+
+void async_init(void);
+void async_fini(void);
+
+extern int Msync_defer;
+void msync_defer_init(void);
+void msync_defer_fini(void);
+int msync_defer_record(const void *addr, size_t len);
 
 int is_pmem_proc(const void *addr, size_t len);
+void pmem_range_register(const void *addr, size_t len);
+void pmem_range_unregister(const void *addr, size_t len);
+
+int pmem_os_thread_create(pthread_t *thread, void *(*start)(void *),
+	void *arg);
+void pmem_os_thread_join(pthread_t thread);
+void pmem_os_atfork_child(void (*child)(void));
 
 #if defined(_WIN32) && (NTDDI_VERSION >= NTDDI_WIN10_RS1)
 typedef BOOL (WINAPI *PQVM)(
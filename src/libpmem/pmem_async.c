@@ -0,0 +1,408 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_async.c -- asynchronous copy engine for libpmem
+ *
+ * Requests are queued for a small pool of worker threads, started on first
+ * use.  A worker writes the range using the same functions as the
+ * synchronous interfaces, i.e. through Func_memmove_nodrain,
+ * Func_memset_nodrain or Func_flush, followed by pmem_drain() issued by
+ * the worker itself, as non-temporal stores and cache flushes are only
+ * serialized by a fence on the CPU which issued them.
+ *
+ * The request structure doubles as the completion handle returned to the
+ * caller, which has to release it.  Completion is signalled under the
+ * queue lock, so a waiter which sees a request done also sees its data
+ * persistent.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "libpmem.h"
+
+#include "pmem.h"
+#include "out.h"
+#include "util.h"
+#include "sys_util.h"
+#include "queue.h"
+
+#define ASYNC_NTHREADS		1	/* default number of worker threads */
+#define ASYNC_MAX_THREADS	16	/* maximum number of worker threads */
+
+enum async_op {
+	ASYNC_MEMCPY,
+	ASYNC_MEMSET,
+	ASYNC_PERSIST,
+};
+
+struct pmem_async {
+	TAILQ_ENTRY(pmem_async) next;	/* link in the queue */
+	enum async_op op;
+	void *pmemdest;
+	const void *src;
+	int c;
+	size_t len;
+	int done;			/* protected by Async.lock */
+};
+
+static struct {
+	pthread_mutex_t lock;	/* protects the whole structure */
+	pthread_cond_t work;	/* a request was queued or the pool exits */
+	pthread_cond_t done;	/* a request was completed */
+	TAILQ_HEAD(async_queue, pmem_async) queue;
+	int exiting;
+	int no_threads;		/* worker threads cannot be started */
+	unsigned nthreads;	/* number of workers to start */
+	unsigned nworkers;	/* number of workers running */
+	pthread_t workers[ASYNC_MAX_THREADS];
+} Async;
+
+/*
+ * async_run -- (internal) perform a request and wait for its stores
+ */
+static void
+async_run(struct pmem_async *req)
+{
+	switch (req->op) {
+	case ASYNC_MEMCPY:
+		pmem_memmove_nodrain(req->pmemdest, req->src, req->len);
+		break;
+	case ASYNC_MEMSET:
+		pmem_memset_nodrain(req->pmemdest, req->c, req->len);
+		break;
+	case ASYNC_PERSIST:
+		pmem_flush(req->pmemdest, req->len);
+		break;
+	}
+
+	pmem_drain();
+}
+
+/*
+ * async_worker -- (internal) worker thread of the asynchronous copy engine
+ *
+ * The queue is drained before the worker exits.
+ */
+static void *
+async_worker(void *arg)
+{
+	util_mutex_lock(&Async.lock);
+	for (;;) {
+		while (!Async.exiting && TAILQ_EMPTY(&Async.queue))
+			pthread_cond_wait(&Async.work, &Async.lock);
+
+		struct pmem_async *req = TAILQ_FIRST(&Async.queue);
+		if (req == NULL)
+			break;
+
+		TAILQ_REMOVE(&Async.queue, req, next);
+		util_mutex_unlock(&Async.lock);
+
+		async_run(req);
+
+		util_mutex_lock(&Async.lock);
+		req->done = 1;
+		pthread_cond_broadcast(&Async.done);
+	}
+	util_mutex_unlock(&Async.lock);
+
+	return NULL;
+}
+
+/*
+ * async_start_workers -- (internal) start the worker threads if not started
+ * yet, returns the number of workers running
+ */
+static unsigned
+async_start_workers(void)
+{
+	while (Async.nworkers < Async.nthreads && !Async.no_threads) {
+		int ret = pmem_os_thread_create(
+				&Async.workers[Async.nworkers],
+				async_worker, NULL);
+		if (ret) {
+			LOG(3, "cannot start worker thread: %s",
+				strerror(ret));
+			/* do not retry for every request */
+			Async.no_threads = 1;
+			break;
+		}
+		Async.nworkers++;
+	}
+
+	return Async.nworkers;
+}
+
+/*
+ * async_submit -- (internal) queue a request, or perform it right away if
+ * there are no worker threads
+ */
+static struct pmem_async *
+async_submit(enum async_op op, void *pmemdest, const void *src, int c,
+	size_t len)
+{
+	struct pmem_async *req = Malloc(sizeof(*req));
+	if (req == NULL) {
+		ERR("!Malloc");
+		return NULL;
+	}
+
+	req->op = op;
+	req->pmemdest = pmemdest;
+	req->src = src;
+	req->c = c;
+	req->len = len;
+	req->done = 0;
+
+	util_mutex_lock(&Async.lock);
+
+	if (async_start_workers() == 0) {
+		util_mutex_unlock(&Async.lock);
+
+		LOG(4, "no worker threads, request %p done synchronously",
+			req);
+		async_run(req);
+		req->done = 1;
+		return req;
+	}
+
+	TAILQ_INSERT_TAIL(&Async.queue, req, next);
+	pthread_cond_signal(&Async.work);
+
+	util_mutex_unlock(&Async.lock);
+
+	return req;
+}
+
+/*
+ * pmem_memcpy_async -- start copying a range to pmem
+ */
+struct pmem_async *
+pmem_memcpy_async(void *pmemdest, const void *src, size_t len)
+{
+	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
+
+	return async_submit(ASYNC_MEMCPY, pmemdest, src, 0, len);
+}
+
+/*
+ * pmem_memset_async -- start setting a range of pmem
+ */
+struct pmem_async *
+pmem_memset_async(void *pmemdest, int c, size_t len)
+{
+	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
+
+	return async_submit(ASYNC_MEMSET, pmemdest, NULL, c, len);
+}
+
+/*
+ * pmem_persist_async -- start persisting a range of pmem
+ */
+struct pmem_async *
+pmem_persist_async(const void *addr, size_t len)
+{
+	LOG(15, "addr %p len %zu", addr, len);
+
+	return async_submit(ASYNC_PERSIST, (void *)addr, NULL, 0, len);
+}
+
+/*
+ * pmem_async_poll -- check whether a request has completed
+ */
+int
+pmem_async_poll(struct pmem_async *req)
+{
+	LOG(15, "req %p", req);
+
+	util_mutex_lock(&Async.lock);
+	int done = req->done;
+	util_mutex_unlock(&Async.lock);
+
+	return done;
+}
+
+/*
+ * pmem_async_wait -- wait for a request to complete
+ */
+void
+pmem_async_wait(struct pmem_async *req)
+{
+	LOG(15, "req %p", req);
+
+	util_mutex_lock(&Async.lock);
+	while (!req->done)
+		pthread_cond_wait(&Async.done, &Async.lock);
+	util_mutex_unlock(&Async.lock);
+}
+
+/*
+ * pmem_async_wait_any -- wait for any of the requests to complete, stores
+ * the index of the first completed one in *idxp
+ *
+ * NULL entries are skipped, so the caller may clear the entries of the
+ * requests it has released.
+ */
+int
+pmem_async_wait_any(struct pmem_async *const *reqs, size_t nreqs,
+	size_t *idxp)
+{
+	LOG(15, "reqs %p nreqs %zu idxp %p", reqs, nreqs, idxp);
+
+	util_mutex_lock(&Async.lock);
+	for (;;) {
+		int pending = 0;
+
+		for (size_t i = 0; i < nreqs; ++i) {
+			if (reqs[i] == NULL)
+				continue;
+
+			if (reqs[i]->done) {
+				util_mutex_unlock(&Async.lock);
+				*idxp = i;
+				return 0;
+			}
+
+			pending = 1;
+		}
+
+		if (!pending)
+			break;
+
+		pthread_cond_wait(&Async.done, &Async.lock);
+	}
+	util_mutex_unlock(&Async.lock);
+
+	ERR("no requests to wait for");
+	errno = EINVAL;
+	return -1;
+}
+
+/*
+ * pmem_async_release -- wait for a request to complete and free its handle
+ */
+void
+pmem_async_release(struct pmem_async *req)
+{
+	LOG(15, "req %p", req);
+
+	if (req == NULL)
+		return;
+
+	pmem_async_wait(req);
+	Free(req);
+}
+
+/*
+ * async_reset -- (internal) initialize the state of the engine
+ */
+static void
+async_reset(void)
+{
+	util_mutex_init(&Async.lock, NULL);
+
+	int ret = pthread_cond_init(&Async.work, NULL);
+	if (ret == 0)
+		ret = pthread_cond_init(&Async.done, NULL);
+	if (ret) {
+		errno = ret;
+		FATAL("!pthread_cond_init");
+	}
+
+	TAILQ_INIT(&Async.queue);
+	Async.exiting = 0;
+	Async.nworkers = 0;
+}
+
+/*
+ * async_atfork_child -- (internal) forget the worker threads and the
+ * requests of the parent process
+ */
+static void
+async_atfork_child(void)
+{
+	async_reset();
+}
+
+/*
+ * async_init -- initialize the asynchronous copy engine, no threads are
+ * started until the first request
+ */
+void
+async_init(void)
+{
+	LOG(3, NULL);
+
+	async_reset();
+	pmem_os_atfork_child(async_atfork_child);
+
+	Async.nthreads = ASYNC_NTHREADS;
+
+	char *e = getenv("PMEM_ASYNC_THREADS");
+	if (e) {
+		long val = atol(e);
+
+		if (val < 1 || val > ASYNC_MAX_THREADS)
+			LOG(3, "Invalid PMEM_ASYNC_THREADS");
+		else {
+			LOG(3, "PMEM_ASYNC_THREADS set to %ld", val);
+			Async.nthreads = (unsigned)val;
+		}
+	}
+}
+
+/*
+ * async_fini -- complete the queued requests and stop the worker threads
+ */
+void
+async_fini(void)
+{
+	LOG(3, NULL);
+
+	util_mutex_lock(&Async.lock);
+	Async.exiting = 1;
+	pthread_cond_broadcast(&Async.work);
+	util_mutex_unlock(&Async.lock);
+
+	for (unsigned i = 0; i < Async.nworkers; i++)
+		pmem_os_thread_join(Async.workers[i]);
+
+	Async.nworkers = 0;
+
+	pthread_cond_destroy(&Async.done);
+	pthread_cond_destroy(&Async.work);
+	util_mutex_destroy(&Async.lock);
+}
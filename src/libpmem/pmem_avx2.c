@@ -0,0 +1,281 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_avx2.c -- 256-bit non-temporal memmove/memset variants
+ *
+ * This file is compiled with -mavx2, so nothing defined here may be called
+ * unless pmem_init() has confirmed that the CPU and the OS support AVX2.
+ */
+
+#include <immintrin.h>
+
+#include "out.h"
+#include "movnt.h"
+
+#define AVX2_SIZE	32
+#define AVX2_SHIFT	5
+#define AVX2_MASK	(AVX2_SIZE - 1)
+
+#define AVX2_CHUNK_SIZE		256 /* 32*8 */
+#define AVX2_CHUNK_SHIFT	8
+#define AVX2_CHUNK_MASK		(AVX2_CHUNK_SIZE - 1)
+
+/*
+ * memmove_movnt_avx2 -- memmove to pmem using non-temporal stores
+ * (avx2), without serializing them
+ */
+void *
+memmove_movnt_avx2(void *pmemdest, const void *src, size_t len)
+{
+	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
+
+	__m256i ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, ymm7;
+	__m128i xmm0;
+	size_t i;
+	__m256i *d;
+	__m256i *s;
+	char *dest1 = pmemdest;
+	const char *src1 = src;
+	size_t cnt;
+
+	if (len == 0 || src == pmemdest)
+		return pmemdest;
+
+	if ((uintptr_t)dest1 - (uintptr_t)src1 >= len) {
+		/* copy the range in the forward direction */
+		cnt = movnt_head_fw(dest1, src1, len);
+		dest1 += cnt;
+		src1 += cnt;
+		len -= cnt;
+
+		d = (__m256i *)dest1;
+		s = (__m256i *)src1;
+
+		cnt = len >> AVX2_CHUNK_SHIFT;
+		for (i = 0; i < cnt; i++) {
+			ymm0 = _mm256_loadu_si256(s);
+			ymm1 = _mm256_loadu_si256(s + 1);
+			ymm2 = _mm256_loadu_si256(s + 2);
+			ymm3 = _mm256_loadu_si256(s + 3);
+			ymm4 = _mm256_loadu_si256(s + 4);
+			ymm5 = _mm256_loadu_si256(s + 5);
+			ymm6 = _mm256_loadu_si256(s + 6);
+			ymm7 = _mm256_loadu_si256(s + 7);
+			s += 8;
+			_mm256_stream_si256(d, ymm0);
+			_mm256_stream_si256(d + 1, ymm1);
+			_mm256_stream_si256(d + 2, ymm2);
+			_mm256_stream_si256(d + 3, ymm3);
+			_mm256_stream_si256(d + 4, ymm4);
+			_mm256_stream_si256(d + 5, ymm5);
+			_mm256_stream_si256(d + 6, ymm6);
+			_mm256_stream_si256(d + 7, ymm7);
+			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+			d += 8;
+		}
+
+		/* copy the tail (<256 bytes) in 32 bytes chunks */
+		len &= AVX2_CHUNK_MASK;
+		cnt = len >> AVX2_SHIFT;
+		for (i = 0; i < cnt; i++) {
+			ymm0 = _mm256_loadu_si256(s);
+			_mm256_stream_si256(d, ymm0);
+			VALGRIND_DO_FLUSH(d, sizeof(*d));
+			s++;
+			d++;
+		}
+
+		/* copy the tail (<32 bytes) in a 16 bytes chunk */
+		len &= AVX2_MASK;
+		char *d8 = (char *)d;
+		const char *s8 = (const char *)s;
+		if (len >= MOVNT_SIZE) {
+			xmm0 = _mm_loadu_si128((__m128i *)s8);
+			_mm_stream_si128((__m128i *)d8, xmm0);
+			VALGRIND_DO_FLUSH(d8, MOVNT_SIZE);
+			d8 += MOVNT_SIZE;
+			s8 += MOVNT_SIZE;
+		}
+
+		/* copy the last bytes (<16), first dwords then bytes */
+		len &= MOVNT_MASK;
+		if (len != 0)
+			movnt_tail_fw(d8, s8, len);
+	} else {
+		/* copy the range in the backward direction */
+		dest1 += len;
+		src1 += len;
+
+		cnt = movnt_head_bw(dest1, src1, len);
+		dest1 -= cnt;
+		src1 -= cnt;
+		len -= cnt;
+
+		d = (__m256i *)dest1;
+		s = (__m256i *)src1;
+
+		cnt = len >> AVX2_CHUNK_SHIFT;
+		for (i = 0; i < cnt; i++) {
+			ymm0 = _mm256_loadu_si256(s - 1);
+			ymm1 = _mm256_loadu_si256(s - 2);
+			ymm2 = _mm256_loadu_si256(s - 3);
+			ymm3 = _mm256_loadu_si256(s - 4);
+			ymm4 = _mm256_loadu_si256(s - 5);
+			ymm5 = _mm256_loadu_si256(s - 6);
+			ymm6 = _mm256_loadu_si256(s - 7);
+			ymm7 = _mm256_loadu_si256(s - 8);
+			s -= 8;
+			_mm256_stream_si256(d - 1, ymm0);
+			_mm256_stream_si256(d - 2, ymm1);
+			_mm256_stream_si256(d - 3, ymm2);
+			_mm256_stream_si256(d - 4, ymm3);
+			_mm256_stream_si256(d - 5, ymm4);
+			_mm256_stream_si256(d - 6, ymm5);
+			_mm256_stream_si256(d - 7, ymm6);
+			_mm256_stream_si256(d - 8, ymm7);
+			d -= 8;
+			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		}
+
+		/* copy the tail (<256 bytes) in 32 bytes chunks */
+		len &= AVX2_CHUNK_MASK;
+		cnt = len >> AVX2_SHIFT;
+		for (i = 0; i < cnt; i++) {
+			d--;
+			s--;
+			ymm0 = _mm256_loadu_si256(s);
+			_mm256_stream_si256(d, ymm0);
+			VALGRIND_DO_FLUSH(d, sizeof(*d));
+		}
+
+		/* copy the tail (<32 bytes) in a 16 bytes chunk */
+		len &= AVX2_MASK;
+		char *d8 = (char *)d;
+		const char *s8 = (const char *)s;
+		if (len >= MOVNT_SIZE) {
+			d8 -= MOVNT_SIZE;
+			s8 -= MOVNT_SIZE;
+			xmm0 = _mm_loadu_si128((__m128i *)s8);
+			_mm_stream_si128((__m128i *)d8, xmm0);
+			VALGRIND_DO_FLUSH(d8, MOVNT_SIZE);
+		}
+
+		/* copy the last bytes (<16), first dwords then bytes */
+		len &= MOVNT_MASK;
+		if (len != 0)
+			movnt_tail_bw(d8, s8, len);
+	}
+
+	return pmemdest;
+}
+
+/*
+ * memmove_nodrain_movnt_avx2 -- memmove to pmem without hw drain, movnt (avx2)
+ */
+void *
+memmove_nodrain_movnt_avx2(void *pmemdest, const void *src, size_t len)
+{
+	return nodrain_memmove_movnt(memmove_movnt_avx2, pmemdest, src, len);
+}
+
+/*
+ * memset_movnt_avx2 -- memset to pmem using non-temporal stores
+ * (avx2), without serializing them
+ */
+void *
+memset_movnt_avx2(void *pmemdest, int c, size_t len)
+{
+	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
+
+	size_t i;
+	char *dest1 = pmemdest;
+	size_t cnt;
+	__m256i ymm0;
+	__m256i *d;
+
+	/* memset up to the next FLUSH_ALIGN boundary */
+	cnt = movnt_head_set(dest1, c, len);
+	dest1 += cnt;
+	len -= cnt;
+
+	ymm0 = _mm256_set1_epi8((char)c);
+
+	d = (__m256i *)dest1;
+	cnt = len >> AVX2_CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm256_stream_si256(d, ymm0);
+		_mm256_stream_si256(d + 1, ymm0);
+		_mm256_stream_si256(d + 2, ymm0);
+		_mm256_stream_si256(d + 3, ymm0);
+		_mm256_stream_si256(d + 4, ymm0);
+		_mm256_stream_si256(d + 5, ymm0);
+		_mm256_stream_si256(d + 6, ymm0);
+		_mm256_stream_si256(d + 7, ymm0);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+
+	/* memset the tail (<256 bytes) in 32 bytes chunks */
+	len &= AVX2_CHUNK_MASK;
+	cnt = len >> AVX2_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm256_stream_si256(d, ymm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+		d++;
+	}
+
+	/* memset the tail (<32 bytes) in a 16 bytes chunk */
+	len &= AVX2_MASK;
+	char *d8 = (char *)d;
+	if (len >= MOVNT_SIZE) {
+		_mm_stream_si128((__m128i *)d8, _mm256_castsi256_si128(ymm0));
+		VALGRIND_DO_FLUSH(d8, MOVNT_SIZE);
+		d8 += MOVNT_SIZE;
+	}
+
+	/* memset the last bytes (<16), first dwords then bytes */
+	len &= MOVNT_MASK;
+	if (len != 0)
+		movnt_tail_set(d8, c, len);
+
+	return pmemdest;
+}
+
+/*
+ * memset_nodrain_movnt_avx2 -- memset to pmem without hw drain, movnt (avx2)
+ */
+void *
+memset_nodrain_movnt_avx2(void *pmemdest, int c, size_t len)
+{
+	return nodrain_memset_movnt(memset_movnt_avx2, pmemdest, c, len);
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_avx512f.c -- 512-bit non-temporal memmove/memset variants
+ *
+ * This file is compiled with -mavx512f, so nothing defined here may be called
+ * unless pmem_init() has confirmed that the CPU and the OS support AVX-512F.
+ */
+
+#include <immintrin.h>
+
+#include "out.h"
+#include "movnt.h"
+
+#define AVX512_SIZE	64
+#define AVX512_SHIFT	6
+#define AVX512_MASK	(AVX512_SIZE - 1)
+
+#define AVX512_CHUNK_SIZE	512 /* 64*8 */
+#define AVX512_CHUNK_SHIFT	9
+#define AVX512_CHUNK_MASK	(AVX512_CHUNK_SIZE - 1)
+
+#define YMM_SIZE	32
+
+/*
+ * memmove_movnt_avx512f -- memmove to pmem using non-temporal stores
+ * (avx512f), without serializing them
+ */
+void *
+memmove_movnt_avx512f(void *pmemdest, const void *src, size_t len)
+{
+	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
+
+	__m512i zmm0, zmm1, zmm2, zmm3, zmm4, zmm5, zmm6, zmm7;
+	__m256i ymm0;
+	__m128i xmm0;
+	size_t i;
+	__m512i *d;
+	__m512i *s;
+	char *dest1 = pmemdest;
+	const char *src1 = src;
+	size_t cnt;
+
+	if (len == 0 || src == pmemdest)
+		return pmemdest;
+
+	if ((uintptr_t)dest1 - (uintptr_t)src1 >= len) {
+		/* copy the range in the forward direction */
+		cnt = movnt_head_fw(dest1, src1, len);
+		dest1 += cnt;
+		src1 += cnt;
+		len -= cnt;
+
+		d = (__m512i *)dest1;
+		s = (__m512i *)src1;
+
+		cnt = len >> AVX512_CHUNK_SHIFT;
+		for (i = 0; i < cnt; i++) {
+			zmm0 = _mm512_loadu_si512(s);
+			zmm1 = _mm512_loadu_si512(s + 1);
+			zmm2 = _mm512_loadu_si512(s + 2);
+			zmm3 = _mm512_loadu_si512(s + 3);
+			zmm4 = _mm512_loadu_si512(s + 4);
+			zmm5 = _mm512_loadu_si512(s + 5);
+			zmm6 = _mm512_loadu_si512(s + 6);
+			zmm7 = _mm512_loadu_si512(s + 7);
+			s += 8;
+			_mm512_stream_si512(d, zmm0);
+			_mm512_stream_si512(d + 1, zmm1);
+			_mm512_stream_si512(d + 2, zmm2);
+			_mm512_stream_si512(d + 3, zmm3);
+			_mm512_stream_si512(d + 4, zmm4);
+			_mm512_stream_si512(d + 5, zmm5);
+			_mm512_stream_si512(d + 6, zmm6);
+			_mm512_stream_si512(d + 7, zmm7);
+			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+			d += 8;
+		}
+
+		/* copy the tail (<512 bytes) in 64 bytes chunks */
+		len &= AVX512_CHUNK_MASK;
+		cnt = len >> AVX512_SHIFT;
+		for (i = 0; i < cnt; i++) {
+			zmm0 = _mm512_loadu_si512(s);
+			_mm512_stream_si512(d, zmm0);
+			VALGRIND_DO_FLUSH(d, sizeof(*d));
+			s++;
+			d++;
+		}
+
+		/* copy the tail (<64 bytes) in 32 and 16 bytes chunks */
+		len &= AVX512_MASK;
+		char *d8 = (char *)d;
+		const char *s8 = (const char *)s;
+		if (len >= YMM_SIZE) {
+			ymm0 = _mm256_loadu_si256((__m256i *)s8);
+			_mm256_stream_si256((__m256i *)d8, ymm0);
+			VALGRIND_DO_FLUSH(d8, YMM_SIZE);
+			d8 += YMM_SIZE;
+			s8 += YMM_SIZE;
+			len -= YMM_SIZE;
+		}
+		if (len >= MOVNT_SIZE) {
+			xmm0 = _mm_loadu_si128((__m128i *)s8);
+			_mm_stream_si128((__m128i *)d8, xmm0);
+			VALGRIND_DO_FLUSH(d8, MOVNT_SIZE);
+			d8 += MOVNT_SIZE;
+			s8 += MOVNT_SIZE;
+		}
+
+		/* copy the last bytes (<16), first dwords then bytes */
+		len &= MOVNT_MASK;
+		if (len != 0)
+			movnt_tail_fw(d8, s8, len);
+	} else {
+		/* copy the range in the backward direction */
+		dest1 += len;
+		src1 += len;
+
+		cnt = movnt_head_bw(dest1, src1, len);
+		dest1 -= cnt;
+		src1 -= cnt;
+		len -= cnt;
+
+		d = (__m512i *)dest1;
+		s = (__m512i *)src1;
+
+		cnt = len >> AVX512_CHUNK_SHIFT;
+		for (i = 0; i < cnt; i++) {
+			zmm0 = _mm512_loadu_si512(s - 1);
+			zmm1 = _mm512_loadu_si512(s - 2);
+			zmm2 = _mm512_loadu_si512(s - 3);
+			zmm3 = _mm512_loadu_si512(s - 4);
+			zmm4 = _mm512_loadu_si512(s - 5);
+			zmm5 = _mm512_loadu_si512(s - 6);
+			zmm6 = _mm512_loadu_si512(s - 7);
+			zmm7 = _mm512_loadu_si512(s - 8);
+			s -= 8;
+			_mm512_stream_si512(d - 1, zmm0);
+			_mm512_stream_si512(d - 2, zmm1);
+			_mm512_stream_si512(d - 3, zmm2);
+			_mm512_stream_si512(d - 4, zmm3);
+			_mm512_stream_si512(d - 5, zmm4);
+			_mm512_stream_si512(d - 6, zmm5);
+			_mm512_stream_si512(d - 7, zmm6);
+			_mm512_stream_si512(d - 8, zmm7);
+			d -= 8;
+			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		}
+
+		/* copy the tail (<512 bytes) in 64 bytes chunks */
+		len &= AVX512_CHUNK_MASK;
+		cnt = len >> AVX512_SHIFT;
+		for (i = 0; i < cnt; i++) {
+			d--;
+			s--;
+			zmm0 = _mm512_loadu_si512(s);
+			_mm512_stream_si512(d, zmm0);
+			VALGRIND_DO_FLUSH(d, sizeof(*d));
+		}
+
+		/* copy the tail (<64 bytes) in 32 and 16 bytes chunks */
+		len &= AVX512_MASK;
+		char *d8 = (char *)d;
+		const char *s8 = (const char *)s;
+		if (len >= YMM_SIZE) {
+			d8 -= YMM_SIZE;
+			s8 -= YMM_SIZE;
+			ymm0 = _mm256_loadu_si256((__m256i *)s8);
+			_mm256_stream_si256((__m256i *)d8, ymm0);
+			VALGRIND_DO_FLUSH(d8, YMM_SIZE);
+			len -= YMM_SIZE;
+		}
+		if (len >= MOVNT_SIZE) {
+			d8 -= MOVNT_SIZE;
+			s8 -= MOVNT_SIZE;
+			xmm0 = _mm_loadu_si128((__m128i *)s8);
+			_mm_stream_si128((__m128i *)d8, xmm0);
+			VALGRIND_DO_FLUSH(d8, MOVNT_SIZE);
+		}
+
+		/* copy the last bytes (<16), first dwords then bytes */
+		len &= MOVNT_MASK;
+		if (len != 0)
+			movnt_tail_bw(d8, s8, len);
+	}
+
+	return pmemdest;
+}
+
+/*
+ * memmove_nodrain_movnt_avx512f -- memmove to pmem without hw drain,
+ * movnt (avx512f)
+ */
+void *
+memmove_nodrain_movnt_avx512f(void *pmemdest, const void *src, size_t len)
+{
+	return nodrain_memmove_movnt(memmove_movnt_avx512f, pmemdest, src, len);
+}
+
+/*
+ * memset_movnt_avx512f -- memset to pmem using non-temporal stores
+ * (avx512f), without serializing them
+ */
+void *
+memset_movnt_avx512f(void *pmemdest, int c, size_t len)
+{
+	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
+
+	size_t i;
+	char *dest1 = pmemdest;
+	size_t cnt;
+	__m512i zmm0;
+	__m512i *d;
+
+	/* memset up to the next FLUSH_ALIGN boundary */
+	cnt = movnt_head_set(dest1, c, len);
+	dest1 += cnt;
+	len -= cnt;
+
+	zmm0 = _mm512_set1_epi32((int)(0x01010101U * (uint8_t)c));
+
+	d = (__m512i *)dest1;
+	cnt = len >> AVX512_CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm512_stream_si512(d, zmm0);
+		_mm512_stream_si512(d + 1, zmm0);
+		_mm512_stream_si512(d + 2, zmm0);
+		_mm512_stream_si512(d + 3, zmm0);
+		_mm512_stream_si512(d + 4, zmm0);
+		_mm512_stream_si512(d + 5, zmm0);
+		_mm512_stream_si512(d + 6, zmm0);
+		_mm512_stream_si512(d + 7, zmm0);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+
+	/* memset the tail (<512 bytes) in 64 bytes chunks */
+	len &= AVX512_CHUNK_MASK;
+	cnt = len >> AVX512_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm512_stream_si512(d, zmm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+		d++;
+	}
+
+	/* memset the tail (<64 bytes) in 32 and 16 bytes chunks */
+	len &= AVX512_MASK;
+	char *d8 = (char *)d;
+	if (len >= YMM_SIZE) {
+		_mm256_stream_si256((__m256i *)d8,
+			_mm512_castsi512_si256(zmm0));
+		VALGRIND_DO_FLUSH(d8, YMM_SIZE);
+		d8 += YMM_SIZE;
+		len -= YMM_SIZE;
+	}
+	if (len >= MOVNT_SIZE) {
+		_mm_stream_si128((__m128i *)d8, _mm512_castsi512_si128(zmm0));
+		VALGRIND_DO_FLUSH(d8, MOVNT_SIZE);
+		d8 += MOVNT_SIZE;
+	}
+
+	/* memset the last bytes (<16), first dwords then bytes */
+	len &= MOVNT_MASK;
+	if (len != 0)
+		movnt_tail_set(d8, c, len);
+
+	return pmemdest;
+}
+
+/*
+ * memset_nodrain_movnt_avx512f -- memset to pmem without hw drain,
+ * movnt (avx512f)
+ */
+void *
+memset_nodrain_movnt_avx512f(void *pmemdest, int c, size_t len)
+{
+	return nodrain_memset_movnt(memset_movnt_avx512f, pmemdest, c, len);
+}
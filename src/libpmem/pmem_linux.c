@@ -35,15 +35,20 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/mman.h>
 
 #include "pmem.h"
 #include "out.h"
+#include "sys_util.h"
 
 #define PROCMAXLEN 2048 /* maximum expected line length in /proc files */
 
+#define PMEM_RANGES_MAX 256 /* maximum number of tracked mappings */
+
 enum parse_res {
 	RES_ERROR = -1,		/* error when parsing */
 	RES_FOUND = 0,		/* range found and has mm flag */
@@ -52,6 +57,206 @@ enum parse_res {
 	RES_AGAIN, /* range not found in smaps but found by mincore(2) */
 };
 
+enum range_state {
+	RANGE_MISS = -1,	/* range not tracked */
+	RANGE_UNKNOWN = 0,	/* tracked, not checked yet */
+	RANGE_NOT_PMEM,		/* tracked, not direct access */
+	RANGE_PMEM,		/* tracked, direct access */
+};
+
+struct pmem_range {
+	uintptr_t start;
+	uintptr_t end;
+	enum range_state state;
+};
+
+/*
+ * Ranges -- index of mappings created by pmem_map_file()
+ *
+ * The table is sorted by address and its entries never overlap.  Writers
+ * are serialized by Ranges_lock and keep the sequence counter odd while
+ * they modify the table, so readers never block: they retry the lookup
+ * if the counter was odd or has changed in the meantime.
+ */
+static struct {
+	unsigned seq;
+	unsigned nranges;
+	struct pmem_range range[PMEM_RANGES_MAX];
+} Ranges;
+
+static pthread_mutex_t Ranges_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * range_write_begin -- (internal) start modification of the range index
+ */
+static void
+range_write_begin(void)
+{
+	__atomic_store_n(&Ranges.seq, Ranges.seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*
+ * range_write_end -- (internal) publish modification of the range index
+ */
+static void
+range_write_end(void)
+{
+	__atomic_store_n(&Ranges.seq, Ranges.seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * range_lookup -- (internal) find the tracked mapping which contains
+ * the entire [addr, addr + len) range
+ *
+ * Returns RANGE_MISS if there is no such mapping, otherwise returns the
+ * cached state of the mapping and stores its boundaries in *rangep.
+ */
+static enum range_state
+range_lookup(uintptr_t addr, size_t len, struct pmem_range *rangep)
+{
+	for (;;) {
+		unsigned seq = __atomic_load_n(&Ranges.seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		enum range_state state = RANGE_MISS;
+		unsigned lo = 0;
+		unsigned hi = __atomic_load_n(&Ranges.nranges,
+				__ATOMIC_RELAXED);
+
+		while (lo < hi) {
+			unsigned mid = lo + (hi - lo) / 2;
+			struct pmem_range *r = &Ranges.range[mid];
+			uintptr_t start = __atomic_load_n(&r->start,
+					__ATOMIC_RELAXED);
+			uintptr_t end = __atomic_load_n(&r->end,
+					__ATOMIC_RELAXED);
+
+			if (addr < start) {
+				hi = mid;
+			} else if (addr >= end) {
+				lo = mid + 1;
+			} else {
+				if (len <= end - addr) {
+					rangep->start = start;
+					rangep->end = end;
+					state = __atomic_load_n(&r->state,
+							__ATOMIC_RELAXED);
+				}
+				break;
+			}
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&Ranges.seq, __ATOMIC_RELAXED) == seq)
+			return state;
+	}
+}
+
+/*
+ * range_remove -- (internal) remove all tracked mappings overlapping
+ * with [start, end), must be called with Ranges_lock held
+ */
+static void
+range_remove(uintptr_t start, uintptr_t end)
+{
+	unsigned i = 0;
+	while (i < Ranges.nranges) {
+		struct pmem_range *r = &Ranges.range[i];
+		if (r->end <= start || r->start >= end) {
+			i++;
+			continue;
+		}
+
+		LOG(4, "removing range %p-%p", (void *)r->start,
+				(void *)r->end);
+
+		range_write_begin();
+		memmove(r, r + 1, (Ranges.nranges - i - 1) * sizeof(*r));
+		Ranges.nranges--;
+		range_write_end();
+	}
+}
+
+/*
+ * pmem_range_register -- start tracking a mapping created by libpmem
+ *
+ * The mapping is not checked here; its state is determined by the first
+ * pmem_is_pmem() call on any part of it and then cached until the mapping
+ * is unregistered.  If the index is full, the mapping is not tracked and
+ * pmem_is_pmem() falls back to parsing /proc/self/smaps.
+ */
+void
+pmem_range_register(const void *addr, size_t len)
+{
+	LOG(3, "addr %p len %zu", addr, len);
+
+	uintptr_t start = (uintptr_t)addr;
+	uintptr_t end = start + len;
+
+	util_mutex_lock(&Ranges_lock);
+
+	/* drop stale entries of mappings unmapped behind our back */
+	range_remove(start, end);
+
+	if (Ranges.nranges == PMEM_RANGES_MAX) {
+		LOG(4, "range index full, not tracking %p-%p", addr,
+				(void *)end);
+		goto out;
+	}
+
+	unsigned i = 0;
+	while (i < Ranges.nranges && Ranges.range[i].start < start)
+		i++;
+
+	range_write_begin();
+	memmove(&Ranges.range[i + 1], &Ranges.range[i],
+			(Ranges.nranges - i) * sizeof(Ranges.range[0]));
+	Ranges.range[i].start = start;
+	Ranges.range[i].end = end;
+	Ranges.range[i].state = RANGE_UNKNOWN;
+	Ranges.nranges++;
+	range_write_end();
+
+out:
+	util_mutex_unlock(&Ranges_lock);
+}
+
+/*
+ * pmem_range_unregister -- stop tracking mappings overlapping given range
+ */
+void
+pmem_range_unregister(const void *addr, size_t len)
+{
+	LOG(3, "addr %p len %zu", addr, len);
+
+	util_mutex_lock(&Ranges_lock);
+	range_remove((uintptr_t)addr, (uintptr_t)addr + len);
+	util_mutex_unlock(&Ranges_lock);
+}
+
+/*
+ * range_set_state -- (internal) cache the state of a tracked mapping
+ */
+static void
+range_set_state(const struct pmem_range *range, enum range_state state)
+{
+	util_mutex_lock(&Ranges_lock);
+
+	for (unsigned i = 0; i < Ranges.nranges; ++i) {
+		struct pmem_range *r = &Ranges.range[i];
+		if (r->start == range->start && r->end == range->end) {
+			range_write_begin();
+			r->state = state;
+			range_write_end();
+			break;
+		}
+	}
+
+	util_mutex_unlock(&Ranges_lock);
+}
+
 /*
  * is_page_mapped -- (internal) checks if specified memory page is mapped
  * using mincore(2)
@@ -182,7 +387,7 @@ is_pmem_proc_parse(const void **addr, size_t *lenp)
 }
 
 /*
- * is_pmem_proc -- use /proc to implement pmem_is_pmem()
+ * is_pmem_smaps -- (internal) use /proc/self/smaps to check the range
  *
  * This function returns true only if the entire range can be confirmed
  * as being direct access persistent memory.  Finding any part of the
@@ -208,16 +413,90 @@ is_pmem_proc_parse(const void **addr, size_t *lenp)
  * file if a given memory range (or part of it) is not visible but the
  * mapping exists according to mincore(2).
  */
-int
-is_pmem_proc(const void *addr, size_t len)
+static int
+is_pmem_smaps(const void *addr, size_t len)
 {
 	enum parse_res res;
 	while ((res = is_pmem_proc_parse(&addr, &len)) == RES_AGAIN)
 		;
 
-	int retval = (res == RES_FOUND) ? 1 : 0;
+	return (res == RES_FOUND) ? 1 : 0;
+}
+
+/*
+ * is_pmem_proc -- use /proc to implement pmem_is_pmem()
+ *
+ * Ranges within a mapping created by pmem_map_file() are answered from
+ * the range index.  The first such query checks the entire mapping in
+ * /proc/self/smaps and caches the result.  Any other range is looked up
+ * in /proc/self/smaps every time.
+ */
+int
+is_pmem_proc(const void *addr, size_t len)
+{
+	struct pmem_range range = { 0, 0, RANGE_MISS };
+	int retval;
+
+	switch (range_lookup((uintptr_t)addr, len, &range)) {
+	case RANGE_PMEM:
+		retval = 1;
+		break;
+	case RANGE_NOT_PMEM:
+		retval = 0;
+		break;
+	case RANGE_UNKNOWN:
+		retval = is_pmem_smaps((void *)range.start,
+				range.end - range.start);
+		range_set_state(&range, retval ? RANGE_PMEM : RANGE_NOT_PMEM);
+		break;
+	default:
+		retval = is_pmem_smaps(addr, len);
+		break;
+	}
 
 	LOG(3, "returning %d", retval);
 
 	return retval;
 }
+
+/*
+ * libpmem is not linked against libpthread, so worker threads can only be
+ * started if the application has loaded it.
+ */
+#pragma weak pthread_create
+#pragma weak pthread_join
+
+/*
+ * pmem_os_thread_create -- start a worker thread, fails with ENOTSUP if
+ * libpthread is not available
+ */
+int
+pmem_os_thread_create(pthread_t *thread, void *(*start)(void *), void *arg)
+{
+	if (pthread_create == NULL)
+		return ENOTSUP;
+
+	return pthread_create(thread, NULL, start, arg);
+}
+
+/*
+ * pmem_os_thread_join -- wait for a worker thread to exit
+ */
+void
+pmem_os_thread_join(pthread_t thread)
+{
+	int ret = pthread_join(thread, NULL);
+	if (ret)
+		LOG(1, "pthread_join failed: %s", strerror(ret));
+}
+
+/*
+ * pmem_os_atfork_child -- register a handler run in the child after fork
+ */
+void
+pmem_os_atfork_child(void (*child)(void))
+{
+	int ret = pthread_atfork(NULL, NULL, child);
+	if (ret)
+		LOG(1, "pthread_atfork failed: %s", strerror(ret));
+}
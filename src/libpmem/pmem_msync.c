@@ -0,0 +1,441 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_msync.c -- write-behind msync coalescer for libpmem
+ *
+ * When enabled with PMEM_MSYNC_DEFER, pmem_msync() does not call msync(2)
+ * but marks the pages of the range dirty and returns.  The address space
+ * is divided into aligned regions of MSYNC_REGION_SIZE bytes, each with a
+ * bitmap of its dirty pages, kept in an array sorted by address.  A flush
+ * walks the array and issues a single msync for every run of consecutive
+ * dirty pages, so any number of small persists to the same or adjacent
+ * pages cost one system call.  Runs separated by clean pages are not
+ * joined, as the hole between them may not be mapped.
+ *
+ * The dirty pages are flushed by pmem_msync_barrier(), by pmem_unmap(),
+ * when the library is unloaded and, unless PMEM_MSYNC_DEFER_INTERVAL is 0,
+ * periodically by a background thread started on first use.
+ *
+ * A flusher swaps the array being filled with an empty one under
+ * Defer.lock and issues the msyncs holding only Defer.flush_lock, so
+ * recording is not blocked by the system calls, while a barrier also
+ * waits for the pages taken by a flush which is in progress.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "libpmem.h"
+
+#include "pmem.h"
+#include "out.h"
+#include "util.h"
+#include "sys_util.h"
+#include "valgrind_internal.h"
+
+#define MSYNC_REGION_SIZE	((uintptr_t)1 << 21) /* 2MB */
+#define MSYNC_REGION_WORDS	8	/* enough for 4k pages */
+#define MSYNC_MAX_REGIONS	4096	/* 8GB of dirty address space */
+#define MSYNC_DEFER_INTERVAL	100	/* default flusher interval in ms */
+
+struct msync_region {
+	uintptr_t base;		/* aligned to MSYNC_REGION_SIZE */
+	uint64_t dirty[MSYNC_REGION_WORDS];
+};
+
+struct msync_dirty {
+	struct msync_region *region;	/* sorted by base */
+	unsigned nregions;
+	unsigned size;			/* number of allocated entries */
+};
+
+/* set once by msync_defer_init, read by pmem_msync() */
+int Msync_defer;
+
+static struct {
+	pthread_mutex_t lock;		/* protects active and the flusher */
+	pthread_mutex_t flush_lock;	/* protects flushing */
+	pthread_cond_t wake;		/* the flusher has to exit */
+	struct msync_dirty active;	/* filled by pmem_msync() */
+	struct msync_dirty flushing;	/* owned by the current flusher */
+	uint64_t interval;		/* flusher interval in ms */
+	unsigned pages;			/* pages per region */
+	int exiting;
+	int running;			/* the flusher thread was started */
+	int no_threads;			/* the flusher cannot be started */
+	pthread_t flusher;
+} Defer;
+
+/*
+ * msync_region_find -- (internal) find the region at base or insert a clean
+ * one, must be called with Defer.lock held
+ */
+static struct msync_region *
+msync_region_find(uintptr_t base)
+{
+	struct msync_dirty *d = &Defer.active;
+	unsigned lo = 0;
+	unsigned hi = d->nregions;
+
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+		if (d->region[mid].base < base)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < d->nregions && d->region[lo].base == base)
+		return &d->region[lo];
+
+	if (d->nregions == MSYNC_MAX_REGIONS)
+		return NULL;
+
+	if (d->nregions == d->size) {
+		unsigned size = d->size ? d->size * 2 : 16;
+		struct msync_region *r = Realloc(d->region,
+				size * sizeof(*r));
+		if (r == NULL)
+			return NULL;
+		d->region = r;
+		d->size = size;
+	}
+
+	memmove(&d->region[lo + 1], &d->region[lo],
+			(d->nregions - lo) * sizeof(d->region[0]));
+	d->nregions++;
+
+	struct msync_region *r = &d->region[lo];
+	r->base = base;
+	memset(r->dirty, 0, sizeof(r->dirty));
+
+	return r;
+}
+
+/*
+ * msync_region_mark -- (internal) mark pages [first, last] of a region dirty
+ */
+static void
+msync_region_mark(struct msync_region *r, unsigned first, unsigned last)
+{
+	for (unsigned w = first / 64; w <= last / 64; ++w) {
+		unsigned lo = w == first / 64 ? first % 64 : 0;
+		unsigned hi = w == last / 64 ? last % 64 : 63;
+		uint64_t bits = UINT64_MAX >> (63 - hi + lo);
+
+		r->dirty[w] |= bits << lo;
+	}
+}
+
+/*
+ * msync_flusher -- (internal) background flusher thread
+ */
+static void *
+msync_flusher(void *arg)
+{
+	util_mutex_lock(&Defer.lock);
+	while (!Defer.exiting) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		uint64_t nsec = (uint64_t)ts.tv_nsec +
+				Defer.interval * 1000000;
+		ts.tv_sec += (time_t)(nsec / 1000000000);
+		ts.tv_nsec = (long)(nsec % 1000000000);
+
+		(void) pthread_cond_timedwait(&Defer.wake, &Defer.lock, &ts);
+		if (Defer.exiting)
+			break;
+
+		util_mutex_unlock(&Defer.lock);
+		(void) pmem_msync_barrier();
+		util_mutex_lock(&Defer.lock);
+	}
+	util_mutex_unlock(&Defer.lock);
+
+	return NULL;
+}
+
+/*
+ * msync_defer_record -- mark the pages of a range dirty, returns -1 if it
+ * cannot be tracked and has to be synced right away
+ */
+int
+msync_defer_record(const void *addr, size_t len)
+{
+	LOG(15, "addr %p len %zu", addr, len);
+
+	if (len == 0)
+		return 0;
+
+	uintptr_t uptr = (uintptr_t)addr;
+	uintptr_t end = uptr + len;
+
+	util_mutex_lock(&Defer.lock);
+
+	if (Defer.interval && !Defer.running && !Defer.no_threads) {
+		int ret = pmem_os_thread_create(&Defer.flusher,
+				msync_flusher, NULL);
+		if (ret) {
+			LOG(3, "cannot start flusher thread: %s",
+				strerror(ret));
+			Defer.no_threads = 1;
+		} else {
+			Defer.running = 1;
+		}
+	}
+
+	for (uintptr_t base = uptr & ~(MSYNC_REGION_SIZE - 1); base < end;
+			base += MSYNC_REGION_SIZE) {
+		struct msync_region *r = msync_region_find(base);
+		if (r == NULL) {
+			util_mutex_unlock(&Defer.lock);
+			LOG(4, "too many dirty regions");
+			return -1;
+		}
+
+		uintptr_t start = uptr > base ? uptr : base;
+		uintptr_t stop = end < base + MSYNC_REGION_SIZE ?
+				end : base + MSYNC_REGION_SIZE;
+
+		msync_region_mark(r, (unsigned)((start - base) / Pagesize),
+				(unsigned)((stop - base - 1) / Pagesize));
+	}
+
+	util_mutex_unlock(&Defer.lock);
+
+	return 0;
+}
+
+/*
+ * msync_run -- (internal) sync a run of dirty pages
+ *
+ * A run may belong to a mapping which has been unmapped since the pages
+ * were marked, there is nothing to sync then.
+ */
+static int
+msync_run(uintptr_t start, uintptr_t end)
+{
+	LOG(4, "msync: addr 0x%jx len %zu", (uintmax_t)start,
+		(size_t)(end - start));
+
+	VALGRIND_DO_DISABLE_ERROR_REPORTING;
+	int ret = msync((void *)start, end - start, MS_SYNC);
+	VALGRIND_DO_ENABLE_ERROR_REPORTING;
+
+	if (ret == 0) {
+		VALGRIND_DO_PERSIST(start, end - start);
+		return 0;
+	}
+
+	if (errno == ENOMEM) {
+		LOG(3, "range 0x%jx-0x%jx no longer mapped",
+			(uintmax_t)start, (uintmax_t)end);
+		return 0;
+	}
+
+	ERR("!msync");
+	return -1;
+}
+
+/*
+ * pmem_msync_barrier -- sync all ranges deferred by pmem_msync()
+ */
+int
+pmem_msync_barrier(void)
+{
+	LOG(15, NULL);
+
+	if (!Msync_defer)
+		return 0;
+
+	util_mutex_lock(&Defer.flush_lock);
+
+	util_mutex_lock(&Defer.lock);
+	struct msync_dirty d = Defer.active;
+	Defer.active = Defer.flushing;
+	util_mutex_unlock(&Defer.lock);
+
+	int ret = 0;
+	int oerrno = 0;
+	uintptr_t start = 0;
+	uintptr_t end = 0;
+
+	for (unsigned i = 0; i < d.nregions; ++i) {
+		struct msync_region *r = &d.region[i];
+
+		for (unsigned p = 0; p < Defer.pages; ++p) {
+			if (r->dirty[p / 64] == 0) {
+				p |= 63;
+				continue;
+			}
+
+			if (!(r->dirty[p / 64] & (1ULL << (p % 64))))
+				continue;
+
+			uintptr_t page = r->base + p * Pagesize;
+			if (page == end) {
+				end += Pagesize;
+				continue;
+			}
+
+			if (end != start && msync_run(start, end)) {
+				ret = -1;
+				oerrno = errno;
+			}
+
+			start = page;
+			end = page + Pagesize;
+		}
+	}
+
+	if (end != start && msync_run(start, end)) {
+		ret = -1;
+		oerrno = errno;
+	}
+
+	d.nregions = 0;
+	Defer.flushing = d;
+
+	util_mutex_unlock(&Defer.flush_lock);
+
+	if (ret)
+		errno = oerrno;
+
+	return ret;
+}
+
+/*
+ * msync_defer_reset -- (internal) initialize the locks and the flusher state
+ */
+static void
+msync_defer_reset(void)
+{
+	util_mutex_init(&Defer.lock, NULL);
+	util_mutex_init(&Defer.flush_lock, NULL);
+
+	int ret = pthread_cond_init(&Defer.wake, NULL);
+	if (ret) {
+		errno = ret;
+		FATAL("!pthread_cond_init");
+	}
+
+	Defer.exiting = 0;
+	Defer.running = 0;
+}
+
+/*
+ * msync_defer_atfork_child -- (internal) forget the flusher thread of the
+ * parent process, its dirty pages are synced by the parent
+ */
+static void
+msync_defer_atfork_child(void)
+{
+	msync_defer_reset();
+	Defer.active.nregions = 0;
+	Defer.flushing.nregions = 0;
+}
+
+/*
+ * msync_defer_init -- enable the msync coalescer if requested
+ */
+void
+msync_defer_init(void)
+{
+	LOG(3, NULL);
+
+	char *e = getenv("PMEM_MSYNC_DEFER");
+	if (e == NULL || strcmp(e, "1") != 0)
+		return;
+
+	LOG(3, "PMEM_MSYNC_DEFER set to 1");
+
+	msync_defer_reset();
+	pmem_os_atfork_child(msync_defer_atfork_child);
+
+	Defer.pages = (unsigned)(MSYNC_REGION_SIZE / Pagesize);
+	Defer.interval = MSYNC_DEFER_INTERVAL;
+
+	e = getenv("PMEM_MSYNC_DEFER_INTERVAL");
+	if (e) {
+		char *endp;
+		errno = 0;
+		unsigned long long val = strtoull(e, &endp, 0);
+
+		if (errno || endp == e || *endp != '\0')
+			LOG(3, "Invalid PMEM_MSYNC_DEFER_INTERVAL");
+		else {
+			LOG(3, "PMEM_MSYNC_DEFER_INTERVAL set to %llu", val);
+			Defer.interval = val;
+		}
+	}
+
+	Msync_defer = 1;
+}
+
+/*
+ * msync_defer_fini -- stop the flusher and sync the remaining dirty pages
+ */
+void
+msync_defer_fini(void)
+{
+	LOG(3, NULL);
+
+	if (!Msync_defer)
+		return;
+
+	util_mutex_lock(&Defer.lock);
+	Defer.exiting = 1;
+	pthread_cond_signal(&Defer.wake);
+	util_mutex_unlock(&Defer.lock);
+
+	if (Defer.running)
+		pmem_os_thread_join(Defer.flusher);
+	Defer.running = 0;
+
+	(void) pmem_msync_barrier();
+
+	Msync_defer = 0;
+
+	Free(Defer.active.region);
+	Free(Defer.flushing.region);
+	memset(&Defer.active, 0, sizeof(Defer.active));
+	memset(&Defer.flushing, 0, sizeof(Defer.flushing));
+
+	pthread_cond_destroy(&Defer.wake);
+	util_mutex_destroy(&Defer.flush_lock);
+	util_mutex_destroy(&Defer.lock);
+}
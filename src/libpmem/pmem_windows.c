@@ -36,6 +36,7 @@
  */
 
 #include <memoryapi.h>
+#include <pthread.h>
 #include "pmem.h"
 #include "out.h"
 #include "win_mmap.h"
@@ -160,3 +161,53 @@ is_pmem_proc(const void *addr, size_t len)
 	LOG(3, "returning %d", retval);
 	return retval;
 }
+
+/*
+ * pmem_range_register -- start tracking a mapping created by libpmem
+ *
+ * File mappings are already tracked by the mmap emulation layer.
+ */
+void
+pmem_range_register(const void *addr, size_t len)
+{
+	LOG(3, "addr %p len %zu", addr, len);
+}
+
+/*
+ * pmem_range_unregister -- stop tracking mappings overlapping given range
+ */
+void
+pmem_range_unregister(const void *addr, size_t len)
+{
+	LOG(3, "addr %p len %zu", addr, len);
+}
+
+/*
+ * pmem_os_thread_create -- start a worker thread
+ */
+int
+pmem_os_thread_create(pthread_t *thread, void *(*start)(void *), void *arg)
+{
+	return pthread_create(thread, NULL, start, arg);
+}
+
+/*
+ * pmem_os_thread_join -- wait for a worker thread to exit
+ */
+void
+pmem_os_thread_join(pthread_t thread)
+{
+	int ret = pthread_join(thread, NULL);
+	if (ret)
+		LOG(1, "pthread_join failed: %d", ret);
+}
+
+/*
+ * pmem_os_atfork_child -- register a handler run in the child after fork
+ *
+ * There is no fork on Windows.
+ */
+void
+pmem_os_atfork_child(void (*child)(void))
+{
+}
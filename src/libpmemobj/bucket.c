@@ -42,8 +42,11 @@
  * creation.
  */
 
+#include <string.h>
+
 #include "bucket.h"
 #include "ctree.h"
+#include "cuckoo.h"
 #include "heap.h"
 #include "out.h"
 #include "sys_util.h"
@@ -73,6 +76,32 @@ struct block_container_ctree {
 	struct ctree *tree;
 };
 
+/*
+ * Number of segregated lists, one for every possible size index of a block
+ * that belongs to a run.
+ */
+#define SEGLISTS_COUNT RUN_UNIT_MAX
+
+#define SEGLIST_INITIAL_CAPACITY 64
+
+struct seglist {
+	uint64_t *keys;
+	uint32_t nkeys;
+	uint32_t capacity;
+};
+
+struct block_container_seglists {
+	struct block_container super;
+	pthread_mutex_t lock;
+
+	/* bit n is set when the list of blocks with size_idx n + 1 is used */
+	uint64_t nonempty;
+	struct seglist lists[SEGLISTS_COUNT];
+
+	/* block key -> position of the key in its list + 1 */
+	struct cuckoo *index;
+};
+
 #ifdef USE_VG_MEMCHECK
 /*
  * bucket_vg_mark_noaccess -- (internal) marks memory block as no access for vg
@@ -89,6 +118,48 @@ bucket_vg_mark_noaccess(struct palloc_heap *heap, struct block_container *bc,
 }
 #endif
 
+/*
+ * bucket_size_bin -- returns the bin of the container size histogram which
+ *	counts memory blocks of the given size
+ */
+unsigned
+bucket_size_bin(uint64_t size_idx)
+{
+	ASSERTne(size_idx, 0);
+
+	unsigned bin = 63U - (unsigned)__builtin_clzll(size_idx);
+
+	return bin < CONTAINER_SIZE_BINS ? bin : CONTAINER_SIZE_BINS - 1;
+}
+
+/*
+ * bucket_container_add -- (internal) accounts a memory block inserted into
+ *	the container
+ */
+static void
+bucket_container_add(struct block_container *bc, uint32_t size_idx)
+{
+	__sync_fetch_and_add(&bc->nunits, size_idx);
+
+	if (bc->track_sizes)
+		__sync_fetch_and_add(&bc->nblocks[bucket_size_bin(size_idx)],
+			1);
+}
+
+/*
+ * bucket_container_remove -- (internal) accounts a memory block removed from
+ *	the container
+ */
+static void
+bucket_container_remove(struct block_container *bc, uint32_t size_idx)
+{
+	__sync_fetch_and_sub(&bc->nunits, size_idx);
+
+	if (bc->track_sizes)
+		__sync_fetch_and_sub(&bc->nblocks[bucket_size_bin(size_idx)],
+			1);
+}
+
 /*
  * bucket_tree_insert_block -- (internal) inserts a new memory block
  *	into the container
@@ -122,7 +193,11 @@ bucket_tree_insert_block(struct block_container *bc, struct palloc_heap *heap,
 	uint64_t key = CHUNK_KEY_PACK(m.zone_id, m.chunk_id, m.block_off,
 				m.size_idx);
 
-	return ctree_insert(c->tree, key, 0);
+	int ret = ctree_insert(c->tree, key, 0);
+	if (ret == 0)
+		bucket_container_add(bc, m.size_idx);
+
+	return ret;
 }
 
 /*
@@ -146,6 +221,8 @@ bucket_tree_get_rm_block_bestfit(struct block_container *bc,
 	m->block_off = CHUNK_KEY_GET_BLOCK_OFF(key);
 	m->size_idx = CHUNK_KEY_GET_SIZE_IDX(key);
 
+	bucket_container_remove(bc, m->size_idx);
+
 	return 0;
 }
 
@@ -164,6 +241,8 @@ bucket_tree_get_rm_block_exact(struct block_container *bc,
 	if ((key = ctree_remove(c->tree, key, 1)) == 0)
 		return ENOMEM;
 
+	bucket_container_remove(bc, m.size_idx);
+
 	return 0;
 }
 
@@ -219,6 +298,9 @@ bucket_tree_create(size_t unit_size)
 
 	bc->super.type = CONTAINER_CTREE;
 	bc->super.unit_size = unit_size;
+	bc->super.nunits = 0;
+	bc->super.track_sizes = 0;
+	memset(bc->super.nblocks, 0, sizeof(bc->super.nblocks));
 
 	bc->tree = ctree_new();
 	if (bc->tree == NULL)
@@ -244,6 +326,284 @@ bucket_tree_delete(struct block_container *bc)
 	Free(bc);
 }
 
+/*
+ * bucket_seglists_unpack -- (internal) fills the memory block from the key
+ */
+static void
+bucket_seglists_unpack(uint64_t key, struct memory_block *m)
+{
+	m->chunk_id = CHUNK_KEY_GET_CHUNK_ID(key);
+	m->zone_id = CHUNK_KEY_GET_ZONE_ID(key);
+	m->block_off = CHUNK_KEY_GET_BLOCK_OFF(key);
+	m->size_idx = CHUNK_KEY_GET_SIZE_IDX(key);
+}
+
+/*
+ * bucket_seglists_remove_at -- (internal) removes the key at the given
+ *	position of a list by moving the last key of that list in its place
+ */
+static void
+bucket_seglists_remove_at(struct block_container_seglists *c,
+	unsigned list, uint32_t pos)
+{
+	struct seglist *l = &c->lists[list];
+	ASSERT(pos < l->nkeys);
+
+	cuckoo_remove(c->index, l->keys[pos]);
+
+	uint64_t last = l->keys[--l->nkeys];
+	if (pos != l->nkeys) {
+		l->keys[pos] = last;
+
+		/*
+		 * The slot freed by removing the moved key is one of its own
+		 * hash locations, so inserting it back cannot fail.
+		 */
+		cuckoo_remove(c->index, last);
+		int ret = cuckoo_insert(c->index, last,
+			(void *)((uintptr_t)pos + 1));
+		ASSERTeq(ret, 0);
+	}
+
+	if (l->nkeys == 0)
+		c->nonempty &= ~(1ULL << list);
+}
+
+/*
+ * bucket_seglists_insert_block -- (internal) pushes a memory block onto the
+ *	list of its size
+ */
+static int
+bucket_seglists_insert_block(struct block_container *bc,
+	struct palloc_heap *heap, struct memory_block m)
+{
+	ASSERT(m.chunk_id < MAX_CHUNK);
+	ASSERT(m.zone_id < UINT16_MAX);
+	ASSERTne(m.size_idx, 0);
+	ASSERT(m.size_idx <= SEGLISTS_COUNT);
+
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+#ifdef USE_VG_MEMCHECK
+	bucket_vg_mark_noaccess(heap, bc, m);
+#endif
+
+	uint64_t key = CHUNK_KEY_PACK(m.zone_id, m.chunk_id, m.block_off,
+				m.size_idx);
+
+	unsigned list = m.size_idx - 1;
+	struct seglist *l = &c->lists[list];
+	int ret = 0;
+
+	util_mutex_lock(&c->lock);
+
+	if (l->nkeys == l->capacity) {
+		uint32_t ncapacity = l->capacity == 0 ?
+			SEGLIST_INITIAL_CAPACITY : l->capacity * 2;
+		uint64_t *nkeys = Realloc(l->keys,
+			sizeof(uint64_t) * ncapacity);
+		if (nkeys == NULL) {
+			ret = ENOMEM;
+			goto out;
+		}
+		l->keys = nkeys;
+		l->capacity = ncapacity;
+	}
+
+	ret = cuckoo_insert(c->index, key,
+		(void *)((uintptr_t)l->nkeys + 1));
+	if (ret != 0) {
+		if (ret == EINVAL) /* the block is already in the container */
+			ret = EEXIST;
+		goto out;
+	}
+
+	l->keys[l->nkeys++] = key;
+	c->nonempty |= 1ULL << list;
+	bucket_container_add(bc, m.size_idx);
+
+out:
+	util_mutex_unlock(&c->lock);
+
+	return ret;
+}
+
+/*
+ * bucket_seglists_get_rm_block_bestfit -- (internal) removes and returns the
+ *	most recently inserted block from the smallest list that satisfies
+ *	the size
+ */
+static int
+bucket_seglists_get_rm_block_bestfit(struct block_container *bc,
+	struct memory_block *m)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	ASSERTne(m->size_idx, 0);
+	if (m->size_idx > SEGLISTS_COUNT)
+		return ENOMEM;
+
+	int ret = 0;
+
+	util_mutex_lock(&c->lock);
+
+	uint64_t lists = c->nonempty & ~((1ULL << (m->size_idx - 1)) - 1);
+	if (lists == 0) {
+		ret = ENOMEM;
+		goto out;
+	}
+
+	unsigned list = (unsigned)__builtin_ctzll(lists);
+	struct seglist *l = &c->lists[list];
+
+	bucket_seglists_unpack(l->keys[l->nkeys - 1], m);
+	bucket_seglists_remove_at(c, list, l->nkeys - 1);
+	bucket_container_remove(bc, m->size_idx);
+
+out:
+	util_mutex_unlock(&c->lock);
+
+	return ret;
+}
+
+/*
+ * bucket_seglists_get_rm_block_exact -- (internal) removes exact match
+ *	memory block
+ */
+static int
+bucket_seglists_get_rm_block_exact(struct block_container *bc,
+	struct memory_block m)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	uint64_t key = CHUNK_KEY_PACK(m.zone_id, m.chunk_id, m.block_off,
+			m.size_idx);
+
+	int ret = 0;
+
+	util_mutex_lock(&c->lock);
+
+	uintptr_t pos = (uintptr_t)cuckoo_get(c->index, key);
+	if (pos == 0) {
+		ret = ENOMEM;
+		goto out;
+	}
+
+	bucket_seglists_remove_at(c, m.size_idx - 1, (uint32_t)(pos - 1));
+	bucket_container_remove(bc, m.size_idx);
+
+out:
+	util_mutex_unlock(&c->lock);
+
+	return ret;
+}
+
+/*
+ * bucket_seglists_get_block_exact -- (internal) finds exact match memory
+ *	block
+ */
+static int
+bucket_seglists_get_block_exact(struct block_container *bc,
+	struct memory_block m)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	uint64_t key = CHUNK_KEY_PACK(m.zone_id, m.chunk_id, m.block_off,
+			m.size_idx);
+
+	util_mutex_lock(&c->lock);
+	void *pos = cuckoo_get(c->index, key);
+	util_mutex_unlock(&c->lock);
+
+	return pos != NULL ? 0 : ENOMEM;
+}
+
+/*
+ * bucket_seglists_is_empty -- (internal) checks whether the bucket is empty
+ */
+static int
+bucket_seglists_is_empty(struct block_container *bc)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	util_mutex_lock(&c->lock);
+	int ret = c->nonempty == 0;
+	util_mutex_unlock(&c->lock);
+
+	return ret;
+}
+
+/*
+ * Segregated-fit block container, usable only for run buckets. There's one
+ * LIFO list of blocks for every size index up to RUN_UNIT_MAX and a bitmask
+ * of lists that are not empty, so that the best-fit lookup is a single bit
+ * scan. Exact lookups go through a hash table that maps a block to its
+ * position in the list. All of the operations are O(1).
+ *
+ * Unlike the tree container, the best-fit get methods return the block of
+ * the smallest fitting size that was inserted most recently, and not the
+ * one with the lowest address.
+ */
+static struct block_container_ops container_seglists_ops = {
+	.insert = bucket_seglists_insert_block,
+	.get_rm_exact = bucket_seglists_get_rm_block_exact,
+	.get_rm_bestfit = bucket_seglists_get_rm_block_bestfit,
+	.get_exact = bucket_seglists_get_block_exact,
+	.is_empty = bucket_seglists_is_empty
+};
+
+/*
+ * bucket_seglists_create -- (internal) creates a new segregated-fit container
+ */
+static struct block_container *
+bucket_seglists_create(size_t unit_size)
+{
+	COMPILE_ERROR_ON(SEGLISTS_COUNT > 64);
+
+	struct block_container_seglists *bc = Zalloc(sizeof(*bc));
+	if (bc == NULL)
+		goto error_container_malloc;
+
+	bc->super.type = CONTAINER_SEGLISTS;
+	bc->super.unit_size = unit_size;
+
+	bc->index = cuckoo_new();
+	if (bc->index == NULL)
+		goto error_cuckoo_new;
+
+	util_mutex_init(&bc->lock, NULL);
+
+	return &bc->super;
+
+error_cuckoo_new:
+	Free(bc);
+
+error_container_malloc:
+	return NULL;
+}
+
+/*
+ * bucket_seglists_delete -- (internal) deletes a segregated-fit container
+ */
+static void
+bucket_seglists_delete(struct block_container *bc)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	for (unsigned i = 0; i < SEGLISTS_COUNT; ++i)
+		Free(c->lists[i].keys);
+
+	util_mutex_destroy(&c->lock);
+	cuckoo_delete(c->index);
+	Free(bc);
+}
+
 static struct {
 	struct block_container_ops *ops;
 	struct block_container *(*create)(size_t unit_size);
@@ -251,6 +611,8 @@ static struct {
 } block_containers[MAX_CONTAINER_TYPE] = {
 	{NULL, NULL, NULL},
 	{&container_ctree_ops, bucket_tree_create, bucket_tree_delete},
+	{&container_seglists_ops, bucket_seglists_create,
+		bucket_seglists_delete},
 };
 
 /*
@@ -282,6 +644,7 @@ bucket_init(struct bucket *b, uint8_t id, enum block_container_type ctype,
 	b->container->unit_size = unit_size;
 
 	util_mutex_init(&b->lock, NULL);
+	b->lock_contended = 0;
 
 	b->c_ops = block_containers[ctype].ops;
 	b->unit_size = unit_size;
@@ -311,6 +674,9 @@ bucket_huge_new(uint8_t id, enum block_container_type ctype,
 
 	b->super.type = BUCKET_HUGE;
 
+	/* the free chunks are reported as extents in the heap statistics */
+	b->super.container->track_sizes = 1;
+
 	return b;
 }
 
@@ -320,15 +686,16 @@ bucket_huge_new(uint8_t id, enum block_container_type ctype,
  * This type of bucket is responsible for holding memory blocks from runs, which
  * means that each object it contains has a representation in a bitmap.
  *
- * The run buckets also contain the detailed information about the bitmap
- * all of the memory blocks contained within this container must be
- * represented by. This is not to say that a single bucket contains objects
- * only from a single chunk/bitmap - a bucket contains objects from a single
- * TYPE of bitmap run.
+ * The bitmap of each run is defined by the unit size of the bucket and the
+ * number of chunks the run spans, which is stored in the chunk header. Runs
+ * created for this bucket consist of run_size_idx chunks, but the bucket can
+ * also contain memory blocks from runs of a different size that were created
+ * in the previous incarnations of the heap.
  */
 struct bucket_run *
 bucket_run_new(uint8_t id, enum block_container_type ctype,
-	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc)
+	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc,
+	uint32_t run_size_idx)
 {
 	struct bucket_run *b = Malloc(sizeof(*b));
 	if (b == NULL)
@@ -342,6 +709,27 @@ bucket_run_new(uint8_t id, enum block_container_type ctype,
 	b->super.type = BUCKET_RUN;
 	b->unit_max = unit_max;
 	b->unit_max_alloc = unit_max_alloc;
+	b->steals = 0;
+	b->units_stolen = 0;
+
+	ASSERT(run_size_idx >= 1 && run_size_idx <= RUN_MAX_SIZE_IDX);
+	b->run_size_idx = run_size_idx;
+
+	return b;
+}
+
+/*
+ * bucket_run_calc_bitmap -- calculates the bitmap definition of a run
+ *
+ * Runs that span many chunks with small unit sizes would need more bits than
+ * the bitmap has, the units that don't fit are simply not used.
+ */
+void
+bucket_run_calc_bitmap(size_t unit_size, uint32_t run_size_idx,
+	struct run_bitmap *bm)
+{
+	ASSERTne(unit_size, 0);
+	ASSERTne(run_size_idx, 0);
 
 	/*
 	 * Here the bitmap definition is calculated based on the size of the
@@ -349,30 +737,28 @@ bucket_run_new(uint8_t id, enum block_container_type ctype,
 	 * dividing those two numbers is the number of possible allocations from
 	 * that block, and in other words, the amount of bits in the bitmap.
 	 */
-	ASSERT(RUN_NALLOCS(unit_size) <= UINT32_MAX);
-	b->bitmap_nallocs = (unsigned)(RUN_NALLOCS(unit_size));
+	size_t nallocs = RUN_NALLOCS(unit_size, run_size_idx);
+	bm->nallocs = nallocs > RUN_BITMAP_SIZE ?
+		RUN_BITMAP_SIZE : (unsigned)nallocs;
 
 	/*
 	 * The two other numbers that define our bitmap is the size of the
 	 * array that represents the bitmap and the last value of that array
 	 * with the bits that exceed number of blocks marked as set (1).
 	 */
-	ASSERT(b->bitmap_nallocs <= RUN_BITMAP_SIZE);
-	unsigned unused_bits = RUN_BITMAP_SIZE - b->bitmap_nallocs;
+	unsigned unused_bits = RUN_BITMAP_SIZE - bm->nallocs;
 
 	unsigned unused_values = unused_bits / BITS_PER_VALUE;
 
 	ASSERT(MAX_BITMAP_VALUES >= unused_values);
-	b->bitmap_nval = MAX_BITMAP_VALUES - unused_values;
+	bm->nval = MAX_BITMAP_VALUES - unused_values;
 
 	ASSERT(unused_bits >= unused_values * BITS_PER_VALUE);
 	unused_bits -= unused_values * BITS_PER_VALUE;
 
-	b->bitmap_lastval = unused_bits ?
+	bm->lastval = unused_bits ?
 		(((1ULL << unused_bits) - 1ULL) <<
 			(BITS_PER_VALUE - unused_bits)) : 0;
-
-	return b;
 }
 
 /*
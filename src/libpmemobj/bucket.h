@@ -43,15 +43,18 @@
 
 #include "memblock.h"
 
-#define RUN_NALLOCS(_bs)\
-((RUNSIZE / ((_bs))))
+#define RUN_NALLOCS(_bs, _size_idx)\
+((RUN_DATA_SIZE(_size_idx) / ((_bs))))
 
 #define CALC_SIZE_IDX(_unit_size, _size)\
 ((uint32_t)(((_size - 1) / _unit_size) + 1))
 
+#define CONTAINER_SIZE_BINS 16
+
 enum block_container_type {
 	CONTAINER_UNKNOWN,
 	CONTAINER_CTREE,
+	CONTAINER_SEGLISTS,
 
 	MAX_CONTAINER_TYPE
 };
@@ -59,6 +62,20 @@ enum block_container_type {
 struct block_container {
 	enum block_container_type type;
 	size_t unit_size; /* required only for valgrind... */
+
+	/*
+	 * Sum of the size indexes of all the contained memory blocks. It's
+	 * updated atomically and can be read without any lock as a hint.
+	 */
+	uint64_t nunits;
+
+	/*
+	 * Histogram of the contained memory blocks, the i-th entry holds the
+	 * number of blocks of [2^i, 2^(i + 1)) units and the last one also all
+	 * of the bigger blocks. Maintained only if track_sizes is set.
+	 */
+	int track_sizes;
+	uint64_t nblocks[CONTAINER_SIZE_BINS];
 };
 
 struct block_container_ops {
@@ -99,6 +116,11 @@ struct bucket {
 
 	pthread_mutex_t lock;
 
+	/*
+	 * Number of times the lock was already held when acquired.
+	 */
+	uint64_t lock_contended;
+
 	struct block_container *container;
 	struct block_container_ops *c_ops;
 };
@@ -107,24 +129,34 @@ struct bucket_huge {
 	struct bucket super;
 };
 
-struct bucket_run {
-	struct bucket super;
-
+/*
+ * Definition of the bitmap of a run with the given unit size and the number
+ * of chunks.
+ */
+struct run_bitmap {
 	/*
-	 * Last value of a bitmap representing completely free run from this
-	 * bucket.
+	 * Last value of a bitmap representing completely free run.
 	 */
-	uint64_t bitmap_lastval;
+	uint64_t lastval;
 
 	/*
 	 * Number of 8 byte values this run bitmap is composed of.
 	 */
-	unsigned bitmap_nval;
+	unsigned nval;
 
 	/*
 	 * Number of allocations that can be performed from a single run.
 	 */
-	unsigned bitmap_nallocs;
+	unsigned nallocs;
+};
+
+struct bucket_run {
+	struct bucket super;
+
+	/*
+	 * Number of chunks the runs created for this bucket are composed of.
+	 */
+	uint32_t run_size_idx;
 
 	/*
 	 * Maximum multiplication factor of unit_size for memory blocks.
@@ -137,13 +169,26 @@ struct bucket_run {
 	 * remainder is returned back to the bucket.
 	 */
 	unsigned unit_max_alloc;
+
+	/*
+	 * Number of times this bucket stole memory blocks from a sibling
+	 * cache bucket and the total number of units it got that way.
+	 */
+	uint64_t steals;
+	uint64_t units_stolen;
 };
 
 struct bucket_huge *bucket_huge_new(uint8_t id, enum block_container_type ctype,
 	size_t unit_size);
 
 struct bucket_run *bucket_run_new(uint8_t id, enum block_container_type ctype,
-	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc);
+	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc,
+	uint32_t run_size_idx);
+
+void bucket_run_calc_bitmap(size_t unit_size, uint32_t run_size_idx,
+	struct run_bitmap *bm);
+
+unsigned bucket_size_bin(uint64_t size_idx);
 
 void bucket_delete(struct bucket *b);
 
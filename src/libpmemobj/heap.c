@@ -37,8 +37,10 @@
 #include <errno.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <float.h>
+#include <limits.h>
 
 #include "queue.h"
 #include "heap.h"
@@ -68,6 +70,20 @@
  */
 #define MAX_UNITS_PCT_DRAINED_TOTAL 2 /* 200% */
 
+/*
+ * Percentage of memory block units from a single run that a starving cache
+ * bucket can steal from a sibling cache bucket in a single steal call.
+ */
+#define MAX_UNITS_PCT_STOLEN 0.5 /* 50% */
+
+/*
+ * Number of free single-unit memory blocks of a single allocation class that
+ * a thread cache can hold. Blocks are moved between the thread cache and the
+ * shared buckets in batches of half that size.
+ */
+#define TCACHE_BIN_SIZE 32
+#define TCACHE_BATCH (TCACHE_BIN_SIZE / 2)
+
 /*
  * Value used to mark a reserved spot in the bucket array.
  */
@@ -78,6 +94,18 @@
  */
 #define MAX_RUN_SIZE (CHUNKSIZE / 2)
 
+/*
+ * Minimum number of units in a run of an allocation class. Runs of classes
+ * with unit sizes too big to fit that many units in a single chunk span
+ * multiple contiguous chunks, up to the configured maximum.
+ */
+#define RUN_MIN_NALLOCS 32
+
+/*
+ * Default maximum number of chunks a single run can span.
+ */
+#define RUN_MAX_CHUNKS_DEFAULT 16
+
 /*
  * Maximum number of bytes the allocation class generation algorithm can decide
  * to waste in a single run chunk.
@@ -127,6 +155,31 @@ struct bucket_cache {
 	struct bucket *buckets[MAX_BUCKETS]; /* no default bucket */
 };
 
+/*
+ * Stack of memory blocks reserved in the transient heap by a single thread,
+ * only the owning thread ever accesses it.
+ */
+struct tcache_bin {
+	unsigned nblocks;
+	struct memory_block blocks[TCACHE_BIN_SIZE];
+};
+
+struct heap_tcache {
+	struct palloc_heap *heap;
+	LIST_ENTRY(heap_tcache) tcache;
+	struct tcache_bin *bins[MAX_BUCKETS]; /* lazily allocated */
+};
+
+/*
+ * Statistics of the runs assigned to the buckets of an allocation class.
+ */
+struct heap_class_stats {
+	uint64_t runs;
+	uint64_t units_allocated;
+	uint64_t units_free;
+	uint64_t run_occupancy[POBJ_RUN_OCCUPANCY_BINS];
+};
+
 struct heap_rt {
 	struct bucket *default_bucket;
 	struct bucket *buckets[MAX_BUCKETS];
@@ -135,6 +188,7 @@ struct heap_rt {
 	pthread_mutex_t active_run_lock;
 	uint8_t *bucket_map;
 	pthread_mutex_t run_locks[MAX_RUN_LOCKS];
+	uint64_t run_lock_contended;
 	unsigned max_zone;
 	unsigned zones_exhausted;
 	size_t last_run_max_size;
@@ -142,6 +196,44 @@ struct heap_rt {
 	struct bucket_cache *caches;
 	unsigned ncaches;
 	uint32_t last_drained[MAX_BUCKETS];
+
+	/* type of the container used by all run buckets */
+	enum block_container_type run_container;
+
+	/* if not zero, all zones are loaded at boot with that many threads */
+	unsigned zone_load_threads;
+
+	/* maximum number of chunks of newly created runs */
+	uint32_t run_max_chunks;
+
+	/* DRAM copies of the chunk headers and footers of every zone */
+	struct chunk_header **chunk_hdrs;
+
+	/*
+	 * Statistics of the heap, updated whenever a chunk or a block changes
+	 * its state, see heap_get_stats. The number of allocated units of
+	 * every run is indexed in the same way as the chunk headers.
+	 */
+	uint16_t **run_units;
+	uint64_t nchunks;
+	uint64_t huge_chunks_allocated;
+	uint64_t runs;
+	uint64_t run_chunks;
+	uint64_t run_bytes_allocated;
+	uint64_t run_bytes_free;
+	struct heap_class_stats class_stats[MAX_BUCKETS];
+
+	/* free extents of every zone, valid only until the zone is loaded */
+	uint64_t (*zone_extents)[POBJ_FREE_EXTENT_BINS];
+
+	/* per-thread caches, the list is used only to free them on cleanup */
+	pthread_key_t tcache_key;
+	pthread_mutex_t tcache_lock;
+	LIST_HEAD(tcaches, heap_tcache) tcaches;
+
+	/* number of thread cache destructors still draining their caches */
+	unsigned tcache_draining;
+	pthread_cond_t tcache_drained;
 };
 
 static __thread unsigned Cache_idx = UINT32_MAX;
@@ -228,13 +320,44 @@ heap_chunk_write_footer(struct chunk_header *hdr, uint32_t size_idx)
 	VALGRIND_SET_CLEAN(hdr + size_idx - 1, sizeof(f));
 }
 
+/*
+ * heap_get_chunk_hdr -- returns the DRAM copy of a chunk header
+ *
+ * The copy always reflects the state of the chunk header after all of the
+ * already processed operations, including the footers, which in the
+ * persistent heap are only rewritten when the zone is loaded.
+ */
+struct chunk_header *
+heap_get_chunk_hdr(struct palloc_heap *heap, uint32_t zone_id,
+	uint32_t chunk_id)
+{
+	return &heap->rt->chunk_hdrs[zone_id][chunk_id];
+}
+
+/*
+ * heap_chunk_hdr_copy -- (internal) updates the DRAM copy of a chunk header
+ *	and its footer
+ */
+static void
+heap_chunk_hdr_copy(struct palloc_heap *heap, uint32_t zone_id,
+	uint32_t chunk_id, struct chunk_header hdr)
+{
+	struct chunk_header *c = heap_get_chunk_hdr(heap, zone_id, chunk_id);
+
+	*c = hdr;
+	heap_chunk_write_footer(c, hdr.size_idx);
+}
+
 /*
  * heap_chunk_init -- (internal) writes chunk header
  */
 static void
-heap_chunk_init(struct palloc_heap *heap, struct chunk_header *hdr,
+heap_chunk_init(struct palloc_heap *heap, uint32_t zone_id, uint32_t chunk_id,
 	uint16_t type, uint32_t size_idx)
 {
+	struct chunk_header *hdr =
+		&ZID_TO_ZONE(heap->layout, zone_id)->chunk_headers[chunk_id];
+
 	struct chunk_header nhdr = {
 		.type = type,
 		.flags = 0,
@@ -246,6 +369,8 @@ heap_chunk_init(struct palloc_heap *heap, struct chunk_header *hdr,
 	pmemops_persist(&heap->p_ops, hdr, sizeof(*hdr));
 
 	heap_chunk_write_footer(hdr, size_idx);
+
+	heap_chunk_hdr_copy(heap, zone_id, chunk_id, nhdr);
 }
 
 /*
@@ -258,7 +383,7 @@ heap_zone_init(struct palloc_heap *heap, uint32_t zone_id)
 	uint32_t size_idx = get_zone_size_idx(zone_id, heap->rt->max_zone,
 			heap->size);
 
-	heap_chunk_init(heap, &z->chunk_headers[0], CHUNK_TYPE_FREE, size_idx);
+	heap_chunk_init(heap, zone_id, 0, CHUNK_TYPE_FREE, size_idx);
 
 	struct zone_header nhdr = {
 		.size_idx = size_idx,
@@ -269,14 +394,79 @@ heap_zone_init(struct palloc_heap *heap, uint32_t zone_id)
 }
 
 /*
- * heap_init_run -- (internal) creates a run based on a chunk
+ * heap_run_occupancy_bin -- (internal) returns the bin of the run occupancy
+ *	histogram, the completely full runs are counted in the last one
+ */
+static unsigned
+heap_run_occupancy_bin(uint64_t used, uint64_t nallocs)
+{
+	uint64_t bin = used * POBJ_RUN_OCCUPANCY_BINS / nallocs;
+
+	return bin < POBJ_RUN_OCCUPANCY_BINS ?
+		(unsigned)bin : POBJ_RUN_OCCUPANCY_BINS - 1;
+}
+
+/*
+ * heap_get_run_units -- (internal) returns the number of allocated units of
+ *	a run
+ */
+static uint16_t *
+heap_get_run_units(struct heap_rt *h, uint32_t zone_id, uint32_t chunk_id)
+{
+	return &h->run_units[zone_id][chunk_id];
+}
+
+/*
+ * heap_class_stats_add_run -- (internal) accounts a run assigned to a bucket
+ *	of the allocation class
+ */
+static void
+heap_class_stats_add_run(struct heap_rt *h, uint8_t class_id,
+	uint64_t used, uint64_t nallocs)
+{
+	struct heap_class_stats *c = &h->class_stats[class_id];
+
+	__sync_fetch_and_add(&c->runs, 1);
+	__sync_fetch_and_add(&c->units_allocated, used);
+	__sync_fetch_and_add(&c->units_free, nallocs - used);
+	__sync_fetch_and_add(
+		&c->run_occupancy[heap_run_occupancy_bin(used, nallocs)], 1);
+}
+
+/*
+ * heap_class_stats_remove_run -- (internal) removes a run from the statistics
+ *	of the allocation class
+ */
+static void
+heap_class_stats_remove_run(struct heap_rt *h, uint8_t class_id,
+	uint64_t used, uint64_t nallocs)
+{
+	struct heap_class_stats *c = &h->class_stats[class_id];
+
+	__sync_fetch_and_sub(&c->runs, 1);
+	__sync_fetch_and_sub(&c->units_allocated, used);
+	__sync_fetch_and_sub(&c->units_free, nallocs - used);
+	__sync_fetch_and_sub(
+		&c->run_occupancy[heap_run_occupancy_bin(used, nallocs)], 1);
+}
+
+/*
+ * heap_init_run -- (internal) creates a run based on a free memory block of
+ *	the given number of chunks
+ *
+ * The size of the run is taken from the argument and not from the chunk
+ * header, for the same reason as in heap_resize_chunk.
  */
 static void
 heap_init_run(struct palloc_heap *heap, struct bucket *b,
-		struct chunk_header *hdr, struct chunk_run *run)
+		struct memory_block m)
 {
 	ASSERTeq(b->type, BUCKET_RUN);
-	struct bucket_run *r = (struct bucket_run *)b;
+
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_header *hdr = &z->chunk_headers[m.chunk_id];
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
+	uint32_t size_idx = m.size_idx;
 
 	/* add/remove chunk_run and chunk_header to valgrind transaction */
 	VALGRIND_ADD_TO_TX(run, sizeof(*run));
@@ -289,20 +479,39 @@ heap_init_run(struct palloc_heap *heap, struct bucket *b,
 	/* set all the bits */
 	memset(run->bitmap, 0xFF, sizeof(run->bitmap));
 
-	unsigned nval = r->bitmap_nval;
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(b->unit_size, size_idx, &bm);
+
+	unsigned nval = bm.nval;
 	ASSERT(nval > 0);
 	/* clear only the bits available for allocations from this bucket */
 	memset(run->bitmap, 0, sizeof(uint64_t) * (nval - 1));
-	run->bitmap[nval - 1] = r->bitmap_lastval;
+	run->bitmap[nval - 1] = bm.lastval;
 	VALGRIND_REMOVE_FROM_TX(run, sizeof(*run));
 
 	pmemops_persist(&heap->p_ops, run->bitmap, sizeof(run->bitmap));
 
+	struct chunk_header nhdr = {
+		.type = CHUNK_TYPE_RUN,
+		.flags = hdr->flags,
+		.size_idx = size_idx
+	};
+
 	VALGRIND_ADD_TO_TX(hdr, sizeof(*hdr));
-	hdr->type = CHUNK_TYPE_RUN;
+	*hdr = nhdr; /* write the entire header (8 bytes) at once */
 	VALGRIND_REMOVE_FROM_TX(hdr, sizeof(*hdr));
 
 	pmemops_persist(&heap->p_ops, hdr, sizeof(*hdr));
+
+	heap_chunk_write_footer(hdr, size_idx);
+
+	heap_chunk_hdr_copy(heap, m.zone_id, m.chunk_id, nhdr);
+
+	struct heap_rt *h = heap->rt;
+	*heap_get_run_units(h, m.zone_id, m.chunk_id) = 0;
+	__sync_fetch_and_add(&h->runs, 1);
+	__sync_fetch_and_add(&h->run_chunks, size_idx);
+	__sync_fetch_and_add(&h->run_bytes_free, bm.nallocs * b->unit_size);
 }
 
 /*
@@ -316,7 +525,7 @@ heap_run_insert(struct palloc_heap *heap, struct bucket *b, uint32_t chunk_id,
 	struct bucket_run *r = (struct bucket_run *)b;
 
 	ASSERT(size_idx <= BITS_PER_VALUE);
-	ASSERT(block_off + size_idx <= r->bitmap_nallocs);
+	ASSERT(block_off + size_idx <= RUN_BITMAP_SIZE);
 
 	uint32_t unit_max = r->unit_max;
 	struct memory_block m = {chunk_id, zone_id,
@@ -344,60 +553,105 @@ heap_get_run_lock(struct palloc_heap *heap, uint32_t chunk_id)
 	return &heap->rt->run_locks[chunk_id % MAX_RUN_LOCKS];
 }
 
+/*
+ * heap_lock_run -- acquires the lock of a run, counting contention
+ */
+void
+heap_lock_run(struct palloc_heap *heap, pthread_mutex_t *lock)
+{
+	util_mutex_lock_count(lock, &heap->rt->run_lock_contended);
+}
+
+/*
+ * heap_bucket_lock -- (internal) acquires the lock of a bucket, counting
+ *	contention
+ */
+static inline void
+heap_bucket_lock(struct bucket *b)
+{
+	util_mutex_lock_count(&b->lock, &b->lock_contended);
+}
+
+/*
+ * heap_bit_range -- (internal) returns a mask with bits [lo, hi) set
+ */
+static inline uint64_t
+heap_bit_range(unsigned lo, unsigned hi)
+{
+	ASSERT(lo <= hi);
+	ASSERT(hi <= BITS_PER_VALUE);
+
+	if (lo == hi)
+		return 0;
+
+	uint64_t below_hi = hi == BITS_PER_VALUE ?
+		UINT64_MAX : (1ULL << hi) - 1;
+
+	return below_hi & ~((1ULL << lo) - 1);
+}
+
+/*
+ * heap_run_bitmap_summary -- (internal) returns the second level of the run
+ *	bitmap, in which every set bit marks a bitmap value with free units
+ */
+static uint64_t
+heap_run_bitmap_summary(const uint64_t *bitmap, unsigned nval)
+{
+	COMPILE_ERROR_ON(MAX_BITMAP_VALUES > BITS_PER_VALUE);
+	ASSERT(nval <= MAX_BITMAP_VALUES);
+
+	uint64_t summary = 0;
+	for (unsigned i = 0; i < nval; ++i)
+		summary |= (uint64_t)(bitmap[i] != UINT64_MAX) << i;
+
+	return summary;
+}
+
 /*
  * heap_process_run_metadata -- (internal) parses the run bitmap
+ *
+ * Only the bitmap values marked in the summary are visited and free blocks
+ * are extracted from each of them a whole range of clear bits at a time.
  */
 static void
 heap_process_run_metadata(struct palloc_heap *heap, struct bucket *b,
 	struct chunk_run *run, uint32_t chunk_id, uint32_t zone_id)
 {
 	ASSERTeq(b->type, BUCKET_RUN);
-	struct bucket_run *r = (struct bucket_run *)b;
 
-	ASSERT(RUN_NALLOCS(run->block_size) <= UINT16_MAX);
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(run->block_size,
+		heap_get_chunk_hdr(heap, zone_id, chunk_id)->size_idx, &bm);
 
-	uint16_t run_bits = (uint16_t)(RUNSIZE / run->block_size);
-	ASSERT(run_bits < (MAX_BITMAP_VALUES * BITS_PER_VALUE));
-	uint16_t block_off = 0;
-	uint16_t block_size_idx = 0;
+	ASSERT(bm.nallocs <= UINT16_MAX);
+
+	uint64_t summary = heap_run_bitmap_summary(run->bitmap, bm.nval);
+
+	while (summary != 0) {
+		unsigned i = (unsigned)__builtin_ctzll(summary);
+		summary &= summary - 1;
 
-	for (unsigned i = 0; i < r->bitmap_nval; ++i) {
-		uint64_t v = run->bitmap[i];
 		ASSERT(BITS_PER_VALUE * i <= UINT16_MAX);
-		block_off = (uint16_t)(BITS_PER_VALUE * i);
-		if (v == 0) {
+		uint16_t block_off = (uint16_t)(BITS_PER_VALUE * i);
+
+		/* every set bit of the inverted value is a free unit */
+		uint64_t free = ~run->bitmap[i];
+		if (free == UINT64_MAX) {
 			heap_run_insert(heap, b, chunk_id, zone_id,
 				BITS_PER_VALUE, block_off);
 			continue;
-		} else if (v == UINT64_MAX) {
-			continue;
 		}
 
-		for (unsigned j = 0; j < BITS_PER_VALUE; ++j) {
-			if (BIT_IS_CLR(v, j)) {
-				block_size_idx++;
-			} else if (block_size_idx != 0) {
-				ASSERT(block_off >= block_size_idx);
+		while (free != 0) {
+			unsigned start = (unsigned)__builtin_ctzll(free);
+			/* the shift brings in zeros, so this never is 0 */
+			unsigned len = (unsigned)__builtin_ctzll(
+				~(free >> start));
 
-				heap_run_insert(heap, b, chunk_id, zone_id,
-					block_size_idx,
-					(uint16_t)(block_off - block_size_idx));
-				block_size_idx = 0;
-			}
-
-			if ((block_off++) == run_bits) {
-				i = MAX_BITMAP_VALUES;
-				break;
-			}
-		}
-
-		if (block_size_idx != 0) {
-			ASSERT(block_off >= block_size_idx);
+			heap_run_insert(heap, b, chunk_id, zone_id, len,
+				(uint16_t)(block_off + start));
 
-			heap_run_insert(heap, b, chunk_id, zone_id,
-					block_size_idx,
-					(uint16_t)(block_off - block_size_idx));
-			block_size_idx = 0;
+			free &= ~heap_bit_range(start, start + len);
 		}
 	}
 }
@@ -415,24 +669,41 @@ heap_set_run_bucket(struct chunk_run *run, struct bucket *b)
 	VALGRIND_REMOVE_FROM_TX(&run->bucket_vptr, sizeof(run->bucket_vptr));
 }
 
+/*
+ * heap_run_assigned -- (internal) accounts a run which was assigned to
+ *	a bucket in the statistics of its allocation class
+ */
+static void
+heap_run_assigned(struct palloc_heap *heap, struct bucket *b,
+	uint32_t chunk_id, uint32_t zone_id)
+{
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(b->unit_size,
+		heap_get_chunk_hdr(heap, zone_id, chunk_id)->size_idx, &bm);
+
+	heap_class_stats_add_run(heap->rt, b->id,
+		*heap_get_run_units(heap->rt, zone_id, chunk_id), bm.nallocs);
+}
+
 /*
  * heap_create_run -- (internal) initializes a new run on an existing free chunk
  */
 static void
 heap_create_run(struct palloc_heap *heap, struct bucket *b,
-	uint32_t chunk_id, uint32_t zone_id)
+	struct memory_block m)
 {
-	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
-	struct chunk_header *hdr = &z->chunk_headers[chunk_id];
-	struct chunk_run *run = (struct chunk_run *)&z->chunks[chunk_id];
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
 
-	ASSERT(hdr->size_idx == 1);
-	ASSERT(hdr->type == CHUNK_TYPE_FREE);
+	ASSERT(heap_get_chunk_hdr(heap, m.zone_id, m.chunk_id)->type ==
+		CHUNK_TYPE_FREE);
+	ASSERT(m.size_idx >= 1 && m.size_idx <= RUN_MAX_SIZE_IDX);
 
-	VALGRIND_DO_MAKE_MEM_UNDEFINED(run, sizeof(*run));
+	VALGRIND_DO_MAKE_MEM_UNDEFINED(run, CHUNKSIZE * m.size_idx);
 	heap_set_run_bucket(run, b);
-	heap_init_run(heap, b, hdr, run);
-	heap_process_run_metadata(heap, b, run, chunk_id, zone_id);
+	heap_init_run(heap, b, m);
+	heap_run_assigned(heap, b, m.chunk_id, m.zone_id);
+	heap_process_run_metadata(heap, b, run, m.chunk_id, m.zone_id);
 }
 
 /*
@@ -445,7 +716,7 @@ heap_reuse_run(struct palloc_heap *heap, struct bucket *b,
 	uint32_t chunk_id, uint32_t zone_id)
 {
 	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
-	struct chunk_header *hdr = &z->chunk_headers[chunk_id];
+	struct chunk_header *hdr = heap_get_chunk_hdr(heap, zone_id, chunk_id);
 	struct chunk_run *run = (struct chunk_run *)&z->chunks[chunk_id];
 
 	/* the run might have changed back to a chunk */
@@ -460,9 +731,9 @@ heap_reuse_run(struct palloc_heap *heap, struct bucket *b,
 		return;
 
 	heap_set_run_bucket(run, b);
-	ASSERTeq(hdr->size_idx, 1);
 	ASSERTeq(b->unit_size, run->block_size);
 
+	heap_run_assigned(heap, b, chunk_id, zone_id);
 	heap_process_run_metadata(heap, b, run, chunk_id, zone_id);
 }
 
@@ -497,20 +768,38 @@ heap_find_first_free_bucket_slot(struct heap_rt *h)
 	return MAX_BUCKETS;
 }
 
+/*
+ * heap_run_size_idx -- (internal) returns the number of chunks of the runs
+ *	created for the allocation class with the given unit size
+ */
+static uint32_t
+heap_run_size_idx(struct heap_rt *h, size_t unit_size)
+{
+	uint32_t size_idx = 1;
+	while (size_idx < h->run_max_chunks &&
+		RUN_NALLOCS(unit_size, size_idx) < RUN_MIN_NALLOCS &&
+		RUN_NALLOCS(unit_size, size_idx + 1) <= RUN_BITMAP_SIZE)
+		size_idx++;
+
+	return size_idx;
+}
+
 /*
  * heap_create_alloc_class_buckets -- (internal) allocates both auxiliary and
  *	cache bucket instances of the specified type
  */
 static uint8_t
 heap_create_alloc_class_buckets(struct heap_rt *h,
-	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc)
+	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc,
+	uint32_t run_size_idx)
 {
 	uint8_t slot = heap_find_first_free_bucket_slot(h);
 	if (slot == MAX_BUCKETS)
 		goto out;
 
-	h->buckets[slot] = &(bucket_run_new(slot, CONTAINER_CTREE,
-			unit_size, unit_max, unit_max_alloc)->super);
+	h->buckets[slot] = &(bucket_run_new(slot, h->run_container,
+			unit_size, unit_max, unit_max_alloc,
+			run_size_idx)->super);
 
 	if (h->buckets[slot] == NULL)
 		goto error_bucket_new;
@@ -518,8 +807,9 @@ heap_create_alloc_class_buckets(struct heap_rt *h,
 	int i;
 	for (i = 0; i < (int)h->ncaches; ++i) {
 		h->caches[i].buckets[slot] =
-			&(bucket_run_new(slot, CONTAINER_CTREE,
-				unit_size, unit_max, unit_max_alloc)->super);
+			&(bucket_run_new(slot, h->run_container,
+				unit_size, unit_max, unit_max_alloc,
+				run_size_idx)->super);
 		if (h->caches[i].buckets[slot] == NULL)
 			goto error_cache_bucket_new;
 	}
@@ -558,7 +848,8 @@ heap_get_create_bucket_idx_by_unit_size(struct heap_rt *h, uint64_t unit_size)
 		 * initialization time.
 		 */
 		bucket_idx = heap_create_alloc_class_buckets(h, unit_size,
-			RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC);
+			RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC,
+			heap_run_size_idx(h, unit_size));
 
 		if (bucket_idx == MAX_BUCKETS) {
 			ERR("Failed to allocate new bucket class");
@@ -604,29 +895,31 @@ heap_register_active_run(struct heap_rt *h, struct chunk_run *run,
 	arun->chunk_id = chunk_id;
 	arun->zone_id = zone_id;
 
+	/* zones can be loaded concurrently, see heap_load_zones_parallel */
+	util_mutex_lock(&h->active_run_lock);
+
 	uint8_t bucket_idx = heap_get_create_bucket_idx_by_unit_size(h,
 		run->block_size);
 
 	if (bucket_idx == MAX_BUCKETS) {
+		util_mutex_unlock(&h->active_run_lock);
 		ASSERT(0);
 		return;
 	}
 
 	SLIST_INSERT_HEAD(&h->active_runs[bucket_idx], arun, run);
+
+	util_mutex_unlock(&h->active_run_lock);
 }
 
 /*
- * heap_populate_buckets -- (internal) creates volatile state of memory blocks
+ * heap_load_zone -- (internal) creates volatile state of memory blocks of
+ *	a single zone
  */
-static int
-heap_populate_buckets(struct palloc_heap *heap)
+static void
+heap_load_zone(struct palloc_heap *heap, uint32_t zone_id)
 {
 	struct heap_rt *h = heap->rt;
-
-	if (h->zones_exhausted == h->max_zone)
-		return ENOMEM;
-
-	uint32_t zone_id = h->zones_exhausted++;
 	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
 
 	/* ignore zone and chunk headers */
@@ -663,10 +956,68 @@ heap_populate_buckets(struct palloc_heap *heap)
 
 		i += hdr->size_idx;
 	}
+}
+
+/*
+ * heap_populate_buckets -- (internal) creates volatile state of memory blocks
+ *	of the next zone that wasn't loaded yet
+ */
+static int
+heap_populate_buckets(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+
+	if (h->zones_exhausted == h->max_zone)
+		return ENOMEM;
+
+	heap_load_zone(heap, h->zones_exhausted++);
 
 	return 0;
 }
 
+struct heap_zone_loader {
+	struct palloc_heap *heap;
+	uint32_t next_zone;
+};
+
+/*
+ * heap_load_zones_worker -- (internal) loads zones until none are left
+ */
+static void *
+heap_load_zones_worker(void *arg)
+{
+	struct heap_zone_loader *l = arg;
+	uint32_t zone_id;
+
+	while ((zone_id = __sync_fetch_and_add(&l->next_zone, 1)) <
+			l->heap->rt->max_zone)
+		heap_load_zone(l->heap, zone_id);
+
+	return NULL;
+}
+
+/*
+ * heap_load_zones_parallel -- (internal) loads all of the zones using
+ *	the given number of threads, including the calling one
+ *
+ * Nothing else can use the heap at this point, the only shared state touched
+ * by the loading threads is the default bucket, whose container has its own
+ * lock, and the list of active runs.
+ */
+static void
+heap_load_zones_parallel(struct palloc_heap *heap, unsigned nthreads)
+{
+	struct heap_rt *h = heap->rt;
+	struct heap_zone_loader l = {heap, 0};
+
+	if (nthreads > h->max_zone)
+		nthreads = h->max_zone;
+
+	util_run_parallel(heap_load_zones_worker, &l, nthreads);
+
+	h->zones_exhausted = h->max_zone;
+}
+
 /*
  * heap_get_active_run -- (internal) searches for an existing, unused, run
  */
@@ -707,14 +1058,90 @@ heap_get_default_bucket(struct palloc_heap *heap)
 	return heap->rt->default_bucket;
 }
 
+/*
+ * heap_steal_from_caches -- (internal) moves a batch of memory blocks that
+ *	can satisfy the request from the sibling cache bucket with the most free
+ *	units to the starving cache bucket
+ *
+ * The victim gives away at most half of its free units, but always at least
+ * one block if it has a fitting one.
+ */
+static int
+heap_steal_from_caches(struct palloc_heap *heap, struct bucket *b,
+	uint32_t size_idx)
+{
+	struct heap_rt *h = heap->rt;
+
+	struct bucket *victim = NULL;
+	uint64_t victim_units = 0;
+
+	for (unsigned i = 0; i < h->ncaches; ++i) {
+		struct bucket *cb = h->caches[i].buckets[b->id];
+		if (cb == b)
+			continue;
+
+		uint64_t units = cb->container->nunits;
+		if (units > victim_units) {
+			victim = cb;
+			victim_units = units;
+		}
+	}
+
+	if (victim == NULL || victim_units < size_idx)
+		return ENOMEM;
+
+	struct bucket_run *r = (struct bucket_run *)b;
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(b->unit_size, r->run_size_idx, &bm);
+
+	uint64_t units_max = (uint64_t)(bm.nallocs * MAX_UNITS_PCT_STOLEN);
+	if (units_max > victim_units / 2)
+		units_max = victim_units / 2;
+
+	uint64_t stolen = 0;
+	struct memory_block m;
+
+	heap_bucket_lock(victim);
+
+	do {
+		m = EMPTY_MEMORY_BLOCK;
+		m.size_idx = size_idx;
+
+		if (CNT_OP(victim, get_rm_bestfit, &m) != 0)
+			break;
+
+		if (CNT_OP(b, insert, heap, m) != 0) {
+			CNT_OP(victim, insert, heap, m);
+			break;
+		}
+
+		stolen += m.size_idx;
+	} while (stolen < units_max);
+
+	util_mutex_unlock(&victim->lock);
+
+	if (stolen == 0)
+		return ENOMEM;
+
+	__sync_fetch_and_add(&r->steals, 1);
+	__sync_fetch_and_add(&r->units_stolen, stolen);
+
+	return 0;
+}
+
 /*
  * heap_ensure_bucket_filled -- (internal) refills the bucket if needed
+ *
+ * A cache bucket that cannot reuse an existing run first tries to steal
+ * memory blocks of at least size_idx units from its siblings, and only then
+ * creates a new run.
  */
 static int
-heap_ensure_bucket_filled(struct palloc_heap *heap, struct bucket *b)
+heap_ensure_bucket_filled(struct palloc_heap *heap, struct bucket *b,
+	uint32_t size_idx)
 {
 	if (b->type == BUCKET_HUGE) {
-		util_mutex_lock(&b->lock);
+		heap_bucket_lock(b);
 		/* not much to do here apart from using the next zone */
 		int ret = heap_populate_buckets(heap);
 		util_mutex_unlock(&b->lock);
@@ -723,14 +1150,27 @@ heap_ensure_bucket_filled(struct palloc_heap *heap, struct bucket *b)
 	}
 
 	struct heap_rt *h = heap->rt;
-	struct memory_block m = {0, 0, 1, 0};
+	struct bucket_run *r = (struct bucket_run *)b;
+	struct memory_block m = {0, 0, r->run_size_idx, 0};
 
 	if (!heap_get_active_run(h, b->id, &m)) {
+		if (h->buckets[b->id] != b &&
+			heap_steal_from_caches(heap, b, size_idx) == 0)
+			return 0;
+
 		/* cannot reuse an existing run, create a new one */
 		struct bucket *def_bucket = heap_get_default_bucket(heap);
 
-		if (heap_get_bestfit_block(heap, def_bucket, &m) != 0)
-			return ENOMEM; /* OOM */
+		if (heap_get_bestfit_block(heap, def_bucket, &m) != 0) {
+			if (r->run_size_idx == 1)
+				return ENOMEM; /* OOM */
+
+			/* no free extent is big enough, use a single chunk */
+			m = EMPTY_MEMORY_BLOCK;
+			m.size_idx = 1;
+			if (heap_get_bestfit_block(heap, def_bucket, &m) != 0)
+				return ENOMEM; /* OOM */
+		}
 
 		ASSERT(m.block_off == 0);
 
@@ -740,12 +1180,12 @@ heap_ensure_bucket_filled(struct palloc_heap *heap, struct bucket *b)
 		 * especially important in the free code path when we are
 		 * searching for neighbour blocks in blocks list.
 		 */
-		util_mutex_lock(&def_bucket->lock);
-		heap_create_run(heap, b, m.chunk_id, m.zone_id);
+		heap_bucket_lock(def_bucket);
+		heap_create_run(heap, b, m);
 		util_mutex_unlock(&def_bucket->lock);
 	} else {
 		pthread_mutex_t *lock = heap_get_run_lock(heap, m.chunk_id);
-		util_mutex_lock(lock);
+		heap_lock_run(heap, lock);
 		heap_reuse_run(heap, b, m.chunk_id, m.zone_id);
 		util_mutex_unlock(lock);
 	}
@@ -799,22 +1239,91 @@ heap_get_best_bucket(struct palloc_heap *heap, size_t size)
 }
 
 /*
- * heap_get_run_bucket -- (internal) returns run bucket
+ * heap_get_class_bucket -- returns the bucket of the given allocation class
+ *	or NULL if there's no such class
  */
-static struct bucket *
-heap_get_run_bucket(struct chunk_run *run)
+struct bucket *
+heap_get_class_bucket(struct palloc_heap *heap, uint8_t class_id)
 {
-	struct bucket *b = (struct bucket *)run->bucket_vptr;
-	ASSERTne(b, NULL);
-	ASSERTne(b->unit_size, 0);
-	ASSERTne(run->block_size, 0);
-	ASSERTeq(run->block_size, b->unit_size);
+	struct heap_rt *rt = heap->rt;
+	if (class_id == MAX_BUCKETS)
+		return NULL;
 
-	return b;
+	struct bucket *b = rt->buckets[class_id];
+	if (b == NULL || b == BUCKET_RESERVED)
+		return NULL;
+
+	return heap_get_bucket_by_idx(rt, class_id);
 }
 
 /*
- * heap_assign_run_bucket -- (internal) finds and sets bucket for a run
+ * heap_create_alloc_class -- creates a new, user-defined, allocation class
+ *
+ * The unit size must be a multiple of the allocation block size. The runs of
+ * the class span the smallest number of chunks that fits the requested number
+ * of units, so the actual capacity of a run is rounded up to fill its chunks.
+ * A single object can occupy up to the default maximum number of units per
+ * allocation, limited by the capacity of the run.
+ */
+int
+heap_create_alloc_class(struct palloc_heap *heap, size_t unit_size,
+	unsigned units_per_run, uint8_t *class_id)
+{
+	if (unit_size < MIN_RUN_SIZE || unit_size > MAX_RUN_SIZE ||
+		unit_size % ALLOC_BLOCK_SIZE != 0) {
+		ERR("invalid allocation class unit size %zu", unit_size);
+		return EINVAL;
+	}
+
+	if (units_per_run == 0 || units_per_run > RUN_BITMAP_SIZE) {
+		ERR("invalid allocation class units per block %u",
+			units_per_run);
+		return EINVAL;
+	}
+
+	uint32_t run_size_idx = 1;
+	while (RUN_NALLOCS(unit_size, run_size_idx) < units_per_run) {
+		if (++run_size_idx > heap->rt->run_max_chunks) {
+			ERR("allocation class run of %u units of %zu bytes "
+				"exceeds %u chunks", units_per_run, unit_size,
+				heap->rt->run_max_chunks);
+			return EINVAL;
+		}
+	}
+
+	size_t nallocs = RUN_NALLOCS(unit_size, run_size_idx);
+	unsigned unit_max_alloc = nallocs < RUN_UNIT_MAX_ALLOC ?
+		(unsigned)nallocs : RUN_UNIT_MAX_ALLOC;
+
+	uint8_t slot = heap_create_alloc_class_buckets(heap->rt, unit_size,
+		RUN_UNIT_MAX, unit_max_alloc, run_size_idx);
+	if (slot == MAX_BUCKETS) {
+		ERR("failed to create allocation class");
+		return ENOMEM;
+	}
+
+	*class_id = slot;
+
+	return 0;
+}
+
+/*
+ * heap_get_run_bucket -- (internal) returns run bucket
+ */
+static struct bucket *
+heap_get_run_bucket(struct chunk_run *run)
+{
+	struct bucket *b = (struct bucket *)run->bucket_vptr;
+	ASSERTne(b, NULL);
+	ASSERTne(b->unit_size, 0);
+	ASSERTne(run->block_size, 0);
+	ASSERTeq(run->block_size, b->unit_size);
+
+	return b;
+}
+
+/*
+ * heap_assign_run_bucket -- (internal) finds and sets bucket for a run
  */
 static struct bucket *
 heap_assign_run_bucket(struct palloc_heap *heap, struct chunk_run *run,
@@ -858,7 +1367,7 @@ heap_get_chunk_bucket(struct palloc_heap *heap, uint32_t chunk_id,
 	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
 
 	ASSERT(chunk_id < z->header.size_idx);
-	struct chunk_header *hdr = &z->chunk_headers[chunk_id];
+	struct chunk_header *hdr = heap_get_chunk_hdr(heap, zone_id, chunk_id);
 
 	if (hdr->type == CHUNK_TYPE_RUN) {
 		struct chunk_run *run =
@@ -878,11 +1387,11 @@ heap_get_chunk_bucket(struct palloc_heap *heap, uint32_t chunk_id,
  * heap_get_auxiliary_bucket -- returns bucket common for all threads
  */
 struct bucket *
-heap_get_auxiliary_bucket(struct palloc_heap *heap, size_t size)
+heap_get_auxiliary_bucket(struct palloc_heap *heap, uint8_t bucket_id)
 {
-	ASSERT(size <= heap->rt->last_run_max_size);
+	ASSERTne(bucket_id, MAX_BUCKETS);
 
-	return heap->rt->buckets[SIZE_TO_BID(heap->rt, size)];
+	return heap->rt->buckets[bucket_id];
 }
 
 /*
@@ -905,14 +1414,15 @@ heap_drain_to_auxiliary(struct palloc_heap *heap, struct bucket *auxb,
 	ASSERTeq(auxb->type, BUCKET_RUN);
 
 	struct bucket_run *auxr = (struct bucket_run *)auxb;
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(auxb->unit_size, auxr->run_size_idx, &bm);
 
 	/* max units drained from a single bucket cache */
-	unsigned units_per_bucket = (unsigned)(auxr->bitmap_nallocs *
+	unsigned units_per_bucket = (unsigned)(bm.nallocs *
 				MAX_UNITS_PCT_DRAINED_CACHE);
 
 	/* max units drained from all of the bucket caches */
-	unsigned units_total = auxr->bitmap_nallocs *
-			MAX_UNITS_PCT_DRAINED_TOTAL;
+	unsigned units_total = bm.nallocs * MAX_UNITS_PCT_DRAINED_TOTAL;
 
 	unsigned cache_id;
 
@@ -929,7 +1439,7 @@ heap_drain_to_auxiliary(struct palloc_heap *heap, struct bucket *auxb,
 
 		drained_cache = 0;
 
-		util_mutex_lock(&b->lock);
+		heap_bucket_lock(b);
 
 		/*
 		 * XXX: Draining should make effort not to split runs
@@ -988,7 +1498,8 @@ heap_find_or_create_alloc_class(struct palloc_heap *heap, size_t n)
 	 * run data size must be divisible by the allocation class unit size
 	 * with the smallest possible remainder, preferably 0.
 	 */
-	while ((RUNSIZE % n) > MAX_RUN_WASTED_BYTES) {
+	while ((RUN_DATA_SIZE(heap_run_size_idx(h, n)) % n) >
+			MAX_RUN_WASTED_BYTES) {
 		n += ALLOC_BLOCK_SIZE;
 	}
 
@@ -1005,7 +1516,7 @@ heap_find_or_create_alloc_class(struct palloc_heap *heap, size_t n)
 	}
 
 	return heap_create_alloc_class_buckets(h, n,
-		RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC);
+		RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC, heap_run_size_idx(h, n));
 }
 
 /*
@@ -1078,7 +1589,8 @@ heap_buckets_init(struct palloc_heap *heap)
 	 */
 	size_t size = 0;
 	uint8_t slot = heap_create_alloc_class_buckets(h,
-		MIN_RUN_SIZE, RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC);
+		MIN_RUN_SIZE, RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC,
+		heap_run_size_idx(h, MIN_RUN_SIZE));
 	if (slot == MAX_BUCKETS)
 		goto error_bucket_create;
 
@@ -1115,13 +1627,15 @@ heap_buckets_init(struct palloc_heap *heap)
 		;
 
 	struct bucket_run *b = (struct bucket_run *)h->buckets[slot];
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(b->super.unit_size, b->run_size_idx, &bm);
 
 	/*
 	 * The actual run might contain less unit blocks than the theoretical
 	 * unit max variable. This may be the case for very large unit sizes.
 	 */
-	size_t real_unit_max = b->bitmap_nallocs < b->unit_max_alloc ?
-		b->bitmap_nallocs : b->unit_max_alloc;
+	size_t real_unit_max = bm.nallocs < b->unit_max_alloc ?
+		bm.nallocs : b->unit_max_alloc;
 
 	size_t theoretical_run_max_size = b->super.unit_size * real_unit_max;
 
@@ -1154,7 +1668,10 @@ heap_buckets_init(struct palloc_heap *heap)
 	}
 #endif
 
-	heap_populate_buckets(heap);
+	if (h->zone_load_threads != 0)
+		heap_load_zones_parallel(heap, h->zone_load_threads);
+	else
+		heap_populate_buckets(heap);
 
 	return 0;
 
@@ -1173,24 +1690,27 @@ error_bucket_map_malloc:
 
 /*
  * heap_resize_chunk -- (internal) splits the chunk into two smaller ones
+ *
+ * The size of the chunk is taken from the transient memory block and not from
+ * the chunk header, because free chunks that were coalesced without an
+ * operation context (i.e. reservations that were canceled) still have their
+ * old headers.
  */
 static void
-heap_resize_chunk(struct palloc_heap *heap,
-	uint32_t chunk_id, uint32_t zone_id, uint32_t new_size_idx)
+heap_resize_chunk(struct palloc_heap *heap, struct memory_block *m,
+	uint32_t new_size_idx)
 {
-	uint32_t new_chunk_id = chunk_id + new_size_idx;
-
-	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
-	struct chunk_header *old_hdr = &z->chunk_headers[chunk_id];
-	struct chunk_header *new_hdr = &z->chunk_headers[new_chunk_id];
+	uint32_t new_chunk_id = m->chunk_id + new_size_idx;
 
-	uint32_t rem_size_idx = old_hdr->size_idx - new_size_idx;
-	heap_chunk_init(heap, new_hdr, CHUNK_TYPE_FREE, rem_size_idx);
-	heap_chunk_init(heap, old_hdr, CHUNK_TYPE_FREE, new_size_idx);
+	uint32_t rem_size_idx = m->size_idx - new_size_idx;
+	heap_chunk_init(heap, m->zone_id, new_chunk_id, CHUNK_TYPE_FREE,
+		rem_size_idx);
+	heap_chunk_init(heap, m->zone_id, m->chunk_id, CHUNK_TYPE_FREE,
+		new_size_idx);
 
 	struct bucket *def_bucket = heap->rt->default_bucket;
-	struct memory_block m = {new_chunk_id, zone_id, rem_size_idx, 0};
-	CNT_OP(def_bucket, insert, heap, m);
+	struct memory_block r = {new_chunk_id, m->zone_id, rem_size_idx, 0};
+	CNT_OP(def_bucket, insert, heap, r);
 }
 
 /*
@@ -1207,7 +1727,7 @@ heap_recycle_block(struct palloc_heap *heap, struct bucket *b,
 			m->size_idx - units, (uint16_t)(m->block_off + units)};
 		CNT_OP(b, insert, heap, r);
 	} else {
-		heap_resize_chunk(heap, m->chunk_id, m->zone_id, units);
+		heap_resize_chunk(heap, m, units);
 	}
 
 	m->size_idx = units;
@@ -1221,17 +1741,17 @@ int
 heap_get_bestfit_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m)
 {
-	util_mutex_lock(&b->lock);
+	heap_bucket_lock(b);
 
 	uint32_t units = m->size_idx;
 	int ret = 0;
 
 	while (CNT_OP(b, get_rm_bestfit, m) != 0) {
 		util_mutex_unlock(&b->lock);
-		if ((ret = heap_ensure_bucket_filled(heap, b)) != 0) {
+		if ((ret = heap_ensure_bucket_filled(heap, b, units)) != 0) {
 			return ret;
 		}
-		util_mutex_lock(&b->lock);
+		heap_bucket_lock(b);
 	}
 
 	ASSERT(m->size_idx >= units);
@@ -1252,7 +1772,7 @@ int
 heap_get_exact_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m, uint32_t units)
 {
-	util_mutex_lock(&b->lock);
+	heap_bucket_lock(b);
 
 	int ret = 0;
 	if ((ret = CNT_OP(b, get_rm_exact, *m)) != 0) {
@@ -1275,7 +1795,8 @@ void *
 heap_get_block_data(struct palloc_heap *heap, struct memory_block m)
 {
 	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
-	struct chunk_header *hdr = &z->chunk_headers[m.chunk_id];
+	struct chunk_header *hdr = heap_get_chunk_hdr(heap, m.zone_id,
+		m.chunk_id);
 
 	void *data = &z->chunks[m.chunk_id].data;
 	if (hdr->type != CHUNK_TYPE_RUN)
@@ -1302,25 +1823,31 @@ heap_run_get_block(struct bucket *rb, struct chunk_run *r,
 	struct bucket_run *run = (struct bucket_run *)rb;
 
 	if (prev) {
-		unsigned i;
-		for (i = b;
-			i % run->unit_max && BIT_IS_CLR(r->bitmap[v], i - 1);
-			--i)
-			;
+		/* the free block can't cross the unit max boundary */
+		unsigned lo = b - b % run->unit_max;
+		uint64_t used = r->bitmap[v] & heap_bit_range(lo, b);
+		unsigned i = used != 0 ?
+			BITS_PER_VALUE - (unsigned)__builtin_clzll(used) : lo;
 
 		mblock->block_off = (uint16_t)(v * BITS_PER_VALUE + i);
 		ASSERT(block_off >= mblock->block_off);
 		mblock->size_idx = (uint16_t)(block_off - mblock->block_off);
 	} else { /* next */
-		unsigned i;
-		for (i = b + size_idx;
-			i % run->unit_max && BIT_IS_CLR(r->bitmap[v], i);
-			++i)
-			;
+		unsigned lo = b + size_idx;
+		ASSERT(lo <= BITS_PER_VALUE);
+
+		unsigned hi = lo % run->unit_max ?
+			lo + run->unit_max - lo % run->unit_max : lo;
+		if (hi > BITS_PER_VALUE)
+			hi = BITS_PER_VALUE;
+
+		uint64_t used = r->bitmap[v] & heap_bit_range(lo, hi);
+		unsigned i = used != 0 ?
+			(unsigned)__builtin_ctzll(used) : hi;
 
 		ASSERT((uint64_t)block_off + size_idx <= UINT16_MAX);
 		mblock->block_off = (uint16_t)(block_off + size_idx);
-		mblock->size_idx = i - (b + size_idx);
+		mblock->size_idx = i - lo;
 	}
 
 	if (mblock->size_idx == 0)
@@ -1331,32 +1858,34 @@ heap_run_get_block(struct bucket *rb, struct chunk_run *r,
 
 /*
  * heap_get_chunk -- (internal) returns next/prev chunk from zone
+ *
+ * Only the DRAM copies of the chunk headers are used to find the chunk.
  */
 static int
-heap_get_chunk(struct zone *z, struct chunk_header *hdr,
+heap_get_chunk(struct zone *z, struct chunk_header *hdrs,
 	struct memory_block *m, uint32_t chunk_id, int prev)
 {
 	if (prev) {
 		if (chunk_id == 0)
 			return ENOENT;
 
-		struct chunk_header *prev_hdr = &z->chunk_headers[chunk_id - 1];
+		struct chunk_header *prev_hdr = &hdrs[chunk_id - 1];
 		m->chunk_id = chunk_id - prev_hdr->size_idx;
 
-		if (z->chunk_headers[m->chunk_id].type != CHUNK_TYPE_FREE)
+		if (hdrs[m->chunk_id].type != CHUNK_TYPE_FREE)
 			return ENOENT;
 
-		m->size_idx = z->chunk_headers[m->chunk_id].size_idx;
+		m->size_idx = hdrs[m->chunk_id].size_idx;
 	} else { /* next */
-		if (chunk_id + hdr->size_idx == z->header.size_idx)
+		if (chunk_id + hdrs[chunk_id].size_idx == z->header.size_idx)
 			return ENOENT;
 
-		m->chunk_id = chunk_id + hdr->size_idx;
+		m->chunk_id = chunk_id + hdrs[chunk_id].size_idx;
 
-		if (z->chunk_headers[m->chunk_id].type != CHUNK_TYPE_FREE)
+		if (hdrs[m->chunk_id].type != CHUNK_TYPE_FREE)
 			return ENOENT;
 
-		m->size_idx = z->chunk_headers[m->chunk_id].size_idx;
+		m->size_idx = hdrs[m->chunk_id].size_idx;
 	}
 
 	return 0;
@@ -1372,17 +1901,17 @@ int heap_get_adjacent_free_block(struct palloc_heap *heap, struct bucket *b,
 		return EINVAL;
 
 	struct zone *z = ZID_TO_ZONE(heap->layout, cnt.zone_id);
-	struct chunk_header *hdr = &z->chunk_headers[cnt.chunk_id];
+	struct chunk_header *hdrs = heap->rt->chunk_hdrs[cnt.zone_id];
 	m->zone_id = cnt.zone_id;
 
-	if (hdr->type == CHUNK_TYPE_RUN) {
+	if (hdrs[cnt.chunk_id].type == CHUNK_TYPE_RUN) {
 		m->chunk_id = cnt.chunk_id;
 		struct chunk_run *r =
 				(struct chunk_run *)&z->chunks[cnt.chunk_id];
 		return heap_run_get_block(b, r, m, cnt.size_idx,
 				cnt.block_off, prev);
 	} else {
-		return heap_get_chunk(z, hdr, m, cnt.chunk_id, prev);
+		return heap_get_chunk(z, hdrs, m, cnt.chunk_id, prev);
 	}
 }
 
@@ -1446,11 +1975,81 @@ heap_free_block(struct palloc_heap *heap, struct bucket *b,
 	return res;
 }
 
+/*
+ * heap_account_block -- updates the statistics after an operation which
+ *	allocated or freed the memory block was processed
+ *
+ * The lock of the run the block belongs to must be held by the caller.
+ */
+void
+heap_account_block(struct palloc_heap *heap, struct memory_block m,
+	enum memblock_state op)
+{
+	struct heap_rt *h = heap->rt;
+	struct chunk_header *hdr = heap_get_chunk_hdr(heap, m.zone_id,
+		m.chunk_id);
+
+	if (hdr->type != CHUNK_TYPE_RUN) {
+		if (op == MEMBLOCK_ALLOCATED)
+			__sync_fetch_and_add(&h->huge_chunks_allocated,
+				m.size_idx);
+		else
+			__sync_fetch_and_sub(&h->huge_chunks_allocated,
+				m.size_idx);
+		return;
+	}
+
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
+	uint64_t bytes = m.size_idx * run->block_size;
+
+	uint16_t *units = heap_get_run_units(h, m.zone_id, m.chunk_id);
+	uint64_t used = *units;
+
+	struct heap_class_stats *c = NULL;
+
+	/* the volatile state of runs from zones not yet loaded is not valid */
+	if (m.zone_id < h->zones_exhausted && run->bucket_vptr != 0)
+		c = &h->class_stats[heap_get_run_bucket(run)->id];
+
+	if (op == MEMBLOCK_ALLOCATED) {
+		*units = (uint16_t)(used + m.size_idx);
+		__sync_fetch_and_add(&h->run_bytes_allocated, bytes);
+		__sync_fetch_and_sub(&h->run_bytes_free, bytes);
+		if (c != NULL) {
+			__sync_fetch_and_add(&c->units_allocated, m.size_idx);
+			__sync_fetch_and_sub(&c->units_free, m.size_idx);
+		}
+	} else {
+		*units = (uint16_t)(used - m.size_idx);
+		__sync_fetch_and_sub(&h->run_bytes_allocated, bytes);
+		__sync_fetch_and_add(&h->run_bytes_free, bytes);
+		if (c != NULL) {
+			__sync_fetch_and_sub(&c->units_allocated, m.size_idx);
+			__sync_fetch_and_add(&c->units_free, m.size_idx);
+		}
+	}
+
+	if (c == NULL)
+		return;
+
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(run->block_size, hdr->size_idx, &bm);
+
+	unsigned from = heap_run_occupancy_bin(used, bm.nallocs);
+	unsigned to = heap_run_occupancy_bin(*units, bm.nallocs);
+	if (from != to) {
+		__sync_fetch_and_sub(&c->run_occupancy[from], 1);
+		__sync_fetch_and_add(&c->run_occupancy[to], 1);
+	}
+}
+
 /*
  * traverse_bucket_run -- (internal) traverses each memory block of a run
  */
 static int
 traverse_bucket_run(struct bucket *b, struct memory_block m,
+	unsigned nallocs,
 	int (*cb)(struct block_container *b, struct memory_block m))
 {
 	ASSERTeq(b->type, BUCKET_RUN);
@@ -1460,9 +2059,9 @@ traverse_bucket_run(struct bucket *b, struct memory_block m,
 	m.size_idx = r->unit_max;
 	uint32_t size_idx_sum = 0;
 
-	while (size_idx_sum != r->bitmap_nallocs) {
-		if (m.block_off + r->unit_max > r->bitmap_nallocs)
-			m.size_idx = r->bitmap_nallocs - m.block_off;
+	while (size_idx_sum != nallocs) {
+		if (m.block_off + r->unit_max > nallocs)
+			m.size_idx = nallocs - m.block_off;
 		else
 			m.size_idx = r->unit_max;
 
@@ -1486,13 +2085,16 @@ heap_degrade_run_if_empty(struct palloc_heap *heap,
 		struct bucket *b, struct memory_block m)
 {
 	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
-	struct chunk_header *hdr = &z->chunk_headers[m.chunk_id];
+	struct chunk_header *hdr = heap_get_chunk_hdr(heap, m.zone_id,
+		m.chunk_id);
 	ASSERT(hdr->type == CHUNK_TYPE_RUN);
 
 	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
 
 	ASSERTeq(b->type, BUCKET_RUN);
-	struct bucket_run *r = (struct bucket_run *)b;
+
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(run->block_size, hdr->size_idx, &bm);
 
 	/*
 	 * The redo log ptr can be NULL if we are sure that there's only one
@@ -1502,18 +2104,19 @@ heap_degrade_run_if_empty(struct palloc_heap *heap,
 	operation_init(&ctx, heap->base, NULL, NULL);
 	ctx.p_ops = &heap->p_ops;
 
-	util_mutex_lock(&b->lock);
+	heap_bucket_lock(b);
 
 	unsigned i;
-	unsigned nval = r->bitmap_nval;
+	unsigned nval = bm.nval;
 	for (i = 0; nval > 0 && i < nval - 1; ++i)
 		if (run->bitmap[i] != 0)
 			goto out;
 
-	if (run->bitmap[i] != r->bitmap_lastval)
+	if (run->bitmap[i] != bm.lastval)
 		goto out;
 
-	if (traverse_bucket_run(b, m, b->c_ops->get_exact) != 0) {
+	if (traverse_bucket_run(b, m, bm.nallocs,
+			b->c_ops->get_exact) != 0) {
 		/*
 		 * The memory block is in the active run list or in a
 		 * different bucket, there's not much we can do here
@@ -1522,16 +2125,24 @@ heap_degrade_run_if_empty(struct palloc_heap *heap,
 		goto out;
 	}
 
-	if (traverse_bucket_run(b, m, b->c_ops->get_rm_exact) != 0) {
+	if (traverse_bucket_run(b, m, bm.nallocs,
+			b->c_ops->get_rm_exact) != 0) {
 		FATAL("Persistent/volatile state mismatch");
 	}
 
 	struct bucket *defb = heap_get_default_bucket(heap);
-	util_mutex_lock(&defb->lock);
+	heap_bucket_lock(defb);
 
 	m.block_off = 0;
-	m.size_idx = 1;
-	heap_chunk_init(heap, hdr, CHUNK_TYPE_FREE, m.size_idx);
+	m.size_idx = hdr->size_idx;
+	heap_chunk_init(heap, m.zone_id, m.chunk_id, CHUNK_TYPE_FREE,
+		m.size_idx);
+
+	struct heap_rt *h = heap->rt;
+	heap_class_stats_remove_run(h, b->id, 0, bm.nallocs);
+	__sync_fetch_and_sub(&h->runs, 1);
+	__sync_fetch_and_sub(&h->run_chunks, m.size_idx);
+	__sync_fetch_and_sub(&h->run_bytes_free, bm.nallocs * b->unit_size);
 
 	struct memory_block fm = heap_free_block(heap, defb, m, &ctx);
 	operation_process(&ctx);
@@ -1544,6 +2155,250 @@ out:
 	util_mutex_unlock(&b->lock);
 }
 
+/*
+ * heap_tcache_drain -- (internal) returns the oldest blocks from the thread
+ *	cache bin back to the buckets owning their runs
+ */
+static void
+heap_tcache_drain(struct palloc_heap *heap, struct tcache_bin *bin,
+	unsigned nblocks)
+{
+	ASSERT(nblocks <= bin->nblocks);
+
+	for (unsigned i = 0; i < nblocks; ++i) {
+		struct memory_block m = bin->blocks[i];
+
+		pthread_mutex_t *lock = heap_get_run_lock(heap, m.chunk_id);
+		heap_lock_run(heap, lock);
+
+		struct bucket *b = heap_get_chunk_bucket(heap,
+			m.chunk_id, m.zone_id);
+		ASSERTne(b, NULL);
+
+		/*
+		 * The block is already free in the persistent heap, so only the
+		 * transient state is coalesced here.
+		 */
+		heap_bucket_lock(b);
+		m = heap_free_block(heap, b, m, NULL);
+		CNT_OP(b, insert, heap, m);
+		util_mutex_unlock(&b->lock);
+
+		heap_degrade_run_if_empty(heap, b, m);
+
+		util_mutex_unlock(lock);
+	}
+
+	bin->nblocks -= nblocks;
+	memmove(bin->blocks, bin->blocks + nblocks,
+		bin->nblocks * sizeof(bin->blocks[0]));
+}
+
+/*
+ * heap_tcache_refill -- (internal) reserves a batch of single-unit blocks
+ *	from the bucket and moves them to an empty thread cache bin
+ */
+static int
+heap_tcache_refill(struct palloc_heap *heap, struct bucket *b,
+	struct tcache_bin *bin)
+{
+	ASSERTeq(bin->nblocks, 0);
+
+	int ret = 0;
+	struct memory_block m;
+
+	heap_bucket_lock(b);
+
+	while (bin->nblocks < TCACHE_BATCH) {
+		m = EMPTY_MEMORY_BLOCK;
+		m.size_idx = 1;
+
+		if (CNT_OP(b, get_rm_bestfit, &m) != 0) {
+			/* partially refilled cache is good enough */
+			if (bin->nblocks != 0)
+				break;
+
+			util_mutex_unlock(&b->lock);
+			if ((ret = heap_ensure_bucket_filled(heap, b, 1)) != 0)
+				return ret;
+			heap_bucket_lock(b);
+			continue;
+		}
+
+		uint32_t units = TCACHE_BATCH - bin->nblocks;
+		if (m.size_idx > units)
+			heap_recycle_block(heap, b, &m, units);
+
+		for (uint32_t i = 0; i < m.size_idx; ++i) {
+			struct memory_block *u = &bin->blocks[bin->nblocks++];
+			*u = m;
+			u->size_idx = 1;
+			u->block_off = (uint16_t)(m.block_off + i);
+		}
+	}
+
+	util_mutex_unlock(&b->lock);
+
+	/* blocks are popped from the end, so hand out lowest offsets first */
+	for (unsigned i = 0; i < bin->nblocks / 2; ++i) {
+		m = bin->blocks[i];
+		bin->blocks[i] = bin->blocks[bin->nblocks - i - 1];
+		bin->blocks[bin->nblocks - i - 1] = m;
+	}
+
+	return 0;
+}
+
+/*
+ * heap_tcache_delete -- (internal) deletes the thread cache and its bins
+ */
+static void
+heap_tcache_delete(struct heap_tcache *t)
+{
+	for (int i = 0; i < MAX_BUCKETS; ++i)
+		Free(t->bins[i]);
+
+	Free(t);
+}
+
+/*
+ * heap_tcache_destroy -- (internal) destructor of the thread cache, returns
+ *	all of the cached blocks to the heap on thread exit
+ */
+static void
+heap_tcache_destroy(void *arg)
+{
+	struct heap_tcache *t = arg;
+	struct heap_rt *rt = t->heap->rt;
+
+	/*
+	 * The cache is unlinked before it's drained, so that heap_cleanup
+	 * running concurrently doesn't free it and waits for the drain to
+	 * finish before the buckets are destroyed.
+	 */
+	util_mutex_lock(&rt->tcache_lock);
+	LIST_REMOVE(t, tcache);
+	rt->tcache_draining++;
+	util_mutex_unlock(&rt->tcache_lock);
+
+	for (int i = 0; i < MAX_BUCKETS; ++i) {
+		if (t->bins[i] != NULL)
+			heap_tcache_drain(t->heap, t->bins[i],
+				t->bins[i]->nblocks);
+	}
+
+	heap_tcache_delete(t);
+
+	util_mutex_lock(&rt->tcache_lock);
+	if (--rt->tcache_draining == 0)
+		pthread_cond_broadcast(&rt->tcache_drained);
+	util_mutex_unlock(&rt->tcache_lock);
+}
+
+/*
+ * heap_tcache_get_bin -- (internal) returns calling thread's cache bin for the
+ *	given allocation class
+ */
+static struct tcache_bin *
+heap_tcache_get_bin(struct palloc_heap *heap, uint8_t id)
+{
+	struct heap_rt *rt = heap->rt;
+	struct heap_tcache *t = pthread_getspecific(rt->tcache_key);
+
+	if (unlikely(t == NULL)) {
+		t = Zalloc(sizeof(*t));
+		if (t == NULL)
+			return NULL;
+
+		t->heap = heap;
+
+		int ret = pthread_setspecific(rt->tcache_key, t);
+		if (ret != 0) {
+			Free(t);
+			return NULL;
+		}
+
+		util_mutex_lock(&rt->tcache_lock);
+		LIST_INSERT_HEAD(&rt->tcaches, t, tcache);
+		util_mutex_unlock(&rt->tcache_lock);
+	}
+
+	if (unlikely(t->bins[id] == NULL)) {
+		t->bins[id] = Malloc(sizeof(struct tcache_bin));
+		if (t->bins[id] == NULL)
+			return NULL;
+
+		t->bins[id]->nblocks = 0;
+	}
+
+	return t->bins[id];
+}
+
+/*
+ * heap_tcache_eligible -- checks whether the memory block can be kept in
+ *	a thread cache
+ */
+int
+heap_tcache_eligible(struct bucket *b, struct memory_block m)
+{
+	return b != NULL && b->type == BUCKET_RUN && m.size_idx == 1;
+}
+
+/*
+ * heap_tcache_get -- reserves a single-unit memory block from the calling
+ *	thread's cache without taking any locks, unless the cache is empty and
+ *	has to be refilled from the bucket
+ */
+int
+heap_tcache_get(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *m)
+{
+	if (!heap_tcache_eligible(b, *m))
+		return EINVAL;
+
+	struct tcache_bin *bin = heap_tcache_get_bin(heap, b->id);
+	if (bin == NULL)
+		return ENOMEM;
+
+	if (bin->nblocks == 0) {
+		int ret = heap_tcache_refill(heap, b, bin);
+		if (ret != 0)
+			return ret;
+	}
+
+	*m = bin->blocks[--bin->nblocks];
+
+	return 0;
+}
+
+/*
+ * heap_tcache_put -- puts a freed single-unit memory block into the calling
+ *	thread's cache, draining a batch of blocks if the cache is full
+ *
+ * Must be called without holding any of the run locks.
+ */
+void
+heap_tcache_put(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block m)
+{
+	ASSERT(heap_tcache_eligible(b, m));
+
+	struct tcache_bin *bin = heap_tcache_get_bin(heap, b->id);
+	if (bin == NULL) {
+		pthread_mutex_t *lock = heap_get_run_lock(heap, m.chunk_id);
+		heap_lock_run(heap, lock);
+		CNT_OP(b, insert, heap, m);
+		heap_degrade_run_if_empty(heap, b, m);
+		util_mutex_unlock(lock);
+		return;
+	}
+
+	if (bin->nblocks == TCACHE_BIN_SIZE)
+		heap_tcache_drain(heap, bin, TCACHE_BATCH);
+
+	bin->blocks[bin->nblocks++] = m;
+}
+
 /*
  * heap_end -- returns first address after heap
  */
@@ -1579,6 +2434,295 @@ heap_get_ncaches(void)
 	return NCACHES_PER_CPU * heap_get_ncpus();
 }
 
+/*
+ * heap_get_run_container -- (internal) returns the type of the container
+ *	for run buckets, selected by the PMEMOBJ_RUN_CONTAINER variable
+ */
+static enum block_container_type
+heap_get_run_container(void)
+{
+	char *env = getenv("PMEMOBJ_RUN_CONTAINER");
+	if (env == NULL || strcmp(env, "ctree") == 0)
+		return CONTAINER_CTREE;
+
+	if (strcmp(env, "seglists") == 0)
+		return CONTAINER_SEGLISTS;
+
+	LOG(2, "unknown run container \"%s\", using ctree", env);
+
+	return CONTAINER_CTREE;
+}
+
+/*
+ * heap_get_zone_load_threads -- (internal) returns the number of threads
+ *	loading the zones at boot, selected by the PMEMOBJ_ZONE_LOAD_THREADS
+ *	variable, zero means the zones are loaded lazily
+ */
+static unsigned
+heap_get_zone_load_threads(void)
+{
+	char *env = getenv("PMEMOBJ_ZONE_LOAD_THREADS");
+	if (env == NULL)
+		return 0;
+
+	char *end;
+	errno = 0;
+	unsigned long n = strtoul(env, &end, 10);
+	if (errno != 0 || end == env || *end != '\0' || n > UINT_MAX) {
+		LOG(2, "invalid zone load threads \"%s\", loading lazily", env);
+		return 0;
+	}
+
+	return (unsigned)n;
+}
+
+/*
+ * heap_get_run_max_chunks -- (internal) returns the maximum number of chunks
+ *	a newly created run can span, selected by the PMEMOBJ_RUN_MAX_CHUNKS
+ *	variable
+ */
+static uint32_t
+heap_get_run_max_chunks(void)
+{
+	char *env = getenv("PMEMOBJ_RUN_MAX_CHUNKS");
+	if (env == NULL)
+		return RUN_MAX_CHUNKS_DEFAULT;
+
+	char *end;
+	errno = 0;
+	unsigned long n = strtoul(env, &end, 10);
+	if (errno != 0 || end == env || *end != '\0' ||
+			n == 0 || n > RUN_MAX_SIZE_IDX) {
+		LOG(2, "invalid run max chunks \"%s\", using %u", env,
+			RUN_MAX_CHUNKS_DEFAULT);
+		return RUN_MAX_CHUNKS_DEFAULT;
+	}
+
+	return (uint32_t)n;
+}
+
+/*
+ * heap_chunk_hdrs_delete -- (internal) deletes the DRAM copies of the chunk
+ *	headers
+ */
+static void
+heap_chunk_hdrs_delete(struct heap_rt *h)
+{
+	for (unsigned i = 0; i < h->max_zone; ++i)
+		Free(h->chunk_hdrs[i]);
+
+	Free(h->chunk_hdrs);
+}
+
+/*
+ * heap_chunk_hdrs_new -- (internal) creates the DRAM copies of the chunk
+ *	headers of all the zones
+ *
+ * Only the headers of the zones that are already initialized are copied, the
+ * footers are recreated from the headers. The copies of the other zones are
+ * filled when the zones are initialized.
+ */
+static int
+heap_chunk_hdrs_new(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+
+	h->chunk_hdrs = Zalloc(sizeof(struct chunk_header *) * h->max_zone);
+	if (h->chunk_hdrs == NULL)
+		return ENOMEM;
+
+	for (uint32_t i = 0; i < h->max_zone; ++i) {
+		uint32_t zone_size_idx = get_zone_size_idx(i, h->max_zone,
+			heap->size);
+
+		h->chunk_hdrs[i] = Zalloc(sizeof(struct chunk_header) *
+			zone_size_idx);
+		if (h->chunk_hdrs[i] == NULL) {
+			heap_chunk_hdrs_delete(h);
+			return ENOMEM;
+		}
+
+		struct zone *z = ZID_TO_ZONE(heap->layout, i);
+		if (z->header.magic != ZONE_HEADER_MAGIC)
+			continue;
+
+		for (uint32_t c = 0; c < z->header.size_idx; ) {
+			struct chunk_header hdr = z->chunk_headers[c];
+
+			/* corrupted headers are reported by heap_check */
+			if (hdr.size_idx == 0 ||
+				c + hdr.size_idx > z->header.size_idx)
+				break;
+
+			heap_chunk_hdr_copy(heap, i, c, hdr);
+			c += hdr.size_idx;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * heap_stats_delete -- (internal) deletes the runtime state of the statistics
+ */
+static void
+heap_stats_delete(struct heap_rt *h)
+{
+	if (h->run_units != NULL) {
+		for (unsigned i = 0; i < h->max_zone; ++i)
+			Free(h->run_units[i]);
+	}
+
+	Free(h->run_units);
+	Free(h->zone_extents);
+}
+
+/*
+ * heap_stats_run -- (internal) returns the number of allocated units of a run
+ *	found in the heap
+ */
+static uint16_t
+heap_stats_run(struct chunk_run *run, uint32_t size_idx, uint64_t *nallocs)
+{
+	uint64_t bs = run->block_size;
+
+	/* corrupted runs are reported by heap_check */
+	if (bs < MIN_RUN_SIZE || size_idx > RUN_MAX_SIZE_IDX ||
+			bs > RUN_DATA_SIZE(size_idx)) {
+		*nallocs = 0;
+		return 0;
+	}
+
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(bs, size_idx, &bm);
+	*nallocs = bm.nallocs;
+
+	uint64_t used = 0;
+	for (unsigned i = 0; i < bm.nval; ++i)
+		used += (uint64_t)__builtin_popcountll(run->bitmap[i]);
+
+	/* the bits past the last unit are always set */
+	uint64_t unused_last = (uint64_t)__builtin_popcountll(bm.lastval);
+	used = used > unused_last ? used - unused_last : 0;
+
+	return (uint16_t)(used < bm.nallocs ? used : bm.nallocs);
+}
+
+/*
+ * heap_stats_new -- (internal) calculates the initial statistics of the heap
+ *
+ * The chunk headers are taken from their DRAM copies, the free extents of
+ * every zone are kept aside until the zone is loaded and its free chunks are
+ * inserted into the default bucket.
+ */
+static int
+heap_stats_new(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+
+	h->nchunks = 0;
+	h->huge_chunks_allocated = 0;
+	h->runs = 0;
+	h->run_chunks = 0;
+	h->run_bytes_allocated = 0;
+	h->run_bytes_free = 0;
+	memset(h->class_stats, 0, sizeof(h->class_stats));
+
+	h->run_units = Zalloc(sizeof(uint16_t *) * h->max_zone);
+	h->zone_extents = Zalloc(sizeof(*h->zone_extents) * h->max_zone);
+	if (h->run_units == NULL || h->zone_extents == NULL)
+		goto error;
+
+	for (uint32_t i = 0; i < h->max_zone; ++i) {
+		uint32_t zone_size_idx = get_zone_size_idx(i, h->max_zone,
+			heap->size);
+		h->nchunks += zone_size_idx;
+
+		h->run_units[i] = Zalloc(sizeof(uint16_t) * zone_size_idx);
+		if (h->run_units[i] == NULL)
+			goto error;
+
+		struct zone *z = ZID_TO_ZONE(heap->layout, i);
+		if (z->header.magic != ZONE_HEADER_MAGIC) {
+			h->zone_extents[i][bucket_size_bin(zone_size_idx)]++;
+			continue;
+		}
+
+		uint64_t free_chunks = 0;
+		for (uint32_t c = 0; c < z->header.size_idx; ) {
+			struct chunk_header *hdr =
+				heap_get_chunk_hdr(heap, i, c);
+			if (hdr->size_idx == 0)
+				break;
+
+			if (hdr->type != CHUNK_TYPE_FREE && free_chunks != 0) {
+				h->zone_extents[i][
+					bucket_size_bin(free_chunks)]++;
+				free_chunks = 0;
+			}
+
+			struct chunk_run *run =
+				(struct chunk_run *)&z->chunks[c];
+			uint64_t nallocs;
+			uint16_t used;
+
+			switch (hdr->type) {
+			case CHUNK_TYPE_FREE:
+				free_chunks += hdr->size_idx;
+				break;
+			case CHUNK_TYPE_USED:
+				h->huge_chunks_allocated += hdr->size_idx;
+				break;
+			case CHUNK_TYPE_RUN:
+				used = heap_stats_run(run, hdr->size_idx,
+					&nallocs);
+				*heap_get_run_units(h, i, c) = used;
+
+				h->runs++;
+				h->run_chunks += hdr->size_idx;
+				h->run_bytes_allocated +=
+					used * run->block_size;
+				h->run_bytes_free +=
+					(nallocs - used) * run->block_size;
+				break;
+			default:
+				break;
+			}
+
+			c += hdr->size_idx;
+		}
+
+		if (free_chunks != 0)
+			h->zone_extents[i][bucket_size_bin(free_chunks)]++;
+	}
+
+	return 0;
+
+error:
+	heap_stats_delete(h);
+	return ENOMEM;
+}
+
+/*
+ * heap_verify_version -- (internal) verifies if the heap layout version is
+ *	supported by this library
+ *
+ * Heaps of older minor versions are a subset of the current layout, while
+ * a newer minor version may contain structures this library doesn't know,
+ * e.g. runs which span multiple chunks.
+ */
+static int
+heap_verify_version(struct heap_header *hdr)
+{
+	if (hdr->major != HEAP_MAJOR || hdr->minor > HEAP_MINOR) {
+		ERR("heap: unsupported version %ju.%ju", hdr->major,
+			hdr->minor);
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * heap_boot -- opens the heap region of the pmemobj pool
  *
@@ -1588,6 +2732,10 @@ int
 heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 		void *base, struct pmem_ops *p_ops)
 {
+	struct heap_layout *layout = heap_start;
+	if (heap_verify_version(&layout->header) != 0)
+		return EINVAL;
+
 	struct heap_rt *h = Malloc(sizeof(*h));
 	int err;
 	if (h == NULL) {
@@ -1604,19 +2752,41 @@ heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 
 	h->max_zone = heap_max_zone(heap_size);
 	h->zones_exhausted = 0;
+	h->run_container = heap_get_run_container();
+	h->zone_load_threads = heap_get_zone_load_threads();
+	h->run_max_chunks = heap_get_run_max_chunks();
 
 	util_mutex_init(&h->active_run_lock, NULL);
 
 	for (int i = 0; i < MAX_RUN_LOCKS; ++i)
 		util_mutex_init(&h->run_locks[i], NULL);
+	h->run_lock_contended = 0;
 
 	memset(h->last_drained, 0, sizeof(h->last_drained));
 
+	if ((err = pthread_key_create(&h->tcache_key,
+			heap_tcache_destroy)) != 0)
+		goto error_tcache_key_create;
+
+	if ((err = pthread_cond_init(&h->tcache_drained, NULL)) != 0)
+		goto error_tcache_cond_init;
+
+	util_mutex_init(&h->tcache_lock, NULL);
+	LIST_INIT(&h->tcaches);
+	h->tcache_draining = 0;
+
 	heap->p_ops = *p_ops;
 	heap->layout = heap_start;
 	heap->rt = h;
 	heap->size = heap_size;
 	heap->base = base;
+
+	if ((err = heap_chunk_hdrs_new(heap)) != 0)
+		goto error_chunk_hdrs_new;
+
+	if ((err = heap_stats_new(heap)) != 0)
+		goto error_stats_new;
+
 	VALGRIND_DO_CREATE_MEMPOOL(heap->layout, 0, 0);
 
 	bucket_group_init(h->buckets);
@@ -1626,6 +2796,18 @@ heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 
 	return 0;
 
+error_stats_new:
+	heap_chunk_hdrs_delete(h);
+error_chunk_hdrs_new:
+	util_mutex_destroy(&h->tcache_lock);
+	pthread_cond_destroy(&h->tcache_drained);
+error_tcache_cond_init:
+	pthread_key_delete(h->tcache_key);
+error_tcache_key_create:
+	for (int i = 0; i < MAX_RUN_LOCKS; ++i)
+		util_mutex_destroy(&h->run_locks[i]);
+	util_mutex_destroy(&h->active_run_lock);
+	Free(h->caches);
 error_heap_cache_malloc:
 	Free(h);
 	heap->rt = NULL;
@@ -1697,6 +2879,33 @@ heap_cleanup(struct palloc_heap *heap)
 {
 	struct heap_rt *rt = heap->rt;
 
+	/*
+	 * Deleting the key stops destructors of threads that exit from now on,
+	 * but not of those that are already running.
+	 */
+	pthread_key_delete(rt->tcache_key);
+
+	/*
+	 * The transient heap state is discarded anyway and blocks kept in the
+	 * thread caches are already free in the persistent heap, so the caches
+	 * of threads that are still alive are simply deleted. The caches being
+	 * drained by their destructors are no longer on the list, and the
+	 * buckets they return the blocks to can't go away until they're done.
+	 */
+	struct heap_tcache *t;
+	util_mutex_lock(&rt->tcache_lock);
+	while ((t = LIST_FIRST(&rt->tcaches)) != NULL) {
+		LIST_REMOVE(t, tcache);
+		heap_tcache_delete(t);
+	}
+
+	while (rt->tcache_draining != 0)
+		pthread_cond_wait(&rt->tcache_drained, &rt->tcache_lock);
+	util_mutex_unlock(&rt->tcache_lock);
+
+	util_mutex_destroy(&rt->tcache_lock);
+	pthread_cond_destroy(&rt->tcache_drained);
+
 	bucket_delete(rt->default_bucket);
 
 	bucket_group_destroy(rt->buckets);
@@ -1711,6 +2920,10 @@ heap_cleanup(struct palloc_heap *heap)
 
 	Free(rt->caches);
 
+	heap_chunk_hdrs_delete(rt);
+
+	heap_stats_delete(rt);
+
 	util_mutex_destroy(&rt->active_run_lock);
 
 	struct active_run *r;
@@ -1743,6 +2956,9 @@ heap_verify_header(struct heap_header *hdr)
 		return -1;
 	}
 
+	if (heap_verify_version(hdr) != 0)
+		return -1;
+
 	return 0;
 }
 
@@ -1783,6 +2999,44 @@ heap_verify_chunk_header(struct chunk_header *hdr)
 		return -1;
 	}
 
+	if (hdr->size_idx == 0) {
+		ERR("heap: invalid chunk size");
+		return -1;
+	}
+
+	if (hdr->type == CHUNK_TYPE_RUN && hdr->size_idx > RUN_MAX_SIZE_IDX) {
+		ERR("heap: invalid run size");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * heap_verify_runs -- (internal) verifies if the metadata of all runs in
+ *	the zone matches their sizes
+ *
+ * Must be called only on zones that were already verified.
+ */
+static int
+heap_verify_runs(struct zone *zone)
+{
+	if (zone->header.magic == 0)
+		return 0;
+
+	for (uint32_t i = 0; i < zone->header.size_idx; ) {
+		struct chunk_header *hdr = &zone->chunk_headers[i];
+		struct chunk_run *run = (struct chunk_run *)&zone->chunks[i];
+
+		if (hdr->type == CHUNK_TYPE_RUN && (run->block_size == 0 ||
+			run->block_size > RUN_DATA_SIZE(hdr->size_idx))) {
+			ERR("heap: invalid run block size");
+			return -1;
+		}
+
+		i += hdr->size_idx;
+	}
+
 	return 0;
 }
 
@@ -1843,7 +3097,8 @@ heap_check(void *heap_start, uint64_t heap_size)
 		return -1;
 
 	for (unsigned i = 0; i < heap_max_zone(layout->header.size); ++i) {
-		if (heap_verify_zone(ZID_TO_ZONE(layout, i)))
+		struct zone *zone = ZID_TO_ZONE(layout, i);
+		if (heap_verify_zone(zone) || heap_verify_runs(zone))
 			return -1;
 	}
 
@@ -1900,46 +3155,67 @@ heap_check_remote(void *heap_start, uint64_t heap_size, struct remote_ops *ops)
 }
 
 /*
- * heap_run_foreach_object -- (internal) iterates through objects in a run
+ * heap_run_value -- (internal) returns the i-th bitmap value of a run without
+ *	the bits past the last unit, which are always set
  */
-static int
-heap_run_foreach_object(struct palloc_heap *heap, object_callback cb,
-		void *arg, struct chunk_run *run)
+static uint64_t
+heap_run_value(struct chunk_run *run, uint64_t bitmap_nallocs, uint64_t i)
+{
+	uint64_t v = run->bitmap[i];
+	uint64_t block_off = BITS_PER_VALUE * i;
+
+	if (bitmap_nallocs - block_off < BITS_PER_VALUE)
+		v &= heap_bit_range(0, (unsigned)(bitmap_nallocs - block_off));
+
+	return v;
+}
+
+/*
+ * heap_run_next_object -- (internal) removes the first object from the set
+ *	of allocated units of a bitmap value and returns its header
+ *
+ * The units of an object never span two bitmap values.
+ */
+static struct allocation_header *
+heap_run_next_object(struct chunk_run *run, uint64_t i, uint64_t *v)
 {
+	ASSERTne(*v, 0);
+
 	uint64_t bs = run->block_size;
-	uint64_t block_off;
+	unsigned j = (unsigned)__builtin_ctzll(*v);
 
-	uint64_t bitmap_nallocs = RUN_NALLOCS(bs);
-	uint64_t unused_bits = RUN_BITMAP_SIZE - bitmap_nallocs;
-	uint64_t unused_values = unused_bits / BITS_PER_VALUE;
-	uint64_t bitmap_nval = MAX_BITMAP_VALUES - unused_values;
+	struct allocation_header *alloc = (struct allocation_header *)
+		(run->data + (BITS_PER_VALUE * i + j) * bs);
 
-	struct allocation_header *alloc;
+	uint64_t end = j + alloc->size / bs;
+	ASSERT(end > j);
+	if (end > BITS_PER_VALUE)
+		end = BITS_PER_VALUE;
 
-	uint64_t i = 0;
-	uint64_t block_start = 0;
+	*v &= ~heap_bit_range(j, (unsigned)end);
 
-	for (; i < bitmap_nval; ++i) {
-		uint64_t v = run->bitmap[i];
-		block_off = (BITS_PER_VALUE * (uint64_t)i);
+	return alloc;
+}
 
-		for (uint64_t j = block_start; j < BITS_PER_VALUE; ) {
+/*
+ * heap_run_foreach_object -- (internal) iterates through objects in a run
+ */
+static int
+heap_run_foreach_object(struct palloc_heap *heap, object_callback cb,
+		void *arg, struct chunk_run *run, uint32_t size_idx)
+{
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(run->block_size, size_idx, &bm);
 
-			if (block_off + j >= bitmap_nallocs)
-				break;
+	for (uint64_t i = 0; i < bm.nval; ++i) {
+		uint64_t v = heap_run_value(run, bm.nallocs, i);
 
-			if (!BIT_IS_CLR(v, j)) {
-				alloc = (struct allocation_header *)
-					(run->data + (block_off + j) * bs);
-				if (cb(PMALLOC_PTR_TO_OFF(heap, alloc), arg)
-						!= 0)
-					return 1;
-				j += (alloc->size / bs);
-			} else {
-				++j;
-			}
+		while (v != 0) {
+			struct allocation_header *alloc =
+				heap_run_next_object(run, i, &v);
+			if (cb(PMALLOC_PTR_TO_OFF(heap, alloc), arg) != 0)
+				return 1;
 		}
-		block_start = 0;
 	}
 
 	return 0;
@@ -1959,7 +3235,7 @@ heap_chunk_foreach_object(struct palloc_heap *heap, object_callback cb,
 			return cb(PMALLOC_PTR_TO_OFF(heap, chunk), arg);
 		case CHUNK_TYPE_RUN:
 			return heap_run_foreach_object(heap, cb, arg,
-				(struct chunk_run *)chunk);
+				(struct chunk_run *)chunk, hdr->size_idx);
 		default:
 			ASSERT(0);
 	}
@@ -1972,13 +3248,13 @@ heap_chunk_foreach_object(struct palloc_heap *heap, object_callback cb,
  */
 static int
 heap_zone_foreach_object(struct palloc_heap *heap, object_callback cb,
-	void *arg, struct zone *zone, struct memory_block start)
+	void *arg, struct zone *zone)
 {
 	if (zone->header.magic == 0)
 		return 0;
 
 	uint32_t i;
-	for (i = start.chunk_id; i < zone->header.size_idx; ) {
+	for (i = 0; i < zone->header.size_idx; ) {
 		if (heap_chunk_foreach_object(heap, cb, arg,
 			&zone->chunk_headers[i], &zone->chunks[i]) != 0)
 			return 1;
@@ -1990,19 +3266,287 @@ heap_zone_foreach_object(struct palloc_heap *heap, object_callback cb,
 }
 
 /*
- * heap_foreach_object -- (internal) iterates through objects in the heap
+ * heap_iter_init -- positions the iterator before the first object of
+ *	the given zone range
  */
 void
-heap_foreach_object(struct palloc_heap *heap, object_callback cb, void *arg,
-	struct memory_block start)
+heap_iter_init(struct palloc_heap *heap, struct palloc_iter *it,
+	uint32_t zone_start, uint32_t zone_end)
 {
-	struct heap_layout *layout = heap->layout;
+	uint32_t max_zone = heap->rt->max_zone;
+
+	it->zone_id = zone_start;
+	it->zone_end = zone_end < max_zone ? zone_end : max_zone;
+	it->chunk_id = 0;
+	it->value = 0;
+	it->objs = 0;
+	it->in_run = 0;
+}
+
+/*
+ * heap_iter_seek -- positions the iterator right after the given block
+ */
+void
+heap_iter_seek(struct palloc_heap *heap, struct palloc_iter *it,
+	struct memory_block m)
+{
+	heap_iter_init(heap, it, m.zone_id, UINT32_MAX);
+
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_header *hdr = &z->chunk_headers[m.chunk_id];
+
+	it->chunk_id = m.chunk_id;
+
+	if (hdr->type != CHUNK_TYPE_RUN) {
+		it->chunk_id += hdr->size_idx;
+		return;
+	}
+
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(run->block_size, hdr->size_idx, &bm);
+
+	it->in_run = 1;
+	it->value = m.block_off / BITS_PER_VALUE;
+	it->objs = heap_run_value(run, bm.nallocs, it->value);
+
+	uint64_t end = m.block_off % BITS_PER_VALUE + m.size_idx;
+	if (end > BITS_PER_VALUE)
+		end = BITS_PER_VALUE;
+
+	it->objs &= ~heap_bit_range(0, (unsigned)end);
+}
+
+/*
+ * heap_iter_run_next -- (internal) returns the next object of the run
+ *	the iterator is positioned in, NULL if there are no more
+ */
+static struct allocation_header *
+heap_iter_run_next(struct chunk_run *run, uint32_t size_idx,
+	struct palloc_iter *it)
+{
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(run->block_size, size_idx, &bm);
+
+	while (it->objs == 0) {
+		if (++it->value >= bm.nval)
+			return NULL;
+
+		it->objs = heap_run_value(run, bm.nallocs, it->value);
+	}
+
+	return heap_run_next_object(run, it->value, &it->objs);
+}
+
+/*
+ * heap_iter_next -- returns the offset of the next object and advances
+ *	the iterator, 0 if there are no more objects
+ *
+ * Every call resumes the walk of the heap metadata where the previous one
+ * stopped, so iterating through the entire heap is linear in the number of
+ * chunks and objects. Just like the rest of the object iteration, this
+ * doesn't take any of the heap locks.
+ */
+uint64_t
+heap_iter_next(struct palloc_heap *heap, struct palloc_iter *it)
+{
+	while (it->zone_id < it->zone_end) {
+		struct zone *z = ZID_TO_ZONE(heap->layout, it->zone_id);
+		if (z->header.magic == 0 ||
+				it->chunk_id >= z->header.size_idx) {
+			it->zone_id++;
+			it->chunk_id = 0;
+			continue;
+		}
+
+		struct chunk_header *hdr = &z->chunk_headers[it->chunk_id];
+		struct chunk *chunk = &z->chunks[it->chunk_id];
+
+		if (it->in_run) {
+			struct allocation_header *alloc = heap_iter_run_next(
+				(struct chunk_run *)chunk, hdr->size_idx, it);
+			if (alloc != NULL)
+				return PMALLOC_PTR_TO_OFF(heap, alloc);
+
+			it->in_run = 0;
+			it->chunk_id += hdr->size_idx;
+			continue;
+		}
+
+		switch (hdr->type) {
+			case CHUNK_TYPE_FREE:
+				break;
+			case CHUNK_TYPE_USED:
+				it->chunk_id += hdr->size_idx;
+				return PMALLOC_PTR_TO_OFF(heap, chunk);
+			case CHUNK_TYPE_RUN: {
+				struct chunk_run *run =
+					(struct chunk_run *)chunk;
+				struct run_bitmap bm;
+				bucket_run_calc_bitmap(run->block_size,
+					hdr->size_idx, &bm);
+				it->in_run = 1;
+				it->value = 0;
+				it->objs = heap_run_value(run, bm.nallocs, 0);
+				continue;
+			}
+			default:
+				ASSERT(0);
+		}
+
+		it->chunk_id += hdr->size_idx;
+	}
+
+	return 0;
+}
+
+struct heap_foreach_ctx {
+	struct palloc_heap *heap;
+	object_callback cb;
+	void *arg;
+	uint32_t next_zone;
+	uint32_t max_zone;
+	int stop; /* accessed atomically, set by the first callback to stop */
+};
+
+/*
+ * heap_foreach_cb -- (internal) calls the user callback unless one of the
+ *	threads already stopped the iteration
+ */
+static int
+heap_foreach_cb(uint64_t off, void *arg)
+{
+	struct heap_foreach_ctx *ctx = arg;
+
+	if (__atomic_load_n(&ctx->stop, __ATOMIC_ACQUIRE))
+		return 1;
+
+	if (ctx->cb(off, ctx->arg) != 0) {
+		__atomic_store_n(&ctx->stop, 1, __ATOMIC_RELEASE);
+		return 1;
+	}
+
+	return 0;
+}
 
-	for (unsigned i = start.zone_id;
-		i < heap_max_zone(layout->header.size); ++i)
-		if (heap_zone_foreach_object(heap, cb, arg,
-				ZID_TO_ZONE(layout, i), start) != 0)
+/*
+ * heap_foreach_worker -- (internal) iterates through objects of the zones
+ *	until none are left or the iteration is stopped
+ */
+static void *
+heap_foreach_worker(void *arg)
+{
+	struct heap_foreach_ctx *ctx = arg;
+	uint32_t zone_id;
+
+	while ((zone_id = __sync_fetch_and_add(&ctx->next_zone, 1)) <
+			ctx->max_zone) {
+		if (heap_zone_foreach_object(ctx->heap, heap_foreach_cb, ctx,
+				ZID_TO_ZONE(ctx->heap->layout, zone_id)) != 0)
 			break;
+	}
+
+	return NULL;
+}
+
+/*
+ * heap_foreach_object_parallel -- iterates through objects in the heap
+ *	using the given number of threads, including the calling one
+ *
+ * The zones are distributed between the threads, so the callback is called
+ * concurrently and objects are not visited in the heap order. Returns 1 if
+ * the iteration was stopped by the callback.
+ */
+int
+heap_foreach_object_parallel(struct palloc_heap *heap, object_callback cb,
+	void *arg, unsigned nthreads)
+{
+	struct heap_foreach_ctx ctx = {heap, cb, arg, 0,
+		heap->rt->max_zone, 0};
+
+	if (nthreads > ctx.max_zone)
+		nthreads = ctx.max_zone;
+
+	util_run_parallel(heap_foreach_worker, &ctx, nthreads);
+
+	return __atomic_load_n(&ctx.stop, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * heap_get_stats -- gathers the statistics of the heap
+ *
+ * All of the values are taken from the counters which are updated whenever
+ * a block or a run changes its state, the cost doesn't depend on the size
+ * of the heap.
+ */
+void
+heap_get_stats(struct palloc_heap *heap, struct pobj_heap_stats *stats)
+{
+	COMPILE_ERROR_ON(POBJ_MAX_ALLOC_CLASSES != MAX_BUCKETS);
+	COMPILE_ERROR_ON(POBJ_FREE_EXTENT_BINS != CONTAINER_SIZE_BINS);
+
+	struct heap_rt *rt = heap->rt;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (uint8_t i = 0; i < MAX_BUCKETS; ++i) {
+		struct bucket *b = rt->buckets[i];
+		if (b == NULL || b == BUCKET_RESERVED)
+			continue;
+
+		struct pobj_alloc_class_stats *c = &stats->classes[i];
+		struct heap_class_stats *cs = &rt->class_stats[i];
+		c->unit_size = b->unit_size;
+		c->runs = cs->runs;
+		c->bytes_allocated = cs->units_allocated * b->unit_size;
+		c->bytes_free = cs->units_free * b->unit_size;
+		for (unsigned j = 0; j < POBJ_RUN_OCCUPANCY_BINS; ++j)
+			c->run_occupancy[j] = cs->run_occupancy[j];
+
+		c->lock_contended = b->lock_contended;
+		for (unsigned j = 0; j < rt->ncaches; ++j) {
+			struct bucket *cb = rt->caches[j].buckets[i];
+			if (cb == NULL)
+				continue;
+
+			c->lock_contended += cb->lock_contended;
+
+			if (cb->type != BUCKET_RUN)
+				continue;
+
+			struct bucket_run *cr = (struct bucket_run *)cb;
+			c->steals += cr->steals;
+			c->bytes_stolen += cr->units_stolen * cb->unit_size;
+		}
+
+		stats->active_runs += c->runs;
+		stats->steals += c->steals;
+		stats->bytes_stolen += c->bytes_stolen;
+	}
+
+	uint64_t huge_allocated = rt->huge_chunks_allocated;
+	uint64_t run_chunks = rt->run_chunks;
+	stats->huge_bytes_allocated = huge_allocated * CHUNKSIZE;
+	stats->huge_bytes_free = (rt->nchunks - huge_allocated - run_chunks) *
+		CHUNKSIZE;
+
+	/* free chunks of the loaded zones are kept in the default bucket */
+	struct block_container *bc = rt->default_bucket->container;
+	for (unsigned i = 0; i < POBJ_FREE_EXTENT_BINS; ++i)
+		stats->free_extents[i] = bc->nblocks[i];
+
+	for (uint32_t i = rt->zones_exhausted; i < rt->max_zone; ++i) {
+		for (unsigned j = 0; j < POBJ_FREE_EXTENT_BINS; ++j)
+			stats->free_extents[j] += rt->zone_extents[i][j];
+	}
+
+	stats->runs = rt->runs;
+	stats->run_chunks = run_chunks;
+	stats->run_bytes_allocated = rt->run_bytes_allocated;
+	stats->run_bytes_free = rt->run_bytes_free;
+
+	stats->huge_lock_contended = rt->default_bucket->lock_contended;
+	stats->run_lock_contended = rt->run_lock_contended;
 }
 
 #ifdef USE_VG_MEMCHECK
@@ -2018,12 +3562,14 @@ heap_vg_open_chunk(struct palloc_heap *heap,
 	if (hdr->type == CHUNK_TYPE_RUN) {
 		struct chunk_run *run = chunk;
 
-		VALGRIND_DO_MAKE_MEM_NOACCESS(run, sizeof(*run));
+		VALGRIND_DO_MAKE_MEM_NOACCESS(run,
+			hdr->size_idx * CHUNKSIZE);
 		VALGRIND_DO_MAKE_MEM_DEFINED(run,
 			sizeof(*run) - sizeof(run->data));
 
 		if (objects) {
-			int ret = heap_run_foreach_object(heap, cb, arg, run);
+			int ret = heap_run_foreach_object(heap, cb, arg, run,
+				hdr->size_idx);
 			ASSERTeq(ret, 0);
 		}
 	} else {
@@ -77,7 +77,11 @@ struct bucket *heap_get_best_bucket(struct palloc_heap *heap, size_t size);
 struct bucket *heap_get_chunk_bucket(struct palloc_heap *heap,
 		uint32_t chunk_id, uint32_t zone_id);
 struct bucket *heap_get_auxiliary_bucket(struct palloc_heap *heap,
-		size_t size);
+		uint8_t bucket_id);
+struct bucket *heap_get_class_bucket(struct palloc_heap *heap,
+		uint8_t class_id);
+int heap_create_alloc_class(struct palloc_heap *heap, size_t unit_size,
+	unsigned units_per_run, uint8_t *class_id);
 void heap_drain_to_auxiliary(struct palloc_heap *heap, struct bucket *auxb,
 	uint32_t size_idx);
 void *heap_get_block_data(struct palloc_heap *heap, struct memory_block m);
@@ -85,6 +89,8 @@ void *heap_get_block_data(struct palloc_heap *heap, struct memory_block m);
 int heap_get_adjacent_free_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m, struct memory_block cnt, int prev);
 void heap_chunk_write_footer(struct chunk_header *hdr, uint32_t size_idx);
+struct chunk_header *heap_get_chunk_hdr(struct palloc_heap *heap,
+	uint32_t zone_id, uint32_t chunk_id);
 
 int heap_get_bestfit_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m);
@@ -93,14 +99,30 @@ int heap_get_exact_block(struct palloc_heap *heap, struct bucket *b,
 void heap_degrade_run_if_empty(struct palloc_heap *heap, struct bucket *b,
 		struct memory_block m);
 
+int heap_tcache_eligible(struct bucket *b, struct memory_block m);
+int heap_tcache_get(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *m);
+void heap_tcache_put(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block m);
+
 pthread_mutex_t *heap_get_run_lock(struct palloc_heap *heap,
 		uint32_t chunk_id);
+void heap_lock_run(struct palloc_heap *heap, pthread_mutex_t *lock);
 
 struct memory_block heap_free_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block m, struct operation_context *ctx);
-
-void heap_foreach_object(struct palloc_heap *heap, object_callback cb,
-	void *arg, struct memory_block start);
+void heap_account_block(struct palloc_heap *heap, struct memory_block m,
+	enum memblock_state op);
+
+void heap_get_stats(struct palloc_heap *heap, struct pobj_heap_stats *stats);
+
+void heap_iter_init(struct palloc_heap *heap, struct palloc_iter *it,
+	uint32_t zone_start, uint32_t zone_end);
+void heap_iter_seek(struct palloc_heap *heap, struct palloc_iter *it,
+	struct memory_block m);
+uint64_t heap_iter_next(struct palloc_heap *heap, struct palloc_iter *it);
+int heap_foreach_object_parallel(struct palloc_heap *heap, object_callback cb,
+	void *arg, unsigned nthreads);
 
 void *heap_end(struct palloc_heap *heap);
 
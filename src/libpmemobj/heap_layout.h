@@ -41,7 +41,7 @@
 #include <stdint.h>
 
 #define HEAP_MAJOR 1
-#define HEAP_MINOR 0
+#define HEAP_MINOR 1 /* runs may span multiple chunks */
 
 #define MAX_CHUNK (UINT16_MAX - 7) /* has to be multiple of 8 */
 #define CHUNKSIZE ((size_t)1024 * 256)	/* 256 kilobytes */
@@ -61,6 +61,15 @@
 #define RUNSIZE (CHUNKSIZE - RUN_METASIZE)
 #define MIN_RUN_SIZE 128
 
+/*
+ * A run may consist of several contiguous chunks, in which case the data
+ * area of the run extends over all of them. The run metadata, including the
+ * bitmap, is located only at the beginning of the first chunk.
+ */
+#define RUN_MAX_SIZE_IDX 64
+#define RUN_DATA_SIZE(size_idx)\
+	(RUNSIZE + ((size_t)(size_idx) - 1) * CHUNKSIZE)
+
 #define ZID_TO_ZONE(layoutp, zone_id)\
 	((struct zone *)((uintptr_t)&(((struct heap_layout *)(layoutp))->zone0)\
 					+ ZONE_MAX_SIZE * (zone_id)))
@@ -41,6 +41,9 @@
 #include <errno.h>
 #include <limits.h>
 #include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "libpmemobj.h"
 #include "cuckoo.h"
@@ -207,14 +210,17 @@ lane_destroy(PMEMobjpool *pop, struct lane *lane)
 }
 
 /*
- * lane_boot -- initializes all lanes
+ * lane_boot -- initializes the lanes available at runtime
  */
 int
 lane_boot(PMEMobjpool *pop)
 {
 	int err = 0;
 
-	pop->lanes_desc.lane = Malloc(sizeof(struct lane) * pop->nlanes);
+	unsigned nlanes = pop->lanes_desc.runtime_nlanes;
+	ASSERT(nlanes <= pop->nlanes);
+
+	pop->lanes_desc.lane = Malloc(sizeof(struct lane) * nlanes);
 	if (pop->lanes_desc.lane == NULL) {
 		err = ENOMEM;
 		ERR("!Malloc of volatile lanes");
@@ -222,9 +228,15 @@ lane_boot(PMEMobjpool *pop)
 	}
 
 	pop->lanes_desc.next_lane_idx = 0;
+	pop->lanes_desc.release_seq = 0;
+	pop->lanes_desc.nwaiters = 0;
+	pop->lanes_desc.waits = 0;
+	pop->lanes_desc.wait_ns = 0;
+	pop->lanes_desc.handoffs = 0;
+	pop->lanes_desc.migrations = 0;
 
 	pop->lanes_desc.lane_locks =
-		Zalloc(sizeof(*pop->lanes_desc.lane_locks) * pop->nlanes);
+		Zalloc(sizeof(*pop->lanes_desc.lane_locks) * nlanes);
 	if (pop->lanes_desc.lane_locks == NULL) {
 		ERR("!Malloc for lane locks");
 		goto error_locks_malloc;
@@ -235,7 +247,7 @@ lane_boot(PMEMobjpool *pop)
 		(sizeof(struct lane_layout) * pop->nlanes));
 
 	uint64_t i;
-	for (i = 0; i < pop->nlanes; ++i) {
+	for (i = 0; i < nlanes; ++i) {
 		struct lane_layout *layout = lane_get_layout(pop, i);
 
 		if ((err = lane_init(pop, &pop->lanes_desc.lane[i], layout))) {
@@ -264,7 +276,7 @@ error_lanes_malloc:
 void
 lane_cleanup(PMEMobjpool *pop)
 {
-	for (uint64_t i = 0; i < pop->nlanes; ++i)
+	for (uint64_t i = 0; i < pop->lanes_desc.runtime_nlanes; ++i)
 		lane_destroy(pop, &pop->lanes_desc.lane[i]);
 
 	Free(pop->lanes_desc.lane);
@@ -276,28 +288,123 @@ lane_cleanup(PMEMobjpool *pop)
 }
 
 /*
- * lane_recover_and_boot -- performs initialization and recovery of all lanes
+ * lane_get_recovery_threads -- (internal) returns the number of threads
+ *	recovering and checking the lanes, selected by the
+ *	PMEMOBJ_RECOVERY_THREADS variable
+ */
+static unsigned
+lane_get_recovery_threads(PMEMobjpool *pop)
+{
+	unsigned n;
+
+	char *env = getenv("PMEMOBJ_RECOVERY_THREADS");
+	if (env != NULL) {
+		char *end;
+		errno = 0;
+		unsigned long val = strtoul(env, &end, 10);
+		if (errno != 0 || end == env || *end != '\0' ||
+				val == 0 || val > UINT_MAX) {
+			LOG(2, "invalid recovery threads \"%s\", using one",
+				env);
+			return 1;
+		}
+		n = (unsigned)val;
+	} else {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n = cpus < 1 ? 1 : (unsigned)cpus;
+		if (n > LANE_RECOVERY_THREADS_DEFAULT_MAX)
+			n = LANE_RECOVERY_THREADS_DEFAULT_MAX;
+	}
+
+	if (n > pop->nlanes)
+		n = (unsigned)pop->nlanes;
+
+	return n;
+}
+
+struct lane_section_walk {
+	PMEMobjpool *pop;
+	int section;
+	section_layout_op op;
+	const char *op_name;
+
+	uint64_t next_lane;
+	int err;
+};
+
+/*
+ * lane_section_walk_worker -- (internal) calls the operation on the section
+ *	of the lanes until none are left or any of the calls fails
+ */
+static void *
+lane_section_walk_worker(void *arg)
+{
+	struct lane_section_walk *w = arg;
+	uint64_t j; /* lane index */
+
+	while ((j = __sync_fetch_and_add(&w->next_lane, 1)) <
+			w->pop->nlanes) {
+		if (__atomic_load_n(&w->err, __ATOMIC_RELAXED) != 0)
+			break;
+
+		struct lane_layout *layout = lane_get_layout(w->pop, j);
+		int err = w->op(w->pop, &layout->sections[w->section],
+			sizeof(layout->sections[w->section]));
+
+		if (err != 0) {
+			LOG(2, "section_ops->%s %d %ju %d", w->op_name,
+				w->section, j, err);
+			__sync_bool_compare_and_swap(&w->err, 0, err);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * lane_section_walk -- (internal) calls the operation on the given section of
+ *	all lanes using the given number of threads, including the calling one
+ *
+ * Every lane is handled by a single thread. The order in which the lanes are
+ * processed is not defined if there's more than one thread.
+ */
+static int
+lane_section_walk(PMEMobjpool *pop, int section, section_layout_op op,
+	const char *op_name, unsigned nthreads)
+{
+	struct lane_section_walk w = {pop, section, op, op_name, 0, 0};
+
+	util_run_parallel(lane_section_walk_worker, &w, nthreads);
+
+	return w.err;
+}
+
+/*
+ * lane_recover_and_section_boot -- performs initialization and recovery of
+ *	all lanes
+ *
+ * The sections are recovered one after another, because the recovery of
+ * the list and transaction sections requires a booted heap. The lanes of
+ * a single section are recovered in parallel.
  */
 int
 lane_recover_and_section_boot(PMEMobjpool *pop)
 {
 	int err = 0;
 	int i; /* section index */
-	uint64_t j; /* lane index */
-	struct lane_layout *layout;
+	struct timespec start;
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	unsigned nthreads = lane_get_recovery_threads(pop);
 
 	for (i = 0; i < MAX_LANE_SECTION; ++i) {
-		for (j = 0; j < pop->nlanes; ++j) {
-			layout = lane_get_layout(pop, j);
-			err = Section_ops[i]->recover(pop, &layout->sections[i],
-				sizeof(layout->sections[i]));
-
-			if (err != 0) {
-				LOG(2, "section_ops->recover %d %ju %d",
-					i, j, err);
-				return err;
-			}
-		}
+		err = lane_section_walk(pop, i, Section_ops[i]->recover,
+			"recover", nthreads);
+		if (err != 0)
+			return err;
 
 		if ((err = Section_ops[i]->boot(pop)) != 0) {
 			LOG(2, "section_ops->init %d %d", i, err);
@@ -305,6 +412,16 @@ lane_recover_and_section_boot(PMEMobjpool *pop)
 		}
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	pop->lanes_desc.recovery_threads = nthreads;
+	pop->lanes_desc.recovery_ns =
+		(uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+		(uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+
+	LOG(3, "lanes recovered in %ju ns using %u threads",
+		pop->lanes_desc.recovery_ns, nthreads);
+
 	return err;
 }
 
@@ -316,44 +433,113 @@ lane_check(PMEMobjpool *pop)
 {
 	int err = 0;
 	int i; /* section index */
-	uint64_t j; /* lane index */
-	struct lane_layout *layout;
+
+	unsigned nthreads = lane_get_recovery_threads(pop);
 
 	for (i = 0; i < MAX_LANE_SECTION; ++i) {
-		for (j = 0; j < pop->nlanes; ++j) {
-			layout = lane_get_layout(pop, j);
-			err = Section_ops[i]->check(pop, &layout->sections[i],
-					sizeof(layout->sections[i]));
+		err = lane_section_walk(pop, i, Section_ops[i]->check,
+			"check", nthreads);
+		if (err != 0)
+			return err;
+	}
 
-			if (err) {
-				LOG(2, "section_ops->check %d %ju %d",
-					i, j, err);
+	return err;
+}
 
-				return err;
-			}
-		}
+/*
+ * lane_try_all -- (internal) makes a single pass over all of the lanes,
+ *	starting from the given index, and tries to grab one of them
+ */
+static inline int
+lane_try_all(uint64_t *locks, uint64_t *index, uint64_t nlocks)
+{
+	for (uint64_t i = 0; i < nlocks; ++i) {
+		*index %= nlocks;
+		if (util_bool_compare_and_swap64(&locks[*index], 0, 1))
+			return 1;
+
+		++(*index);
 	}
 
-	return err;
+	return 0;
+}
+
+/*
+ * lane_wait -- (internal) sleeps until a lane is released and grabs it
+ *
+ * A waiter announces itself in nwaiters before the last pass over the lanes,
+ * so a lane released after that pass is always seen by the releasing thread,
+ * which bumps release_seq and wakes a waiter up.
+ */
+static void
+lane_wait(struct lane_descriptor *ld, uint64_t *index, uint64_t nlocks)
+{
+	struct timespec start;
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (1) {
+		uint32_t seq = __atomic_load_n(&ld->release_seq,
+			__ATOMIC_ACQUIRE);
+		__sync_fetch_and_add(&ld->nwaiters, 1);
+
+		int got = lane_try_all(ld->lane_locks, index, nlocks);
+		if (!got)
+			util_futex_wait(&ld->release_seq, seq);
+
+		__sync_fetch_and_sub(&ld->nwaiters, 1);
+
+		if (got)
+			break;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	uint64_t ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+		(uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+
+	__sync_fetch_and_add(&ld->waits, 1);
+	__sync_fetch_and_add(&ld->wait_ns, ns);
 }
 
 /*
  * get_lane -- (internal) get free lane index
+ *
+ * The thread's preferred lane is tried first. If it turns out to be busy
+ * too many times in a row, the lane the thread ends up with becomes the
+ * preferred one. When all of the lanes are taken, the thread sleeps until
+ * one of them is released instead of spinning.
  */
 static inline void
-get_lane(uint64_t *locks, uint64_t *index, uint64_t nlocks)
+get_lane(struct lane_descriptor *ld, struct lane_info *info, uint64_t nlocks)
 {
-	while (1) {
-		do {
-			*index %= nlocks;
-			if (likely(util_bool_compare_and_swap64(
-					&locks[*index], 0, 1)))
-				return;
+	uint64_t *locks = ld->lane_locks;
 
-			++(*index);
-		} while (*index < nlocks);
+	info->primary %= nlocks;
+	info->lane_idx = info->primary;
 
-		sched_yield();
+	if (likely(util_bool_compare_and_swap64(
+			&locks[info->lane_idx], 0, 1))) {
+		info->primary_attempts = LANE_PRIMARY_ATTEMPTS;
+		return;
+	}
+
+	if (info->primary_attempts > 0)
+		info->primary_attempts--;
+
+	++info->lane_idx;
+	if (!lane_try_all(locks, &info->lane_idx, nlocks))
+		lane_wait(ld, &info->lane_idx, nlocks);
+
+	if (info->lane_idx == info->primary)
+		return;
+
+	__sync_fetch_and_add(&ld->migrations, 1);
+
+	if (info->primary_attempts == 0) {
+		info->primary = info->lane_idx;
+		info->primary_attempts = LANE_PRIMARY_ATTEMPTS;
 	}
 }
 
@@ -382,6 +568,8 @@ get_lane_info_record(PMEMobjpool *pop)
 		}
 		info->pop_uuid_lo = pop->uuid_lo;
 		info->lane_idx = UINT64_MAX;
+		info->primary = UINT64_MAX;
+		info->primary_attempts = LANE_PRIMARY_ATTEMPTS;
 		info->nest_count = 0;
 		info->next = Lane_info_records;
 		info->prev = NULL;
@@ -422,16 +610,15 @@ lane_hold(PMEMobjpool *pop, struct lane_section **section,
 	}
 
 	struct lane_info *lane = get_lane_info_record(pop);
-	while (unlikely(lane->lane_idx == UINT64_MAX)) {
+	while (unlikely(lane->primary == UINT64_MAX)) {
 		/* initial wrap to next CL */
-		lane->lane_idx = __sync_fetch_and_add(
+		lane->primary = __sync_fetch_and_add(
 			&pop->lanes_desc.next_lane_idx, LANE_JUMP);
 	} /* handles wraparound */
 
-	uint64_t *llocks = pop->lanes_desc.lane_locks;
 	/* grab next free lane from lanes available at runtime */
 	if (!lane->nest_count++)
-		get_lane(llocks, &lane->lane_idx,
+		get_lane(&pop->lanes_desc, lane,
 			pop->lanes_desc.runtime_nlanes);
 
 	if (section) {
@@ -461,10 +648,37 @@ lane_release(PMEMobjpool *pop)
 	if (unlikely(lane->nest_count == 0)) {
 		FATAL("lane_release");
 	} else if (--(lane->nest_count) == 0) {
+		struct lane_descriptor *ld = &pop->lanes_desc;
+
 		if (unlikely(!util_bool_compare_and_swap64(
-				&pop->lanes_desc.lane_locks[lane->lane_idx],
-				1, 0))) {
+				&ld->lane_locks[lane->lane_idx], 1, 0))) {
 			FATAL("util_bool_compare_and_swap64");
 		}
+
+		/* the swap above is a full barrier */
+		if (unlikely(__atomic_load_n(&ld->nwaiters,
+				__ATOMIC_RELAXED) != 0)) {
+			__sync_fetch_and_add(&ld->release_seq, 1);
+			util_futex_wake(&ld->release_seq, 1);
+			__sync_fetch_and_add(&ld->handoffs, 1);
+		}
 	}
 }
+
+/*
+ * lane_stats -- gathers the lane acquisition statistics
+ */
+void
+lane_stats(PMEMobjpool *pop, struct pobj_lane_stats *stats)
+{
+	struct lane_descriptor *ld = &pop->lanes_desc;
+
+	stats->nlanes = ld->runtime_nlanes;
+	stats->waits = __atomic_load_n(&ld->waits, __ATOMIC_RELAXED);
+	stats->wait_ns = __atomic_load_n(&ld->wait_ns, __ATOMIC_RELAXED);
+	stats->handoffs = __atomic_load_n(&ld->handoffs, __ATOMIC_RELAXED);
+	stats->migrations = __atomic_load_n(&ld->migrations,
+		__ATOMIC_RELAXED);
+	stats->recovery_ns = ld->recovery_ns;
+	stats->recovery_threads = ld->recovery_threads;
+}
@@ -56,6 +56,18 @@
 
 #define RLANE_DEFAULT 0
 
+/*
+ * Number of times a thread fails to get its preferred lane before the lane
+ * it actually got becomes the preferred one.
+ */
+#define LANE_PRIMARY_ATTEMPTS 128
+
+/*
+ * Maximum number of threads recovering the lanes when the number isn't
+ * selected explicitly.
+ */
+#define LANE_RECOVERY_THREADS_DEFAULT_MAX 8
+
 enum lane_section_type {
 	LANE_SECTION_ALLOCATOR,
 	LANE_SECTION_LIST,
@@ -96,6 +108,22 @@ struct lane_descriptor {
 	unsigned next_lane_idx;
 	uint64_t *lane_locks;
 	struct lane *lane;
+
+	/*
+	 * Threads which found all of the lanes busy sleep on the futex word
+	 * release_seq, which is bumped by every release that sees nwaiters
+	 * different from zero.
+	 */
+	uint32_t release_seq;
+	uint32_t nwaiters;
+
+	uint64_t waits;		/* acquisitions that had to sleep */
+	uint64_t wait_ns;	/* total time spent sleeping */
+	uint64_t handoffs;	/* releases that woke up a waiter */
+	uint64_t migrations;	/* acquisitions of a non-preferred lane */
+
+	uint64_t recovery_ns;	/* time spent recovering the lanes at open */
+	unsigned recovery_threads; /* number of threads recovering the lanes */
 };
 
 typedef int (*section_layout_op)(PMEMobjpool *pop, void *data, unsigned length);
@@ -114,6 +142,8 @@ struct section_operations {
 struct lane_info {
 	uint64_t pop_uuid_lo;
 	uint64_t lane_idx;
+	uint64_t primary;
+	int primary_attempts;
 	unsigned long nest_count;
 	struct lane_info *prev, *next;
 };
@@ -131,6 +161,7 @@ int lane_check(PMEMobjpool *pop);
 unsigned lane_hold(PMEMobjpool *pop, struct lane_section **section,
 	enum lane_section_type type);
 void lane_release(PMEMobjpool *pop);
+void lane_stats(PMEMobjpool *pop, struct pobj_lane_stats *stats);
 
 #ifndef _MSC_VER
 
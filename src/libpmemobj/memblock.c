@@ -126,7 +126,8 @@ run_block_offset(struct memory_block *m, struct palloc_heap *heap, void *ptr)
 
 	void *data = heap_get_block_data(heap, *m);
 	uintptr_t diff = (uintptr_t)ptr - (uintptr_t)data;
-	ASSERT(diff <= RUNSIZE);
+	ASSERT(diff <= RUN_DATA_SIZE(ZID_TO_ZONE(heap->layout, m->zone_id)->
+		chunk_headers[m->chunk_id].size_idx));
 	ASSERT((size_t)diff / block_size <= UINT16_MAX);
 	ASSERT(diff % block_size == 0);
 	uint16_t block_off = (uint16_t)((size_t)diff / block_size);
@@ -152,6 +153,36 @@ chunk_get_chunk_hdr_value(uint16_t type, uint32_t size_idx)
 	return val;
 }
 
+/*
+ * huge_prep_operation_hdr_copy -- prepares the new value of the DRAM copy of
+ *	a chunk header and its footer
+ *
+ * The copy is updated together with the transient part of the operation, so
+ * it never reflects a state that is not yet persistent.
+ */
+static void
+huge_prep_operation_hdr_copy(struct memory_block *m, struct palloc_heap *heap,
+	enum memblock_state op, struct operation_context *ctx)
+{
+	struct chunk_header *hdr = heap_get_chunk_hdr(heap, m->zone_id,
+		m->chunk_id);
+
+	uint64_t val = chunk_get_chunk_hdr_value(
+		op == MEMBLOCK_ALLOCATED ? CHUNK_TYPE_USED : CHUNK_TYPE_FREE,
+		m->size_idx);
+
+	operation_add_typed_entry(ctx, hdr, val, OPERATION_SET,
+		ENTRY_TRANSIENT);
+
+	if (m->size_idx == 1)
+		return;
+
+	val = chunk_get_chunk_hdr_value(CHUNK_TYPE_FOOTER, m->size_idx);
+
+	operation_add_typed_entry(ctx, hdr + m->size_idx - 1, val,
+		OPERATION_SET, ENTRY_TRANSIENT);
+}
+
 /*
  * huge_prep_operation_hdr -- prepares the new value of a chunk header that will
  *	be set after the operation concludes.
@@ -173,6 +204,8 @@ huge_prep_operation_hdr(struct memory_block *m, struct palloc_heap *heap,
 
 	operation_add_entry(ctx, hdr, val, OPERATION_SET);
 
+	huge_prep_operation_hdr_copy(m, heap, op, ctx);
+
 	/*
 	 * In the case of chunks larger than one unit the footer must be
 	 * created immediately AFTER the persistent state is safely updated.
@@ -129,8 +129,9 @@ enum memory_block_type {
 	 */
 	MEMORY_BLOCK_HUGE,
 	/*
-	 * Run memory blocks are chunks with CHUNK_TYPE_RUN and size index of 1.
-	 * The entire chunk is subdivided into smaller blocks and has an
+	 * Run memory blocks are chunks with CHUNK_TYPE_RUN and size index of
+	 * one or more - a run can span multiple contiguous chunks.
+	 * The entire run is subdivided into smaller blocks and has an
 	 * additional metadata attached in the form of a bitmap - each bit
 	 * corresponds to a single block.
 	 * In this case there's no need to perform any coalescing or splitting
@@ -165,6 +166,13 @@ enum memblock_state {
 enum memory_block_type memblock_autodetect_type(struct memory_block *m,
 	struct heap_layout *h);
 
+/*
+ * Maximum number of transient entries prep_hdr adds to the operation context,
+ * a huge memory block needs the chunk footer and the DRAM copies of the chunk
+ * header and footer.
+ */
+#define MEMBLOCK_MAX_TRANSIENT_ENTRIES 3
+
 struct memory_block_ops {
 	size_t (*block_size)(struct memory_block *m, struct heap_layout *h);
 	uint16_t (*block_offset)(struct memory_block *m,
@@ -63,10 +63,141 @@ operation_init(struct operation_context *ctx, const void *base,
 	else
 		ctx->p_ops = NULL;
 
+	ctx->linked = NULL;
+	ctx->ext[ENTRY_PERSISTENT] = NULL;
+	ctx->ext[ENTRY_TRANSIENT] = NULL;
+
 	ctx->nentries[ENTRY_PERSISTENT] = 0;
 	ctx->nentries[ENTRY_TRANSIENT] = 0;
 }
 
+/*
+ * operation_entries -- (internal) returns the array of entries of given type
+ */
+static inline struct operation_entry *
+operation_entries(struct operation_context *ctx,
+	enum operation_entry_type en_type)
+{
+	return ctx->ext[en_type] ? ctx->ext[en_type]->entries :
+		ctx->entries[en_type];
+}
+
+/*
+ * operation_ext_slot -- (internal) returns the slot of the hash table with
+ *	the number of the entry at given location, or the empty one where it
+ *	belongs
+ */
+static size_t *
+operation_ext_slot(struct operation_ext *ext, void *ptr)
+{
+	uint64_t h = ((uint64_t)(uintptr_t)ptr >> 3) * 0x9E3779B97F4A7C15ULL;
+	size_t i = (size_t)(h ^ (h >> 32)) & ext->index_mask;
+
+	/* the table is at least twice as big as the array of entries */
+	while (ext->index[i] != 0 &&
+			ext->entries[ext->index[i] - 1].ptr != ptr)
+		i = (i + 1) & ext->index_mask;
+
+	return &ext->index[i];
+}
+
+/*
+ * operation_ext_new -- (internal) moves the entries of given type to the
+ *	storage for the given number of them
+ */
+static int
+operation_ext_new(struct operation_context *ctx,
+	enum operation_entry_type en_type, size_t capacity)
+{
+	struct operation_ext *ext = Malloc(sizeof(*ext));
+	if (ext == NULL)
+		goto err_ext;
+
+	size_t slots = 1;
+	while (slots < capacity * 2)
+		slots <<= 1;
+
+	ext->capacity = capacity;
+	ext->index_mask = slots - 1;
+	ext->entries = Malloc(sizeof(*ext->entries) * capacity);
+	if (ext->entries == NULL)
+		goto err_entries;
+
+	ext->index = Zalloc(sizeof(*ext->index) * slots);
+	if (ext->index == NULL)
+		goto err_index;
+
+	for (size_t i = 0; i < ctx->nentries[en_type]; ++i) {
+		ext->entries[i] = ctx->entries[en_type][i];
+		*operation_ext_slot(ext, ext->entries[i].ptr) = i + 1;
+	}
+
+	ctx->ext[en_type] = ext;
+
+	return 0;
+
+err_index:
+	Free(ext->entries);
+err_entries:
+	Free(ext);
+err_ext:
+	ERR("!Malloc");
+	return -1;
+}
+
+/*
+ * operation_reserve -- makes room for the given number of entries of both
+ *	types, the persistent entries which don't fit in the redo log are
+ *	committed through the array of linked redo log entries
+ *
+ * The operation has to be finished with operation_fini.
+ */
+int
+operation_reserve(struct operation_context *ctx, struct redo_log *linked,
+	size_t npersistent, size_t ntransient)
+{
+	if (npersistent > MAX_PERSITENT_ENTRIES) {
+		ASSERTne(linked, NULL);
+		ASSERTeq(ctx->ext[ENTRY_PERSISTENT], NULL);
+
+		if (operation_ext_new(ctx, ENTRY_PERSISTENT, npersistent) != 0)
+			return -1;
+
+		ctx->linked = linked;
+	}
+
+	if (ntransient > MAX_TRANSIENT_ENTRIES) {
+		ASSERTeq(ctx->ext[ENTRY_TRANSIENT], NULL);
+
+		if (operation_ext_new(ctx, ENTRY_TRANSIENT, ntransient) != 0) {
+			operation_fini(ctx);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * operation_fini -- releases the storage reserved for the operation
+ */
+void
+operation_fini(struct operation_context *ctx)
+{
+	for (int i = 0; i < MAX_OPERATION_ENTRY_TYPE; ++i) {
+		struct operation_ext *ext = ctx->ext[i];
+		if (ext == NULL)
+			continue;
+
+		Free(ext->index);
+		Free(ext->entries);
+		Free(ext);
+		ctx->ext[i] = NULL;
+	}
+
+	ctx->linked = NULL;
+}
+
 /*
  * operation_perform -- (internal) performs a operation on the field
  */
@@ -98,8 +229,12 @@ operation_add_typed_entry(struct operation_context *ctx,
 	void *ptr, uint64_t value,
 	enum operation_type type, enum operation_entry_type en_type)
 {
-	ASSERT(ctx->nentries[ENTRY_PERSISTENT] <= MAX_PERSITENT_ENTRIES);
-	ASSERT(ctx->nentries[ENTRY_TRANSIENT] <= MAX_TRANSIENT_ENTRIES);
+	struct operation_ext *ext = ctx->ext[en_type];
+
+	ASSERT(ctx->ext[ENTRY_PERSISTENT] != NULL ||
+		ctx->nentries[ENTRY_PERSISTENT] <= MAX_PERSITENT_ENTRIES);
+	ASSERT(ctx->ext[ENTRY_TRANSIENT] != NULL ||
+		ctx->nentries[ENTRY_TRANSIENT] <= MAX_TRANSIENT_ENTRIES);
 
 	/*
 	 * New entry to be added to the operations, all operations eventually
@@ -107,26 +242,42 @@ operation_add_typed_entry(struct operation_context *ctx,
 	 */
 	struct operation_entry en = {ptr, value, OPERATION_SET};
 
-	struct operation_entry *e; /* existing entry */
-	for (size_t i = 0; i < ctx->nentries[en_type]; ++i) {
-		e = &ctx->entries[en_type][i];
-		/* update existing and exit, no reason to add new op */
-		if (e->ptr == ptr) {
-			operation_perform(&e->value, value, type);
-
-			return;
+	struct operation_entry *entries = operation_entries(ctx, en_type);
+	struct operation_entry *e = NULL; /* existing entry */
+	size_t *slot = NULL;
+	if (ext != NULL) {
+		slot = operation_ext_slot(ext, ptr);
+		if (*slot != 0)
+			e = &entries[*slot - 1];
+	} else {
+		for (size_t i = 0; i < ctx->nentries[en_type]; ++i) {
+			if (entries[i].ptr == ptr) {
+				e = &entries[i];
+				break;
+			}
 		}
 	}
 
+	/* update existing and exit, no reason to add new op */
+	if (e != NULL) {
+		operation_perform(&e->value, value, type);
+
+		return;
+	}
+
 	if (type == OPERATION_AND || type == OPERATION_OR) {
 		/* change the new entry to current value and apply logic op */
 		en.value = *(uint64_t *)ptr;
 		operation_perform(&en.value, value, type);
 	}
 
-	ctx->entries[en_type][ctx->nentries[en_type]] = en;
+	ASSERT(ext == NULL || ctx->nentries[en_type] < ext->capacity);
+
+	entries[ctx->nentries[en_type]] = en;
 
 	ctx->nentries[en_type]++;
+	if (slot != NULL)
+		*slot = ctx->nentries[en_type];
 }
 
 /*
@@ -171,10 +322,34 @@ operation_process_persistent_redo(struct operation_context *ctx)
 {
 	struct operation_entry *e;
 	const struct redo_ctx *redo = ctx->redo_ctx;
+	struct operation_entry *entries =
+		operation_entries(ctx, ENTRY_PERSISTENT);
 
 	size_t i;
+	if (ctx->nentries[ENTRY_PERSISTENT] > MAX_PERSITENT_ENTRIES) {
+		/*
+		 * All of the entries are linked by the first one of the redo
+		 * log, so they are processed only once the log is complete.
+		 */
+		ASSERTne(ctx->linked, NULL);
+
+		for (i = 0; i < ctx->nentries[ENTRY_PERSISTENT]; ++i) {
+			e = &entries[i];
+
+			redo_log_store_linked(redo, ctx->linked, i,
+				(uintptr_t)e->ptr - (uintptr_t)ctx->base,
+				e->value);
+		}
+
+		redo_log_store_link(redo, ctx->redo, 0, ctx->linked, i);
+		redo_log_set_last(redo, ctx->redo, 0);
+		redo_log_process(redo, ctx->redo, 1);
+
+		return;
+	}
+
 	for (i = 0; i < ctx->nentries[ENTRY_PERSISTENT]; ++i) {
-		e = &ctx->entries[ENTRY_PERSISTENT][i];
+		e = &entries[i];
 
 		redo_log_store(redo, ctx->redo, i,
 				(uintptr_t)e->ptr - (uintptr_t)ctx->base,
@@ -204,7 +379,7 @@ operation_process(struct operation_context *ctx)
 	 * atomic.
 	 */
 	if (ctx->nentries[ENTRY_PERSISTENT] == 1) {
-		e = &ctx->entries[ENTRY_PERSISTENT][0];
+		e = &operation_entries(ctx, ENTRY_PERSISTENT)[0];
 
 		VALGRIND_ADD_TO_TX(e->ptr, sizeof(uint64_t));
 
@@ -217,8 +392,10 @@ operation_process(struct operation_context *ctx)
 		operation_process_persistent_redo(ctx);
 	}
 
+	struct operation_entry *transient =
+		operation_entries(ctx, ENTRY_TRANSIENT);
 	for (size_t i = 0; i < ctx->nentries[ENTRY_TRANSIENT]; ++i) {
-		e = &ctx->entries[ENTRY_TRANSIENT][i];
+		e = &transient[i];
 		*e->ptr = e->value;
 		/*
 		 * Just in case that the entry was transient but in reality
@@ -57,7 +57,8 @@ struct operation_entry {
 	enum operation_type type;
 };
 
-#define MAX_TRANSIENT_ENTRIES 10
+/* enough for the transient entries of MAX_PERSITENT_ENTRIES memory blocks */
+#define MAX_TRANSIENT_ENTRIES 30
 #define MAX_PERSITENT_ENTRIES 10
 
 enum operation_entry_type {
@@ -67,6 +68,17 @@ enum operation_entry_type {
 	MAX_OPERATION_ENTRY_TYPE
 };
 
+/*
+ * operation_ext -- storage of an operation with more entries than fit in
+ *	the context, see operation_reserve
+ */
+struct operation_ext {
+	size_t capacity;
+	struct operation_entry *entries;
+	size_t *index; /* hash table of entry numbers (plus one) by location */
+	size_t index_mask;
+};
+
 /*
  * operation_context -- context of an ongoing palloc operation
  */
@@ -77,9 +89,13 @@ struct operation_context {
 	struct redo_log *redo;
 	const struct pmem_ops *p_ops;
 
+	/* persistent entries which don't fit in the redo log, if reserved */
+	struct redo_log *linked;
+	struct operation_ext *ext[MAX_OPERATION_ENTRY_TYPE];
+
 	size_t nentries[MAX_OPERATION_ENTRY_TYPE];
 	struct operation_entry
-		entries[MAX_OPERATION_ENTRY_TYPE][MAX_PERSITENT_ENTRIES];
+		entries[MAX_OPERATION_ENTRY_TYPE][MAX_TRANSIENT_ENTRIES];
 };
 
 void operation_init(struct operation_context *ctx, const void *base,
@@ -92,5 +108,8 @@ void operation_add_typed_entry(struct operation_context *ctx,
 void operation_add_entries(struct operation_context *ctx,
 	struct operation_entry *entries, size_t nentries);
 void operation_process(struct operation_context *ctx);
+int operation_reserve(struct operation_context *ctx, struct redo_log *linked,
+	size_t npersistent, size_t ntransient);
+void operation_fini(struct operation_context *ctx);
 
 #endif
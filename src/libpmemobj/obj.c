@@ -34,6 +34,7 @@
  * obj.c -- transactional object store implementation
  */
 #include <limits.h>
+#include <inttypes.h>
 
 #include "valgrind_internal.h"
 #include "libpmem.h"
@@ -47,6 +48,7 @@
 #include "set.h"
 #include "sync.h"
 #include "tx.h"
+#include "type_index.h"
 
 static struct cuckoo *pools_ht; /* hash table used for searching by UUID */
 static struct ctree *pools_tree; /* tree used for searching by address */
@@ -677,6 +679,30 @@ pmemobj_boot(PMEMobjpool *pop)
 	return 0;
 }
 
+/*
+ * obj_get_nlanes -- (internal) returns the number of lanes selected by the
+ *	PMEMOBJ_NLANES variable
+ */
+static unsigned
+obj_get_nlanes(void)
+{
+	char *env = getenv("PMEMOBJ_NLANES");
+	if (env == NULL)
+		return OBJ_NLANES;
+
+	char *end;
+	errno = 0;
+	unsigned long n = strtoul(env, &end, 10);
+	if (errno != 0 || end == env || *end != '\0' ||
+			n == 0 || n > OBJ_NLANES_MAX) {
+		LOG(2, "invalid number of lanes \"%s\", using %u", env,
+			OBJ_NLANES);
+		return OBJ_NLANES;
+	}
+
+	return (unsigned)n;
+}
+
 /*
  * pmemobj_descr_create -- (internal) create obj pool descriptor
  */
@@ -702,19 +728,24 @@ pmemobj_descr_create(PMEMobjpool *pop, const char *layout, size_t poolsize)
 	pmemops_persist(p_ops, &pop->run_id, sizeof(pop->run_id));
 
 	pop->lanes_offset = OBJ_LANES_OFFSET;
-	pop->nlanes = OBJ_NLANES;
+	pop->nlanes = obj_get_nlanes();
 	pop->root_offset = 0;
 
-	/* zero all lanes */
-	void *lanes_layout = (void *)((uintptr_t)pop + pop->lanes_offset);
-	pmemops_memset_persist(p_ops, lanes_layout, 0,
-				pop->nlanes * sizeof(struct lane_layout));
-
 	pop->heap_offset = pop->lanes_offset +
 		pop->nlanes * sizeof(struct lane_layout);
 	pop->heap_offset = (pop->heap_offset + Pagesize - 1) & ~(Pagesize - 1);
+	if (pop->heap_offset >= poolsize) {
+		ERR("pool too small for %ju lanes", pop->nlanes);
+		errno = EINVAL;
+		return -1;
+	}
 	pop->heap_size = poolsize - pop->heap_offset;
 
+	/* zero all lanes */
+	void *lanes_layout = (void *)((uintptr_t)pop + pop->lanes_offset);
+	pmemops_memset_persist(p_ops, lanes_layout, 0,
+				pop->nlanes * sizeof(struct lane_layout));
+
 	/* initialize heap prior to storing the checksum */
 	errno = palloc_init((char *)pop + pop->heap_offset, pop->heap_size,
 			p_ops);
@@ -793,6 +824,14 @@ pmemobj_descr_check(PMEMobjpool *pop, const char *layout, size_t poolsize)
 		return -1;
 	}
 
+	if (pop->nlanes == 0 || pop->nlanes > OBJ_NLANES_MAX ||
+	    pop->lanes_offset + pop->nlanes * sizeof(struct lane_layout) >
+	    pop->heap_offset) {
+		ERR("invalid number of lanes: %ju", pop->nlanes);
+		errno = EINVAL;
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -973,6 +1012,10 @@ pmemobj_runtime_init(PMEMobjpool *pop, int rdonly, int boot, unsigned nlanes)
 
 	pop->uuid_lo = pmemobj_get_uuid_lo(pop);
 
+	/* the pool may have been created with fewer lanes than requested */
+	if (nlanes > pop->nlanes)
+		nlanes = (unsigned)pop->nlanes;
+
 	pop->lanes_desc.runtime_nlanes = nlanes;
 
 	if (boot) {
@@ -1054,9 +1097,9 @@ pmemobj_create(const char *path, const char *layout, size_t poolsize,
 	 * A number of lanes available at runtime equals the lowest value
 	 * from all reported by remote replicas hosts. In the single host mode
 	 * the runtime number of lanes is equal to the total number of lanes
-	 * available in the pool.
+	 * available in the pool, unless limited by PMEMOBJ_NLANES.
 	 */
-	unsigned runtime_nlanes = OBJ_NLANES;
+	unsigned runtime_nlanes = obj_get_nlanes();
 
 	if (util_pool_create(&set, path, poolsize, PMEMOBJ_MIN_POOL,
 			OBJ_HDR_SIG, OBJ_FORMAT_MAJOR,
@@ -1154,9 +1197,10 @@ pmemobj_check_basic_local(PMEMobjpool *pop)
 		consistent = 0;
 	}
 
-	errno = palloc_heap_check((char *)pop + pop->heap_offset,
-			pop->heap_size);
-	if (errno != 0) {
+	/* the heap check reports -1 on failure, not an error number */
+	if (palloc_heap_check((char *)pop + pop->heap_offset,
+			pop->heap_size) != 0) {
+		errno = EINVAL;
 		LOG(2, "!heap_check");
 		consistent = 0;
 	}
@@ -1216,9 +1260,9 @@ pmemobj_check_basic_remote(PMEMobjpool *pop)
 
 	/* XXX add lane_check_remote */
 
-	errno = palloc_heap_check_remote((char *)pop + pop->heap_offset,
-			pop->heap_size, &pop->p_ops.remote);
-	if (errno != 0) {
+	if (palloc_heap_check_remote((char *)pop + pop->heap_offset,
+			pop->heap_size, &pop->p_ops.remote) != 0) {
+		errno = EINVAL;
 		LOG(2, "!heap_check_remote");
 		consistent = 0;
 	}
@@ -1260,9 +1304,9 @@ pmemobj_open_common(const char *path, const char *layout, int cow, int boot)
 	 * A number of lanes available at runtime equals the lowest value
 	 * from all reported by remote replicas hosts. In the single host mode
 	 * the runtime number of lanes is equal to the total number of lanes
-	 * available in the pool.
+	 * available in the pool, unless limited by PMEMOBJ_NLANES.
 	 */
-	unsigned runtime_nlanes = OBJ_NLANES;
+	unsigned runtime_nlanes = obj_get_nlanes();
 
 	if (util_pool_open(&set, path, cow, PMEMOBJ_MIN_POOL,
 			OBJ_HDR_SIG, OBJ_FORMAT_MAJOR,
@@ -1441,6 +1485,7 @@ obj_pool_cleanup(PMEMobjpool *pop)
 {
 	LOG(3, "pop %p", pop);
 
+	type_index_cleanup(pop);
 	palloc_heap_cleanup(&pop->heap);
 
 	lane_cleanup(pop);
@@ -1624,7 +1669,7 @@ static int
 obj_alloc_construct(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	type_num_t type_num, int zero_init,
 	pmemobj_constr constructor,
-	void *arg)
+	void *arg, uint8_t class_id)
 {
 	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
 		ERR("requested size too large");
@@ -1650,7 +1695,7 @@ obj_alloc_construct(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 
 	int ret = pmalloc_operation(&pop->heap, 0,
 			oidp != NULL ? &oidp->off : NULL, size + OBJ_OOB_SIZE,
-			constructor_alloc_bytype, &carg, &ctx);
+			constructor_alloc_bytype, &carg, class_id, &ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -1678,7 +1723,49 @@ pmemobj_alloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	}
 
 	return obj_alloc_construct(pop, oidp, size, type_num,
-			0, constructor, arg);
+			0, constructor, arg, 0);
+}
+
+/*
+ * pmemobj_xalloc -- allocates a new object with the provided flags
+ */
+int
+pmemobj_xalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+	uint64_t type_num, uint64_t flags,
+	pmemobj_constr constructor, void *arg)
+{
+	LOG(3, "pop %p oidp %p size %zu type_num %llx flags %llx "
+		"constructor %p arg %p",
+		pop, oidp, size, (unsigned long long)type_num,
+		(unsigned long long)flags,
+		constructor, arg);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	if (size == 0) {
+		ERR("allocation with size 0");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (flags & ~(POBJ_FLAG_ZERO | POBJ_XALLOC_CLASS_MASK)) {
+		ERR("unknown flags 0x%" PRIx64,
+			flags & ~(POBJ_FLAG_ZERO | POBJ_XALLOC_CLASS_MASK));
+		errno = EINVAL;
+		return -1;
+	}
+
+	uint64_t class_id = (flags & POBJ_XALLOC_CLASS_MASK) >> 48;
+	if (class_id > UINT8_MAX) {
+		ERR("invalid allocation class %" PRIu64, class_id);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return obj_alloc_construct(pop, oidp, size, type_num,
+			(flags & POBJ_FLAG_ZERO) != 0, constructor, arg,
+			(uint8_t)class_id);
 }
 
 /* arguments for constructor_realloc and constructor_zrealloc */
@@ -1712,7 +1799,7 @@ pmemobj_zalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	}
 
 	return obj_alloc_construct(pop, oidp, size, type_num,
-					1, NULL, NULL);
+					1, NULL, NULL, 0);
 }
 
 /*
@@ -1731,7 +1818,7 @@ obj_free(PMEMobjpool *pop, PMEMoid *oidp)
 	operation_add_entry(&ctx, &oidp->pool_uuid_lo, 0, OPERATION_SET);
 
 	pmalloc_operation(&pop->heap, oidp->off, &oidp->off, 0, NULL, NULL,
-			&ctx);
+			0, &ctx);
 
 	pmalloc_redo_release(pop);
 }
@@ -1786,7 +1873,7 @@ obj_realloc_common(PMEMobjpool *pop,
 			return 0;
 
 		return obj_alloc_construct(pop, oidp, size, type_num,
-				zero_init, NULL, NULL);
+				zero_init, NULL, NULL, 0);
 	}
 
 	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
@@ -1822,13 +1909,14 @@ obj_realloc_common(PMEMobjpool *pop,
 	if (type_num == user_type_old) {
 		ret = pmalloc_operation(&pop->heap, oidp->off, &oidp->off,
 			size + OBJ_OOB_SIZE,
-			constructor_realloc, &carg, &ctx);
+			constructor_realloc, &carg, 0, &ctx);
 	} else {
 		operation_add_entry(&ctx, &pobj->type_num, type_num,
 				OPERATION_SET);
 
 		ret = pmalloc_operation(&pop->heap, oidp->off, &oidp->off,
-			size + OBJ_OOB_SIZE, constructor_realloc, &carg, &ctx);
+			size + OBJ_OOB_SIZE, constructor_realloc, &carg, 0,
+			&ctx);
 	}
 	pmalloc_redo_release(pop);
 
@@ -1954,7 +2042,7 @@ pmemobj_strdup(PMEMobjpool *pop, PMEMoid *oidp, const char *s,
 	carg.s = s;
 
 	return obj_alloc_construct(pop, oidp, carg.size,
-		(type_num_t)type_num, 0, constructor_strdup, &carg);
+		(type_num_t)type_num, 0, constructor_strdup, &carg, 0);
 }
 
 /*
@@ -1981,6 +2069,123 @@ pmemobj_free(PMEMoid *oidp)
 	obj_free(pop, oidp);
 }
 
+/*
+ * pmemobj_reserve -- reserves a new object without allocating it persistently
+ */
+PMEMoid
+pmemobj_reserve(PMEMobjpool *pop, struct pobj_action *act,
+	size_t size, uint64_t type_num)
+{
+	LOG(3, "pop %p act %p size %zu type_num %llx",
+		pop, act, size, (unsigned long long)type_num);
+
+	PMEMoid oid = OID_NULL;
+
+	if (size == 0) {
+		ERR("allocation with size 0");
+		errno = EINVAL;
+		return oid;
+	}
+
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("requested size too large");
+		errno = ENOMEM;
+		return oid;
+	}
+
+	struct carg_bytype carg;
+
+	carg.user_type = type_num;
+	carg.zero_init = 0;
+	carg.constructor = NULL;
+	carg.arg = NULL;
+
+	if (pmalloc_reserve(&pop->heap, size + OBJ_OOB_SIZE,
+			constructor_alloc_bytype, &carg, act) != 0)
+		return oid;
+
+	oid.pool_uuid_lo = pop->uuid_lo;
+	oid.off = act->heap.offset;
+
+	return oid;
+}
+
+/*
+ * pmemobj_set_value -- creates an action that sets the value on publish
+ */
+void
+pmemobj_set_value(PMEMobjpool *pop, struct pobj_action *act,
+	uint64_t *ptr, uint64_t value)
+{
+	LOG(3, "pop %p act %p ptr %p value %ju", pop, act, ptr, value);
+
+	palloc_set_value(&pop->heap, act, ptr, value);
+}
+
+/*
+ * pmemobj_publish -- persistently commits all of the actions
+ */
+int
+pmemobj_publish(PMEMobjpool *pop, struct pobj_action *actv, size_t actvcnt)
+{
+	LOG(3, "pop %p actv %p actvcnt %zu", pop, actv, actvcnt);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	int ret = pmalloc_publish(pop, actv, actvcnt);
+
+	if (ret == 0) {
+		for (size_t i = 0; i < actvcnt; ++i) {
+			if (actv[i].type == POBJ_ACTION_TYPE_HEAP)
+				type_index_insert(pop, actv[i].heap.offset);
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * pmemobj_cancel -- releases the reservations of all of the actions
+ */
+void
+pmemobj_cancel(PMEMobjpool *pop, struct pobj_action *actv, size_t actvcnt)
+{
+	LOG(3, "pop %p actv %p actvcnt %zu", pop, actv, actvcnt);
+
+	palloc_cancel(&pop->heap, actv, actvcnt);
+}
+
+/*
+ * pmemobj_alloc_class_new -- registers a new allocation class
+ */
+int
+pmemobj_alloc_class_new(PMEMobjpool *pop, struct pobj_alloc_class_desc *desc)
+{
+	LOG(3, "pop %p desc %p", pop, desc);
+
+	int ret = palloc_alloc_class_new(&pop->heap, desc);
+	if (ret != 0) {
+		errno = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_heap_stats -- gathers the statistics of the pool's heap
+ */
+int
+pmemobj_heap_stats(PMEMobjpool *pop, struct pobj_heap_stats *stats)
+{
+	LOG(3, "pop %p stats %p", pop, stats);
+
+	palloc_heap_stats(&pop->heap, stats);
+
+	return 0;
+}
+
 /*
  * pmemobj_alloc_usable_size -- returns usable size of object
  */
@@ -2164,13 +2369,26 @@ obj_realloc_root(PMEMobjpool *pop, size_t size,
 
 	int ret = pmalloc_operation(&pop->heap, pop->root_offset,
 			&pop->root_offset, size + OBJ_OOB_SIZE,
-			constructor_zrealloc_root, &carg, &ctx);
+			constructor_zrealloc_root, &carg, 0, &ctx);
 
 	pmalloc_redo_release(pop);
 
 	return ret;
 }
 
+/*
+ * pmemobj_lane_stats -- gathers the lane statistics of the pool
+ */
+int
+pmemobj_lane_stats(PMEMobjpool *pop, struct pobj_lane_stats *stats)
+{
+	LOG(3, "pop %p stats %p", pop, stats);
+
+	lane_stats(pop, stats);
+
+	return 0;
+}
+
 /*
  * pmemobj_root_size -- returns size of the root object
  */
@@ -2236,6 +2454,51 @@ pmemobj_root(PMEMobjpool *pop, size_t size)
 	return pmemobj_root_construct(pop, size, NULL, NULL);
 }
 
+/*
+ * obj_iter_next -- (internal) returns the next user object of the given type
+ *	and advances the heap iterator
+ */
+static PMEMoid
+obj_iter_next(PMEMobjpool *pop, struct palloc_iter *it, uint64_t type_num)
+{
+	uint64_t off;
+	while ((off = palloc_iter_next(&pop->heap, it)) != 0) {
+		PMEMoid oid = {pop->uuid_lo, off + OBJ_OOB_SIZE};
+
+		struct oob_header *oobh = OOB_HEADER_FROM_OID(pop, oid);
+		if (oobh->size & OBJ_INTERNAL_OBJECT_MASK)
+			continue;
+
+		if (type_num == POBJ_ITER_ANY_TYPE ||
+				oobh->type_num == type_num)
+			return oid;
+	}
+
+	return OID_NULL;
+}
+
+/*
+ * obj_next_type -- (internal) returns the first object of the given type
+ *	with an offset greater than 'off', or the first one if 'off' is 0
+ */
+static PMEMoid
+obj_next_type(PMEMobjpool *pop, uint64_t off, uint64_t type_num)
+{
+	uint64_t next = off;
+	if (type_index_next(pop, type_num, &next) == 0) {
+		PMEMoid oid = {pop->uuid_lo, next};
+		return next == 0 ? OID_NULL : oid;
+	}
+
+	struct palloc_iter it;
+	if (off == 0)
+		palloc_iter_init(&pop->heap, &it);
+	else
+		palloc_iter_seek(&pop->heap, &it, off);
+
+	return obj_iter_next(pop, &it, type_num);
+}
+
 /*
  * pmemobj_first - returns first object of specified type
  */
@@ -2244,20 +2507,10 @@ pmemobj_first(PMEMobjpool *pop)
 {
 	LOG(3, "pop %p", pop);
 
-	PMEMoid ret = {0, 0};
-
-	uint64_t off = palloc_first(&pop->heap);
-	if (off != 0) {
-		ret.off = off + OBJ_OOB_SIZE;
-		ret.pool_uuid_lo = pop->uuid_lo;
+	struct palloc_iter it;
+	palloc_iter_init(&pop->heap, &it);
 
-		struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, ret.off);
-		if (oobh->size & OBJ_INTERNAL_OBJECT_MASK) {
-			return pmemobj_next(ret);
-		}
-	}
-
-	return ret;
+	return obj_iter_next(pop, &it, POBJ_ITER_ANY_TYPE);
 }
 
 /*
@@ -2276,21 +2529,196 @@ pmemobj_next(PMEMoid oid)
 	ASSERTne(pop, NULL);
 	ASSERT(OBJ_OID_IS_VALID(pop, oid));
 
-	PMEMoid ret = {0, 0};
-	uint64_t off = palloc_next(&pop->heap, oid.off);
-	if (off != 0) {
-		ret.off = off + OBJ_OOB_SIZE;
-		ret.pool_uuid_lo = pop->uuid_lo;
+	struct palloc_iter it;
+	palloc_iter_seek(&pop->heap, &it, oid.off);
 
-		struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, ret.off);
-		if (oobh->size & OBJ_INTERNAL_OBJECT_MASK) {
-			return pmemobj_next(ret);
+	return obj_iter_next(pop, &it, POBJ_ITER_ANY_TYPE);
+}
+
+/*
+ * pmemobj_first_type -- returns the first object of the type number
+ */
+PMEMoid
+pmemobj_first_type(PMEMobjpool *pop, uint64_t type_num)
+{
+	LOG(3, "pop %p type_num %" PRIu64, pop, type_num);
+
+	return obj_next_type(pop, 0, type_num);
+}
+
+/*
+ * pmemobj_next_type -- returns the next object of the same type
+ */
+PMEMoid
+pmemobj_next_type(PMEMoid oid)
+{
+	LOG(3, "oid.off 0x%016jx", oid.off);
+
+	if (oid.off == 0)
+		return OID_NULL;
+
+	PMEMobjpool *pop = pmemobj_pool_by_oid(oid);
+
+	ASSERTne(pop, NULL);
+	ASSERT(OBJ_OID_IS_VALID(pop, oid));
+
+	return obj_next_type(pop, oid.off,
+		OOB_HEADER_FROM_OID(pop, oid)->type_num);
+}
+
+/*
+ * pmemobj_type_count -- returns the number of objects of the type number
+ */
+uint64_t
+pmemobj_type_count(PMEMobjpool *pop, uint64_t type_num)
+{
+	LOG(3, "pop %p type_num %" PRIu64, pop, type_num);
+
+	uint64_t count;
+	if (type_index_count(pop, type_num, &count) == 0)
+		return count;
+
+	struct palloc_iter it;
+	palloc_iter_init(&pop->heap, &it);
+
+	count = 0;
+	while (!OID_IS_NULL(obj_iter_next(pop, &it, type_num)))
+		count++;
+
+	return count;
+}
+
+struct pobj_iter {
+	PMEMobjpool *pop;
+	uint64_t type_num;
+	struct palloc_iter it;
+
+	int indexed;	/* the objects are looked up in the type index */
+	uint64_t off;	/* last object found in the index, UINT64_MAX at end */
+};
+
+/*
+ * pmemobj_iter_new -- creates an iterator through the objects of the pool
+ */
+struct pobj_iter *
+pmemobj_iter_new(PMEMobjpool *pop, uint64_t type_num)
+{
+	LOG(3, "pop %p type_num %" PRIu64, pop, type_num);
+
+	struct pobj_iter *iter = Malloc(sizeof(*iter));
+	if (iter == NULL) {
+		ERR("!Malloc");
+		return NULL;
+	}
+
+	uint64_t count;
+
+	iter->pop = pop;
+	iter->type_num = type_num;
+	palloc_iter_init(&pop->heap, &iter->it);
+	iter->indexed = type_num != POBJ_ITER_ANY_TYPE &&
+		type_index_count(pop, type_num, &count) == 0;
+	iter->off = 0;
+
+	return iter;
+}
+
+/*
+ * pmemobj_iter_next -- returns the next object of the iterator
+ */
+PMEMoid
+pmemobj_iter_next(struct pobj_iter *iter)
+{
+	LOG(3, "iter %p", iter);
+
+	PMEMobjpool *pop = iter->pop;
+
+	if (iter->indexed) {
+		if (iter->off == UINT64_MAX)
+			return OID_NULL;
+
+		uint64_t off = iter->off;
+		if (type_index_next(pop, iter->type_num, &off) == 0) {
+			iter->off = off == 0 ? UINT64_MAX : off;
+
+			PMEMoid oid = {pop->uuid_lo, off};
+			return off == 0 ? OID_NULL : oid;
 		}
+
+		/* the index can't be used anymore, continue in the heap */
+		iter->indexed = 0;
+		if (iter->off != 0)
+			palloc_iter_seek(&pop->heap, &iter->it, iter->off);
 	}
 
+	return obj_iter_next(pop, &iter->it, iter->type_num);
+}
+
+/*
+ * pmemobj_iter_delete -- deletes the iterator
+ */
+void
+pmemobj_iter_delete(struct pobj_iter *iter)
+{
+	LOG(3, "iter %p", iter);
+
+	Free(iter);
+}
+
+struct obj_iter_parallel_args {
+	PMEMobjpool *pop;
+	uint64_t type_num;
+	pmemobj_iter_cb cb;
+	void *arg;
+	int ret;
+};
+
+/*
+ * obj_iter_parallel_cb -- (internal) calls the user callback for user
+ *	objects of the requested type
+ */
+static int
+obj_iter_parallel_cb(uint64_t off, void *arg)
+{
+	struct obj_iter_parallel_args *args = arg;
+	PMEMobjpool *pop = args->pop;
+
+	PMEMoid oid = {pop->uuid_lo, off + OBJ_OOB_SIZE};
+
+	struct oob_header *oobh = OOB_HEADER_FROM_OID(pop, oid);
+	if (oobh->size & OBJ_INTERNAL_OBJECT_MASK)
+		return 0;
+
+	if (args->type_num != POBJ_ITER_ANY_TYPE &&
+			oobh->type_num != args->type_num)
+		return 0;
+
+	int ret = args->cb(oid, args->arg);
+	if (ret != 0)
+		__sync_bool_compare_and_swap(&args->ret, 0, ret);
+
 	return ret;
 }
 
+/*
+ * pmemobj_iter_parallel -- calls the callback for every object of the pool
+ *	from multiple threads
+ */
+int
+pmemobj_iter_parallel(PMEMobjpool *pop, uint64_t type_num, unsigned nthreads,
+	pmemobj_iter_cb cb, void *arg)
+{
+	LOG(3, "pop %p type_num %" PRIu64 " nthreads %u", pop, type_num,
+		nthreads);
+
+	struct obj_iter_parallel_args args = {pop, type_num, cb, arg, 0};
+
+	palloc_foreach_parallel(&pop->heap, obj_iter_parallel_cb, &args,
+		nthreads);
+
+	return args.ret;
+}
+
 /*
  * pmemobj_list_insert -- adds object to a list
  */
@@ -51,7 +51,7 @@
 
 /* attributes of the obj memory pool format for the pool header */
 #define OBJ_HDR_SIG "PMEMOBJ"	/* must be 8 bytes including '\0' */
-#define OBJ_FORMAT_MAJOR 3
+#define OBJ_FORMAT_MAJOR 4
 #define OBJ_FORMAT_COMPAT 0x0000
 #define OBJ_FORMAT_INCOMPAT 0x0000
 #define OBJ_FORMAT_RO_COMPAT 0x0000
@@ -62,7 +62,8 @@
 #define OBJ_DSC_P_UNUSED	(OBJ_DSC_P_SIZE - PMEMOBJ_MAX_LAYOUT - 40)
 
 #define OBJ_LANES_OFFSET	8192	/* lanes offset (8kB) */
-#define OBJ_NLANES		1024	/* number of lanes */
+#define OBJ_NLANES		1024	/* default number of lanes */
+#define OBJ_NLANES_MAX		65536	/* maximum number of lanes */
 
 #define OBJ_OOB_SIZE		(sizeof(struct oob_header))
 #define OBJ_OFF_TO_PTR(pop, off) ((void *)((uintptr_t)(pop) + (off)))
@@ -172,9 +173,11 @@ struct pmemobjpool {
 
 	int vg_boot;
 
+	struct type_index *tidx;	/* volatile index of objects by type */
+
 	/* padding to align size of this structure to page boundary */
 	/* sizeof(unused2) == 8192 - offsetof(struct pmemobjpool, unused2) */
-	char unused2[1590];
+	char unused2[1528];
 };
 
 /*
@@ -113,6 +113,10 @@ get_mblock_from_alloc(struct palloc_heap *heap,
  * size. The underlying block allocation algorithm (best-fit, next-fit, ...)
  * varies depending on the bucket container.
  *
+ * Single-unit blocks of the run buckets are served from a per-thread cache,
+ * which is refilled from the bucket in batches, so that the common case
+ * doesn't have to lock the bucket at all.
+ *
  * Because the heap in general tries to avoid lock-contention on buckets,
  * the threads might, in near OOM cases, be unable to allocate requested memory
  * from their assigned buckets. To combat this there's one common collection
@@ -120,14 +124,23 @@ get_mblock_from_alloc(struct palloc_heap *heap,
  * memory from other caches if that's required to satisfy the current caller
  * needs.
  *
+ * If the caller requested a specific allocation class, the bucket of that
+ * class is used instead, regardless of the requested size.
+ *
  * Once this method completes no further locking is required on the transient
  * part of the heap during the allocation process.
  */
 static int
 alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
-		size_t sizeh)
+		size_t sizeh, uint8_t class_id)
 {
-	struct bucket *b = heap_get_best_bucket(heap, sizeh);
+	struct bucket *b;
+	if (class_id == 0) {
+		b = heap_get_best_bucket(heap, sizeh);
+	} else if ((b = heap_get_class_bucket(heap, class_id)) == NULL) {
+		ERR("invalid allocation class %u", class_id);
+		return EINVAL;
+	}
 
 	/*
 	 * The caller provided size in bytes, but buckets operate in
@@ -138,6 +151,15 @@ alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
 	 */
 	m->size_idx = b->calc_units(b, sizeh);
 
+	if (class_id != 0 &&
+		m->size_idx > ((struct bucket_run *)b)->unit_max_alloc) {
+		ERR("allocation too large for class %u", class_id);
+		return EINVAL;
+	}
+
+	if (heap_tcache_get(heap, b, m) == 0)
+		return 0;
+
 	int err = heap_get_bestfit_block(heap, b, m);
 
 	if (err == ENOMEM && b->type == BUCKET_HUGE)
@@ -148,7 +170,7 @@ alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
 		 * There's no more available memory in the common heap and in
 		 * this lane cache, fallback to the auxiliary (shared) bucket.
 		 */
-		b = heap_get_auxiliary_bucket(heap, sizeh);
+		b = heap_get_auxiliary_bucket(heap, b->id);
 		err = heap_get_bestfit_block(heap, b, m);
 	}
 
@@ -241,6 +263,27 @@ alloc_prep_block(struct palloc_heap *heap, struct memory_block m,
 	return 0;
 }
 
+/*
+ * alloc_cancel_block -- (internal) returns a reserved memory block, whose
+ *	allocation was never committed, back to its originating bucket
+ */
+static void
+alloc_cancel_block(struct palloc_heap *heap, struct memory_block m)
+{
+	struct bucket *b = heap_get_chunk_bucket(heap, m.chunk_id, m.zone_id);
+	ASSERTne(b, NULL);
+
+	/*
+	 * Omitting the context in this method results in coalescing of blocks
+	 * without affecting the persistent heap state.
+	 */
+	m = heap_free_block(heap, b, m, NULL);
+	CNT_OP(b, insert, heap, m);
+
+	if (b->type == BUCKET_RUN)
+		heap_degrade_run_if_empty(heap, b, m);
+}
+
 /*
  * palloc_operation -- persistent memory operation. Takes a NULL pointer
  *	or an existing memory block and modifies it to occupy, at least, 'size'
@@ -276,7 +319,7 @@ alloc_prep_block(struct palloc_heap *heap, struct memory_block m,
 int
 palloc_operation(struct palloc_heap *heap,
 	uint64_t off, uint64_t *dest_off, size_t size,
-	palloc_constr constructor, void *arg,
+	palloc_constr constructor, void *arg, uint8_t class_id,
 	struct operation_context *ctx)
 {
 	struct bucket *b = NULL;
@@ -285,6 +328,9 @@ palloc_operation(struct palloc_heap *heap,
 	struct memory_block new_block = {0, 0, 0, 0};
 	struct memory_block reclaimed_block = {0, 0, 0, 0};
 
+	/* the freed block is to be put into the thread cache */
+	int tcache_put = 0;
+
 	int ret = 0;
 
 	/*
@@ -314,7 +360,7 @@ palloc_operation(struct palloc_heap *heap,
 		existing_block_lock = MEMBLOCK_OPS(AUTO, &existing_block)->
 				get_lock(&existing_block, heap);
 		if (existing_block_lock != NULL)
-			util_mutex_lock(existing_block_lock);
+			heap_lock_run(heap, existing_block_lock);
 
 #ifdef DEBUG
 		if (MEMBLOCK_OPS(AUTO,
@@ -347,7 +393,8 @@ palloc_operation(struct palloc_heap *heap,
 		if (alloc != NULL && alloc->size == sizeh)
 			goto out;
 
-		errno = alloc_reserve_block(heap, &new_block, sizeh);
+		errno = alloc_reserve_block(heap, &new_block, sizeh,
+				class_id);
 		if (errno != 0) {
 			ret = -1;
 			goto out;
@@ -374,8 +421,19 @@ palloc_operation(struct palloc_heap *heap,
 		 * The rb block is the coalesced memory block that the free
 		 * resulted in, to prevent volatile memory leak it needs to be
 		 * inserted into the corresponding bucket.
+		 *
+		 * Blocks that go to the thread cache are not coalesced, that
+		 * happens once they are drained back to the bucket.
 		 */
-		reclaimed_block = heap_free_block(heap, b, existing_block, ctx);
+		if (heap_tcache_eligible(b, existing_block)) {
+			reclaimed_block = existing_block;
+			MEMBLOCK_OPS(AUTO, &reclaimed_block)->prep_hdr(
+				&reclaimed_block, heap, MEMBLOCK_FREE, ctx);
+			tcache_put = 1;
+		} else {
+			reclaimed_block = heap_free_block(heap, b,
+				existing_block, ctx);
+		}
 		offset_value = 0;
 	}
 
@@ -386,22 +444,7 @@ palloc_operation(struct palloc_heap *heap,
 			 * Constructor returned non-zero value which means
 			 * the memory block reservation has to be rolled back.
 			 */
-			struct bucket *new_bucket = heap_get_chunk_bucket(heap,
-				new_block.chunk_id, new_block.zone_id);
-			ASSERTne(new_bucket, NULL);
-
-			/*
-			 * Omitting the context in this method results in
-			 * coalescing of blocks without affecting the persistent
-			 * heap state.
-			 */
-			new_block = heap_free_block(heap, new_bucket,
-					new_block, NULL);
-			CNT_OP(new_bucket, insert, heap, new_block);
-
-			if (new_bucket->type == BUCKET_RUN)
-				heap_degrade_run_if_empty(heap,
-					new_bucket, new_block);
+			alloc_cancel_block(heap, new_block);
 
 			errno = ECANCELED;
 			ret = -1;
@@ -423,7 +466,7 @@ palloc_operation(struct palloc_heap *heap,
 			new_block_lock = NULL;
 
 		if (new_block_lock != NULL)
-			util_mutex_lock(new_block_lock);
+			heap_lock_run(heap, new_block_lock);
 
 #ifdef DEBUG
 		if (MEMBLOCK_OPS(AUTO,
@@ -470,6 +513,12 @@ palloc_operation(struct palloc_heap *heap,
 
 	operation_process(ctx);
 
+	if (!MEMORY_BLOCK_IS_EMPTY(existing_block))
+		heap_account_block(heap, existing_block, MEMBLOCK_FREE);
+
+	if (!MEMORY_BLOCK_IS_EMPTY(new_block))
+		heap_account_block(heap, new_block, MEMBLOCK_ALLOCATED);
+
 	/*
 	 * After the operation succeeded, the persistent state is all in order
 	 * but in some cases it might not be in-sync with the its transient
@@ -481,7 +530,7 @@ palloc_operation(struct palloc_heap *heap,
 			+ ALLOC_OFF);
 
 		/* we might have been operating on inactive run */
-		if (b != NULL) {
+		if (b != NULL && !tcache_put) {
 			/*
 			 * Even though the initial condition is to check
 			 * whether the existing block exists it's important to
@@ -514,77 +563,361 @@ out:
 	if (existing_block_lock != NULL)
 		util_mutex_unlock(existing_block_lock);
 
+	/*
+	 * Draining the thread cache might require any of the run locks, so
+	 * the block is put there only once the locks are released.
+	 */
+	if (tcache_put && ret == 0)
+		heap_tcache_put(heap, b, reclaimed_block);
+
 	return ret;
 }
 
 /*
- * palloc_usable_size -- returns the number of bytes in the memory block
+ * palloc_action -- internal representation of the pobj_action structure
  */
-size_t
-palloc_usable_size(struct palloc_heap *heap, uint64_t off)
+struct palloc_action {
+	enum pobj_action_type type;
+	uint32_t padding[3];
+	union {
+		/* POBJ_ACTION_TYPE_HEAP */
+		struct {
+			uint64_t offset;
+			struct memory_block m;
+		} heap;
+
+		/* POBJ_ACTION_TYPE_MEM */
+		struct {
+			uint64_t *ptr;
+			uint64_t value;
+		} mem;
+	} u;
+};
+
+/*
+ * palloc_reserve -- reserves and prepares a new memory block, without
+ *	modifying the persistent state of the heap
+ *
+ * The block is removed from the transient heap, its allocation header is
+ * written and the constructor is called - just like in the allocation part of
+ * palloc_operation. Instead of committing the chunk metadata modifications
+ * right away, the block is recorded in the action which can then be either
+ * published or canceled.
+ *
+ * In case of a crash before the action is published, the memory block remains
+ * free in the persistent heap and will be back in the free blocks collection.
+ */
+int
+palloc_reserve(struct palloc_heap *heap, size_t size,
+	palloc_constr constructor, void *arg, struct pobj_action *act)
 {
-	return USABLE_SIZE(ALLOC_GET_HEADER(heap, off));
+	COMPILE_ERROR_ON(sizeof(struct palloc_action) >
+		sizeof(struct pobj_action));
+	COMPILE_ERROR_ON(offsetof(struct palloc_action, u.heap.offset) !=
+		offsetof(struct pobj_action, heap.offset));
+
+	struct palloc_action *a = (struct palloc_action *)act;
+	struct memory_block m = {0, 0, 0, 0};
+
+	size_t sizeh = size + sizeof(struct allocation_header);
+
+	errno = alloc_reserve_block(heap, &m, sizeh, 0);
+	if (errno != 0)
+		return -1;
+
+	uint64_t offset_value = 0;
+	if (alloc_prep_block(heap, m, constructor, arg, &offset_value) != 0) {
+		alloc_cancel_block(heap, m);
+
+		errno = ECANCELED;
+		return -1;
+	}
+
+	a->type = POBJ_ACTION_TYPE_HEAP;
+	a->u.heap.offset = offset_value;
+	a->u.heap.m = m;
+
+	return 0;
 }
 
 /*
- * pmalloc_search_cb -- (internal) foreach callback. If the argument is equal
- *	to the current object offset then sets the argument to UINT64_MAX.
- *	If the argument is UINT64_MAX it breaks the iteration and sets the
- *	argument to the current object offset.
+ * palloc_set_value -- creates an action that will persistently store the value
+ *	at the given location once published
+ */
+void
+palloc_set_value(struct palloc_heap *heap, struct pobj_action *act,
+	uint64_t *ptr, uint64_t value)
+{
+	struct palloc_action *a = (struct palloc_action *)act;
+
+	a->type = POBJ_ACTION_TYPE_MEM;
+	a->u.mem.ptr = ptr;
+	a->u.mem.value = value;
+}
+
+/* entry of the publish order, see palloc_publish */
+struct palloc_publish_entry {
+	struct palloc_action *a;
+	pthread_mutex_t *lock;
+	size_t idx; /* position in the array provided by the caller */
+};
+
+/*
+ * palloc_publish_entry_compare -- (internal) orders the actions so that the
+ *	memory blocks come first, sorted by the lock protecting their metadata
+ *	and their location, and the stores come last, in the original order
  */
 static int
-pmalloc_search_cb(uint64_t off, void *arg)
+palloc_publish_entry_compare(const void *lhs, const void *rhs)
 {
-	uint64_t *prev = arg;
+	const struct palloc_publish_entry *l = lhs;
+	const struct palloc_publish_entry *r = rhs;
+
+	if (l->a->type != r->a->type)
+		return l->a->type < r->a->type ? -1 : 1;
+
+	if (l->a->type == POBJ_ACTION_TYPE_HEAP) {
+		if (l->lock != r->lock)
+			return (uintptr_t)l->lock < (uintptr_t)r->lock ? -1 : 1;
 
-	if (*prev == UINT64_MAX) {
-		*prev = off;
+		const struct memory_block *lm = &l->a->u.heap.m;
+		const struct memory_block *rm = &r->a->u.heap.m;
 
-		return 1;
+		if (lm->zone_id != rm->zone_id)
+			return lm->zone_id < rm->zone_id ? -1 : 1;
+		if (lm->chunk_id != rm->chunk_id)
+			return lm->chunk_id < rm->chunk_id ? -1 : 1;
+		if (lm->block_off != rm->block_off)
+			return lm->block_off < rm->block_off ? -1 : 1;
 	}
 
-	if (off == *prev)
-		*prev = UINT64_MAX;
+	if (l->idx != r->idx)
+		return l->idx < r->idx ? -1 : 1;
 
 	return 0;
 }
 
 /*
- * palloc_first -- returns the first object from the heap.
+ * palloc_publish -- persistently commits the reservations and stores
+ *	from the provided actions
+ *
+ * All of the chunk metadata modifications are collected in a single operation
+ * context. Reservations from the same run usually land in the same 8-byte
+ * bitmap value, so the number of redo log entries is typically much lower
+ * than the number of actions. The operation context has to have room for one
+ * persistent and MEMBLOCK_MAX_TRANSIENT_ENTRIES transient entries per action,
+ * see operation_reserve, so that all of the actions are committed at once.
+ * The stores are always ordered after all of the reservations, which means
+ * that the objects become reachable through them only once the heap
+ * metadata of all the objects is already committed.
+ *
+ * The metadata locks are always acquired in the same (address) order, so
+ * that concurrent publications cannot deadlock.
  */
-uint64_t
-palloc_first(struct palloc_heap *heap)
+int
+palloc_publish(struct palloc_heap *heap, struct pobj_action *actv,
+	size_t actvcnt, struct operation_context *ctx)
 {
-	uint64_t off_search = UINT64_MAX;
-	struct memory_block m = {0, 0, 0, 0};
+	if (actvcnt == 0)
+		return 0;
 
-	heap_foreach_object(heap, pmalloc_search_cb, &off_search, m);
+	struct palloc_publish_entry *entries =
+		Malloc(sizeof(*entries) * actvcnt);
+	if (entries == NULL) {
+		ERR("!Malloc");
+		return -1;
+	}
 
-	if (off_search == UINT64_MAX)
-		return 0;
+	for (size_t i = 0; i < actvcnt; ++i) {
+		struct palloc_action *a = (struct palloc_action *)&actv[i];
+		ASSERT(a->type < POBJ_MAX_ACTION_TYPE);
+
+		entries[i].a = a;
+		entries[i].idx = i;
+		entries[i].lock = a->type == POBJ_ACTION_TYPE_HEAP ?
+			MEMBLOCK_OPS(AUTO, &a->u.heap.m)->get_lock(
+				&a->u.heap.m, heap) : NULL;
+	}
+
+	qsort(entries, actvcnt, sizeof(*entries),
+		palloc_publish_entry_compare);
+
+	/* the entries with the same lock are next to each other */
+	pthread_mutex_t *lock = NULL;
+	for (size_t i = 0; i < actvcnt; ++i) {
+		if (entries[i].lock != NULL && entries[i].lock != lock) {
+			lock = entries[i].lock;
+			heap_lock_run(heap, lock);
+		}
+	}
+
+	for (size_t i = 0; i < actvcnt; ++i) {
+		struct palloc_action *a = entries[i].a;
+		if (a->type == POBJ_ACTION_TYPE_MEM) {
+			operation_add_entry(ctx, a->u.mem.ptr, a->u.mem.value,
+				OPERATION_SET);
+			continue;
+		}
+
+		struct memory_block *m = &a->u.heap.m;
+
+#ifdef DEBUG
+		if (MEMBLOCK_OPS(AUTO, m)->get_state(m, heap) !=
+				MEMBLOCK_FREE) {
+			ERR("Double free or heap corruption");
+			ASSERT(0);
+		}
+#endif /* DEBUG */
+
+		MEMBLOCK_OPS(AUTO, m)->prep_hdr(m, heap,
+			MEMBLOCK_ALLOCATED, ctx);
+	}
 
-	return off_search + sizeof(struct allocation_header);
+	operation_process(ctx);
+
+	for (size_t i = 0; i < actvcnt; ++i) {
+		if (entries[i].a->type == POBJ_ACTION_TYPE_HEAP)
+			heap_account_block(heap, entries[i].a->u.heap.m,
+				MEMBLOCK_ALLOCATED);
+	}
+
+	lock = NULL;
+	for (size_t i = 0; i < actvcnt; ++i) {
+		if (entries[i].lock != NULL && entries[i].lock != lock) {
+			lock = entries[i].lock;
+			util_mutex_unlock(lock);
+		}
+	}
+
+	Free(entries);
+
+	return 0;
 }
 
 /*
- * palloc_next -- returns the next object relative to 'off'.
+ * palloc_cancel -- returns the reserved memory blocks back to the transient
+ *	heap, the stores are discarded
  */
-uint64_t
-palloc_next(struct palloc_heap *heap, uint64_t off)
+void
+palloc_cancel(struct palloc_heap *heap, struct pobj_action *actv,
+	size_t actvcnt)
 {
-	struct allocation_header *alloc = ALLOC_GET_HEADER(heap, off);
-	struct memory_block m = get_mblock_from_alloc(heap, alloc);
+	for (size_t i = 0; i < actvcnt; ++i) {
+		struct palloc_action *a = (struct palloc_action *)&actv[i];
+		ASSERT(a->type < POBJ_MAX_ACTION_TYPE);
+
+		if (a->type != POBJ_ACTION_TYPE_HEAP)
+			continue;
+
+		VALGRIND_DO_MEMPOOL_FREE(heap->layout,
+			PMALLOC_OFF_TO_PTR(heap, a->u.heap.offset));
 
-	uint64_t off_search = off - ALLOC_OFF;
+		alloc_cancel_block(heap, a->u.heap.m);
+	}
+}
 
-	heap_foreach_object(heap, pmalloc_search_cb, &off_search, m);
+/*
+ * palloc_alloc_class_new -- creates a new allocation class described by the
+ *	user, returns the class id in the descriptor
+ */
+int
+palloc_alloc_class_new(struct palloc_heap *heap,
+	struct pobj_alloc_class_desc *desc)
+{
+	uint8_t class_id;
+	int ret = heap_create_alloc_class(heap, desc->unit_size,
+		desc->units_per_block, &class_id);
+	if (ret != 0)
+		return ret;
+
+	desc->class_id = class_id;
+
+	return 0;
+}
 
-	if (off_search == (off - ALLOC_OFF) ||
-		off_search == 0 ||
-		off_search == UINT64_MAX)
+/*
+ * palloc_heap_stats -- gathers the statistics of the heap
+ */
+void
+palloc_heap_stats(struct palloc_heap *heap, struct pobj_heap_stats *stats)
+{
+	heap_get_stats(heap, stats);
+}
+
+/*
+ * palloc_usable_size -- returns the number of bytes in the memory block
+ */
+size_t
+palloc_usable_size(struct palloc_heap *heap, uint64_t off)
+{
+	return USABLE_SIZE(ALLOC_GET_HEADER(heap, off));
+}
+
+/*
+ * palloc_iter_init -- positions the iterator before the first object
+ *	of the heap
+ */
+void
+palloc_iter_init(struct palloc_heap *heap, struct palloc_iter *it)
+{
+	heap_iter_init(heap, it, 0, UINT32_MAX);
+}
+
+/*
+ * palloc_iter_seek -- positions the iterator right after the object at 'off'
+ */
+void
+palloc_iter_seek(struct palloc_heap *heap, struct palloc_iter *it,
+	uint64_t off)
+{
+	struct allocation_header *alloc = ALLOC_GET_HEADER(heap, off);
+
+	heap_iter_seek(heap, it, get_mblock_from_alloc(heap, alloc));
+}
+
+/*
+ * palloc_iter_next -- returns the next object and advances the iterator,
+ *	0 if there are no more objects
+ */
+uint64_t
+palloc_iter_next(struct palloc_heap *heap, struct palloc_iter *it)
+{
+	uint64_t off = heap_iter_next(heap, it);
+	if (off == 0)
 		return 0;
 
-	return off_search + sizeof(struct allocation_header);
+	return off + sizeof(struct allocation_header);
+}
+
+struct palloc_foreach_args {
+	object_callback cb;
+	void *arg;
+};
+
+/*
+ * palloc_foreach_cb -- (internal) translates the offset of the allocation
+ *	header to the offset of the object
+ */
+static int
+palloc_foreach_cb(uint64_t off, void *arg)
+{
+	struct palloc_foreach_args *args = arg;
+
+	return args->cb(off + sizeof(struct allocation_header), args->arg);
+}
+
+/*
+ * palloc_foreach_parallel -- calls the callback for every object in the heap
+ *	from the given number of threads
+ */
+int
+palloc_foreach_parallel(struct palloc_heap *heap, object_callback cb,
+	void *arg, unsigned nthreads)
+{
+	struct palloc_foreach_args args = {cb, arg};
+
+	return heap_foreach_object_parallel(heap, palloc_foreach_cb, &args,
+		nthreads);
 }
 
 /*
@@ -40,6 +40,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "libpmemobj.h"
 #include "memops.h"
 #include "redo.h"
 
@@ -57,15 +58,49 @@ struct palloc_heap {
 	void *base;
 };
 
+/*
+ * Position of an object iteration in the heap, allows the next object to be
+ * found without walking the heap from the beginning.
+ */
+struct palloc_iter {
+	uint32_t zone_id;
+	uint32_t zone_end;	/* one past the last zone to visit */
+	uint32_t chunk_id;
+	uint32_t value;		/* index of the current run bitmap value */
+	uint64_t objs;		/* objects of the value not returned yet */
+	int in_run;		/* the objects of chunk_id's run are visited */
+};
+
+/* foreach callback, terminates iteration if return value is non-zero */
+typedef int (*object_callback)(uint64_t off, void *arg);
+
 typedef int (*palloc_constr)(void *base, void *ptr,
 		size_t usable_size, void *arg);
 
 int palloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
-	size_t size, palloc_constr constructor, void *arg,
+	size_t size, palloc_constr constructor, void *arg, uint8_t class_id,
 	struct operation_context *ctx);
 
-uint64_t palloc_first(struct palloc_heap *heap);
-uint64_t palloc_next(struct palloc_heap *heap, uint64_t off);
+int palloc_reserve(struct palloc_heap *heap, size_t size,
+	palloc_constr constructor, void *arg, struct pobj_action *act);
+void palloc_set_value(struct palloc_heap *heap, struct pobj_action *act,
+	uint64_t *ptr, uint64_t value);
+int palloc_publish(struct palloc_heap *heap, struct pobj_action *actv,
+	size_t actvcnt, struct operation_context *ctx);
+void palloc_cancel(struct palloc_heap *heap, struct pobj_action *actv,
+	size_t actvcnt);
+
+int palloc_alloc_class_new(struct palloc_heap *heap,
+	struct pobj_alloc_class_desc *desc);
+void palloc_heap_stats(struct palloc_heap *heap,
+	struct pobj_heap_stats *stats);
+int palloc_foreach_parallel(struct palloc_heap *heap, object_callback cb,
+	void *arg, unsigned nthreads);
+
+void palloc_iter_init(struct palloc_heap *heap, struct palloc_iter *it);
+void palloc_iter_seek(struct palloc_heap *heap, struct palloc_iter *it,
+	uint64_t off);
+uint64_t palloc_iter_next(struct palloc_heap *heap, struct palloc_iter *it);
 
 size_t palloc_usable_size(struct palloc_heap *heap, uint64_t off);
 
@@ -80,9 +115,6 @@ int palloc_heap_check_remote(void *heap_start, uint64_t heap_size,
 		struct remote_ops *ops);
 void palloc_heap_cleanup(struct palloc_heap *heap);
 
-/* foreach callback, terminates iteration if return value is non-zero */
-typedef int (*object_callback)(uint64_t off, void *arg);
-
 #ifdef USE_VG_MEMCHECK
 void palloc_heap_vg_open(struct palloc_heap *heap,
 		object_callback cb, void *arg, int objects);
@@ -46,6 +46,7 @@
 #include "out.h"
 #include "palloc.h"
 #include "pmalloc.h"
+#include "type_index.h"
 
 /*
  * pmalloc_redo_hold -- acquires allocator lane section and returns a pointer to
@@ -77,20 +78,31 @@ pmalloc_redo_release(PMEMobjpool *pop)
  */
 int
 pmalloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
-	size_t size, palloc_constr constructor, void *arg,
+	size_t size, palloc_constr constructor, void *arg, uint8_t class_id,
 	struct operation_context *ctx)
 {
-#ifdef USE_VG_MEMCHECK
+	PMEMobjpool *pop = heap->base;
+
+	/* the type index needs the offset of the new object */
 	uint64_t tmp;
-	if (size && On_valgrind && dest_off == NULL)
+	if (size && dest_off == NULL)
 		dest_off = &tmp;
-#endif
+
+	/* the header of the old object is gone once the operation is done */
+	uint64_t old_type_num = 0;
+	int old_indexed = off != 0 &&
+		type_index_get_type(pop, off, &old_type_num);
 
 	int ret = palloc_operation(heap, off, dest_off, size, constructor, arg,
-			ctx);
+			class_id, ctx);
 	if (ret)
 		return ret;
 
+	if (old_indexed)
+		type_index_remove(pop, off, old_type_num);
+	if (size)
+		type_index_insert(pop, *dest_off);
+
 #ifdef USE_VG_MEMCHECK
 	if (size && On_valgrind) {
 		struct oob_header *pobj =
@@ -109,6 +121,34 @@ pmalloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
 	return 0;
 }
 
+/*
+ * pmalloc_reserve -- higher level wrapper for the reservation part of the
+ *	allocator API
+ *
+ * If successful function returns zero. Otherwise an error number is returned.
+ */
+int
+pmalloc_reserve(struct palloc_heap *heap, size_t size,
+	palloc_constr constructor, void *arg, struct pobj_action *act)
+{
+	int ret = palloc_reserve(heap, size, constructor, arg, act);
+	if (ret)
+		return ret;
+
+#ifdef USE_VG_MEMCHECK
+	if (On_valgrind) {
+		struct oob_header *pobj = OOB_HEADER_FROM_PTR(
+			(char *)heap->base + act->heap.offset);
+
+		/* see pmalloc_operation */
+		VALGRIND_DO_MAKE_MEM_NOACCESS(pobj->unused,
+				sizeof(pobj->unused));
+	}
+#endif
+
+	return 0;
+}
+
 /*
  * pmalloc -- allocates a new block of memory
  *
@@ -124,7 +164,8 @@ pmalloc(PMEMobjpool *pop, uint64_t *off, size_t size)
 	struct operation_context ctx;
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, 0, off, size, NULL, NULL, &ctx);
+	int ret = pmalloc_operation(&pop->heap, 0, off, size, NULL, NULL, 0,
+		&ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -149,7 +190,7 @@ pmalloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
 	operation_init(&ctx, pop, pop->redo, redo);
 
 	int ret = pmalloc_operation(&pop->heap, 0, off, size, constructor, arg,
-			&ctx);
+			0, &ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -171,7 +212,8 @@ prealloc(PMEMobjpool *pop, uint64_t *off, size_t size)
 
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, *off, off, size, NULL, 0, &ctx);
+	int ret = pmalloc_operation(&pop->heap, *off, off, size, NULL, 0, 0,
+		&ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -196,7 +238,7 @@ prealloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
 	operation_init(&ctx, pop, pop->redo, redo);
 
 	int ret = pmalloc_operation(&pop->heap, *off, off, size, constructor,
-			arg, &ctx);
+			arg, 0, &ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -218,12 +260,101 @@ pfree(PMEMobjpool *pop, uint64_t *off)
 
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, *off, off, 0, NULL, NULL, &ctx);
+	int ret = pmalloc_operation(&pop->heap, *off, off, 0, NULL, NULL, 0,
+		&ctx);
 	ASSERTeq(ret, 0);
 
 	pmalloc_redo_release(pop);
 }
 
+/*
+ * constructor_redo_overflow -- (internal) constructor for the overflow redo
+ *	log of a lane
+ */
+static int
+constructor_redo_overflow(void *ctx, void *ptr, size_t usable_size, void *arg)
+{
+	PMEMobjpool *pop = ctx;
+
+	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+	VALGRIND_ADD_TO_TX(oobh, OBJ_OOB_SIZE);
+
+	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
+	pmemops_persist(&pop->p_ops, &oobh->size, sizeof(oobh->size));
+
+	VALGRIND_REMOVE_FROM_TX(oobh, OBJ_OOB_SIZE);
+
+	return 0;
+}
+
+/*
+ * pmalloc_redo_overflow -- (internal) returns the overflow redo log of the
+ *	lane, grown to fit the given number of entries
+ */
+static struct redo_log *
+pmalloc_redo_overflow(PMEMobjpool *pop, struct lane_alloc_layout *sec,
+	size_t nentries)
+{
+	size_t size = nentries * sizeof(struct redo_log);
+
+	if (sec->overflow != 0 && palloc_usable_size(&pop->heap,
+			sec->overflow) - OBJ_OOB_SIZE < size)
+		pfree(pop, &sec->overflow);
+
+	if (sec->overflow == 0 && pmalloc_construct(pop, &sec->overflow,
+			size + OBJ_OOB_SIZE, constructor_redo_overflow,
+			NULL) != 0) {
+		ERR("!cannot allocate overflow redo log");
+		return NULL;
+	}
+
+	return OBJ_OFF_TO_PTR(pop, sec->overflow);
+}
+
+/*
+ * pmalloc_publish -- publishes the actions in a single operation
+ *
+ * Every action adds at most one persistent entry to the operation, the ones
+ * which don't fit in the redo log of the lane are committed through the
+ * overflow redo log.
+ */
+int
+pmalloc_publish(PMEMobjpool *pop, struct pobj_action *actv, size_t actvcnt)
+{
+	struct lane_section *lane;
+	lane_hold(pop, &lane, LANE_SECTION_ALLOCATOR);
+
+	struct lane_alloc_layout *sec = (void *)lane->layout;
+
+	struct operation_context ctx;
+	operation_init(&ctx, pop, pop->redo, sec->redo);
+
+	int ret = -1;
+	struct redo_log *linked = NULL;
+	if (actvcnt > MAX_PERSITENT_ENTRIES) {
+		linked = pmalloc_redo_overflow(pop, sec, actvcnt);
+		if (linked == NULL)
+			goto out;
+	}
+
+	if (operation_reserve(&ctx, linked, actvcnt,
+			actvcnt * MEMBLOCK_MAX_TRANSIENT_ENTRIES) != 0)
+		goto out;
+
+	ret = palloc_publish(&pop->heap, actv, actvcnt, &ctx);
+
+	operation_fini(&ctx);
+
+out:
+	if (sec->overflow != 0 && palloc_usable_size(&pop->heap,
+			sec->overflow) > ALLOC_REDO_OVERFLOW_MAX_RETAINED)
+		pfree(pop, &sec->overflow);
+
+	lane_release(pop);
+
+	return ret;
+}
+
 /*
  * pmalloc_construct_rt -- construct runtime part of allocator section
  */
@@ -292,6 +423,9 @@ pmalloc_boot(PMEMobjpool *pop)
 #endif
 
 	ret = palloc_buckets_init(&pop->heap);
+	if (ret == 0)
+		ret = type_index_boot(pop);
+
 	if (ret)
 		palloc_heap_cleanup(&pop->heap);
 
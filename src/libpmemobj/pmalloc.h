@@ -50,15 +50,27 @@
  * location and the second for applying the chunk metadata modifications.
  */
 #define ALLOC_REDO_LOG_SIZE 10
+
+/*
+ * The redo log entries of an operation which don't fit in the lane are kept
+ * in the overflow log of the lane, an object which is kept between operations
+ * unless it's larger than the limit below.
+ */
+#define ALLOC_REDO_OVERFLOW_MAX_RETAINED (1 << 20) /* 1 megabyte */
+
 struct lane_alloc_layout {
 	struct redo_log redo[ALLOC_REDO_LOG_SIZE];
+	uint64_t overflow; /* offset of the overflow redo log object */
 };
 
 int pmalloc_operation(struct palloc_heap *heap,
 	uint64_t off, uint64_t *dest_off, size_t size,
-	palloc_constr constructor, void *arg,
+	palloc_constr constructor, void *arg, uint8_t class_id,
 	struct operation_context *ctx);
 
+int pmalloc_reserve(struct palloc_heap *heap, size_t size,
+	palloc_constr constructor, void *arg, struct pobj_action *act);
+
 int pmalloc(PMEMobjpool *pop, uint64_t *off, size_t size);
 int pmalloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
 	palloc_constr constructor, void *arg);
@@ -69,6 +81,9 @@ int prealloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
 
 void pfree(PMEMobjpool *pop, uint64_t *off);
 
+int pmalloc_publish(PMEMobjpool *pop, struct pobj_action *actv,
+	size_t actvcnt);
+
 struct redo_log *pmalloc_redo_hold(PMEMobjpool *pop);
 void pmalloc_redo_release(PMEMobjpool *pop);
 
@@ -43,7 +43,13 @@
  * Finish flag at the least significant bit
  */
 #define REDO_FINISH_FLAG	((uint64_t)1<<0)
-#define REDO_FLAG_MASK		(~REDO_FINISH_FLAG)
+
+/*
+ * Link flag at the next bit, the offset of such entry points to an array of
+ * linked entries and the value is the number of them
+ */
+#define REDO_LINK_FLAG		((uint64_t)1<<1)
+#define REDO_FLAG_MASK		(~(REDO_FINISH_FLAG | REDO_LINK_FLAG))
 
 struct redo_ctx {
 	void *base;
@@ -126,6 +132,50 @@ redo_log_store(const struct redo_ctx *ctx, struct redo_log *redo, size_t index,
 	redo[index].value = value;
 }
 
+/*
+ * redo_log_store_linked -- (internal) store entry at specified index of
+ *	an array of linked entries
+ */
+void
+redo_log_store_linked(const struct redo_ctx *ctx, struct redo_log *linked,
+		size_t index, uint64_t offset, uint64_t value)
+{
+	LOG(15, "linked %p index %zu offset %ju value %ju",
+			linked, index, offset, value);
+
+	ASSERTeq(offset & ~REDO_FLAG_MASK, 0);
+
+	linked[index].offset = offset;
+	linked[index].value = value;
+}
+
+/*
+ * redo_log_store_link -- (internal) persist the array of linked entries and
+ *	store the entry linking it at specified index
+ *
+ * The linked entries are processed in place of the link entry, so a single
+ * redo log can hold more entries than fit in the lane.
+ */
+void
+redo_log_store_link(const struct redo_ctx *ctx, struct redo_log *redo,
+		size_t index, struct redo_log *linked, size_t nlinked)
+{
+	LOG(15, "redo %p index %zu linked %p nlinked %zu",
+			redo, index, linked, nlinked);
+
+	ASSERT(index < ctx->redo_num_entries);
+	ASSERTne(nlinked, 0);
+
+	pmemops_persist(&ctx->p_ops, linked, nlinked * sizeof(*linked));
+
+	uint64_t offset = (uint64_t)((uintptr_t)linked -
+			(uintptr_t)ctx->base);
+	ASSERTeq(offset & ~REDO_FLAG_MASK, 0);
+
+	redo[index].offset = offset | REDO_LINK_FLAG;
+	redo[index].value = nlinked;
+}
+
 /*
  * redo_log_store_last -- (internal) store last entry at specified index
  */
@@ -171,6 +221,41 @@ redo_log_set_last(const struct redo_ctx *ctx, struct redo_log *redo,
 	pmemops_persist(p_ops, &redo[index].offset, sizeof(redo[index].offset));
 }
 
+/*
+ * redo_log_apply -- (internal) store the value of a redo log entry, or of
+ *	all the entries linked by it, the last value is persisted
+ */
+static void
+redo_log_apply(const struct redo_ctx *ctx, const struct redo_log *redo,
+		int last)
+{
+	const struct pmem_ops *p_ops = &ctx->p_ops;
+	uint64_t offset = redo->offset & REDO_FLAG_MASK;
+
+	if (redo->offset & REDO_LINK_FLAG) {
+		const struct redo_log *linked = (struct redo_log *)
+			((uintptr_t)ctx->base + offset);
+
+		for (uint64_t i = 0; i < redo->value; ++i) {
+			ASSERTeq(linked[i].offset & ~REDO_FLAG_MASK, 0);
+			redo_log_apply(ctx, &linked[i],
+				last && i == redo->value - 1);
+		}
+
+		return;
+	}
+
+	uint64_t *val = (uint64_t *)((uintptr_t)ctx->base + offset);
+	VALGRIND_ADD_TO_TX(val, sizeof(*val));
+	*val = redo->value;
+	VALGRIND_REMOVE_FROM_TX(val, sizeof(*val));
+
+	if (last)
+		pmemops_persist(p_ops, val, sizeof(uint64_t));
+	else
+		pmemops_flush(p_ops, val, sizeof(uint64_t));
+}
+
 /*
  * redo_log_process -- (internal) process redo log entries
  */
@@ -185,25 +270,12 @@ redo_log_process(const struct redo_ctx *ctx, struct redo_log *redo,
 #endif
 	const struct pmem_ops *p_ops = &ctx->p_ops;
 
-	uint64_t *val;
 	while ((redo->offset & REDO_FINISH_FLAG) == 0) {
-		val = (uint64_t *)((uintptr_t)ctx->base + redo->offset);
-		VALGRIND_ADD_TO_TX(val, sizeof(*val));
-		*val = redo->value;
-		VALGRIND_REMOVE_FROM_TX(val, sizeof(*val));
-
-		pmemops_flush(p_ops, val, sizeof(uint64_t));
-
+		redo_log_apply(ctx, redo, 0);
 		redo++;
 	}
 
-	uint64_t offset = redo->offset & REDO_FLAG_MASK;
-	val = (uint64_t *)((uintptr_t)ctx->base + offset);
-	VALGRIND_ADD_TO_TX(val, sizeof(*val));
-	*val = redo->value;
-	VALGRIND_REMOVE_FROM_TX(val, sizeof(*val));
-
-	pmemops_persist(p_ops, val, sizeof(uint64_t));
+	redo_log_apply(ctx, redo, 1);
 
 	redo->offset = 0;
 
@@ -229,6 +301,46 @@ redo_log_recover(const struct redo_ctx *ctx, struct redo_log *redo,
 		redo_log_process(ctx, redo, nentries);
 }
 
+/*
+ * redo_log_check_entry -- (internal) check the offset of a redo log entry,
+ *	or of the array of entries linked by it and all of theirs
+ */
+static int
+redo_log_check_entry(const struct redo_ctx *ctx, const struct redo_log *redo)
+{
+	void *cctx = ctx->check_offset_ctx;
+	uint64_t offset = redo->offset & REDO_FLAG_MASK;
+
+	if (!ctx->check_offset(cctx, offset)) {
+		LOG(15, "redo %p invalid offset %ju", redo, offset);
+		return -1;
+	}
+
+	if ((redo->offset & REDO_LINK_FLAG) == 0)
+		return 0;
+
+	if (redo->value == 0 || !ctx->check_offset(cctx, offset +
+			(redo->value - 1) * sizeof(struct redo_log))) {
+		LOG(15, "redo %p invalid number of linked entries %ju",
+				redo, redo->value);
+		return -1;
+	}
+
+	const struct redo_log *linked = (struct redo_log *)
+		((uintptr_t)ctx->base + offset);
+
+	for (uint64_t i = 0; i < redo->value; ++i) {
+		if ((linked[i].offset & ~REDO_FLAG_MASK) != 0 ||
+				!ctx->check_offset(cctx, linked[i].offset)) {
+			LOG(15, "redo %p invalid linked offset %ju",
+					redo, linked[i].offset);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 /*
  * redo_log_check -- (internal) check consistency of redo log entries
  */
@@ -247,22 +359,14 @@ redo_log_check(const struct redo_ctx *ctx, struct redo_log *redo,
 	}
 
 	if (nflags == 1) {
-		void *cctx = ctx->check_offset_ctx;
-
 		while ((redo->offset & REDO_FINISH_FLAG) == 0) {
-			if (!ctx->check_offset(cctx, redo->offset)) {
-				LOG(15, "redo %p invalid offset %ju",
-						redo, redo->offset);
+			if (redo_log_check_entry(ctx, redo) != 0)
 				return -1;
-			}
 			redo++;
 		}
 
-		uint64_t offset = redo->offset & REDO_FLAG_MASK;
-		if (!ctx->check_offset(cctx, offset)) {
-			LOG(15, "redo %p invalid offset %ju", redo, offset);
+		if (redo_log_check_entry(ctx, redo) != 0)
 			return -1;
-		}
 	}
 
 	return 0;
@@ -64,6 +64,10 @@ void redo_log_config_delete(struct redo_ctx *ctx);
 
 void redo_log_store(const struct redo_ctx *ctx, struct redo_log *redo,
 		size_t index, uint64_t offset, uint64_t value);
+void redo_log_store_linked(const struct redo_ctx *ctx, struct redo_log *linked,
+		size_t index, uint64_t offset, uint64_t value);
+void redo_log_store_link(const struct redo_ctx *ctx, struct redo_log *redo,
+		size_t index, struct redo_log *linked, size_t nlinked);
 void redo_log_store_last(const struct redo_ctx *ctx, struct redo_log *redo,
 		size_t index, uint64_t offset, uint64_t value);
 void redo_log_set_last(const struct redo_ctx *ctx, struct redo_log *redo,
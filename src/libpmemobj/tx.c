@@ -95,10 +95,15 @@ struct tx_undo_runtime {
 struct lane_tx_runtime {
 	PMEMobjpool *pop;
 	struct ctree *ranges;
-	unsigned cache_slot;
+	struct tx_arena *arena; /* chunk of the undo arena in use, if any */
+	uint64_t arena_pos; /* offset of the first free byte in the chunk */
 	struct tx_undo_runtime undo;
 	SLIST_HEAD(txd, tx_data) tx_entries;
 	SLIST_HEAD(txl, tx_lock_data) tx_locks;
+
+	int redo; /* new values are kept in the write set until commit */
+	struct ctree *writes; /* offset -> struct tx_range with new data */
+	size_t redo_size; /* size of the redo log built from the write set */
 };
 
 struct tx_alloc_args {
@@ -232,50 +237,6 @@ constructor_tx_copy(void *ctx, void *ptr, size_t usable_size, void *arg)
 	return 0;
 }
 
-/*
- * constructor_tx_add_range -- (internal) constructor for add_range
- */
-static int
-constructor_tx_add_range(void *ctx, void *ptr, size_t usable_size, void *arg)
-{
-	LOG(3, NULL);
-	PMEMobjpool *pop = ctx;
-
-	ASSERTne(ptr, NULL);
-	ASSERTne(arg, NULL);
-
-	struct tx_add_range_args *args = arg;
-	struct tx_range *range = ptr;
-	const struct pmem_ops *p_ops = &pop->p_ops;
-
-	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
-	/* temporarily add the object copy to the transaction */
-	VALGRIND_ADD_TO_TX(oobh,
-				sizeof(struct tx_range) + args->size
-				+ OBJ_OOB_SIZE);
-
-	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
-
-	range->offset = args->offset;
-	range->size = args->size;
-
-	void *src = OBJ_OFF_TO_PTR(args->pop, args->offset);
-
-	/* flush offset and size */
-	pmemops_flush(p_ops, range, sizeof(struct tx_range));
-	/* memcpy data and persist */
-	pmemops_memcpy_persist(p_ops, range->data, src, args->size);
-
-	VALGRIND_REMOVE_FROM_TX(oobh,
-				sizeof(struct tx_range) + args->size
-				+ OBJ_OOB_SIZE);
-
-	/* do not report changes to the original object */
-	VALGRIND_ADD_TO_TX(src, args->size);
-
-	return 0;
-}
-
 /*
  * tx_set_state -- (internal) set transaction state
  */
@@ -514,15 +475,125 @@ tx_restore_range(PMEMobjpool *pop, struct tx_range *range)
 	}
 }
 
+/*
+ * tx_arena_foreach -- (internal) iterates over the valid entries of the undo
+ *	arena, the entries of every chunk end with the first entry of a
+ *	different generation
+ */
+static void
+tx_arena_foreach(PMEMobjpool *pop, struct lane_tx_layout *layout,
+	void (*cb)(PMEMobjpool *pop, struct tx_range *range))
+{
+	uint64_t gen = layout->arena_gen;
+	struct tx_arena *chunk;
+
+	for (uint64_t off = layout->arena; off != 0; off = chunk->next) {
+		chunk = OBJ_OFF_TO_PTR(pop, off);
+
+		struct tx_arena_entry *e;
+		for (uint64_t pos = 0; pos + sizeof(*e) <= chunk->size;
+				pos += TX_ARENA_ENTRY_SIZE(e->size)) {
+			e = (struct tx_arena_entry *)(chunk->data + pos);
+			if (e->gen != gen)
+				break;
+
+			/* those structures are binary compatible */
+			cb(pop, (struct tx_range *)&e->offset);
+		}
+	}
+}
+
+/*
+ * tx_arena_in_use -- (internal) checks whether the undo arena contains any
+ *	entries of the current generation
+ */
+static int
+tx_arena_in_use(PMEMobjpool *pop, struct lane_tx_layout *layout)
+{
+	struct tx_arena *chunk;
+
+	for (uint64_t off = layout->arena; off != 0; off = chunk->next) {
+		chunk = OBJ_OFF_TO_PTR(pop, off);
+
+		struct tx_arena_entry *e = (struct tx_arena_entry *)chunk->data;
+		if (sizeof(*e) <= chunk->size && e->gen == layout->arena_gen)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * tx_arena_trim -- (internal) frees the chunks of the undo arena which are
+ *	beyond the retained size, starting from the last one
+ */
+static void
+tx_arena_trim(PMEMobjpool *pop, struct lane_tx_layout *layout)
+{
+	uint64_t *tail = &layout->arena;
+	size_t retained = 0;
+
+	while (*tail != 0) {
+		struct tx_arena *chunk = OBJ_OFF_TO_PTR(pop, *tail);
+		retained += chunk->size;
+		if (retained > TX_ARENA_MAX_RETAINED)
+			break;
+
+		tail = &chunk->next;
+	}
+
+	while (*tail != 0) {
+		uint64_t *last = tail;
+		struct tx_arena *chunk = OBJ_OFF_TO_PTR(pop, *last);
+		while (chunk->next != 0) {
+			last = &chunk->next;
+			chunk = OBJ_OFF_TO_PTR(pop, *last);
+		}
+
+		pfree(pop, last);
+	}
+}
+
+/*
+ * tx_arena_reset -- (internal) discards all entries of the undo arena, if
+ *	it has been used by the transaction
+ */
+static void
+tx_arena_reset(PMEMobjpool *pop, struct lane_tx_layout *layout, int recovery)
+{
+	LOG(3, NULL);
+
+	if (recovery) {
+		if (!tx_arena_in_use(pop, layout))
+			return;
+	} else {
+		struct lane_tx_runtime *lane = tx.section->runtime;
+		if (lane->arena == NULL)
+			return;
+	}
+
+	layout->arena_gen++;
+	pmemops_persist(&pop->p_ops, &layout->arena_gen,
+		sizeof(layout->arena_gen));
+
+	tx_arena_trim(pop, layout);
+}
+
 /*
  * tx_foreach_set -- (internal) iterates over every memory range
+ *
+ * Apart from the undo arena, the snapshots can also be found in the undo
+ * log vectors of a transaction interrupted by an older version of the library.
  */
 static void
-tx_foreach_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
+tx_foreach_set(PMEMobjpool *pop, struct lane_tx_layout *layout,
+	struct tx_undo_runtime *tx_rt,
 	void (*cb)(PMEMobjpool *pop, struct tx_range *range))
 {
 	LOG(3, NULL);
 
+	tx_arena_foreach(pop, layout, cb);
+
 	struct tx_range *range = NULL;
 	uint64_t off;
 	struct pvector_context *ctx = tx_rt->ctx[UNDO_SET];
@@ -571,14 +642,17 @@ tx_abort_recover_range(PMEMobjpool *pop, struct tx_range *range)
  * tx_abort_set -- (internal) abort all set operations
  */
 static void
-tx_abort_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt, int recovery)
+tx_abort_set(PMEMobjpool *pop, struct lane_tx_layout *layout,
+	struct tx_undo_runtime *tx_rt, int recovery)
 {
 	LOG(3, NULL);
 
 	if (recovery)
-		tx_foreach_set(pop, tx_rt, tx_abort_recover_range);
+		tx_foreach_set(pop, layout, tx_rt, tx_abort_recover_range);
 	else
-		tx_foreach_set(pop, tx_rt, tx_abort_restore_range);
+		tx_foreach_set(pop, layout, tx_rt, tx_abort_restore_range);
+
+	tx_arena_reset(pop, layout, recovery);
 
 	tx_clear_undo_log(pop, tx_rt->ctx[UNDO_SET_CACHE],
 		TX_CLR_FLAG_FREE | TX_CLR_FLAG_VG_CLEAN);
@@ -656,49 +730,236 @@ tx_post_commit_range_vg_tx_remove(PMEMobjpool *pop, struct tx_range *range)
  * add range
  */
 static void
-tx_post_commit_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
-		int recovery)
+tx_post_commit_set(PMEMobjpool *pop, struct lane_tx_layout *layout,
+	struct tx_undo_runtime *tx_rt, int recovery)
 {
 	LOG(3, NULL);
 
 #ifdef USE_VG_PMEMCHECK
 	if (On_valgrind)
-		tx_foreach_set(pop, tx_rt, tx_post_commit_range_vg_tx_remove);
+		tx_foreach_set(pop, layout, tx_rt,
+			tx_post_commit_range_vg_tx_remove);
 #endif
 
-	struct pvector_context *cache_undo = tx_rt->ctx[UNDO_SET_CACHE];
-	uint64_t first_cache = pvector_first(cache_undo);
-	uint64_t off;
+	tx_arena_reset(pop, layout, recovery);
 
-	int zero_all = recovery;
+	/* the range caches are no longer reused */
+	tx_clear_undo_log(pop, tx_rt->ctx[UNDO_SET_CACHE], TX_CLR_FLAG_FREE);
+	tx_clear_undo_log(pop, tx_rt->ctx[UNDO_SET], TX_CLR_FLAG_FREE);
+}
 
-	while ((off = pvector_last(cache_undo)) != first_cache) {
-		pvector_pop_back(cache_undo, tx_free_vec_entry);
-		zero_all = 1;
+/*
+ * tx_writes_free_range -- (internal) frees one range of the write set
+ */
+static void
+tx_writes_free_range(uint64_t offset, uint64_t value, void *ctx)
+{
+	Free((void *)value);
+}
+
+/*
+ * tx_writes_delete -- (internal) discards the write set of the transaction
+ */
+static void
+tx_writes_delete(struct lane_tx_runtime *lane)
+{
+	if (lane->writes == NULL)
+		return;
+
+	ctree_delete_cb(lane->writes, tx_writes_free_range, NULL);
+	lane->writes = NULL;
+	lane->redo_size = 0;
+}
+
+/*
+ * tx_redo_copy_range -- (internal) appends one range of the write set to
+ *	the redo log
+ */
+static void
+tx_redo_copy_range(uint64_t offset, uint64_t value, void *ctx)
+{
+	struct tx_range *src = (struct tx_range *)value;
+	uint8_t **pos = ctx;
+
+	memcpy(*pos, src, sizeof(*src) + src->size);
+	*pos += TX_REDO_RANGE_SIZE(src->size);
+
+	Free(src);
+}
+
+/*
+ * tx_redo_write -- (internal) moves the write set to the redo log
+ */
+static void
+tx_redo_write(PMEMobjpool *pop, struct lane_tx_runtime *lane, void *ptr)
+{
+	size_t size = lane->redo_size + sizeof(struct tx_range);
+
+	VALGRIND_ADD_TO_TX(ptr, size);
+
+	uint8_t *pos = ptr;
+	ctree_delete_cb(lane->writes, tx_redo_copy_range, &pos);
+	lane->writes = NULL;
+
+	/* the terminating range */
+	memset(pos, 0, sizeof(struct tx_range));
+
+	pmemops_persist(&pop->p_ops, ptr, size);
+
+	VALGRIND_REMOVE_FROM_TX(ptr, size);
+}
+
+/*
+ * tx_redo_invalidate -- (internal) terminates the redo log at its first range
+ *
+ * The redo log is kept in the lane between transactions, so it has to be
+ * emptied once it's applied or abandoned. Otherwise the next transaction
+ * which commits without writes would apply it again. The flush is drained
+ * before the next transaction is marked as committed.
+ */
+static void
+tx_redo_invalidate(PMEMobjpool *pop, struct lane_tx_layout *layout)
+{
+	struct tx_range *range = OBJ_OFF_TO_PTR(pop, layout->redo_log);
+	if (range->offset == 0)
+		return;
+
+	VALGRIND_ADD_TO_TX(&range->offset, sizeof(range->offset));
+	range->offset = 0;
+	pmemops_flush(&pop->p_ops, &range->offset, sizeof(range->offset));
+	VALGRIND_REMOVE_FROM_TX(&range->offset, sizeof(range->offset));
+}
+
+/*
+ * constructor_tx_redo_log -- (internal) constructor for the redo log
+ */
+static int
+constructor_tx_redo_log(void *ctx, void *ptr, size_t usable_size, void *arg)
+{
+	LOG(3, NULL);
+	PMEMobjpool *pop = ctx;
+
+	ASSERTne(ptr, NULL);
+	ASSERTne(arg, NULL);
+
+	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+	VALGRIND_ADD_TO_TX(oobh, OBJ_OOB_SIZE);
+
+	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
+	pmemops_flush(&pop->p_ops, &oobh->size, sizeof(oobh->size));
+
+	VALGRIND_REMOVE_FROM_TX(oobh, OBJ_OOB_SIZE);
+
+	tx_redo_write(pop, arg, ptr);
+
+	return 0;
+}
+
+/*
+ * tx_pre_commit_redo -- (internal) writes the redo log of the transaction
+ *
+ * The redo log of the previous transaction of the lane is reused if it's big
+ * enough, a new one is allocated only when the log overflows it.
+ */
+static int
+tx_pre_commit_redo(PMEMobjpool *pop, struct lane_tx_runtime *lane,
+	struct lane_tx_layout *layout)
+{
+	LOG(3, NULL);
+
+	if (ctree_is_empty_unlocked(lane->writes)) {
+		tx_writes_delete(lane);
+		return 0;
 	}
 
-	if (first_cache != 0) {
-		struct tx_range_cache *cache = OBJ_OFF_TO_PTR(pop, first_cache);
+	size_t size = lane->redo_size + sizeof(struct tx_range);
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("redo log too large");
+		return ENOMEM;
+	}
 
-		size_t sz;
-		if (zero_all) {
-			sz = sizeof(*cache);
-		} else {
-			struct lane_tx_runtime *r = tx.section->runtime;
-			sz = sizeof(cache->range[0]) * r->cache_slot;
+	if (layout->redo_log != 0) {
+		if (palloc_usable_size(&pop->heap, layout->redo_log) -
+				OBJ_OOB_SIZE >= size) {
+			tx_redo_write(pop, lane,
+				OBJ_OFF_TO_PTR(pop, layout->redo_log));
+			lane->redo_size = 0;
+
+			return 0;
 		}
 
-		VALGRIND_ADD_TO_TX(cache, sz);
-		pmemops_memset_persist(&pop->p_ops, cache, 0, sz);
-		VALGRIND_REMOVE_FROM_TX(cache, sz);
+		pfree(pop, &layout->redo_log);
+	}
 
-#ifdef DEBUG
-		if (!zero_all) /* for recovery we know we zeroed everything */
-			ASSERTeq(util_is_zeroed(cache, sizeof(*cache)), 1);
-#endif
+	if (pmalloc_construct(pop, &layout->redo_log, size + OBJ_OOB_SIZE,
+			constructor_tx_redo_log, lane) != 0) {
+		ERR("!cannot allocate redo log");
+		return ENOMEM;
 	}
 
-	tx_clear_undo_log(pop, tx_rt->ctx[UNDO_SET], TX_CLR_FLAG_FREE);
+	lane->redo_size = 0;
+
+	return 0;
+}
+
+/*
+ * tx_post_commit_redo -- (internal) applies the redo log
+ *
+ * The log is kept for the next transaction of the lane, unless it's too big
+ * or the pool is being recovered.
+ */
+static void
+tx_post_commit_redo(PMEMobjpool *pop, struct lane_tx_layout *layout,
+	int recovery)
+{
+	LOG(3, NULL);
+
+	if (layout->redo_log == 0)
+		return;
+
+	const struct pmem_ops *p_ops = &pop->p_ops;
+	uint8_t *pos = OBJ_OFF_TO_PTR(pop, layout->redo_log);
+	struct tx_range *range = (struct tx_range *)pos;
+
+	/* the transaction didn't write anything through the redo log */
+	if (range->offset == 0 && !recovery)
+		return;
+
+	for (; range->offset != 0; pos += TX_REDO_RANGE_SIZE(range->size),
+			range = (struct tx_range *)pos) {
+		void *dest = OBJ_OFF_TO_PTR(pop, range->offset);
+
+		VALGRIND_ADD_TO_TX(dest, range->size);
+		memcpy(dest, range->data, range->size);
+		pmemops_flush(p_ops, dest, range->size);
+		VALGRIND_REMOVE_FROM_TX(dest, range->size);
+	}
+
+	pmemops_drain(p_ops);
+
+	if (recovery || palloc_usable_size(&pop->heap, layout->redo_log) -
+			OBJ_OOB_SIZE > TX_REDO_MAX_RETAINED)
+		pfree(pop, &layout->redo_log);
+	else
+		tx_redo_invalidate(pop, layout);
+}
+
+/*
+ * tx_abort_redo -- (internal) discards the redo log of an uncommitted
+ *	transaction, the log is freed only by the recovery
+ */
+static void
+tx_abort_redo(PMEMobjpool *pop, struct lane_tx_layout *layout, int recovery)
+{
+	LOG(3, NULL);
+
+	if (layout->redo_log == 0)
+		return;
+
+	if (recovery)
+		pfree(pop, &layout->redo_log);
+	else
+		tx_redo_invalidate(pop, layout);
 }
 
 /*
@@ -790,7 +1051,8 @@ tx_post_commit(PMEMobjpool *pop, struct lane_tx_layout *layout, int recovery)
 		tx_rt = &lane->undo;
 	}
 
-	tx_post_commit_set(pop, tx_rt, recovery);
+	tx_post_commit_redo(pop, layout, recovery);
+	tx_post_commit_set(pop, layout, tx_rt, recovery);
 	tx_post_commit_alloc(pop, tx_rt);
 	tx_post_commit_free(pop, tx_rt);
 
@@ -850,10 +1112,20 @@ tx_abort(PMEMobjpool *pop, struct lane_tx_runtime *lane,
 		tx_abort_register_valgrind(pop, tx_rt->ctx[UNDO_SET]);
 		tx_abort_register_valgrind(pop, tx_rt->ctx[UNDO_ALLOC]);
 		tx_abort_register_valgrind(pop, tx_rt->ctx[UNDO_SET_CACHE]);
+
+		if (layout->redo_log != 0) {
+			void *p = (char *)pop + layout->redo_log;
+			size_t sz = palloc_usable_size(&pop->heap,
+				layout->redo_log) - OBJ_OOB_SIZE;
+
+			VALGRIND_DO_MEMPOOL_ALLOC(pop->heap.layout, p, sz);
+			VALGRIND_DO_MAKE_MEM_DEFINED(p, sz);
+		}
 	}
 #endif
 
-	tx_abort_set(pop, tx_rt, recovery);
+	tx_abort_redo(pop, layout, recovery);
+	tx_abort_set(pop, layout, tx_rt, recovery);
 	tx_abort_alloc(pop, tx_rt);
 	tx_abort_free(pop, tx_rt);
 
@@ -863,6 +1135,7 @@ tx_abort(PMEMobjpool *pop, struct lane_tx_runtime *lane,
 		ASSERTne(lane, NULL);
 		ctree_delete(lane->ranges);
 		lane->ranges = NULL;
+		tx_writes_delete(lane);
 	}
 }
 
@@ -963,6 +1236,173 @@ release_and_free_tx_locks(struct lane_tx_runtime *lane)
 	}
 }
 
+/*
+ * tx_writes_overlay -- (internal) copies the data of the write set that
+ *	overlaps with the given range on top of its persistent contents
+ */
+static void
+tx_writes_overlay(struct lane_tx_runtime *lane, uint64_t offset,
+	void *dest, size_t size)
+{
+	if (lane->writes == NULL || size == 0)
+		return;
+
+	uint64_t end = offset + size;
+	uint64_t key = end - 1;
+	uint64_t value;
+
+	while ((value = ctree_find_le_unlocked(lane->writes, &key)) != 0) {
+		struct tx_range *range = (struct tx_range *)value;
+		uint64_t range_end = range->offset + range->size;
+		if (range_end <= offset)
+			break;
+
+		uint64_t lo = range->offset > offset ? range->offset : offset;
+		uint64_t hi = range_end < end ? range_end : end;
+		memcpy((char *)dest + (lo - offset),
+			range->data + (lo - range->offset), hi - lo);
+
+		key = range->offset - 1;
+	}
+}
+
+/*
+ * tx_writes_insert -- (internal) adds new data to the write set, merging it
+ *	with the overlapping and adjacent ranges
+ *
+ * On failure the write set may lose some of its ranges, which is fine because
+ * the transaction is aborted.
+ */
+static int
+tx_writes_insert(struct lane_tx_runtime *lane, uint64_t offset,
+	const void *src, size_t size)
+{
+	uint64_t end = offset + size;
+	uint64_t lo = offset;
+	uint64_t hi = end;
+	uint64_t key = end;
+	uint64_t value;
+
+	/* find the bounds of the merged range */
+	while ((value = ctree_find_le_unlocked(lane->writes, &key)) != 0) {
+		struct tx_range *range = (struct tx_range *)value;
+		uint64_t range_end = range->offset + range->size;
+		if (range_end < offset)
+			break;
+
+		if (range->offset <= offset && range_end >= end) {
+			/* the new data fits in an existing range */
+			memcpy(range->data + (offset - range->offset),
+				src, size);
+			return 0;
+		}
+
+		if (range->offset < lo)
+			lo = range->offset;
+		if (range_end > hi)
+			hi = range_end;
+
+		key = range->offset - 1;
+	}
+
+	struct tx_range *merged = Malloc(sizeof(*merged) + (hi - lo));
+	if (merged == NULL) {
+		ERR("!Malloc");
+		return ENOMEM;
+	}
+
+	merged->offset = lo;
+	merged->size = hi - lo;
+
+	key = end;
+	while ((value = ctree_find_le_unlocked(lane->writes, &key)) != 0) {
+		struct tx_range *range = (struct tx_range *)value;
+		if (range->offset + range->size < offset)
+			break;
+
+		memcpy(merged->data + (range->offset - lo), range->data,
+			range->size);
+
+		ctree_remove_unlocked(lane->writes, range->offset, 1);
+		lane->redo_size -= TX_REDO_RANGE_SIZE(range->size);
+		Free(range);
+
+		key = end;
+	}
+
+	memcpy(merged->data + (offset - lo), src, size);
+
+	if (ctree_insert_unlocked(lane->writes, lo, (uint64_t)merged) != 0) {
+		Free(merged);
+		return ENOMEM;
+	}
+
+	lane->redo_size += TX_REDO_RANGE_SIZE(merged->size);
+
+	return 0;
+}
+
+/*
+ * tx_writes_discard -- (internal) removes the given range from the write set,
+ *	used when an object allocated in the transaction is freed
+ */
+static int
+tx_writes_discard(struct lane_tx_runtime *lane, uint64_t offset, size_t size)
+{
+	if (lane->writes == NULL || size == 0)
+		return 0;
+
+	uint64_t end = offset + size;
+	uint64_t key = end - 1;
+	uint64_t value;
+
+	while ((value = ctree_find_le_unlocked(lane->writes, &key)) != 0) {
+		struct tx_range *range = (struct tx_range *)value;
+		uint64_t range_end = range->offset + range->size;
+		if (range_end <= offset)
+			break;
+
+		if (range_end > end) {
+			/* keep the part past the discarded range */
+			struct tx_range *tail =
+				Malloc(sizeof(*tail) + (range_end - end));
+			if (tail == NULL) {
+				ERR("!Malloc");
+				return ENOMEM;
+			}
+
+			tail->offset = end;
+			tail->size = range_end - end;
+			memcpy(tail->data, range->data + (end - range->offset),
+				tail->size);
+
+			if (ctree_insert_unlocked(lane->writes, end,
+					(uint64_t)tail) != 0) {
+				Free(tail);
+				return ENOMEM;
+			}
+
+			lane->redo_size += TX_REDO_RANGE_SIZE(tail->size);
+		}
+
+		lane->redo_size -= TX_REDO_RANGE_SIZE(range->size);
+
+		if (range->offset < offset) {
+			/* keep the part before the discarded range */
+			range->size = offset - range->offset;
+			lane->redo_size += TX_REDO_RANGE_SIZE(range->size);
+			break;
+		}
+
+		ctree_remove_unlocked(lane->writes, range->offset, 1);
+		Free(range);
+
+		key = end - 1;
+	}
+
+	return 0;
+}
+
 /*
  * tx_alloc_common -- (internal) common function for alloc and zalloc
  */
@@ -1129,6 +1569,10 @@ tx_realloc_common(PMEMoid oid, size_t size, uint64_t type_num,
 			ptr, copy_size, constructor_realloc, flags);
 
 	if (!OBJ_OID_IS_NULL(new_obj)) {
+		/* the copy includes the new data from the write set */
+		tx_writes_overlay(lane, oid.off,
+			OBJ_OFF_TO_PTR(lane->pop, new_obj.off), copy_size);
+
 		if (pmemobj_tx_free(oid)) {
 			ERR("pmemobj_tx_free failed");
 			pvector_pop_back(lane->undo.ctx[UNDO_ALLOC],
@@ -1168,7 +1612,11 @@ pmemobj_tx_begin(PMEMobjpool *pop, jmp_buf env, ...)
 		SLIST_INIT(&lane->tx_entries);
 		SLIST_INIT(&lane->tx_locks);
 		lane->ranges = ctree_new();
-		lane->cache_slot = 0;
+		lane->arena = NULL;
+		lane->arena_pos = 0;
+		lane->redo = 0;
+		lane->writes = NULL;
+		lane->redo_size = 0;
 
 		struct lane_tx_layout *layout =
 			(struct lane_tx_layout *)tx.section->layout;
@@ -1224,6 +1672,26 @@ pmemobj_tx_begin(PMEMobjpool *pop, jmp_buf env, ...)
 
 			tx.stage_callback = cb;
 			tx.stage_callback_arg = arg;
+		} else if (param_type == TX_PARAM_REDO) {
+			if (SLIST_NEXT(txd, tx_entry) != NULL && !lane->redo) {
+				ERR("redo mode can be selected only by "
+					"the outermost transaction");
+				err = EINVAL;
+				va_end(argp);
+				goto err_abort;
+			}
+
+			if (lane->writes == NULL) {
+				lane->writes = ctree_new();
+				if (lane->writes == NULL) {
+					err = ENOMEM;
+					ERR("!ctree_new");
+					va_end(argp);
+					goto err_abort;
+				}
+			}
+
+			lane->redo = 1;
 		} else {
 			err = add_to_tx_and_lock(lane, param_type,
 					va_arg(argp, void *));
@@ -1380,6 +1848,14 @@ pmemobj_tx_commit()
 		PMEMobjpool *pop = lane->pop;
 
 		/* pre-commit phase */
+		if (lane->writes != NULL) {
+			int err = tx_pre_commit_redo(pop, lane, layout);
+			if (err != 0) {
+				obj_tx_abort(err, 0);
+				return;
+			}
+		}
+
 		tx_pre_commit(pop, lane);
 
 		pmemops_drain(&pop->p_ops);
@@ -1434,14 +1910,12 @@ pmemobj_tx_end()
 		struct lane_tx_layout *layout =
 			(struct lane_tx_layout *)tx.section->layout;
 
-		/* cleanup cache */
-		lane->cache_slot = 0;
-
 		/* the transaction state and undo log should be clear */
 		ASSERTeq(layout->state, TX_STATE_NONE);
 		if (layout->state != TX_STATE_NONE)
 			LOG(2, "invalid transaction state");
 
+		ASSERTeq(lane->writes, NULL);
 		ASSERTeq(pvector_nvalues(lane->undo.ctx[UNDO_ALLOC]), 0);
 		ASSERTeq(pvector_nvalues(lane->undo.ctx[UNDO_SET]), 0);
 		ASSERTeq(pvector_nvalues(lane->undo.ctx[UNDO_FREE]), 0);
@@ -1506,140 +1980,165 @@ pmemobj_tx_process()
 }
 
 /*
- * pmemobj_tx_add_large -- (internal) adds large memory range to undo log
+ * constructor_tx_arena -- (internal) constructor for a chunk of undo arena
  */
 static int
-pmemobj_tx_add_large(struct tx_add_range_args *args)
-{
-	struct lane_tx_runtime *runtime = tx.section->runtime;
-	struct pvector_context *undo = runtime->undo.ctx[UNDO_SET];
-	uint64_t *entry = pvector_push_back(undo);
-	if (entry == NULL) {
-		ERR("large set undo log too large");
-		return -1;
-	}
-
-	/* insert snapshot to undo log */
-	int ret = pmalloc_construct(args->pop, entry,
-			args->size + sizeof(struct tx_range) + OBJ_OOB_SIZE,
-			constructor_tx_add_range, args);
-
-	if (ret != 0) {
-		pvector_pop_back(undo, NULL);
-	}
-
-	return ret;
-}
-
-/*
- * constructor_tx_range_cache -- (internal) cache constructor
- */
-static int
-constructor_tx_range_cache(void *ctx, void *ptr, size_t usable_size, void *arg)
+constructor_tx_arena(void *ctx, void *ptr, size_t usable_size, void *arg)
 {
 	LOG(3, NULL);
 	PMEMobjpool *pop = ctx;
 	const struct pmem_ops *p_ops = &pop->p_ops;
 
 	ASSERTne(ptr, NULL);
+	ASSERT(usable_size > sizeof(struct tx_arena));
+
+	struct tx_arena *chunk = ptr;
+	size_t size = sizeof(*chunk) + sizeof(struct tx_arena_entry);
 
 	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
-	/* temporarily add the object copy to the transaction */
-	VALGRIND_ADD_TO_TX(oobh,
-		OBJ_OOB_SIZE + sizeof(struct tx_range_cache));
+	VALGRIND_ADD_TO_TX(oobh, OBJ_OOB_SIZE + size);
 
 	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
 	pmemops_flush(p_ops, &oobh->size, sizeof(oobh->size));
 
-	pmemops_memset_persist(p_ops, ptr, 0, sizeof(struct tx_range_cache));
+	chunk->next = 0;
+	chunk->size = usable_size - sizeof(*chunk);
 
-	VALGRIND_REMOVE_FROM_TX(oobh,
-		OBJ_OOB_SIZE + sizeof(struct tx_range_cache));
+	/* the first entry must not be mistaken for a valid one */
+	memset(chunk->data, 0, sizeof(struct tx_arena_entry));
+	pmemops_persist(p_ops, chunk, size);
+
+	VALGRIND_REMOVE_FROM_TX(oobh, OBJ_OOB_SIZE + size);
 
 	return 0;
 }
 
 /*
- * pmemobj_tx_get_range_cache -- (internal) returns first available cache
+ * tx_arena_next -- (internal) returns the first chunk of the undo arena after
+ *	the given one with enough space for the entry, the arena grows if there
+ *	is no such chunk
  */
-static struct tx_range_cache *
-pmemobj_tx_get_range_cache(PMEMobjpool *pop, struct pvector_context *undo)
+static struct tx_arena *
+tx_arena_next(PMEMobjpool *pop, struct lane_tx_layout *layout,
+	struct tx_arena *chunk, size_t size)
 {
-	uint64_t last_cache = pvector_last(undo);
+	uint64_t *next = chunk ? &chunk->next : &layout->arena;
 
-	struct tx_range_cache *cache = NULL;
-	/* get the last element from the caches list */
-	if (last_cache != 0)
-		cache = OBJ_OFF_TO_PTR(pop, last_cache);
+	if (layout->arena_gen == 0) {
+		/* zeroed entries are never valid */
+		layout->arena_gen = 1;
+		pmemops_persist(&pop->p_ops, &layout->arena_gen,
+			sizeof(layout->arena_gen));
+	}
 
-	/* verify if the cache exists and has at least one free slot */
-	if (cache == NULL || cache->range[MAX_CACHED_RANGES - 1].offset != 0) {
-		/* no existing cache, allocate a new one */
-		uint64_t *entry = pvector_push_back(undo);
-		if (entry == NULL) {
-			ERR("cache set undo log too large");
-			return NULL;
-		}
-		int err = pmalloc_construct(pop, entry,
-			sizeof(struct tx_range_cache) + OBJ_OOB_SIZE,
-			constructor_tx_range_cache, NULL);
+	/* the chunks too small for the entry are left empty */
+	for (; *next != 0; next = &chunk->next) {
+		chunk = OBJ_OFF_TO_PTR(pop, *next);
+		if (size <= chunk->size)
+			return chunk;
+	}
 
-		if (err != 0) {
-			pvector_pop_back(undo, NULL);
-			return NULL;
-		}
+	size_t chunk_size = TX_ARENA_MIN_SIZE;
+	if (chunk != NULL && chunk->size * 2 > chunk_size)
+		chunk_size = chunk->size * 2;
+	if (size > chunk_size)
+		chunk_size = size;
+
+	chunk_size += sizeof(struct tx_arena);
+	if (chunk_size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("undo arena too large");
+		return NULL;
+	}
+
+	if (pmalloc_construct(pop, next, chunk_size + OBJ_OOB_SIZE,
+			constructor_tx_arena, NULL) != 0) {
+		ERR("!cannot grow undo arena");
+		return NULL;
+	}
+
+	return OBJ_OFF_TO_PTR(pop, *next);
+}
 
-		cache = OBJ_OFF_TO_PTR(pop, *entry);
+/*
+ * tx_arena_reserve -- (internal) bump-allocates the space for the next entry
+ *	of the undo arena
+ */
+static struct tx_arena_entry *
+tx_arena_reserve(PMEMobjpool *pop, struct lane_tx_layout *layout, size_t size)
+{
+	struct lane_tx_runtime *lane = tx.section->runtime;
 
-		/* since the cache is new, we start the count from 0 */
-		struct lane_tx_runtime *runtime = tx.section->runtime;
-		runtime->cache_slot = 0;
+	if (lane->arena == NULL || lane->arena_pos + size > lane->arena->size) {
+		struct tx_arena *chunk = tx_arena_next(pop, layout,
+			lane->arena, size);
+		if (chunk == NULL)
+			return NULL;
+
+		lane->arena = chunk;
+		lane->arena_pos = 0;
 	}
 
-	return cache;
+	struct tx_arena_entry *e =
+		(struct tx_arena_entry *)(lane->arena->data + lane->arena_pos);
+	lane->arena_pos += size;
+
+	return e;
 }
 
 /*
- * pmemobj_tx_add_small -- (internal) adds small memory range to undo log cache
+ * pmemobj_tx_add_snapshot -- (internal) adds memory range to the undo arena
  */
 static int
-pmemobj_tx_add_small(struct tx_add_range_args *args)
+pmemobj_tx_add_snapshot(struct tx_add_range_args *args)
 {
 	PMEMobjpool *pop = args->pop;
+	const struct pmem_ops *p_ops = &pop->p_ops;
 
 	struct lane_tx_runtime *runtime = tx.section->runtime;
-	struct pvector_context *undo = runtime->undo.ctx[UNDO_SET_CACHE];
-	const struct pmem_ops *p_ops = &pop->p_ops;
+	struct lane_tx_layout *layout =
+		(struct lane_tx_layout *)tx.section->layout;
+
+	size_t size = TX_ARENA_ENTRY_SIZE(args->size);
+	struct tx_arena_entry *e = tx_arena_reserve(pop, layout, size);
+	if (e == NULL)
+		return -1;
 
-	struct tx_range_cache *cache = pmemobj_tx_get_range_cache(pop, undo);
-	if (cache == NULL) {
-		ERR("Failed to create range cache");
-		return 1;
+	/* the entry is followed by a terminator, unless it ends the chunk */
+	struct tx_arena_entry *t = NULL;
+	if (runtime->arena_pos + sizeof(*t) <= runtime->arena->size) {
+		t = (struct tx_arena_entry *)
+			(runtime->arena->data + runtime->arena_pos);
+		size += sizeof(t->gen);
 	}
 
-	unsigned n = runtime->cache_slot++; /* first free cache slot */
+	VALGRIND_ADD_TO_TX(e, size);
 
-	ASSERT(n != MAX_CACHED_RANGES);
+	void *src = OBJ_OFF_TO_PTR(pop, args->offset);
 
-	/* those structures are binary compatible */
-	struct tx_range *range = (struct tx_range *)&cache->range[n];
-	VALGRIND_ADD_TO_TX(range,
-		sizeof(struct tx_range) + MAX_CACHED_RANGE_SIZE);
+	/*
+	 * Only the header and the terminator are flushed on their own, so that
+	 * the data can be copied with non-temporal stores. The fence which
+	 * follows the copy covers all three.
+	 */
+	e->offset = args->offset;
+	e->size = args->size;
+	pmemops_flush(p_ops, &e->offset, sizeof(e->offset) + sizeof(e->size));
 
-	/* this isn't transactional so we have to keep the order */
-	void *src = OBJ_OFF_TO_PTR(pop, args->offset);
-	VALGRIND_ADD_TO_TX(src, args->size);
+	if (t != NULL) {
+		t->gen = 0;
+		pmemops_flush(p_ops, &t->gen, sizeof(t->gen));
+	}
 
-	pmemops_memcpy_persist(p_ops, range->data, src, args->size);
+	pmemops_memcpy_persist(p_ops, e->data, src, args->size);
 
-	/* the range is only valid if both size and offset are != 0 */
-	range->size = args->size;
-	range->offset = args->offset;
-	pmemops_persist(p_ops, range,
-		sizeof(range->offset) + sizeof(range->size));
+	/* this isn't transactional, the entry is valid once gen is set */
+	e->gen = layout->arena_gen;
+	pmemops_persist(p_ops, &e->gen, sizeof(e->gen));
 
-	VALGRIND_REMOVE_FROM_TX(range,
-		sizeof(struct tx_range) + MAX_CACHED_RANGE_SIZE);
+	VALGRIND_REMOVE_FROM_TX(e, size);
+
+	/* do not report changes to the original object */
+	VALGRIND_ADD_TO_TX(src, args->size);
 
 	return 0;
 }
@@ -1708,14 +2207,7 @@ pmemobj_tx_add_common(struct tx_add_range_args *args)
 			nargs.size = apoint - nargs.offset;
 		}
 
-		/*
-		 * Depending on the size of the block, either allocate an
-		 * entire new object or use cache.
-		 */
-		ret = nargs.size > MAX_CACHED_RANGE_SIZE ?
-			pmemobj_tx_add_large(&nargs) :
-			pmemobj_tx_add_small(&nargs);
-
+		ret = pmemobj_tx_add_snapshot(&nargs);
 		if (ret != 0)
 			break;
 
@@ -1884,6 +2376,91 @@ pmemobj_tx_xadd_range(PMEMoid oid, uint64_t hoff, size_t size, uint64_t flags)
 	return 0;
 }
 
+/*
+ * pmemobj_tx_write -- writes data to persistent memory within the transaction
+ */
+int
+pmemobj_tx_write(void *dest, const void *src, size_t len)
+{
+	LOG(3, NULL);
+
+	ASSERT_IN_TX();
+	ASSERT_TX_STAGE_WORK();
+
+	struct lane_tx_runtime *lane =
+		(struct lane_tx_runtime *)tx.section->runtime;
+	PMEMobjpool *pop = lane->pop;
+
+	if (!OBJ_PTR_FROM_POOL(pop, dest)) {
+		ERR("object outside of pool");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	struct tx_add_range_args args = {
+		.pop = pop,
+		.offset = (uint64_t)((char *)dest - (char *)pop),
+		.size = len,
+		.flags = 0,
+	};
+
+	if (!lane->redo) {
+		int ret = pmemobj_tx_add_common(&args);
+		if (ret == 0)
+			memcpy(dest, src, len);
+
+		return ret;
+	}
+
+	if (len > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("write size too large");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	if (args.offset < pop->heap_offset ||
+		(args.offset + len) > (pop->heap_offset + pop->heap_size)) {
+		ERR("object outside of heap");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	if (len == 0)
+		return 0;
+
+	if (tx_writes_insert(lane, args.offset, src, len) != 0) {
+		ERR("out of memory");
+		return obj_tx_abort_err(ENOMEM);
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_tx_read -- reads persistent memory as seen by the transaction
+ */
+int
+pmemobj_tx_read(void *dest, const void *src, size_t len)
+{
+	LOG(3, NULL);
+
+	ASSERT_IN_TX();
+	ASSERT_TX_STAGE_WORK();
+
+	struct lane_tx_runtime *lane =
+		(struct lane_tx_runtime *)tx.section->runtime;
+	PMEMobjpool *pop = lane->pop;
+
+	if (!OBJ_PTR_FROM_POOL(pop, src) ||
+		len > pop->size - (size_t)((char *)src - (char *)pop)) {
+		ERR("object outside of pool");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	memcpy(dest, src, len);
+	tx_writes_overlay(lane, (uint64_t)((char *)src - (char *)pop),
+		dest, len);
+
+	return 0;
+}
+
 /*
  * pmemobj_tx_alloc -- allocates a new object
  */
@@ -2054,6 +2631,14 @@ pmemobj_tx_free(PMEMoid oid)
 		}
 #endif
 
+		/* the memory of the object can be reused right away */
+		if (lane->writes != NULL && tx_writes_discard(lane, oid.off,
+				palloc_usable_size(&pop->heap, oid.off) -
+				OBJ_OOB_SIZE) != 0) {
+			ERR("out of memory");
+			return obj_tx_abort_err(ENOMEM);
+		}
+
 		if (ctree_remove_unlocked(lane->ranges, oid.off, 1) != oid.off)
 			FATAL("TX undo state mismatch");
 
@@ -2073,7 +2658,7 @@ pmemobj_tx_free(PMEMoid oid)
 				OPERATION_SET);
 
 		pmalloc_operation(&pop->heap, *entry_offset,
-			entry_offset, 0, NULL, NULL, &ctx);
+			entry_offset, 0, NULL, NULL, 0, &ctx);
 
 		pmalloc_redo_release(pop);
 	}
@@ -2104,6 +2689,7 @@ lane_transaction_destroy_rt(PMEMobjpool *pop, void *rt)
 {
 	struct lane_tx_runtime *lane = rt;
 	tx_destroy_undo_runtime(&lane->undo);
+	tx_writes_delete(lane);
 	Free(lane);
 }
 
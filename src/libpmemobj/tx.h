@@ -41,9 +41,8 @@
 #include "pvector.h"
 
 /*
- * To make sure that the range cache does not needlessly waste memory in the
- * allocator, the values set here must very closely match allocation class
- * sizes. A good value to aim for is multiples of 1024 bytes.
+ * Range caches are no longer created, these values only describe the ones
+ * left in the undo log by older versions of the library.
  */
 #define MAX_CACHED_RANGE_SIZE 32
 #define MAX_CACHED_RANGES 169
@@ -59,6 +58,20 @@ struct tx_range {
 	uint8_t data[];
 };
 
+/*
+ * The redo log of a transaction is a single object with the ranges written
+ * back to back, each padded to 8 bytes, and terminated by a zeroed range.
+ */
+#define TX_REDO_RANGE_SIZE(size)\
+	(sizeof(struct tx_range) + (((size) + 7) & ~7ULL))
+
+/*
+ * The redo log object is kept in the lane and reused by the following
+ * transactions, unless it's bigger than this. Its ranges are valid only while
+ * the transaction is in the committed state.
+ */
+#define TX_REDO_MAX_RETAINED (1 << 20) /* 1 megabyte */
+
 struct tx_range_cache {
 	struct { /* compatible with struct tx_range */
 		uint64_t offset;
@@ -67,6 +80,32 @@ struct tx_range_cache {
 	} range[MAX_CACHED_RANGES];
 };
 
+/*
+ * The snapshots of a transaction are bump-allocated in the undo arena of its
+ * lane, a list of chunks which are kept between transactions. An entry is
+ * valid only if its generation is equal to the generation of the arena, so
+ * the whole arena is discarded by incrementing the latter once the
+ * transaction is finished.
+ */
+#define TX_ARENA_MIN_SIZE (1 << 13) /* 8 kilobytes */
+#define TX_ARENA_MAX_RETAINED (1 << 20) /* 1 megabyte */
+
+struct tx_arena {
+	uint64_t next; /* offset of the next chunk */
+	uint64_t size; /* size of the data */
+	uint8_t data[];
+};
+
+struct tx_arena_entry {
+	uint64_t gen;
+	uint64_t offset; /* offset and the rest compatible with tx_range */
+	uint64_t size;
+	uint8_t data[];
+};
+
+#define TX_ARENA_ENTRY_SIZE(size)\
+	(sizeof(struct tx_arena_entry) + (((size) + 7) & ~7ULL))
+
 enum undo_types {
 	UNDO_ALLOC,
 	UNDO_FREE,
@@ -79,6 +118,9 @@ enum undo_types {
 struct lane_tx_layout {
 	uint64_t state;
 	struct pvector undo_log[MAX_UNDO_TYPES];
+	uint64_t redo_log; /* offset of the redo log object */
+	uint64_t arena; /* offset of the first chunk of the undo arena */
+	uint64_t arena_gen; /* generation of the undo arena */
 };
 
 /*
@@ -0,0 +1,437 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * type_index.c -- volatile index of objects by type number
+ *
+ * The index keeps, for every type number, a crit-bit tree of the offsets of
+ * the user objects of that type, so that the objects of a single type can be
+ * iterated through and counted without walking the entire heap. It's
+ * disabled by default, since it costs memory proportional to the number of
+ * objects in the pool, and can be enabled with the PMEMOBJ_TYPE_INDEX
+ * environment variable. The index is built with a single walk of the heap,
+ * either when the pool is opened or on the first typed iteration, and from
+ * then on it's updated by every allocation and deallocation.
+ *
+ * An allocation or deallocation first modifies the heap and only then
+ * checks whether the index was built. The build first marks the index as
+ * built and only then walks the heap, all the while holding the index lock
+ * for writing, which the updates take for reading. This way every change of
+ * the heap is either seen by the walk or applied to the index afterwards.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ctree.h"
+#include "cuckoo.h"
+#include "obj.h"
+#include "out.h"
+#include "palloc.h"
+#include "sys_util.h"
+#include "type_index.h"
+
+enum type_index_mode {
+	TYPE_INDEX_DISABLED,
+	TYPE_INDEX_LAZY,	/* built on the first typed iteration */
+	TYPE_INDEX_BOOT,	/* built when the pool is opened */
+};
+
+/* objects of a single type number */
+struct type_index_objs {
+	struct ctree *objs;	/* keys are the complements of the offsets */
+	uint64_t count;
+	struct type_index_objs *next;
+};
+
+struct type_index {
+	pthread_rwlock_t lock;
+	struct cuckoo *types;	/* type number -> struct type_index_objs */
+	struct type_index_objs *list; /* all of the entries, for cleanup */
+	int built;
+	int failed;		/* the index is incomplete, don't use it */
+};
+
+/*
+ * The offsets are stored as their bitwise complements, which reverses their
+ * order, because the crit-bit tree can only look up the greatest key that
+ * is less than or equal to a given one and the iteration needs the smallest
+ * offset greater than the current one.
+ */
+#define TYPE_INDEX_KEY(off) (~(uint64_t)(off))
+
+/*
+ * type_index_get_mode -- (internal) returns the mode of the index selected by
+ *	the PMEMOBJ_TYPE_INDEX variable
+ */
+static enum type_index_mode
+type_index_get_mode(void)
+{
+	char *env = getenv("PMEMOBJ_TYPE_INDEX");
+	if (env == NULL || strcmp(env, "0") == 0)
+		return TYPE_INDEX_DISABLED;
+
+	if (strcmp(env, "lazy") == 0 || strcmp(env, "1") == 0)
+		return TYPE_INDEX_LAZY;
+
+	if (strcmp(env, "boot") == 0)
+		return TYPE_INDEX_BOOT;
+
+	LOG(2, "unknown type index mode \"%s\", index disabled", env);
+
+	return TYPE_INDEX_DISABLED;
+}
+
+/*
+ * type_index_get_objs -- (internal) returns the entry of the type number,
+ *	creates it if requested
+ *
+ * Has to be called with the index lock held, for writing when an entry
+ * may be created.
+ */
+static struct type_index_objs *
+type_index_get_objs(struct type_index *idx, uint64_t type_num, int create)
+{
+	struct type_index_objs *o = cuckoo_get(idx->types, type_num);
+	if (o != NULL || !create)
+		return o;
+
+	o = Malloc(sizeof(*o));
+	if (o == NULL)
+		goto error_objs_malloc;
+
+	if ((o->objs = ctree_new()) == NULL)
+		goto error_ctree_new;
+
+	if (cuckoo_insert(idx->types, type_num, o) != 0)
+		goto error_cuckoo_insert;
+
+	o->count = 0;
+	o->next = idx->list;
+	idx->list = o;
+
+	return o;
+
+error_cuckoo_insert:
+	ctree_delete(o->objs);
+error_ctree_new:
+	Free(o);
+error_objs_malloc:
+	idx->failed = 1;
+	return NULL;
+}
+
+/*
+ * type_index_add -- (internal) adds the object to the entry of its type
+ *
+ * Has to be called with the index lock held, for writing when an entry
+ * may be created.
+ */
+static void
+type_index_add(struct type_index *idx, uint64_t type_num, uint64_t off,
+	int create)
+{
+	struct type_index_objs *o = type_index_get_objs(idx, type_num, create);
+	if (o == NULL)
+		return;
+
+	int ret = ctree_insert(o->objs, TYPE_INDEX_KEY(off), off);
+	if (ret == 0)
+		__sync_fetch_and_add(&o->count, 1);
+	else if (ret != EEXIST)
+		idx->failed = 1;
+}
+
+/*
+ * type_index_get_type -- returns the type number of the object at the given
+ *	offset, 0 if the object is internal and not indexed
+ */
+int
+type_index_get_type(PMEMobjpool *pop, uint64_t off, uint64_t *type_num)
+{
+	struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, off);
+	if (oobh->size & OBJ_INTERNAL_OBJECT_MASK)
+		return 0;
+
+	*type_num = oobh->type_num;
+
+	return 1;
+}
+
+/*
+ * type_index_build -- (internal) adds all of the objects of the heap
+ */
+static void
+type_index_build(PMEMobjpool *pop, struct type_index *idx)
+{
+	LOG(3, "pop %p", pop);
+
+	if (pthread_rwlock_wrlock(&idx->lock) != 0)
+		FATAL("!pthread_rwlock_wrlock");
+
+	if (idx->built)
+		goto out;
+
+	__atomic_store_n(&idx->built, 1, __ATOMIC_SEQ_CST);
+
+	struct palloc_iter it;
+	palloc_iter_init(&pop->heap, &it);
+
+	uint64_t off;
+	uint64_t type_num;
+	while ((off = palloc_iter_next(&pop->heap, &it)) != 0) {
+		off += OBJ_OOB_SIZE;
+		if (type_index_get_type(pop, off, &type_num))
+			type_index_add(idx, type_num, off, 1);
+	}
+
+out:
+	util_rwlock_unlock(&idx->lock);
+}
+
+/*
+ * type_index_updated -- (internal) returns the index if it has to be updated
+ *	after a change of the heap, NULL otherwise
+ */
+static struct type_index *
+type_index_updated(PMEMobjpool *pop)
+{
+	struct type_index *idx = pop->tidx;
+	if (idx == NULL)
+		return NULL;
+
+	/* order the check after the modification of the heap */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (!__atomic_load_n(&idx->built, __ATOMIC_SEQ_CST))
+		return NULL;
+
+	/* waits for the build to finish */
+	if (pthread_rwlock_rdlock(&idx->lock) != 0)
+		FATAL("!pthread_rwlock_rdlock");
+
+	return idx;
+}
+
+/*
+ * type_index_insert -- adds a newly allocated object to the index
+ */
+void
+type_index_insert(PMEMobjpool *pop, uint64_t off)
+{
+	uint64_t type_num;
+	struct type_index *idx = type_index_updated(pop);
+	if (idx == NULL)
+		return;
+
+	if (!type_index_get_type(pop, off, &type_num))
+		goto out;
+
+	if (cuckoo_get(idx->types, type_num) != NULL) {
+		type_index_add(idx, type_num, off, 0);
+		goto out;
+	}
+
+	/* the object is the first one of its type */
+	util_rwlock_unlock(&idx->lock);
+
+	if (pthread_rwlock_wrlock(&idx->lock) != 0)
+		FATAL("!pthread_rwlock_wrlock");
+
+	type_index_add(idx, type_num, off, 1);
+
+out:
+	util_rwlock_unlock(&idx->lock);
+}
+
+/*
+ * type_index_remove -- removes a freed object of the given type number
+ *	from the index
+ */
+void
+type_index_remove(PMEMobjpool *pop, uint64_t off, uint64_t type_num)
+{
+	struct type_index *idx = type_index_updated(pop);
+	if (idx == NULL)
+		return;
+
+	struct type_index_objs *o = type_index_get_objs(idx, type_num, 0);
+	if (o != NULL && ctree_remove(o->objs, TYPE_INDEX_KEY(off), 1) != 0)
+		__sync_fetch_and_sub(&o->count, 1);
+
+	util_rwlock_unlock(&idx->lock);
+}
+
+/*
+ * type_index_acquire -- (internal) builds the index if needed and returns it
+ *	locked for reading, NULL if the index can't be used
+ */
+static struct type_index *
+type_index_acquire(PMEMobjpool *pop)
+{
+	struct type_index *idx = pop->tidx;
+	if (idx == NULL)
+		return NULL;
+
+	if (!__atomic_load_n(&idx->built, __ATOMIC_SEQ_CST))
+		type_index_build(pop, idx);
+
+	if (pthread_rwlock_rdlock(&idx->lock) != 0)
+		FATAL("!pthread_rwlock_rdlock");
+
+	if (idx->failed) {
+		util_rwlock_unlock(&idx->lock);
+		return NULL;
+	}
+
+	return idx;
+}
+
+/*
+ * type_index_next -- looks up the first object of the type number with
+ *	an offset greater than *off, sets *off to 0 if there is none
+ *
+ * Returns ENOTSUP if the index is disabled or incomplete, in which case
+ * the heap has to be searched instead.
+ */
+int
+type_index_next(PMEMobjpool *pop, uint64_t type_num, uint64_t *off)
+{
+	struct type_index *idx = type_index_acquire(pop);
+	if (idx == NULL)
+		return ENOTSUP;
+
+	struct type_index_objs *o = type_index_get_objs(idx, type_num, 0);
+
+	uint64_t key = TYPE_INDEX_KEY(*off);
+	if (o == NULL || key == 0) {
+		*off = 0;
+	} else {
+		key -= 1;
+		*off = ctree_find_le(o->objs, &key);
+	}
+
+	util_rwlock_unlock(&idx->lock);
+
+	return 0;
+}
+
+/*
+ * type_index_count -- returns the number of objects of the type number
+ *
+ * Returns ENOTSUP if the index is disabled or incomplete.
+ */
+int
+type_index_count(PMEMobjpool *pop, uint64_t type_num, uint64_t *count)
+{
+	struct type_index *idx = type_index_acquire(pop);
+	if (idx == NULL)
+		return ENOTSUP;
+
+	struct type_index_objs *o = type_index_get_objs(idx, type_num, 0);
+	*count = o != NULL ? o->count : 0;
+
+	util_rwlock_unlock(&idx->lock);
+
+	return 0;
+}
+
+/*
+ * type_index_boot -- creates the index of the pool if it's enabled
+ */
+int
+type_index_boot(PMEMobjpool *pop)
+{
+	pop->tidx = NULL;
+
+	enum type_index_mode mode = type_index_get_mode();
+	if (mode == TYPE_INDEX_DISABLED)
+		return 0;
+
+	struct type_index *idx = Malloc(sizeof(*idx));
+	if (idx == NULL)
+		goto error_idx_malloc;
+
+	if ((idx->types = cuckoo_new()) == NULL)
+		goto error_cuckoo_new;
+
+	if ((errno = pthread_rwlock_init(&idx->lock, NULL)) != 0) {
+		ERR("!pthread_rwlock_init");
+		goto error_lock_init;
+	}
+
+	idx->list = NULL;
+	idx->built = 0;
+	idx->failed = 0;
+
+	pop->tidx = idx;
+
+	if (mode == TYPE_INDEX_BOOT)
+		type_index_build(pop, idx);
+
+	return 0;
+
+error_lock_init:
+	cuckoo_delete(idx->types);
+error_cuckoo_new:
+	Free(idx);
+error_idx_malloc:
+	return ENOMEM;
+}
+
+/*
+ * type_index_cleanup -- deletes the index of the pool
+ */
+void
+type_index_cleanup(PMEMobjpool *pop)
+{
+	struct type_index *idx = pop->tidx;
+	if (idx == NULL)
+		return;
+
+	struct type_index_objs *o;
+	while ((o = idx->list) != NULL) {
+		idx->list = o->next;
+		ctree_delete(o->objs);
+		Free(o);
+	}
+
+	if ((errno = pthread_rwlock_destroy(&idx->lock)) != 0)
+		FATAL("!pthread_rwlock_destroy");
+
+	cuckoo_delete(idx->types);
+	Free(idx);
+
+	pop->tidx = NULL;
+}
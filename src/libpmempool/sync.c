@@ -379,8 +379,13 @@ copy_data_to_broken_parts(struct pool_set *set, unsigned healthy_replica,
 					ADDR_SUM(rep_h->part[0].addr, off);
 
 				/* copy all data */
-				memcpy(dst_addr, src_addr, len);
-				PERSIST_GENERIC(part->is_dax, dst_addr, len);
+				if (part->is_dax) {
+					pmem_memcpy_persist_mt(dst_addr,
+						src_addr, len, 0);
+				} else {
+					memcpy(dst_addr, src_addr, len);
+					pmem_msync(dst_addr, len);
+				}
 			}
 		}
 	}
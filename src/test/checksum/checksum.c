@@ -65,6 +65,53 @@ fletcher64(void *addr, size_t len)
 	return htole64((uint64_t)hi32 << 32 | lo32);
 }
 
+/*
+ * check_lengths -- verify checksums of buffers of various lengths, with
+ * the checksum at various locations, including unaligned ones and outside
+ * the buffer, against the gold standard fletcher64
+ *
+ * The lengths cover the tails left by the vectorized implementations.
+ */
+static void
+check_lengths(void)
+{
+	size_t maxlen = 4 * 1024 + 64;
+	uint32_t *buf = MALLOC(maxlen + sizeof(uint64_t));
+	uint64_t outside = 0;
+
+	for (size_t i = 0; i < maxlen / 4 + 2; ++i)
+		buf[i] = htole32((uint32_t)(i * 2654435761u));
+
+	for (size_t len = 4; len <= maxlen; len += 4) {
+		util_checksum(buf, len, &outside, 1);
+		UT_ASSERTeq(outside, fletcher64(buf, len));
+
+		for (size_t off = 0; off + 8 <= len;
+				off += len < 256 ? 4 : 60) {
+			uint64_t *ptr = (uint64_t *)((char *)buf + off);
+			uint64_t oldval = *ptr;
+
+			util_checksum(buf, len, ptr, 1);
+			UT_ASSERT(util_checksum(buf, len, ptr, 0));
+			uint64_t csum = *ptr;
+
+			*ptr = 0;
+			UT_ASSERTeq(csum, fletcher64(buf, len));
+			*ptr = oldval;
+
+			/* not at a word boundary, nothing is skipped */
+			ptr = (uint64_t *)((char *)buf + off + 2);
+			oldval = *ptr;
+			uint64_t gold_csum = fletcher64(buf, len);
+			util_checksum(buf, len, ptr, 1);
+			UT_ASSERTeq(*ptr, gold_csum);
+			*ptr = oldval;
+		}
+	}
+
+	FREE(buf);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -73,6 +120,11 @@ main(int argc, char *argv[])
 	if (argc < 2)
 		UT_FATAL("usage: %s files...", argv[0]);
 
+	/* select the implementation the libraries use */
+	util_init();
+
+	check_lengths();
+
 	for (int arg = 1; arg < argc; arg++) {
 		int fd = OPEN(argv[arg], O_RDONLY);
 
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_class.c -- unit test for user-defined allocation classes
+ *
+ * usage: obj_alloc_class file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_alloc_class"
+
+#define NOBJS 1024
+#define NLARGE 16
+
+/* size of the per-object headers included in the unit size of a class */
+#define OBJ_HDR_SIZE 64
+
+enum obj_type {
+	TYPE_SMALL,
+	TYPE_MEDIUM,
+	TYPE_LARGE,
+
+	MAX_TYPE
+};
+
+struct root {
+	PMEMoid small[NOBJS];
+	PMEMoid medium[NOBJS];
+	PMEMoid large[NLARGE];
+};
+
+/*
+ * count_objs -- returns the number of objects of the given type in the pool
+ */
+static unsigned
+count_objs(PMEMobjpool *pop, enum obj_type type)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) == type)
+			n++;
+	}
+
+	return n;
+}
+
+/*
+ * class_new -- registers a new allocation class, returns its id
+ */
+static unsigned
+class_new(PMEMobjpool *pop, size_t unit_size, unsigned units_per_block)
+{
+	struct pobj_alloc_class_desc desc;
+	desc.unit_size = unit_size;
+	desc.units_per_block = units_per_block;
+	desc.class_id = 0;
+
+	int ret = pmemobj_alloc_class_new(pop, &desc);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTne(desc.class_id, 0);
+
+	return desc.class_id;
+}
+
+/*
+ * test_invalid_desc -- verifies that invalid class descriptions are rejected
+ */
+static void
+test_invalid_desc(PMEMobjpool *pop)
+{
+	struct {
+		size_t unit_size;
+		unsigned units_per_block;
+	} descs[] = {
+		{ 0, 1 },		/* no unit size */
+		{ 64, 1 },		/* unit smaller than the minimum */
+		{ 200, 1 },		/* not a multiple of the block size */
+		{ 1024, 0 },		/* no units */
+		{ 128, 2433 },		/* more units than in a run bitmap */
+		{ 1 << 20, 1 },		/* unit bigger than half of a chunk */
+		{ 1 << 17, 1024 },	/* run longer than the chunk limit */
+	};
+
+	for (size_t i = 0; i < sizeof(descs) / sizeof(descs[0]); ++i) {
+		struct pobj_alloc_class_desc desc;
+		desc.unit_size = descs[i].unit_size;
+		desc.units_per_block = descs[i].units_per_block;
+		desc.class_id = 0;
+
+		errno = 0;
+		UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), -1);
+		UT_ASSERTeq(errno, EINVAL);
+		UT_ASSERTeq(desc.class_id, 0);
+	}
+}
+
+/*
+ * test_invalid_alloc -- verifies that invalid flags and class ids are rejected
+ */
+static void
+test_invalid_alloc(PMEMobjpool *pop, unsigned small_class)
+{
+	PMEMoid oid = OID_NULL;
+
+	/* the object doesn't fit in the maximum number of units of the class */
+	errno = 0;
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, 2000, TYPE_SMALL,
+		POBJ_CLASS_ID(small_class), NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* class which was never registered */
+	errno = 0;
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, 64, TYPE_SMALL,
+		POBJ_CLASS_ID(254), NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* class id out of range */
+	errno = 0;
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, 64, TYPE_SMALL,
+		POBJ_CLASS_ID(1000), NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* flag supported only by the transactional allocations */
+	errno = 0;
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, 64, TYPE_SMALL,
+		POBJ_XALLOC_NO_FLUSH, NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* the class can't be used in a transaction */
+	TX_BEGIN(pop) {
+		pmemobj_tx_xalloc(64, TYPE_SMALL, POBJ_CLASS_ID(small_class));
+		UT_ASSERT(0);
+	} TX_ONABORT {
+		UT_ASSERTeq(errno, EINVAL);
+	} TX_END
+
+	UT_ASSERT(OID_IS_NULL(oid));
+}
+
+/*
+ * test_alloc -- allocates objects from the user-defined classes
+ */
+static void
+test_alloc(PMEMobjpool *pop, unsigned small_class, unsigned medium_class,
+	unsigned large_class)
+{
+	struct root *r = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		int ret = pmemobj_xalloc(pop, &r->small[i], 100, TYPE_SMALL,
+			POBJ_CLASS_ID(small_class), NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		UT_ASSERTeq(pmemobj_alloc_usable_size(r->small[i]),
+			192 - OBJ_HDR_SIZE);
+
+		/* the object spans multiple units of the class */
+		ret = pmemobj_xalloc(pop, &r->medium[i], 2000, TYPE_MEDIUM,
+			POBJ_XALLOC_ZERO | POBJ_CLASS_ID(medium_class),
+			NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		UT_ASSERTeq(pmemobj_alloc_usable_size(r->medium[i]),
+			3 * 1024 - OBJ_HDR_SIZE);
+
+		char *data = pmemobj_direct(r->medium[i]);
+		for (size_t n = 0; n < 2000; ++n)
+			UT_ASSERTeq(data[n], 0);
+	}
+
+	UT_OUT("alloc small %u medium %u", count_objs(pop, TYPE_SMALL),
+		count_objs(pop, TYPE_MEDIUM));
+
+	/* a run of eight units of this class spans three chunks */
+	for (unsigned i = 0; i < NLARGE; ++i) {
+		int ret = pmemobj_xalloc(pop, &r->large[i], 300 * 1024,
+			TYPE_LARGE, POBJ_CLASS_ID(large_class), NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		UT_ASSERTeq(pmemobj_alloc_usable_size(r->large[i]),
+			5 * 64 * 1024 - OBJ_HDR_SIZE);
+		memset(pmemobj_direct(r->large[i]), i, 300 * 1024);
+	}
+
+	struct pobj_heap_stats s;
+	UT_ASSERTeq(pmemobj_heap_stats(pop, &s), 0);
+
+	UT_OUT("alloc large %u multi-chunk runs %d",
+		count_objs(pop, TYPE_LARGE), s.run_chunks > s.runs);
+}
+
+/*
+ * test_free -- frees all of the objects, some of which belong to runs
+ *	of classes from the previous incarnation of the pool
+ */
+static void
+test_free(PMEMobjpool *pop)
+{
+	struct root *r = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		UT_ASSERTeq(pmemobj_alloc_usable_size(r->small[i]),
+			192 - OBJ_HDR_SIZE);
+		pmemobj_free(&r->small[i]);
+		pmemobj_free(&r->medium[i]);
+	}
+
+	for (unsigned i = 0; i < NLARGE; ++i) {
+		char *data = pmemobj_direct(r->large[i]);
+		UT_ASSERTeq(data[0], (char)i);
+		UT_ASSERTeq(data[300 * 1024 - 1], (char)i);
+		pmemobj_free(&r->large[i]);
+	}
+
+	UT_OUT("free small %u medium %u large %u", count_objs(pop, TYPE_SMALL),
+		count_objs(pop, TYPE_MEDIUM), count_objs(pop, TYPE_LARGE));
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_class");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT_NAME,
+		PMEMOBJ_MIN_POOL * 4, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	test_invalid_desc(pop);
+
+	unsigned small_class = class_new(pop, 192, 1024);
+	unsigned medium_class = class_new(pop, 1024, 64);
+	unsigned large_class = class_new(pop, 64 * 1024, 8);
+	UT_ASSERTne(small_class, medium_class);
+	UT_ASSERTne(medium_class, large_class);
+
+	test_invalid_alloc(pop, small_class);
+	test_alloc(pop, small_class, medium_class, large_class);
+
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmemobj_check(path, LAYOUT_NAME), 1);
+
+	pop = pmemobj_open(path, LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	UT_OUT("reopen small %u medium %u large %u",
+		count_objs(pop, TYPE_SMALL), count_objs(pop, TYPE_MEDIUM),
+		count_objs(pop, TYPE_LARGE));
+
+	test_free(pop);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -34,6 +34,7 @@
  * obj_bucket.c -- unit test for bucket
  */
 #include "bucket.h"
+#include "heap.h"
 #include "util.h"
 #include "unittest.h"
 
@@ -114,18 +115,27 @@ test_new_delete_bucket()
 static void
 test_bucket_bitmap_correctness()
 {
-	struct bucket_run *b = bucket_run_new(1, CONTAINER_CTREE,
-		(RUNSIZE / 10), TEST_MAX_UNIT, TEST_MAX_UNIT);
-	UT_ASSERT(b != NULL);
+	struct run_bitmap bm;
+	bucket_run_calc_bitmap(RUNSIZE / 10, 1, &bm);
 
 	/* 54 set (not available for allocations), and 10 clear (available) */
 	uint64_t bitmap_lastval =
 	0b1111111111111111111111111111111111111111111111111111110000000000;
 
-	struct bucket_run *r = (struct bucket_run *)b;
-	UT_ASSERTeq(r->bitmap_lastval, bitmap_lastval);
+	UT_ASSERTeq(bm.nallocs, 10);
+	UT_ASSERTeq(bm.nval, 1);
+	UT_ASSERTeq(bm.lastval, bitmap_lastval);
 
-	bucket_delete(&b->super);
+	/* a run of two chunks fits more than twice as many units */
+	bucket_run_calc_bitmap(RUNSIZE / 10, 2, &bm);
+	UT_ASSERTeq(bm.nallocs, 20);
+	UT_ASSERTeq(bm.nval, 1);
+
+	/* the units that don't fit in the bitmap are not used */
+	bucket_run_calc_bitmap(MIN_RUN_SIZE, 2, &bm);
+	UT_ASSERTeq(bm.nallocs, RUN_BITMAP_SIZE);
+	UT_ASSERTeq(bm.nval, MAX_BITMAP_VALUES);
+	UT_ASSERTeq(bm.lastval, 0);
 }
 
 static void
@@ -146,7 +156,7 @@ static void
 test_bucket_insert_get()
 {
 	struct bucket *b = &(bucket_run_new(1, CONTAINER_CTREE,
-		TEST_UNIT_SIZE, TEST_MAX_UNIT, TEST_MAX_UNIT))->super;
+		TEST_UNIT_SIZE, TEST_MAX_UNIT, TEST_MAX_UNIT, 1))->super;
 	UT_ASSERT(b != NULL);
 
 	struct memory_block m = {TEST_CHUNK_ID, TEST_ZONE_ID,
@@ -171,7 +181,7 @@ static void
 test_bucket_remove()
 {
 	struct bucket *b = &(bucket_run_new(1, CONTAINER_CTREE,
-		TEST_UNIT_SIZE, TEST_MAX_UNIT, TEST_MAX_UNIT))->super;
+		TEST_UNIT_SIZE, TEST_MAX_UNIT, TEST_MAX_UNIT, 1))->super;
 	UT_ASSERT(b != NULL);
 
 	struct memory_block m = {TEST_CHUNK_ID, TEST_ZONE_ID,
@@ -184,6 +194,85 @@ test_bucket_remove()
 	bucket_delete(b);
 }
 
+static void
+test_bucket_seglists()
+{
+	struct bucket *b = &(bucket_run_new(1, CONTAINER_SEGLISTS,
+		TEST_UNIT_SIZE, RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC, 1))->super;
+	UT_ASSERT(b != NULL);
+
+	UT_ASSERT(CNT_OP(b, is_empty));
+
+	struct memory_block m = {TEST_CHUNK_ID, TEST_ZONE_ID,
+		TEST_SIZE_IDX, TEST_BLOCK_OFF};
+
+	/* get from empty */
+	UT_ASSERT(CNT_OP(b, get_rm_bestfit, &m) != 0);
+
+	struct memory_block small = {TEST_CHUNK_ID, TEST_ZONE_ID,
+		1, TEST_BLOCK_OFF};
+	struct memory_block mid1 = {TEST_CHUNK_ID, TEST_ZONE_ID,
+		TEST_SIZE_IDX, TEST_BLOCK_OFF + 1};
+	struct memory_block mid2 = {TEST_CHUNK_ID + 1, TEST_ZONE_ID,
+		TEST_SIZE_IDX, TEST_BLOCK_OFF + 2};
+	struct memory_block big = {TEST_CHUNK_ID, TEST_ZONE_ID,
+		RUN_UNIT_MAX, 0};
+
+	UT_ASSERT(CNT_OP(b, insert, NULL, big) == 0);
+	UT_ASSERT(CNT_OP(b, insert, NULL, mid1) == 0);
+	UT_ASSERT(CNT_OP(b, insert, NULL, small) == 0);
+	UT_ASSERT(CNT_OP(b, insert, NULL, mid2) == 0);
+	UT_ASSERT(CNT_OP(b, insert, NULL, mid2) != 0);
+	UT_ASSERT(!CNT_OP(b, is_empty));
+
+	UT_ASSERT(CNT_OP(b, get_exact, mid1) == 0);
+	UT_ASSERT(CNT_OP(b, get_exact, m) != 0);
+
+	/* exact removal from the middle of a list */
+	UT_ASSERT(CNT_OP(b, get_rm_exact, mid1) == 0);
+	UT_ASSERT(CNT_OP(b, get_rm_exact, mid1) != 0);
+	UT_ASSERT(CNT_OP(b, get_exact, mid2) == 0);
+
+	/* the smallest block that fits is returned */
+	m.size_idx = 2;
+	UT_ASSERT(CNT_OP(b, get_rm_bestfit, &m) == 0);
+	UT_ASSERT(m.chunk_id == mid2.chunk_id);
+	UT_ASSERT(m.block_off == mid2.block_off);
+	UT_ASSERT(m.size_idx == TEST_SIZE_IDX);
+
+	m.size_idx = TEST_SIZE_IDX;
+	UT_ASSERT(CNT_OP(b, get_rm_bestfit, &m) == 0);
+	UT_ASSERT(m.size_idx == RUN_UNIT_MAX);
+	UT_ASSERT(m.block_off == 0);
+
+	m.size_idx = 2;
+	UT_ASSERT(CNT_OP(b, get_rm_bestfit, &m) != 0);
+
+	m.size_idx = 1;
+	UT_ASSERT(CNT_OP(b, get_rm_bestfit, &m) == 0);
+	UT_ASSERT(m.chunk_id == TEST_CHUNK_ID);
+	UT_ASSERT(m.zone_id == TEST_ZONE_ID);
+	UT_ASSERT(m.block_off == TEST_BLOCK_OFF);
+	UT_ASSERT(m.size_idx == 1);
+
+	UT_ASSERT(CNT_OP(b, is_empty));
+
+	/* list growth and exact removal of every block */
+	for (uint16_t i = 0; i < 1000; ++i) {
+		struct memory_block e = {i, TEST_ZONE_ID, 1 + i % 3, i};
+		UT_ASSERT(CNT_OP(b, insert, NULL, e) == 0);
+	}
+
+	for (uint16_t i = 0; i < 1000; ++i) {
+		struct memory_block e = {i, TEST_ZONE_ID, 1 + i % 3, i};
+		UT_ASSERT(CNT_OP(b, get_rm_exact, e) == 0);
+	}
+
+	UT_ASSERT(CNT_OP(b, is_empty));
+
+	bucket_delete(b);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -196,6 +285,7 @@ main(int argc, char *argv[])
 	test_bucket_insert_get();
 	test_bucket_remove();
 	test_bucket_bitmap_correctness();
+	test_bucket_seglists();
 
 	DONE(NULL);
 }
@@ -41,6 +41,7 @@
 #define MOCK_POOL_SIZE PMEMOBJ_MIN_POOL
 
 #define MAX_BLOCKS 3
+#define RUN_TEST_PATTERNS 100
 
 struct mock_pop {
 	PMEMobjpool p;
@@ -61,6 +62,90 @@ obj_heap_memset_persist(void *ctx, void *ptr, int c, size_t sz)
 	return ptr;
 }
 
+/*
+ * test_run_adjacent -- compares the search for adjacent free blocks in a run
+ *	with a bit by bit scan of the bitmap
+ */
+static void
+test_run_adjacent(struct palloc_heap *heap, struct bucket *b)
+{
+	struct memory_block m = {0, 0, 1, 0};
+	UT_ASSERTeq(heap_get_bestfit_block(heap, b, &m), 0);
+
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
+	unsigned unit_max = ((struct bucket_run *)b)->unit_max;
+	uint64_t saved = run->bitmap[0];
+
+	for (int n = 0; n < RUN_TEST_PATTERNS; ++n) {
+		uint64_t v = ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+		if (n % 3 == 1)
+			v &= ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+		else if (n % 3 == 2)
+			v |= ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+		run->bitmap[0] = v;
+
+		for (unsigned off = 0; off < BITS_PER_VALUE; ++off) {
+			struct memory_block cnt = {m.chunk_id, m.zone_id,
+				1, (uint16_t)off};
+			struct memory_block r;
+			unsigned i;
+
+			int ret = heap_get_adjacent_free_block(heap, b, &r,
+				cnt, 1);
+			for (i = off; i % unit_max && BIT_IS_CLR(v, i - 1); --i)
+				;
+			if (i == off) {
+				UT_ASSERTeq(ret, ENOENT);
+			} else {
+				UT_ASSERTeq(ret, 0);
+				UT_ASSERTeq(r.block_off, i);
+				UT_ASSERTeq(r.size_idx, off - i);
+			}
+
+			ret = heap_get_adjacent_free_block(heap, b, &r,
+				cnt, 0);
+			for (i = off + 1; i % unit_max && BIT_IS_CLR(v, i); ++i)
+				;
+			if (i == off + 1) {
+				UT_ASSERTeq(ret, ENOENT);
+			} else {
+				UT_ASSERTeq(ret, 0);
+				UT_ASSERTeq(r.block_off, off + 1);
+				UT_ASSERTeq(r.size_idx, i - off - 1);
+			}
+		}
+	}
+
+	run->bitmap[0] = saved;
+}
+
+/*
+ * test_chunk_hdrs -- compares the DRAM copies of the chunk headers with the
+ *	persistent ones
+ */
+static void
+test_chunk_hdrs(struct palloc_heap *heap)
+{
+	struct zone *z = ZID_TO_ZONE(heap->layout, 0);
+
+	for (uint32_t i = 0; i < z->header.size_idx; ) {
+		struct chunk_header *hdr = &z->chunk_headers[i];
+		struct chunk_header *c = heap_get_chunk_hdr(heap, 0, i);
+
+		UT_ASSERTeq(c->type, hdr->type);
+		UT_ASSERTeq(c->size_idx, hdr->size_idx);
+
+		if (hdr->size_idx > 1) {
+			struct chunk_header *f = c + hdr->size_idx - 1;
+			UT_ASSERTeq(f->type, CHUNK_TYPE_FOOTER);
+			UT_ASSERTeq(f->size_idx, hdr->size_idx);
+		}
+
+		i += hdr->size_idx;
+	}
+}
+
 static void
 test_heap()
 {
@@ -110,6 +195,8 @@ test_heap()
 		UT_ASSERT(blocks[i].block_off == 0);
 	}
 
+	test_chunk_hdrs(heap);
+
 	struct memory_block prev;
 	heap_get_adjacent_free_block(heap, b_def, &prev, blocks[1], 1);
 	UT_ASSERT(prev.chunk_id == blocks[0].chunk_id);
@@ -121,6 +208,9 @@ test_heap()
 	heap_get_adjacent_free_block(heap, b_def, &next, blocks[1], 0);
 	UT_ASSERT(next.chunk_id == blocks[2].chunk_id);
 
+	test_run_adjacent(heap, b_small);
+	test_chunk_hdrs(heap);
+
 	UT_ASSERT(heap_check(heap_start, heap_size) == 0);
 	heap_cleanup(heap);
 	UT_ASSERT(heap->rt == NULL);
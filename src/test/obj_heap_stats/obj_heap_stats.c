@@ -0,0 +1,384 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_heap_stats.c -- unit test for the heap statistics
+ *
+ * usage: obj_heap_stats file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_heap_stats"
+
+#define POOL_SIZE (PMEMOBJ_MIN_POOL * 8)
+
+#define NSMALL 4096
+#define SMALL_SIZE 100
+#define NHUGE 4
+#define HUGE_SIZE (1024 * 1024)
+#define CLASS_UNIT_SIZE 192
+#define CHUNKSIZE (256 * 1024)
+
+#define NTHREADS 4
+#define NOPS 1000
+
+#define STEAL_UNIT_SIZE 320
+#define NSTEAL 1024
+
+struct root {
+	PMEMoid small[NSMALL];
+	PMEMoid huge[NHUGE];
+	PMEMoid steal[NSTEAL];
+};
+
+struct steal_args {
+	PMEMobjpool *pop;
+	uint8_t class_id;
+};
+
+/*
+ * check_stats -- verifies that the per-class statistics add up to the totals
+ */
+static void
+check_stats(struct pobj_heap_stats *s)
+{
+	uint64_t runs = 0;
+	uint64_t allocated = 0;
+	uint64_t free = 0;
+
+	for (unsigned i = 0; i < POBJ_MAX_ALLOC_CLASSES; ++i) {
+		struct pobj_alloc_class_stats *c = &s->classes[i];
+		if (c->unit_size == 0) {
+			UT_ASSERTeq(c->runs, 0);
+			continue;
+		}
+
+		uint64_t occupancy = 0;
+		for (unsigned j = 0; j < POBJ_RUN_OCCUPANCY_BINS; ++j)
+			occupancy += c->run_occupancy[j];
+		UT_ASSERTeq(occupancy, c->runs);
+
+		UT_ASSERTeq((c->bytes_allocated + c->bytes_free) %
+			c->unit_size, 0);
+
+		runs += c->runs;
+		allocated += c->bytes_allocated;
+		free += c->bytes_free;
+	}
+
+	/* the runs not assigned to any class are only in the totals */
+	UT_ASSERTeq(runs, s->active_runs);
+	UT_ASSERT(s->active_runs <= s->runs);
+	UT_ASSERT(allocated <= s->run_bytes_allocated);
+	UT_ASSERT(free <= s->run_bytes_free);
+
+	uint64_t extents = 0;
+	for (unsigned i = 0; i < POBJ_FREE_EXTENT_BINS; ++i)
+		extents += s->free_extents[i];
+	UT_ASSERT(extents != 0);
+}
+
+/*
+ * heap_nchunks -- returns the number of chunks in the heap
+ */
+static uint64_t
+heap_nchunks(struct pobj_heap_stats *s)
+{
+	return s->run_chunks + (s->huge_bytes_allocated + s->huge_bytes_free) /
+		CHUNKSIZE;
+}
+
+/*
+ * test_alloc -- checks the statistics of allocated and freed objects
+ */
+static void
+test_alloc(PMEMobjpool *pop, struct pobj_heap_stats *s)
+{
+	struct root *r = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+
+	pmemobj_heap_stats(pop, s);
+	check_stats(s);
+	uint64_t run_allocated = s->run_bytes_allocated;
+	uint64_t huge_allocated = s->huge_bytes_allocated;
+	uint64_t heap_chunks = heap_nchunks(s);
+
+	for (unsigned i = 0; i < NSMALL; ++i) {
+		int ret = pmemobj_alloc(pop, &r->small[i], SMALL_SIZE, 0,
+			NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	for (unsigned i = 0; i < NHUGE; ++i) {
+		int ret = pmemobj_alloc(pop, &r->huge[i], HUGE_SIZE, 0,
+			NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	pmemobj_heap_stats(pop, s);
+	check_stats(s);
+
+	UT_ASSERT(s->run_bytes_allocated >=
+		run_allocated + NSMALL * SMALL_SIZE);
+	UT_ASSERT(s->huge_bytes_allocated >=
+		huge_allocated + NHUGE * HUGE_SIZE);
+
+	/* the chunks only change hands between runs and huge blocks */
+	UT_ASSERTeq(heap_nchunks(s), heap_chunks);
+
+	run_allocated = s->run_bytes_allocated;
+	for (unsigned i = 0; i < NSMALL; i += 2)
+		pmemobj_free(&r->small[i]);
+
+	for (unsigned i = 0; i < NHUGE; ++i)
+		pmemobj_free(&r->huge[i]);
+
+	pmemobj_heap_stats(pop, s);
+	check_stats(s);
+
+	UT_ASSERT(s->run_bytes_allocated <
+		run_allocated - NSMALL / 2 * SMALL_SIZE);
+	UT_ASSERTeq(s->huge_bytes_allocated, huge_allocated);
+
+	UT_OUT("alloc runs %d huge %d", s->runs != 0,
+		s->huge_bytes_allocated == huge_allocated);
+}
+
+/*
+ * test_class -- checks the statistics of a user-defined allocation class
+ */
+static void
+test_class(PMEMobjpool *pop, struct pobj_heap_stats *s)
+{
+	struct pobj_alloc_class_desc desc;
+	desc.unit_size = CLASS_UNIT_SIZE;
+	desc.units_per_block = 1;
+	desc.class_id = 0;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), 0);
+
+	pmemobj_heap_stats(pop, s);
+	struct pobj_alloc_class_stats *c = &s->classes[desc.class_id];
+	UT_ASSERTeq(c->unit_size, CLASS_UNIT_SIZE);
+	UT_ASSERTeq(c->runs, 0);
+
+	PMEMoid oid;
+	int ret = pmemobj_xalloc(pop, &oid, SMALL_SIZE, 0,
+		POBJ_CLASS_ID(desc.class_id), NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	pmemobj_heap_stats(pop, s);
+	check_stats(s);
+	UT_ASSERTeq(c->runs, 1);
+	UT_ASSERTeq(c->bytes_allocated, CLASS_UNIT_SIZE);
+	UT_ASSERTeq(c->run_occupancy[0], 1);
+
+	/* the completely full run is counted in the last bin */
+	size_t nfill = c->bytes_free / CLASS_UNIT_SIZE;
+	PMEMoid *fill = MALLOC(sizeof(*fill) * nfill);
+	for (size_t i = 0; i < nfill; ++i) {
+		ret = pmemobj_xalloc(pop, &fill[i], SMALL_SIZE, 0,
+			POBJ_CLASS_ID(desc.class_id), NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	pmemobj_heap_stats(pop, s);
+	check_stats(s);
+	UT_ASSERTeq(c->runs, 1);
+	UT_ASSERTeq(c->bytes_free, 0);
+	UT_ASSERTeq(c->run_occupancy[POBJ_RUN_OCCUPANCY_BINS - 1], 1);
+
+	for (size_t i = 0; i < nfill; ++i)
+		pmemobj_free(&fill[i]);
+	FREE(fill);
+
+	pmemobj_free(&oid);
+
+	pmemobj_heap_stats(pop, s);
+	UT_ASSERTeq(c->bytes_allocated, 0);
+
+	UT_OUT("class unit %zu", c->unit_size);
+}
+
+/*
+ * steal_worker -- allocates objects in a thread which uses a different
+ *	bucket cache than the main thread
+ */
+static void *
+steal_worker(void *arg)
+{
+	struct steal_args *a = arg;
+	struct root *r = pmemobj_direct(pmemobj_root(a->pop,
+		sizeof(struct root)));
+
+	for (unsigned i = 1; i < NSTEAL / 2; i += 2) {
+		int ret = pmemobj_xalloc(a->pop, &r->steal[i], SMALL_SIZE, 0,
+			POBJ_CLASS_ID(a->class_id), NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_steal -- checks that a thread which runs out of free blocks takes
+ *	them from the cache of another thread instead of creating new runs
+ */
+static void
+test_steal(PMEMobjpool *pop, struct pobj_heap_stats *s)
+{
+	struct root *r = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+
+	struct pobj_alloc_class_desc desc;
+	desc.unit_size = STEAL_UNIT_SIZE;
+	desc.units_per_block = 1;
+	desc.class_id = 0;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), 0);
+
+	for (unsigned i = 0; i < NSTEAL; ++i) {
+		int ret = pmemobj_xalloc(pop, &r->steal[i], SMALL_SIZE, 0,
+			POBJ_CLASS_ID(desc.class_id), NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	/* leave the runs half-full, so that they are not degraded */
+	for (unsigned i = 1; i < NSTEAL; i += 2)
+		pmemobj_free(&r->steal[i]);
+
+	pmemobj_heap_stats(pop, s);
+	struct pobj_alloc_class_stats *c = &s->classes[desc.class_id];
+	uint64_t runs = c->runs;
+	UT_ASSERTeq(c->steals, 0);
+
+	struct steal_args a = {pop, desc.class_id};
+	pthread_t thread;
+	PTHREAD_CREATE(&thread, NULL, steal_worker, &a);
+	PTHREAD_JOIN(thread, NULL);
+
+	pmemobj_heap_stats(pop, s);
+	check_stats(s);
+	UT_ASSERTeq(c->runs, runs);
+	UT_ASSERT(c->steals != 0);
+	UT_ASSERTeq(c->bytes_stolen % STEAL_UNIT_SIZE, 0);
+	UT_ASSERT(c->bytes_stolen >= NSTEAL / 4 * STEAL_UNIT_SIZE);
+	UT_ASSERTeq(s->steals, c->steals);
+	UT_ASSERTeq(s->bytes_stolen, c->bytes_stolen);
+
+	for (unsigned i = 0; i < NSTEAL; ++i)
+		pmemobj_free(&r->steal[i]);
+
+	UT_OUT("steal runs %d", c->runs == runs);
+}
+
+/*
+ * worker -- allocates and frees objects to generate lock traffic
+ */
+static void *
+worker(void *arg)
+{
+	PMEMobjpool *pop = arg;
+	PMEMoid oid;
+
+	for (unsigned i = 0; i < NOPS; ++i) {
+		int ret = pmemobj_alloc(pop, &oid, SMALL_SIZE, 0, NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		pmemobj_free(&oid);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_mt -- gathers the statistics while other threads use the heap
+ */
+static void
+test_mt(PMEMobjpool *pop, struct pobj_heap_stats *s)
+{
+	pthread_t threads[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, worker, pop);
+
+	for (unsigned i = 0; i < NOPS / 10; ++i)
+		pmemobj_heap_stats(pop, s);
+
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	pmemobj_heap_stats(pop, s);
+	check_stats(s);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_heap_stats");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT_NAME, POOL_SIZE,
+		S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	struct pobj_heap_stats *s = MALLOC(sizeof(*s));
+	struct pobj_heap_stats *reopened = MALLOC(sizeof(*reopened));
+
+	test_alloc(pop, s);
+	test_class(pop, s);
+	test_steal(pop, s);
+	test_mt(pop, s);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(path, LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	/* the runs are reported before they are loaded by the allocator */
+	pmemobj_heap_stats(pop, reopened);
+	check_stats(reopened);
+	UT_ASSERTeq(reopened->runs, s->runs);
+	UT_ASSERTeq(reopened->run_bytes_allocated, s->run_bytes_allocated);
+	UT_ASSERTeq(reopened->huge_bytes_allocated, s->huge_bytes_allocated);
+	UT_ASSERTeq(reopened->huge_bytes_free, s->huge_bytes_free);
+
+	UT_OUT("reopen runs %d", reopened->runs == s->runs);
+
+	pmemobj_close(pop);
+
+	FREE(reopened);
+	FREE(s);
+
+	DONE(NULL);
+}
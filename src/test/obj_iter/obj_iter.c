@@ -0,0 +1,224 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_iter.c -- unit test for the object iterators
+ *
+ * usage: obj_iter file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_iter"
+
+#define POOL_SIZE (PMEMOBJ_MIN_POOL * 8)
+
+#define NOBJS 5000
+#define NTYPES 4
+#define NSIZES 5
+#define HUGE_SIZE (300 * 1024)
+#define NTHREADS 4
+#define STOP_RET 5
+
+static const size_t Sizes[NSIZES] = {
+	1, 100, 200, 1000, 4000
+};
+
+struct iter_arg {
+	uint64_t count;
+	uint64_t off_sum;
+};
+
+/*
+ * count_cb -- counts the objects visited by pmemobj_iter_parallel
+ */
+static int
+count_cb(PMEMoid oid, void *arg)
+{
+	struct iter_arg *a = arg;
+
+	UT_ASSERT(!OID_IS_NULL(oid));
+
+	__sync_fetch_and_add(&a->count, 1);
+	__sync_fetch_and_add(&a->off_sum, oid.off);
+
+	return 0;
+}
+
+/*
+ * stop_cb -- stops the iteration after a couple of objects
+ */
+static int
+stop_cb(PMEMoid oid, void *arg)
+{
+	struct iter_arg *a = arg;
+
+	return __sync_add_and_fetch(&a->count, 1) >= 10 ? STOP_RET : 0;
+}
+
+/*
+ * check_iter -- verifies that all of the ways to iterate through the objects
+ *	visit the same objects, returns the number of objects
+ */
+static uint64_t
+check_iter(PMEMobjpool *pop, uint64_t *type_count)
+{
+	struct pobj_iter *iter = pmemobj_iter_new(pop, POBJ_ITER_ANY_TYPE);
+	UT_ASSERTne(iter, NULL);
+
+	uint64_t count = 0;
+	uint64_t off_sum = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		PMEMoid it_oid = pmemobj_iter_next(iter);
+		UT_ASSERT(OID_EQUALS(oid, it_oid));
+		count++;
+		off_sum += oid.off;
+	}
+	UT_ASSERT(OID_IS_NULL(pmemobj_iter_next(iter)));
+	pmemobj_iter_delete(iter);
+
+	uint64_t typed = 0;
+	for (uint64_t t = 0; t < NTYPES; ++t) {
+		iter = pmemobj_iter_new(pop, t);
+		UT_ASSERTne(iter, NULL);
+
+		uint64_t n = 0;
+		while (!OID_IS_NULL(oid = pmemobj_iter_next(iter))) {
+			UT_ASSERTeq(pmemobj_type_num(oid), t);
+			n++;
+		}
+		pmemobj_iter_delete(iter);
+
+		UT_ASSERTeq(n, type_count[t]);
+		typed += n;
+	}
+	UT_ASSERTeq(typed, count);
+
+	for (unsigned nthreads = 0; nthreads <= NTHREADS; ++nthreads) {
+		struct iter_arg a = {0, 0};
+		int ret = pmemobj_iter_parallel(pop, POBJ_ITER_ANY_TYPE,
+			nthreads, count_cb, &a);
+		UT_ASSERTeq(ret, 0);
+		UT_ASSERTeq(a.count, count);
+		UT_ASSERTeq(a.off_sum, off_sum);
+	}
+
+	struct iter_arg a = {0, 0};
+	int ret = pmemobj_iter_parallel(pop, 1, NTHREADS, count_cb, &a);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(a.count, type_count[1]);
+
+	return count;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_iter");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME, POOL_SIZE,
+		S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	/* the root object is not visited by the iterators */
+	UT_ASSERT(!OID_IS_NULL(pmemobj_root(pop, sizeof(uint64_t))));
+
+	struct pobj_alloc_class_desc desc = {192, 1, 0};
+	int ret = pmemobj_alloc_class_new(pop, &desc);
+	UT_ASSERTeq(ret, 0);
+
+	uint64_t type_count[NTYPES] = {0};
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		uint64_t type_num = i % NTYPES;
+		size_t size = Sizes[i % NSIZES];
+
+		if (i % 7 == 0)
+			ret = pmemobj_xalloc(pop, NULL, 100, type_num,
+				POBJ_CLASS_ID(desc.class_id), NULL, NULL);
+		else if (i % 100 == 1)
+			ret = pmemobj_alloc(pop, NULL, HUGE_SIZE, type_num,
+				NULL, NULL);
+		else
+			ret = pmemobj_alloc(pop, NULL, size, type_num,
+				NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		type_count[type_num]++;
+	}
+
+	uint64_t count = check_iter(pop, type_count);
+	UT_ASSERTeq(count, NOBJS);
+	UT_OUT("objects %ju", count);
+
+	struct iter_arg a = {0, 0};
+	ret = pmemobj_iter_parallel(pop, POBJ_ITER_ANY_TYPE, NTHREADS,
+		stop_cb, &a);
+	UT_ASSERTeq(ret, STOP_RET);
+	UT_ASSERT(a.count < NOBJS);
+
+	/* free every other object, starting with the first one */
+	PMEMoid oid;
+	PMEMoid next;
+	unsigned i = 0;
+	POBJ_FOREACH_SAFE(pop, oid, next) {
+		if (i++ % 2 == 0) {
+			type_count[pmemobj_type_num(oid)]--;
+			pmemobj_free(&oid);
+		}
+	}
+
+	count = check_iter(pop, type_count);
+	UT_ASSERTeq(count, NOBJS / 2);
+	UT_OUT("after free %ju", count);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	UT_ASSERTne(pop, NULL);
+
+	count = check_iter(pop, type_count);
+	UT_ASSERTeq(count, NOBJS / 2);
+	UT_OUT("reopen %ju", count);
+
+	POBJ_FOREACH_SAFE(pop, oid, next)
+		pmemobj_free(&oid);
+
+	UT_ASSERT(OID_IS_NULL(pmemobj_first(pop)));
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
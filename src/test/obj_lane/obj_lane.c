@@ -125,7 +125,10 @@ test_lane_boot_cleanup_ok()
 {
 	struct mock_pop pop = {
 		.p = {
-			.nlanes = MAX_MOCK_LANES
+			.nlanes = MAX_MOCK_LANES,
+			.lanes_desc = {
+				.runtime_nlanes = MAX_MOCK_LANES
+			}
 		}
 	};
 	base_ptr = &pop.p;
@@ -155,7 +158,10 @@ test_lane_boot_fail()
 {
 	struct mock_pop pop = {
 		.p = {
-			.nlanes = MAX_MOCK_LANES
+			.nlanes = MAX_MOCK_LANES,
+			.lanes_desc = {
+				.runtime_nlanes = MAX_MOCK_LANES
+			}
 		}
 	};
 	base_ptr = &pop.p;
@@ -171,6 +177,37 @@ test_lane_boot_fail()
 	UT_ASSERTeq(pop.p.lanes_desc.lane_locks, NULL);
 }
 
+/*
+ * test_lane_boot_runtime_nlanes -- only the lanes available at runtime get
+ *	their runtime state
+ */
+static void
+test_lane_boot_runtime_nlanes(void)
+{
+	struct mock_pop pop = {
+		.p = {
+			.nlanes = MAX_MOCK_LANES,
+			.lanes_desc = {
+				.runtime_nlanes = 2
+			}
+		}
+	};
+	base_ptr = &pop.p;
+	pop.p.lanes_offset = (uint64_t)&pop.l - (uint64_t)&pop.p;
+
+	UT_ASSERTeq(lane_boot(&pop.p), 0);
+
+	for (int i = 0; i < 2; ++i) {
+		for (int j = 0; j < MAX_LANE_SECTION; ++j) {
+			struct lane_section *section =
+				&pop.p.lanes_desc.lane[i].sections[j];
+			UT_ASSERTeq(section->layout, &pop.l[i].sections[j]);
+		}
+	}
+
+	lane_cleanup(&pop.p);
+}
+
 static void
 test_lane_recovery_check_ok()
 {
@@ -338,7 +375,10 @@ test_lane_cleanup_in_separate_thread(void)
 {
 	struct mock_pop pop = {
 		.p = {
-			.nlanes = MAX_MOCK_LANES
+			.nlanes = MAX_MOCK_LANES,
+			.lanes_desc = {
+				.runtime_nlanes = MAX_MOCK_LANES
+			}
 		}
 	};
 	base_ptr = &pop.p;
@@ -368,6 +408,182 @@ test_lane_cleanup_in_separate_thread(void)
 	UT_ASSERTeq(pop.p.lanes_desc.lane_locks, NULL);
 }
 
+#define CONTENTION_LANES 2
+#define CONTENTION_THREADS 16
+#define CONTENTION_OPS 10000
+
+static uint64_t Lane_owners[CONTENTION_LANES];
+
+/*
+ * test_contention_thread -- holds and releases a lane over and over,
+ *	checking that nobody else holds it at the same time
+ */
+static void *
+test_contention_thread(void *arg)
+{
+	PMEMobjpool *pop = arg;
+
+	for (int i = 0; i < CONTENTION_OPS; ++i) {
+		unsigned idx = lane_hold(pop, NULL, LANE_ID);
+		UT_ASSERT(idx < CONTENTION_LANES);
+
+		UT_ASSERTeq(__sync_fetch_and_add(&Lane_owners[idx], 1), 0);
+		if (i % 64 == 0)
+			sched_yield();
+		UT_ASSERTeq(__sync_fetch_and_sub(&Lane_owners[idx], 1), 1);
+
+		lane_release(pop);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_lane_hold_contention -- many more threads than lanes
+ */
+static void
+test_lane_hold_contention(void)
+{
+	struct mock_pop pop = {
+		.p = {
+			.nlanes = CONTENTION_LANES,
+			.uuid_lo = 0x1234,
+			.lanes_desc = {
+				.runtime_nlanes = CONTENTION_LANES,
+			}
+		}
+	};
+	pop.p.lanes_desc.lane_locks = CALLOC(CONTENTION_LANES,
+		sizeof(uint64_t));
+
+	pthread_t threads[CONTENTION_THREADS];
+	for (int i = 0; i < CONTENTION_THREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, test_contention_thread,
+			&pop.p);
+
+	for (int i = 0; i < CONTENTION_THREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	struct pobj_lane_stats stats;
+	lane_stats(&pop.p, &stats);
+
+	UT_ASSERTeq(stats.nlanes, CONTENTION_LANES);
+	UT_ASSERTeq(pop.p.lanes_desc.nwaiters, 0);
+	UT_ASSERT(stats.handoffs <=
+		(uint64_t)CONTENTION_THREADS * CONTENTION_OPS);
+	UT_ASSERT(stats.waits == 0 || stats.wait_ns != 0);
+
+	for (int i = 0; i < CONTENTION_LANES; ++i) {
+		UT_ASSERTeq(Lane_owners[i], 0);
+		UT_ASSERTeq(pop.p.lanes_desc.lane_locks[i], 0);
+	}
+
+	FREE(pop.p.lanes_desc.lane_locks);
+}
+
+static uint64_t Recovered[MAX_LANE_SECTION][MAX_MOCK_LANES];
+static unsigned Booted[MAX_LANE_SECTION];
+static uint64_t Recovery_fail_off;
+
+/*
+ * lane_count_recovery -- counts the recoveries of every section, fails
+ *	for the section at Recovery_fail_off
+ */
+static int
+lane_count_recovery(PMEMobjpool *pop, void *data, unsigned length)
+{
+	uint64_t off = RPTR(data) - pop->lanes_offset;
+	uint64_t lane = off / sizeof(struct lane_layout);
+	uint64_t section = off % sizeof(struct lane_layout) /
+		sizeof(struct lane_section_layout);
+
+	UT_ASSERT(lane < MAX_MOCK_LANES);
+	__sync_fetch_and_add(&Recovered[section][lane], 1);
+
+	if (Recovery_fail_off != 0 && RPTR(data) == Recovery_fail_off)
+		return EINVAL;
+
+	return 0;
+}
+
+/*
+ * lane_count_boot -- counts the boots of sections, which must happen after
+ *	all lanes of the section are recovered
+ */
+static int
+lane_count_boot(PMEMobjpool *pop)
+{
+	int section = 0;
+	while (section < MAX_LANE_SECTION && Booted[section] != 0)
+		section++;
+
+	UT_ASSERT(section < MAX_LANE_SECTION);
+	for (int i = 0; i < MAX_MOCK_LANES; ++i)
+		UT_ASSERTeq(Recovered[section][i], 1);
+
+	Booted[section]++;
+
+	return 0;
+}
+
+static struct section_operations count_ops = {
+	.construct_rt = lane_noop_construct_rt,
+	.destroy_rt = lane_noop_destroy_rt,
+	.recover = lane_count_recovery,
+	.check = lane_count_recovery,
+	.boot = lane_count_boot
+};
+
+/*
+ * test_lane_recovery_parallel -- recovery of lanes using many threads
+ */
+static void
+test_lane_recovery_parallel(void)
+{
+	struct mock_pop pop = {
+		.p = {
+			.nlanes = MAX_MOCK_LANES
+		}
+	};
+	base_ptr = &pop.p;
+	pop.p.lanes_offset = (uint64_t)&pop.l - (uint64_t)&pop.p;
+
+	struct section_operations *ops[MAX_LANE_SECTION];
+	for (int i = 0; i < MAX_LANE_SECTION; ++i) {
+		ops[i] = Section_ops[i];
+		Section_ops[i] = &count_ops;
+	}
+
+	UT_ASSERTeq(setenv("PMEMOBJ_RECOVERY_THREADS", "4", 1), 0);
+
+	UT_ASSERTeq(lane_recover_and_section_boot(&pop.p), 0);
+	for (int i = 0; i < MAX_LANE_SECTION; ++i)
+		UT_ASSERTeq(Booted[i], 1);
+
+	struct pobj_lane_stats stats;
+	lane_stats(&pop.p, &stats);
+	UT_ASSERTeq(stats.recovery_threads, 4);
+
+	/* the recovery stops at the failed lane */
+	memset(Recovered, 0, sizeof(Recovered));
+	memset(Booted, 0, sizeof(Booted));
+	Recovery_fail_off = RPTR(&pop.l[3].sections[LANE_SECTION_LIST]);
+
+	UT_ASSERTeq(lane_recover_and_section_boot(&pop.p), EINVAL);
+	UT_ASSERTeq(Booted[LANE_SECTION_ALLOCATOR], 1);
+	UT_ASSERTeq(Booted[LANE_SECTION_LIST], 0);
+	for (int i = 0; i < MAX_MOCK_LANES; ++i)
+		UT_ASSERTeq(Recovered[LANE_SECTION_TRANSACTION][i], 0);
+
+	memset(Recovered, 0, sizeof(Recovered));
+	UT_ASSERTeq(lane_check(&pop.p), EINVAL);
+
+	UT_ASSERTeq(unsetenv("PMEMOBJ_RECOVERY_THREADS"), 0);
+
+	for (int i = 0; i < MAX_LANE_SECTION; ++i)
+		Section_ops[i] = ops[i];
+}
+
 static void
 usage(const char *app)
 {
@@ -391,11 +607,14 @@ main(int argc, char *argv[])
 		test_lane_recovery_check_fail();
 		test_lane_hold_release();
 		test_lane_sizes();
+		test_lane_boot_runtime_nlanes();
 		break;
 	case 'm':
 		/* multithreaded scenarios */
 		test_lane_info_destroy_in_separate_thread();
 		test_lane_cleanup_in_separate_thread();
+		test_lane_hold_contention();
+		test_lane_recovery_parallel();
 		break;
 	default:
 		usage(argv[0]);
@@ -73,6 +73,25 @@ FUNC_MOCK(operation_add_entry, void, struct operation_context *ctx, void *ptr,
 	}
 FUNC_MOCK_END
 
+static struct chunk_header Chunk_hdrs[NCHUNKS];
+
+FUNC_MOCK(heap_get_chunk_hdr, struct chunk_header *, struct palloc_heap *heap,
+	uint32_t zone_id, uint32_t chunk_id)
+	FUNC_MOCK_RUN_DEFAULT {
+		return &Chunk_hdrs[chunk_id];
+	}
+FUNC_MOCK_END
+
+FUNC_MOCK(heap_get_block_data, void *, struct palloc_heap *heap,
+	struct memory_block m)
+	FUNC_MOCK_RUN_DEFAULT {
+		struct chunk_run *run = (struct chunk_run *)
+			&heap->layout->zone0.chunks[m.chunk_id];
+
+		return (char *)&run->data + run->block_size * m.block_off;
+	}
+FUNC_MOCK_END
+
 static void
 test_detect()
 {
@@ -180,10 +199,12 @@ test_prep_hdr()
 	MEMBLOCK_OPS(, &mhuge_used)->prep_hdr(&mhuge_used,
 			heap, MEMBLOCK_FREE, NULL);
 	UT_ASSERTeq(layout->zone0.chunk_headers[0].type, CHUNK_TYPE_FREE);
+	UT_ASSERTeq(Chunk_hdrs[0].type, CHUNK_TYPE_FREE);
 
 	MEMBLOCK_OPS(, &mhuge_free)->prep_hdr(&mhuge_free,
 			heap, MEMBLOCK_ALLOCATED, NULL);
 	UT_ASSERTeq(layout->zone0.chunk_headers[1].type, CHUNK_TYPE_USED);
+	UT_ASSERTeq(Chunk_hdrs[1].type, CHUNK_TYPE_USED);
 
 	MEMBLOCK_OPS(, &mrun_used)->prep_hdr(&mrun_used,
 			heap, MEMBLOCK_FREE, NULL);
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_nlanes.c -- unit test for the number of lanes selected by
+ *	the PMEMOBJ_NLANES variable
+ *
+ * usage: obj_nlanes file1 file2
+ */
+
+#include <errno.h>
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_nlanes"
+
+#define NTHREADS 8
+#define NOPS 1000
+
+/*
+ * worker -- allocates and frees objects in transactions
+ */
+static void *
+worker(void *arg)
+{
+	PMEMobjpool *pop = arg;
+
+	for (int i = 0; i < NOPS; ++i) {
+		TX_BEGIN(pop) {
+			PMEMoid oid = pmemobj_tx_alloc(64, 0);
+			pmemobj_tx_free(oid);
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+	}
+
+	return NULL;
+}
+
+/*
+ * run_workers -- runs the workers and prints the number of lanes
+ */
+static void
+run_workers(PMEMobjpool *pop, const char *desc)
+{
+	pthread_t threads[NTHREADS];
+
+	for (int i = 0; i < NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, worker, pop);
+
+	for (int i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	struct pobj_lane_stats stats;
+	UT_ASSERTeq(pmemobj_lane_stats(pop, &stats), 0);
+	UT_OUT("%s nlanes %u", desc, stats.nlanes);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_nlanes");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file1 file2", argv[0]);
+
+	PMEMobjpool *pop;
+
+	UT_ASSERTeq(setenv("PMEMOBJ_NLANES", "4", 1), 0);
+	pop = pmemobj_create(argv[1], LAYOUT_NAME, PMEMOBJ_MIN_POOL,
+		S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+	run_workers(pop, "create");
+	pmemobj_close(pop);
+
+	/* the pool can't be opened with more lanes than it was created with */
+	UT_ASSERTeq(unsetenv("PMEMOBJ_NLANES"), 0);
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+	run_workers(pop, "open");
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(setenv("PMEMOBJ_NLANES", "1", 1), 0);
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+	run_workers(pop, "open limited");
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmemobj_check(argv[1], LAYOUT_NAME), 1);
+
+	/* the lanes wouldn't leave any space for the heap */
+	UT_ASSERTeq(setenv("PMEMOBJ_NLANES", "65536", 1), 0);
+	pop = pmemobj_create(argv[2], LAYOUT_NAME, PMEMOBJ_MIN_POOL,
+		S_IWUSR | S_IRUSR);
+	UT_ASSERTeq(pop, NULL);
+	UT_OUT("create too many lanes: %s", strerror(errno));
+
+	DONE(NULL);
+}
@@ -40,10 +40,17 @@
 #include "unittest.h"
 
 #define TEST_ALLOC_SIZE (131072 - 64) /* last unit size */
+#define TEST_SMALL_ALLOC_SIZE 128 /* served from the thread cache */
 #define LAYOUT_NAME "oom_mt"
+#define CLOSE_THREADS 8
+#define CLOSE_ALLOCS 16
 
 int allocated;
 PMEMobjpool *pop;
+pthread_mutex_t close_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t close_cond = PTHREAD_COND_INITIALIZER;
+int nready;
+int closing;
 
 static void *
 oom_worker(void *arg)
@@ -59,6 +66,44 @@ oom_worker(void *arg)
 	return NULL;
 }
 
+static void *
+small_alloc_worker(void *arg)
+{
+	allocated = 0;
+	while (pmemobj_alloc(pop, NULL, TEST_SMALL_ALLOC_SIZE,
+			0, NULL, NULL) == 0)
+		allocated++;
+
+	return NULL;
+}
+
+static void *
+free_worker(void *arg)
+{
+	PMEMoid iter, iter2;
+	POBJ_FOREACH_SAFE(pop, iter, iter2)
+		pmemobj_free(&iter);
+
+	return NULL;
+}
+
+static void *
+exit_worker(void *arg)
+{
+	for (int i = 0; i < CLOSE_ALLOCS; ++i)
+		pmemobj_alloc(pop, NULL, TEST_SMALL_ALLOC_SIZE, 0, NULL, NULL);
+
+	/* exit while the pool is being closed */
+	pthread_mutex_lock(&close_lock);
+	nready++;
+	pthread_cond_broadcast(&close_cond);
+	while (!closing)
+		pthread_cond_wait(&close_cond, &close_lock);
+	pthread_mutex_unlock(&close_lock);
+
+	return NULL;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -84,7 +129,47 @@ main(int argc, char *argv[])
 
 	UT_ASSERTeq(first_thread_allocated, allocated);
 
+	/*
+	 * Objects freed by a different thread than the one which allocated
+	 * them must return to the heap once the freeing thread exits.
+	 */
+	pthread_create(&t, NULL, small_alloc_worker, NULL);
+	pthread_join(t, NULL);
+
+	first_thread_allocated = allocated;
+
+	pthread_create(&t, NULL, free_worker, NULL);
+	pthread_join(t, NULL);
+
+	pthread_create(&t, NULL, small_alloc_worker, NULL);
+	pthread_join(t, NULL);
+
+	UT_ASSERTeq(first_thread_allocated, allocated);
+
 	pmemobj_close(pop);
 
+	/*
+	 * Threads exiting while the pool is being closed must not return
+	 * their cached blocks to an already freed heap.
+	 */
+	if ((pop = pmemobj_open(path, LAYOUT_NAME)) == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	pthread_t threads[CLOSE_THREADS];
+	for (int i = 0; i < CLOSE_THREADS; ++i)
+		pthread_create(&threads[i], NULL, exit_worker, NULL);
+
+	pthread_mutex_lock(&close_lock);
+	while (nready != CLOSE_THREADS)
+		pthread_cond_wait(&close_cond, &close_lock);
+	closing = 1;
+	pthread_cond_broadcast(&close_cond);
+	pthread_mutex_unlock(&close_lock);
+
+	pmemobj_close(pop);
+
+	for (int i = 0; i < CLOSE_THREADS; ++i)
+		pthread_join(threads[i], NULL);
+
 	DONE(NULL);
 }
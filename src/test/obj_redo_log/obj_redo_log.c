@@ -38,6 +38,8 @@
  * s:<index>:<offset>:<value> - store <value> at <offset>
  * f:<index>:<offset>:<value> - store last <value> at <offset>
  * F:<index>                  - set <index> entry as the last one
+ * l:<index>:<offset>:<value> - store <value> at <offset> in linked entry
+ * L:<index>:<nlinked>        - link <nlinked> linked entries from <index>
  * r:<offset>                 - read at <offset>
  * e:<index>                  - read redo log entry at <index>
  * P                          - process redo log
@@ -63,7 +65,7 @@
 #include "unittest.h"
 
 #define FATAL_USAGE()	UT_FATAL("usage: obj_redo_log <fname> <redo_log_size> "\
-		"[sfFrePRC][<index>:<offset>:<value>]\n")
+		"[sfFlLrePRC][<index>:<offset>:<value>]\n")
 
 #define PMEMOBJ_POOL_HDR_SIZE	8192
 
@@ -188,6 +190,11 @@ main(int argc, char *argv[])
 	struct redo_log *redo =
 		(struct redo_log *)((char *)pop->addr + PMEMOBJ_POOL_HDR_SIZE);
 
+	/* the linked entries are at the beginning of the data area */
+	struct redo_log *linked =
+		(struct redo_log *)((char *)pop->addr + pop->heap_offset);
+	size_t nlinked;
+
 	uint64_t offset;
 	uint64_t value;
 	int i;
@@ -220,6 +227,21 @@ main(int argc, char *argv[])
 			UT_OUT("F:%ld", index);
 			redo_log_set_last(pop->redo, redo, index);
 			break;
+		case 'l':
+			if (sscanf(arg, "l:%zd:0x%zx:0x%zx",
+					&index, &offset, &value) != 3)
+				FATAL_USAGE();
+			UT_OUT("l:%ld:0x%08lx:0x%08lx", index, offset, value);
+			redo_log_store_linked(pop->redo, linked, index, offset,
+					value);
+			break;
+		case 'L':
+			if (sscanf(arg, "L:%zd:%zd", &index, &nlinked) != 2)
+				FATAL_USAGE();
+			UT_OUT("L:%ld:%ld", index, nlinked);
+			redo_log_store_link(pop->redo, redo, index, linked,
+					nlinked);
+			break;
 		case 'r':
 			if (sscanf(arg, "r:0x%zx", &offset) != 1)
 				FATAL_USAGE();
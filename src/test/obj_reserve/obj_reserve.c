@@ -0,0 +1,238 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_reserve.c -- unit test for the reserve/publish allocation API
+ *
+ * usage: obj_reserve file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_reserve"
+
+#define POOL_SIZE (PMEMOBJ_MIN_POOL * 16)
+
+#define NOBJS 1024
+#define NHUGE 8
+#define SMALL_SIZE 64
+#define HUGE_SIZE (512 * 1024)
+
+enum obj_type {
+	TYPE_SMALL,
+	TYPE_HUGE,
+
+	MAX_TYPE
+};
+
+struct root {
+	PMEMoid objs[NOBJS + NHUGE];
+};
+
+/*
+ * count_objs -- returns the number of objects of the given type in the pool
+ */
+static unsigned
+count_objs(PMEMobjpool *pop, enum obj_type type)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) == type)
+			n++;
+	}
+
+	return n;
+}
+
+/*
+ * reserve_objs -- reserves the small and huge objects, fills them with their
+ *	index and optionally creates the actions linking them to the root
+ */
+static size_t
+reserve_objs(PMEMobjpool *pop, struct pobj_action *actv, int link)
+{
+	struct root *r = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+	size_t nact = 0;
+
+	for (unsigned i = 0; i < NOBJS + NHUGE; ++i) {
+		size_t size = i < NOBJS ? SMALL_SIZE : HUGE_SIZE;
+		uint64_t type = i < NOBJS ? TYPE_SMALL : TYPE_HUGE;
+
+		struct pobj_action *act = &actv[nact++];
+		PMEMoid oid = pmemobj_reserve(pop, act, size, type);
+		UT_ASSERT(!OID_IS_NULL(oid));
+		UT_ASSERTeq(act->type, POBJ_ACTION_TYPE_HEAP);
+		UT_ASSERTeq(act->heap.offset, oid.off);
+		UT_ASSERTeq(pmemobj_type_num(oid), type);
+		UT_ASSERT(pmemobj_alloc_usable_size(oid) >= size);
+
+		unsigned *data = pmemobj_direct(oid);
+		*data = i;
+		pmemobj_persist(pop, data, sizeof(*data));
+
+		if (!link)
+			continue;
+
+		pmemobj_set_value(pop, &actv[nact++],
+			&r->objs[i].pool_uuid_lo, oid.pool_uuid_lo);
+		pmemobj_set_value(pop, &actv[nact++],
+			&r->objs[i].off, oid.off);
+	}
+
+	return nact;
+}
+
+/*
+ * test_publish -- publishes many reservations along with the stores that
+ *	link the objects to the root object
+ */
+static void
+test_publish(PMEMobjpool *pop, struct pobj_action *actv)
+{
+	struct root *r = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+
+	size_t nact = reserve_objs(pop, actv, 1);
+
+	/* nothing is visible until the actions are published */
+	UT_ASSERTeq(count_objs(pop, TYPE_SMALL), 0);
+	UT_ASSERT(OID_IS_NULL(r->objs[0]));
+
+	UT_ASSERTeq(pmemobj_publish(pop, actv, nact), 0);
+
+	UT_OUT("publish small %u huge %u", count_objs(pop, TYPE_SMALL),
+		count_objs(pop, TYPE_HUGE));
+
+	for (unsigned i = 0; i < NOBJS + NHUGE; ++i) {
+		unsigned *data = pmemobj_direct(r->objs[i]);
+		UT_ASSERTne(data, NULL);
+		UT_ASSERTeq(*data, i);
+	}
+}
+
+/*
+ * test_cancel -- cancels reservations, the memory must be reusable afterwards
+ */
+static void
+test_cancel(PMEMobjpool *pop, struct pobj_action *actv)
+{
+	size_t nact = reserve_objs(pop, actv, 0);
+	pmemobj_cancel(pop, actv, nact);
+
+	UT_OUT("cancel small %u huge %u", count_objs(pop, TYPE_SMALL),
+		count_objs(pop, TYPE_HUGE));
+
+	/* reserve until the pool is full and give everything back */
+	nact = 0;
+	while (!OID_IS_NULL(pmemobj_reserve(pop, &actv[nact], HUGE_SIZE,
+			TYPE_HUGE)))
+		nact++;
+	UT_ASSERTeq(errno, ENOMEM);
+	UT_ASSERTne(nact, 0);
+
+	pmemobj_cancel(pop, actv, nact);
+
+	/* the same number of objects must fit in the pool again */
+	PMEMoid *oids = MALLOC(sizeof(*oids) * (nact + 1));
+	size_t n = 0;
+	while (n <= nact && pmemobj_alloc(pop, &oids[n], HUGE_SIZE,
+			TYPE_HUGE, NULL, NULL) == 0)
+		n++;
+	UT_ASSERTeq(n, nact);
+
+	while (n != 0)
+		pmemobj_free(&oids[--n]);
+	FREE(oids);
+
+	UT_ASSERTeq(pmemobj_publish(pop, actv, 0), 0);
+}
+
+/*
+ * test_free -- frees all of the published objects
+ */
+static void
+test_free(PMEMobjpool *pop)
+{
+	struct root *r = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+
+	for (unsigned i = 0; i < NOBJS + NHUGE; ++i)
+		pmemobj_free(&r->objs[i]);
+
+	UT_OUT("free small %u huge %u", count_objs(pop, TYPE_SMALL),
+		count_objs(pop, TYPE_HUGE));
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_reserve");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT_NAME, POOL_SIZE,
+		S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	/* each object needs one reservation and two stores */
+	struct pobj_action *actv =
+		MALLOC(sizeof(*actv) * (NOBJS + NHUGE) * 3);
+
+	test_publish(pop, actv);
+	test_cancel(pop, actv);
+
+	/* reservations which are never published do not survive reopen */
+	reserve_objs(pop, actv, 0);
+
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmemobj_check(path, LAYOUT_NAME), 1);
+
+	pop = pmemobj_open(path, LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	UT_OUT("reopen small %u huge %u", count_objs(pop, TYPE_SMALL),
+		count_objs(pop, TYPE_HUGE));
+
+	test_free(pop);
+
+	pmemobj_close(pop);
+
+	FREE(actv);
+
+	DONE(NULL);
+}
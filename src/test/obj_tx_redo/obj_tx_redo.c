@@ -0,0 +1,466 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_tx_redo.c -- unit test for the redo mode of transactions
+ *
+ * usage: obj_tx_redo file [cmd: c/o] scenario
+ */
+#include "obj.h"
+#include "pmalloc.h"
+#include "unittest.h"
+
+POBJ_LAYOUT_BEGIN(tx_redo);
+POBJ_LAYOUT_ROOT(tx_redo, struct root);
+POBJ_LAYOUT_TOID(tx_redo, struct object);
+POBJ_LAYOUT_END(tx_redo);
+
+#define NVALUES 16
+#define BIG_SIZE 4096
+#define OBJ_VALUE 0xabcdULL
+
+struct object {
+	uint64_t value;
+	uint64_t unused[7];
+};
+
+struct root {
+	uint64_t values[NVALUES];
+	TOID(struct object) obj;
+	uint8_t big[BIG_SIZE];
+};
+
+static struct root *Root;
+
+static int exit_on_construct;
+static int nconstructs;
+FUNC_MOCK(pmalloc_construct, int, PMEMobjpool *pop, uint64_t *off,
+	size_t size, palloc_constr constructor, void *arg)
+	FUNC_MOCK_RUN_DEFAULT {
+		nconstructs++;
+		int ret = _FUNC_REAL(pmalloc_construct)(pop, off, size,
+			constructor, arg);
+
+		/* the redo log is written, but not committed */
+		if (exit_on_construct)
+			exit(0);
+
+		return ret;
+	}
+FUNC_MOCK_END
+
+/*
+ * The size of the redo log is checked after it's applied, to decide whether
+ * it's kept for the next transaction.
+ */
+static PMEMobjpool *Pop;
+static int exit_on_applied;
+FUNC_MOCK(palloc_usable_size, size_t, struct palloc_heap *heap, uint64_t off)
+	FUNC_MOCK_RUN_DEFAULT {
+		if (exit_on_applied) {
+			/* pretend the applied changes didn't reach the pool */
+			pmemobj_memset_persist(Pop, Root->values, 0,
+				sizeof(Root->values));
+			exit(0);
+		}
+
+		return _FUNC_REAL(palloc_usable_size)(heap, off);
+	}
+FUNC_MOCK_END
+
+/*
+ * write_value -- writes a single value within the transaction
+ */
+static void
+write_value(int i, uint64_t value)
+{
+	UT_ASSERTeq(pmemobj_tx_write(&Root->values[i], &value,
+		sizeof(value)), 0);
+}
+
+/*
+ * read_values -- reads all values as seen by the transaction
+ */
+static void
+read_values(uint64_t *values)
+{
+	UT_ASSERTeq(pmemobj_tx_read(values, Root->values,
+		sizeof(Root->values)), 0);
+}
+
+/*
+ * init_values -- sets the initial values of the root object
+ */
+static void
+init_values(PMEMobjpool *pop)
+{
+	for (int i = 0; i < NVALUES; ++i)
+		Root->values[i] = (uint64_t)i;
+
+	pmemobj_persist(pop, Root->values, sizeof(Root->values));
+}
+
+/*
+ * check_values -- verifies the values of the root object
+ */
+static void
+check_values(const uint64_t *expected)
+{
+	for (int i = 0; i < NVALUES; ++i)
+		UT_ASSERTeq(Root->values[i], expected[i]);
+}
+
+/*
+ * sc0_commit -- buffered writes are visible only to the transaction until
+ *	it commits
+ */
+static void
+sc0_commit(PMEMobjpool *pop)
+{
+	uint64_t values[NVALUES];
+
+	TX_BEGIN_PARAM(pop, TX_PARAM_REDO) {
+		write_value(1, 100);
+		UT_ASSERTeq(Root->values[1], 1);
+
+		/* adjacent, separate and overlapping writes */
+		write_value(2, 200);
+		write_value(4, 400);
+		uint64_t three[3] = {300, 301, 302};
+		UT_ASSERTeq(pmemobj_tx_write(&Root->values[3], three,
+			sizeof(three)), 0);
+
+		TX_BEGIN(pop) {
+			write_value(7, 700);
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+
+		read_values(values);
+		UT_ASSERTeq(values[0], 0);
+		UT_ASSERTeq(values[1], 100);
+		UT_ASSERTeq(values[2], 200);
+		UT_ASSERTeq(values[3], 300);
+		UT_ASSERTeq(values[4], 301);
+		UT_ASSERTeq(values[5], 302);
+		UT_ASSERTeq(values[6], 6);
+		UT_ASSERTeq(values[7], 700);
+
+		/* a read of a part of a buffered range */
+		uint64_t value;
+		UT_ASSERTeq(pmemobj_tx_read(&value, &Root->values[4],
+			sizeof(value)), 0);
+		UT_ASSERTeq(value, 301);
+
+		for (int i = 1; i < 8; ++i)
+			UT_ASSERTeq(Root->values[i], (uint64_t)i);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(values);
+}
+
+/*
+ * sc0_abort -- buffered writes are discarded on abort
+ */
+static void
+sc0_abort(PMEMobjpool *pop)
+{
+	uint64_t values[NVALUES];
+	memcpy(values, Root->values, sizeof(values));
+
+	TX_BEGIN_PARAM(pop, TX_PARAM_REDO) {
+		write_value(0, 1000);
+		write_value(NVALUES - 1, 1000);
+		pmemobj_tx_abort(ECANCELED);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(values);
+}
+
+/*
+ * sc0_undo -- pmemobj_tx_write outside of the redo mode modifies the pool
+ *	immediately
+ */
+static void
+sc0_undo(PMEMobjpool *pop)
+{
+	TX_BEGIN(pop) {
+		write_value(8, 800);
+		UT_ASSERTeq(Root->values[8], 800);
+		pmemobj_tx_abort(ECANCELED);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(Root->values[8], 8);
+
+	TX_BEGIN(pop) {
+		write_value(8, 800);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(Root->values[8], 800);
+}
+
+/*
+ * sc0_nested -- the redo mode can't be selected by a nested transaction
+ */
+static void
+sc0_nested(PMEMobjpool *pop)
+{
+	TX_BEGIN(pop) {
+		TX_BEGIN_PARAM(pop, TX_PARAM_REDO) {
+			UT_ASSERT(0);
+		} TX_END
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_ONABORT {
+		UT_ASSERTeq(errno, EINVAL);
+	} TX_END
+}
+
+/*
+ * sc0_objects -- buffered writes to objects allocated, reallocated and freed
+ *	in the same transaction
+ */
+static void
+sc0_objects(PMEMobjpool *pop)
+{
+	TX_BEGIN_PARAM(pop, TX_PARAM_REDO) {
+		TOID(struct object) obj = TX_ZNEW(struct object);
+		uint64_t value = OBJ_VALUE;
+		pmemobj_tx_write(&D_RW(obj)->value, &value, sizeof(value));
+
+		/* the freed object takes its buffered writes with it */
+		TOID(struct object) tmp = TX_ZNEW(struct object);
+		pmemobj_tx_write(&D_RW(tmp)->value, &value, sizeof(value));
+		TX_FREE(tmp);
+
+		/* the new copy includes the buffered writes */
+		obj = TX_REALLOC(obj, 2 * sizeof(struct object));
+		UT_ASSERTeq(D_RO(obj)->value, OBJ_VALUE);
+
+		pmemobj_tx_write(&Root->obj, &obj, sizeof(obj));
+		UT_ASSERT(TOID_IS_NULL(Root->obj));
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERT(!TOID_IS_NULL(Root->obj));
+	UT_ASSERTeq(D_RO(Root->obj)->value, OBJ_VALUE);
+}
+
+/*
+ * sc0_reuse -- the redo log is reused by the following transactions of the
+ *	lane, until it's too small, and it's not applied again
+ */
+static void
+sc0_reuse(PMEMobjpool *pop)
+{
+	/* the redo log of the previous transactions is big enough */
+	nconstructs = 0;
+	TX_BEGIN_PARAM(pop, TX_PARAM_REDO) {
+		write_value(9, 900);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(nconstructs, 0);
+	UT_ASSERTeq(Root->values[9], 900);
+
+	/* a transaction without writes must not apply the old log */
+	TX_BEGIN(pop) {
+		write_value(9, 9);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	TX_BEGIN_PARAM(pop, TX_PARAM_REDO) {
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(Root->values[9], 9);
+
+	/* the log overflows, so a bigger one is allocated */
+	uint8_t big[BIG_SIZE];
+	memset(big, 0xc, sizeof(big));
+	TX_BEGIN_PARAM(pop, TX_PARAM_REDO) {
+		UT_ASSERTeq(pmemobj_tx_write(Root->big, big, sizeof(big)), 0);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(nconstructs, 1);
+	UT_ASSERTeq(memcmp(Root->big, big, sizeof(big)), 0);
+}
+
+/*
+ * sc0_create -- runs the transactions that don't exit
+ */
+static void
+sc0_create(PMEMobjpool *pop)
+{
+	sc0_commit(pop);
+	sc0_abort(pop);
+	sc0_undo(pop);
+	sc0_nested(pop);
+	sc0_objects(pop);
+	sc0_reuse(pop);
+}
+
+/*
+ * sc0_verify -- checks the values left by sc0_create
+ */
+static void
+sc0_verify(PMEMobjpool *pop)
+{
+	uint64_t expected[NVALUES] = {
+		0, 100, 200, 300, 301, 302, 6, 700,
+		800, 9, 10, 11, 12, 13, 14, 15
+	};
+
+	check_values(expected);
+	UT_ASSERTeq(D_RO(Root->obj)->value, OBJ_VALUE);
+}
+
+/*
+ * sc_write_all -- writes all values in the redo mode
+ */
+static void
+sc_write_all(PMEMobjpool *pop, int *exit_flag)
+{
+	TX_BEGIN_PARAM(pop, TX_PARAM_REDO) {
+		for (int i = 0; i < NVALUES; ++i)
+			write_value(i, (uint64_t)i * 10);
+
+		*exit_flag = 1;
+	} TX_END
+
+	/* if we get here, something is wrong with function mocking */
+	UT_ASSERT(0);
+}
+
+/*
+ * sc1_create -- exits after writing the redo log
+ */
+static void
+sc1_create(PMEMobjpool *pop)
+{
+	sc_write_all(pop, &exit_on_construct);
+}
+
+/*
+ * sc1_verify -- the transaction must be rolled back
+ */
+static void
+sc1_verify(PMEMobjpool *pop)
+{
+	for (int i = 0; i < NVALUES; ++i)
+		UT_ASSERTeq(Root->values[i], (uint64_t)i);
+}
+
+/*
+ * sc2_create -- exits after the commit, before the redo log is emptied
+ */
+static void
+sc2_create(PMEMobjpool *pop)
+{
+	sc_write_all(pop, &exit_on_applied);
+}
+
+/*
+ * sc2_verify -- the transaction must be recovered from the redo log
+ */
+static void
+sc2_verify(PMEMobjpool *pop)
+{
+	for (int i = 0; i < NVALUES; ++i)
+		UT_ASSERTeq(Root->values[i], (uint64_t)i * 10);
+}
+
+typedef void (*scenario_func)(PMEMobjpool *pop);
+
+static struct {
+	scenario_func create;
+	scenario_func verify;
+} scenarios[] = {
+	{sc0_create, sc0_verify},
+	{sc1_create, sc1_verify},
+	{sc2_create, sc2_verify},
+};
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_redo");
+
+	if (argc != 4)
+		UT_FATAL("usage: %s file [cmd: c/o] scenario", argv[0]);
+
+	const char *path = argv[1];
+	int exists = argv[2][0] == 'o';
+	int scenario = atoi(argv[3]);
+
+	PMEMobjpool *pop = NULL;
+	if (!exists) {
+		pop = pmemobj_create(path, POBJ_LAYOUT_NAME(tx_redo), 0,
+			S_IWUSR | S_IRUSR);
+		if (pop == NULL)
+			UT_FATAL("!pmemobj_create: %s", path);
+
+		Pop = pop;
+		Root = D_RW(POBJ_ROOT(pop, struct root));
+		init_values(pop);
+
+		scenarios[scenario].create(pop);
+	} else {
+		pop = pmemobj_open(path, POBJ_LAYOUT_NAME(tx_redo));
+		if (pop == NULL)
+			UT_FATAL("!pmemobj_open: %s", path);
+
+		Root = D_RW(POBJ_ROOT(pop, struct root));
+
+		scenarios[scenario].verify(pop);
+	}
+
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmemobj_check(path, POBJ_LAYOUT_NAME(tx_redo)), 1);
+
+	DONE(NULL);
+}
@@ -0,0 +1,337 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_tx_undo_arena.c -- unit test for the undo arena of transactions
+ *
+ * usage: obj_tx_undo_arena file [cmd: c/o] scenario
+ */
+#include "obj.h"
+#include "pmalloc.h"
+#include "tx.h"
+#include "unittest.h"
+
+POBJ_LAYOUT_BEGIN(tx_undo_arena);
+POBJ_LAYOUT_ROOT(tx_undo_arena, struct root);
+POBJ_LAYOUT_TOID(tx_undo_arena, struct buffer);
+POBJ_LAYOUT_END(tx_undo_arena);
+
+#define NVALUES 16
+#define SMALL_SIZE 1024
+#define GROW_SIZE (4 * TX_ARENA_MIN_SIZE)
+#define BUF_SIZE (2 * TX_ARENA_MAX_RETAINED)
+#define NTXS 16
+
+struct buffer {
+	uint8_t data[BUF_SIZE];
+};
+
+struct root {
+	uint64_t values[NVALUES];
+	TOID(struct buffer) buf;
+};
+
+static struct root *Root;
+static struct buffer *Buf;
+
+static unsigned Nconstructs;
+FUNC_MOCK(pmalloc_construct, int, PMEMobjpool *pop, uint64_t *off,
+	size_t size, palloc_constr constructor, void *arg)
+	FUNC_MOCK_RUN_DEFAULT {
+		Nconstructs++;
+		return _FUNC_REAL(pmalloc_construct)(pop, off, size,
+			constructor, arg);
+	}
+FUNC_MOCK_END
+
+static unsigned Nfrees;
+FUNC_MOCK(pfree, void, PMEMobjpool *pop, uint64_t *off)
+	FUNC_MOCK_RUN_DEFAULT {
+		Nfrees++;
+		_FUNC_REAL(pfree)(pop, off);
+	}
+FUNC_MOCK_END
+
+/*
+ * reset_calls -- resets the allocator call counters
+ */
+static void
+reset_calls(void)
+{
+	Nconstructs = 0;
+	Nfrees = 0;
+}
+
+/*
+ * init_pool -- allocates the buffer and sets the initial values
+ */
+static void
+init_pool(PMEMobjpool *pop)
+{
+	for (int i = 0; i < NVALUES; ++i)
+		Root->values[i] = (uint64_t)i;
+
+	pmemobj_persist(pop, Root->values, sizeof(Root->values));
+
+	int ret = pmemobj_zalloc(pop, &Root->buf.oid, sizeof(struct buffer),
+		TOID_TYPE_NUM(struct buffer));
+	UT_ASSERTeq(ret, 0);
+
+	Buf = D_RW(Root->buf);
+}
+
+/*
+ * modify -- snapshots and modifies the values and the given part of
+ *	the buffer, each value is snapshotted separately
+ */
+static void
+modify(uint64_t value, size_t buf_size)
+{
+	for (int i = 0; i < NVALUES; ++i) {
+		pmemobj_tx_add_range_direct(&Root->values[i],
+			sizeof(Root->values[i]));
+		Root->values[i] = value;
+	}
+
+	pmemobj_tx_add_range_direct(Buf->data, buf_size);
+	memset(Buf->data, (int)value, buf_size);
+}
+
+/*
+ * check -- verifies the values and the given part of the buffer
+ */
+static void
+check(uint64_t value, size_t buf_size)
+{
+	for (int i = 0; i < NVALUES; ++i)
+		UT_ASSERTeq(Root->values[i], value);
+
+	for (size_t i = 0; i < buf_size; ++i)
+		UT_ASSERTeq(Buf->data[i], (uint8_t)value);
+}
+
+/*
+ * commit -- runs a transaction which modifies the pool and commits
+ */
+static void
+commit(PMEMobjpool *pop, uint64_t value, size_t buf_size)
+{
+	TX_BEGIN(pop) {
+		modify(value, buf_size);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check(value, buf_size);
+}
+
+/*
+ * sc0_reuse -- after the first transaction the snapshots are written to
+ *	the existing arena
+ */
+static void
+sc0_reuse(PMEMobjpool *pop)
+{
+	commit(pop, 1, SMALL_SIZE);
+	UT_ASSERTeq(Nconstructs, 1);
+	UT_ASSERTeq(Nfrees, 0);
+
+	reset_calls();
+	for (uint64_t v = 2; v < NTXS; ++v)
+		commit(pop, v, SMALL_SIZE);
+
+	TX_BEGIN(pop) {
+		modify(NTXS, SMALL_SIZE);
+		pmemobj_tx_abort(ECANCELED);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check(NTXS - 1, SMALL_SIZE);
+	UT_ASSERTeq(Nconstructs, 0);
+	UT_ASSERTeq(Nfrees, 0);
+}
+
+/*
+ * sc0_grow -- a snapshot which doesn't fit in the arena adds a chunk which
+ *	is then kept
+ */
+static void
+sc0_grow(PMEMobjpool *pop)
+{
+	reset_calls();
+	commit(pop, 1, GROW_SIZE);
+	UT_ASSERTeq(Nconstructs, 1);
+	UT_ASSERTeq(Nfrees, 0);
+
+	reset_calls();
+	commit(pop, 2, GROW_SIZE);
+	UT_ASSERTeq(Nconstructs, 0);
+	UT_ASSERTeq(Nfrees, 0);
+}
+
+/*
+ * sc0_trim -- the chunks beyond the retained size are freed at the end of
+ *	the transaction
+ */
+static void
+sc0_trim(PMEMobjpool *pop)
+{
+	reset_calls();
+	commit(pop, 3, BUF_SIZE);
+	UT_ASSERTeq(Nconstructs, 1);
+	UT_ASSERTeq(Nfrees, 1);
+
+	reset_calls();
+	commit(pop, 4, GROW_SIZE);
+	UT_ASSERTeq(Nconstructs, 0);
+	UT_ASSERTeq(Nfrees, 0);
+}
+
+/*
+ * sc0_create -- runs the transactions which don't exit
+ */
+static void
+sc0_create(PMEMobjpool *pop)
+{
+	sc0_reuse(pop);
+	sc0_grow(pop);
+	sc0_trim(pop);
+}
+
+/*
+ * sc0_verify -- checks the contents left by sc0_create, the arena is kept
+ *	in the pool
+ */
+static void
+sc0_verify(PMEMobjpool *pop)
+{
+	check(4, GROW_SIZE);
+	for (size_t i = GROW_SIZE; i < BUF_SIZE; ++i)
+		UT_ASSERTeq(Buf->data[i], 3);
+
+	reset_calls();
+	commit(pop, 5, GROW_SIZE);
+	UT_ASSERTeq(Nconstructs, 0);
+	UT_ASSERTeq(Nfrees, 0);
+}
+
+/*
+ * sc1_create -- exits in the middle of a transaction with snapshots in
+ *	more than one chunk
+ */
+static void
+sc1_create(PMEMobjpool *pop)
+{
+	commit(pop, 1, SMALL_SIZE);
+
+	TX_BEGIN(pop) {
+		modify(2, GROW_SIZE);
+		exit(0);
+	} TX_END
+
+	/* if we get here, something is wrong with the transaction */
+	UT_ASSERT(0);
+}
+
+/*
+ * sc1_verify -- the transaction must be rolled back and the snapshots
+ *	must not be used again
+ */
+static void
+sc1_verify(PMEMobjpool *pop)
+{
+	check(1, SMALL_SIZE);
+	for (size_t i = SMALL_SIZE; i < GROW_SIZE; ++i)
+		UT_ASSERTeq(Buf->data[i], 0);
+
+	TX_BEGIN(pop) {
+		modify(3, SMALL_SIZE);
+		pmemobj_tx_abort(ECANCELED);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check(1, SMALL_SIZE);
+}
+
+typedef void (*scenario_func)(PMEMobjpool *pop);
+
+static struct {
+	scenario_func create;
+	scenario_func verify;
+} scenarios[] = {
+	{sc0_create, sc0_verify},
+	{sc1_create, sc1_verify},
+};
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_undo_arena");
+
+	if (argc != 4)
+		UT_FATAL("usage: %s file [cmd: c/o] scenario", argv[0]);
+
+	const char *path = argv[1];
+	int exists = argv[2][0] == 'o';
+	int scenario = atoi(argv[3]);
+
+	PMEMobjpool *pop = NULL;
+	if (!exists) {
+		pop = pmemobj_create(path, POBJ_LAYOUT_NAME(tx_undo_arena), 0,
+			S_IWUSR | S_IRUSR);
+		if (pop == NULL)
+			UT_FATAL("!pmemobj_create: %s", path);
+
+		Root = D_RW(POBJ_ROOT(pop, struct root));
+		init_pool(pop);
+
+		reset_calls();
+		scenarios[scenario].create(pop);
+	} else {
+		pop = pmemobj_open(path, POBJ_LAYOUT_NAME(tx_undo_arena));
+		if (pop == NULL)
+			UT_FATAL("!pmemobj_open: %s", path);
+
+		Root = D_RW(POBJ_ROOT(pop, struct root));
+		Buf = D_RW(Root->buf);
+
+		scenarios[scenario].verify(pop);
+	}
+
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmemobj_check(path, POBJ_LAYOUT_NAME(tx_undo_arena)), 1);
+
+	DONE(NULL);
+}
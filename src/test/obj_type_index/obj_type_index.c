@@ -0,0 +1,263 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_type_index.c -- unit test for the iteration through objects by type
+ *
+ * usage: obj_type_index file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_type_index"
+
+#define POOL_SIZE (PMEMOBJ_MIN_POOL * 8)
+
+#define NOBJS 3000
+#define NTYPES 5
+#define NSIZES 4
+#define HUGE_SIZE (300 * 1024)
+#define NRESERVED 10
+
+#define TYPE_FOO 1
+
+struct foo {
+	uint64_t value;
+};
+
+TOID_DECLARE(struct foo, TYPE_FOO);
+
+static const size_t Sizes[NSIZES] = {
+	1, 100, 1000, 4000
+};
+
+/*
+ * check_type -- verifies that all of the ways to iterate through the objects
+ *	of the type number visit the same objects as a walk of all objects,
+ *	returns their number
+ */
+static uint64_t
+check_type(PMEMobjpool *pop, uint64_t type_num)
+{
+	struct pobj_iter *iter = pmemobj_iter_new(pop, type_num);
+	UT_ASSERTne(iter, NULL);
+
+	PMEMoid typed = pmemobj_first_type(pop, type_num);
+	uint64_t count = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) != type_num)
+			continue;
+
+		PMEMoid it_oid = pmemobj_iter_next(iter);
+		UT_ASSERT(OID_EQUALS(oid, typed));
+		UT_ASSERT(OID_EQUALS(oid, it_oid));
+		typed = pmemobj_next_type(typed);
+		count++;
+	}
+	UT_ASSERT(OID_IS_NULL(typed));
+	UT_ASSERT(OID_IS_NULL(pmemobj_iter_next(iter)));
+	pmemobj_iter_delete(iter);
+
+	UT_ASSERTeq(pmemobj_type_count(pop, type_num), count);
+
+	return count;
+}
+
+/*
+ * check_types -- verifies the iteration through the objects of every type
+ *	and the number of objects of each type
+ */
+static void
+check_types(PMEMobjpool *pop, const uint64_t *type_count)
+{
+	for (uint64_t t = 0; t < NTYPES; ++t)
+		UT_ASSERTeq(check_type(pop, t), type_count[t]);
+
+	uint64_t n = 0;
+	TOID(struct foo) foo;
+	POBJ_FOREACH_TYPE(pop, foo) {
+		UT_ASSERTeq(pmemobj_type_num(foo.oid), TYPE_FOO);
+		n++;
+	}
+	UT_ASSERTeq(n, type_count[TYPE_FOO]);
+
+	/* a type number without any objects */
+	UT_ASSERT(OID_IS_NULL(pmemobj_first_type(pop, NTYPES)));
+	UT_ASSERTeq(pmemobj_type_count(pop, NTYPES), 0);
+}
+
+/*
+ * total -- returns the number of all objects
+ */
+static uint64_t
+total(const uint64_t *type_count)
+{
+	uint64_t n = 0;
+	for (uint64_t t = 0; t < NTYPES; ++t)
+		n += type_count[t];
+
+	return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_type_index");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME, POOL_SIZE,
+		S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	/* the root object is not visited by the iterators */
+	UT_ASSERT(!OID_IS_NULL(pmemobj_root(pop, sizeof(uint64_t))));
+
+	uint64_t type_count[NTYPES] = {0};
+	check_types(pop, type_count);
+
+	int ret;
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		uint64_t type_num = i % NTYPES;
+		size_t size = i % 100 == 1 ? HUGE_SIZE : Sizes[i % NSIZES];
+
+		ret = pmemobj_alloc(pop, NULL, size, type_num, NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		type_count[type_num]++;
+
+		/* the first checks may build the index in the middle */
+		if (i == NOBJS / 2)
+			check_types(pop, type_count);
+	}
+
+	check_types(pop, type_count);
+	UT_OUT("alloc %ju", total(type_count));
+
+	/* free every third object and change the type of every third one */
+	static PMEMoid oids[NOBJS];
+	unsigned nobjs = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid)
+		oids[nobjs++] = oid;
+	UT_ASSERTeq(nobjs, NOBJS);
+
+	unsigned i;
+	for (i = 0; i < nobjs; ++i) {
+		uint64_t type_num = pmemobj_type_num(oids[i]);
+		if (i % 3 == 0) {
+			pmemobj_free(&oids[i]);
+			type_count[type_num]--;
+		} else if (i % 3 == 1) {
+			uint64_t new_type = (type_num + 1) % NTYPES;
+			ret = pmemobj_realloc(pop, &oids[i],
+				Sizes[i % NSIZES] * 2, new_type);
+			UT_ASSERTeq(ret, 0);
+			type_count[type_num]--;
+			type_count[new_type]++;
+		}
+	}
+
+	check_types(pop, type_count);
+	UT_OUT("free realloc %ju", total(type_count));
+
+	/* the reserved objects are visible only once they are published */
+	struct pobj_action act[NRESERVED];
+	for (i = 0; i < NRESERVED; ++i) {
+		oid = pmemobj_reserve(pop, &act[i], Sizes[i % NSIZES],
+			TYPE_FOO);
+		UT_ASSERT(!OID_IS_NULL(oid));
+	}
+
+	check_types(pop, type_count);
+
+	pmemobj_cancel(pop, act, NRESERVED / 2);
+	ret = pmemobj_publish(pop, &act[NRESERVED / 2], NRESERVED / 2);
+	UT_ASSERTeq(ret, 0);
+	type_count[TYPE_FOO] += NRESERVED / 2;
+
+	check_types(pop, type_count);
+	UT_OUT("publish %ju", total(type_count));
+
+	PMEMoid aborted = OID_NULL;
+	TX_BEGIN(pop) {
+		aborted = pmemobj_tx_alloc(Sizes[1], TYPE_FOO);
+		pmemobj_tx_abort(-1);
+	} TX_END
+
+	UT_ASSERT(!OID_IS_NULL(aborted));
+	check_types(pop, type_count);
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_alloc(Sizes[1], TYPE_FOO);
+		pmemobj_tx_free(pmemobj_first_type(pop, 0));
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+	type_count[TYPE_FOO]++;
+	type_count[0]--;
+
+	check_types(pop, type_count);
+	UT_OUT("tx %ju", total(type_count));
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	UT_ASSERTne(pop, NULL);
+
+	check_types(pop, type_count);
+	UT_OUT("reopen %ju", total(type_count));
+
+	TOID(struct foo) foo;
+	TOID(struct foo) nfoo;
+	POBJ_FOREACH_SAFE_TYPE(pop, foo, nfoo) {
+		POBJ_FREE(&foo);
+		type_count[TYPE_FOO]--;
+	}
+	UT_ASSERTeq(type_count[TYPE_FOO], 0);
+
+	check_types(pop, type_count);
+	UT_OUT("free type %ju", total(type_count));
+
+	PMEMoid next;
+	POBJ_FOREACH_SAFE(pop, oid, next)
+		pmemobj_free(&oid);
+
+	UT_ASSERT(OID_IS_NULL(pmemobj_first(pop)));
+	UT_ASSERTeq(pmemobj_type_count(pop, 0), 0);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
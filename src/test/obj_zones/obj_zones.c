@@ -0,0 +1,143 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_zones.c -- unit test for loading the zones of a multi-zone heap
+ *
+ * The pool is created and filled with objects, then it's reopened, all of
+ * the objects are freed and the pool is filled again.
+ *
+ * usage: obj_zones file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_zones"
+
+#define HUGE_SIZE ((size_t)1 << 30)
+#define MEDIUM_SIZE ((size_t)1 << 20)
+#define SMALL_SIZE 128
+#define SMALL_PER_HUGE 64
+
+enum obj_type {
+	TYPE_HUGE,
+	TYPE_MEDIUM,
+	TYPE_SMALL,
+
+	MAX_TYPE
+};
+
+/*
+ * fill -- allocates objects of all sizes until the pool is full, small
+ *	objects are interleaved with the huge ones so that runs are created
+ *	in every zone
+ */
+static void
+fill(PMEMobjpool *pop)
+{
+	unsigned n[MAX_TYPE] = {0};
+
+	while (pmemobj_alloc(pop, NULL, HUGE_SIZE, TYPE_HUGE,
+			NULL, NULL) == 0) {
+		n[TYPE_HUGE]++;
+
+		for (int i = 0; i < SMALL_PER_HUGE; ++i) {
+			int ret = pmemobj_alloc(pop, NULL, SMALL_SIZE,
+				TYPE_SMALL, NULL, NULL);
+			UT_ASSERTeq(ret, 0);
+			n[TYPE_SMALL]++;
+		}
+	}
+
+	while (pmemobj_alloc(pop, NULL, MEDIUM_SIZE, TYPE_MEDIUM,
+			NULL, NULL) == 0)
+		n[TYPE_MEDIUM]++;
+
+	UT_OUT("alloc huge %u medium %u small %u", n[TYPE_HUGE],
+		n[TYPE_MEDIUM], n[TYPE_SMALL]);
+}
+
+/*
+ * free_all -- frees every object in the pool
+ */
+static void
+free_all(PMEMobjpool *pop)
+{
+	unsigned n[MAX_TYPE] = {0};
+	PMEMoid oid;
+	PMEMoid next;
+
+	POBJ_FOREACH_SAFE(pop, oid, next) {
+		uint64_t type = pmemobj_type_num(oid);
+		UT_ASSERT(type < MAX_TYPE);
+		n[type]++;
+		pmemobj_free(&oid);
+	}
+
+	UT_OUT("free huge %u medium %u small %u", n[TYPE_HUGE],
+		n[TYPE_MEDIUM], n[TYPE_SMALL]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_zones");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT_NAME, 0,
+		S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	fill(pop);
+
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmemobj_check(path, LAYOUT_NAME), 1);
+
+	pop = pmemobj_open(path, LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	free_all(pop);
+	fill(pop);
+
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmemobj_check(path, LAYOUT_NAME), 1);
+
+	DONE(NULL);
+}
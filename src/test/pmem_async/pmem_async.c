@@ -0,0 +1,147 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_async.c -- unit test for the asynchronous copy engine
+ *
+ * usage: pmem_async file
+ */
+
+#include "unittest.h"
+
+#define NREQS 16
+#define REQ_SPACE (1024 * 1024 + 4096)	/* destination space per request */
+#define FILE_LEN (NREQS * REQ_SPACE)
+
+/*
+ * req_len -- (internal) length of the i-th request, from a few bytes to
+ * a megabyte, so both regular and non-temporal stores are used
+ */
+static size_t
+req_len(size_t i)
+{
+	return ((size_t)1 << (i + 4)) % (1024 * 1024) + i * 7;
+}
+
+/*
+ * check_file -- (internal) verify the file contents match the mapping
+ */
+static void
+check_file(int fd, const char *dest)
+{
+	char *buf = MALLOC(FILE_LEN);
+
+	LSEEK(fd, 0, SEEK_SET);
+	UT_ASSERTeq(READ(fd, buf, FILE_LEN), FILE_LEN);
+	UT_ASSERTeq(memcmp(buf, dest, FILE_LEN), 0);
+
+	FREE(buf);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_async");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	int fd = OPEN(argv[1], O_RDWR);
+
+	size_t mapped_len;
+	char *dest = pmem_map_file(argv[1], 0, 0, 0, &mapped_len, NULL);
+	if (dest == NULL)
+		UT_FATAL("!could not map file: %s", argv[1]);
+	UT_ASSERT(mapped_len >= FILE_LEN);
+
+	char *src = MALLOC(REQ_SPACE);
+	for (size_t i = 0; i < REQ_SPACE; ++i)
+		src[i] = (char)(i % 251 + 1);
+
+	struct pmem_async *reqs[NREQS];
+
+	/* copies completed in any order */
+	memset(dest, 0, FILE_LEN);
+	for (size_t i = 0; i < NREQS; ++i) {
+		reqs[i] = pmem_memcpy_async(dest + i * REQ_SPACE + i,
+				src + i, req_len(i));
+		UT_ASSERTne(reqs[i], NULL);
+	}
+
+	for (size_t n = 0; n < NREQS; ++n) {
+		size_t i;
+		UT_ASSERTeq(pmem_async_wait_any(reqs, NREQS, &i), 0);
+		UT_ASSERT(i < NREQS);
+		UT_ASSERTne(reqs[i], NULL);
+		UT_ASSERTeq(pmem_async_poll(reqs[i]), 1);
+		UT_ASSERTeq(memcmp(dest + i * REQ_SPACE + i, src + i,
+				req_len(i)), 0);
+		pmem_async_release(reqs[i]);
+		reqs[i] = NULL;
+	}
+	check_file(fd, dest);
+
+	size_t i;
+	errno = 0;
+	UT_ASSERTeq(pmem_async_wait_any(reqs, NREQS, &i), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* fills released without waiting */
+	for (i = 0; i < NREQS; ++i) {
+		reqs[i] = pmem_memset_async(dest + i * REQ_SPACE, (int)i,
+				REQ_SPACE);
+		UT_ASSERTne(reqs[i], NULL);
+	}
+	for (i = 0; i < NREQS; ++i)
+		pmem_async_release(reqs[i]);
+
+	for (i = 0; i < FILE_LEN; ++i)
+		UT_ASSERTeq(dest[i], (char)(i / REQ_SPACE));
+	check_file(fd, dest);
+
+	/* persisting data written with regular stores */
+	memcpy(dest, src, REQ_SPACE);
+	struct pmem_async *req = pmem_persist_async(dest, REQ_SPACE);
+	UT_ASSERTne(req, NULL);
+	pmem_async_wait(req);
+	UT_ASSERTeq(pmem_async_poll(req), 1);
+	pmem_async_release(req);
+	check_file(fd, dest);
+
+	pmem_async_release(NULL);
+
+	FREE(src);
+	UT_ASSERTeq(pmem_unmap(dest, mapped_len), 0);
+	CLOSE(fd);
+
+	DONE(NULL);
+}
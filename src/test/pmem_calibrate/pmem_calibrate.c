@@ -0,0 +1,121 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_calibrate.c -- unit test for pmem_calibrate()
+ *
+ * usage: pmem_calibrate file [d|c|m|e|n]
+ *
+ * d - print the thresholds
+ * c - check the thresholds calibrated at initialization
+ * m - calibrate on the mapped file and in regular memory
+ * e - calibrate on a too small range
+ * n - calibrate without movnt
+ */
+
+#include "unittest.h"
+
+#define MIN_THRESHOLD 64
+#define MAX_THRESHOLD (PMEM_CALIBRATE_MIN_LEN / 2)
+
+/*
+ * check_threshold -- (internal) verify a calibrated threshold
+ */
+static void
+check_threshold(size_t threshold)
+{
+	UT_ASSERT(threshold >= MIN_THRESHOLD);
+	UT_ASSERT(threshold <= MAX_THRESHOLD);
+	UT_ASSERTeq(threshold & (threshold - 1), 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_calibrate");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file [d|c|m|e|n]", argv[0]);
+
+	size_t mapped_len;
+	char *addr = pmem_map_file(argv[1], 0, 0, 0, &mapped_len, NULL);
+	if (addr == NULL)
+		UT_FATAL("!could not map file: %s", argv[1]);
+
+	size_t memcpy_threshold;
+	size_t memset_threshold;
+
+	switch (argv[2][0]) {
+	case 'd':
+		pmem_get_movnt_thresholds(&memcpy_threshold,
+				&memset_threshold);
+		UT_OUT("memcpy %zu memset %zu", memcpy_threshold,
+				memset_threshold);
+		break;
+	case 'c':
+		pmem_get_movnt_thresholds(&memcpy_threshold,
+				&memset_threshold);
+		check_threshold(memcpy_threshold);
+		check_threshold(memset_threshold);
+		break;
+	case 'm':
+		UT_ASSERTeq(pmem_calibrate(addr, mapped_len), 0);
+		pmem_get_movnt_thresholds(&memcpy_threshold,
+				&memset_threshold);
+		check_threshold(memcpy_threshold);
+		check_threshold(memset_threshold);
+
+		UT_ASSERTeq(pmem_calibrate(NULL, 0), 0);
+		pmem_get_movnt_thresholds(&memcpy_threshold, NULL);
+		check_threshold(memcpy_threshold);
+		pmem_get_movnt_thresholds(NULL, &memset_threshold);
+		check_threshold(memset_threshold);
+		break;
+	case 'e':
+		UT_ASSERTeq(pmem_calibrate(addr, PMEM_CALIBRATE_MIN_LEN - 1),
+				-1);
+		UT_OUT("%s", pmem_errormsg());
+		UT_ASSERTeq(errno, EINVAL);
+		break;
+	case 'n':
+		UT_ASSERTeq(pmem_calibrate(NULL, 0), -1);
+		UT_OUT("%s", pmem_errormsg());
+		UT_ASSERTeq(errno, ENOTSUP);
+		break;
+	default:
+		UT_FATAL("unknown operation %c", argv[2][0]);
+	}
+
+	UT_ASSERTeq(pmem_unmap(addr, mapped_len), 0);
+
+	DONE(NULL);
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_is_pmem_cache_linux.c -- unit test for caching of pmem_is_pmem()
+ * results for ranges mapped with pmem_map_file() and for the pools of
+ * libpmemobj
+ *
+ * usage: pmem_is_pmem_cache_linux file pool
+ */
+
+#define _GNU_SOURCE
+#include "unittest.h"
+
+#include <dlfcn.h>
+
+#define FILE_SIZE (4 * 1024 * 1024)
+
+static unsigned Smaps_opens;
+
+/*
+ * fopen -- interpose on libc fopen()
+ *
+ * This counts opens of /proc/self/smaps.
+ */
+FILE *
+fopen(const char *path, const char *mode)
+{
+	static FILE *(*fopen_ptr)(const char *path, const char *mode);
+
+	if (strcmp(path, "/proc/self/smaps") == 0)
+		Smaps_opens++;
+
+	if (fopen_ptr == NULL)
+		fopen_ptr = dlsym(RTLD_NEXT, "fopen");
+
+	return (*fopen_ptr)(path, mode);
+}
+
+/*
+ * check_opens -- print and reset the number of /proc/self/smaps opens
+ */
+static void
+check_opens(const char *what)
+{
+	UT_OUT("%s: %u", what, Smaps_opens);
+	Smaps_opens = 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_is_pmem_cache_linux");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file pool", argv[0]);
+
+	size_t mlen;
+	int is_pmem;
+	char *addr = pmem_map_file(argv[1], FILE_SIZE,
+			PMEM_FILE_CREATE | PMEM_FILE_EXCL, 0644,
+			&mlen, &is_pmem);
+	if (addr == NULL)
+		UT_FATAL("!pmem_map_file");
+	UT_ASSERTeq(mlen, FILE_SIZE);
+	check_opens("pmem_map_file");
+
+	UT_ASSERTeq(pmem_is_pmem(addr, mlen), is_pmem);
+	UT_ASSERTeq(pmem_is_pmem(addr, mlen), is_pmem);
+	UT_ASSERTeq(pmem_is_pmem(addr + 4096, 4096), is_pmem);
+	UT_ASSERTeq(pmem_is_pmem(addr + mlen - 1, 1), is_pmem);
+	check_opens("mapped range");
+
+	char buf[64];
+	UT_ASSERTeq(pmem_is_pmem(buf, sizeof(buf)), 0);
+	UT_ASSERTeq(pmem_is_pmem(buf, sizeof(buf)), 0);
+	check_opens("untracked range");
+
+	UT_ASSERTeq(pmem_unmap(addr, mlen), 0);
+
+	addr = pmem_map_file(argv[1], 0, 0, 0, &mlen, NULL);
+	if (addr == NULL)
+		UT_FATAL("!pmem_map_file");
+	check_opens("pmem_map_file without is_pmem");
+
+	UT_ASSERTeq(pmem_is_pmem(addr + 4096, 4096), is_pmem);
+	UT_ASSERTeq(pmem_is_pmem(addr, mlen), is_pmem);
+	check_opens("remapped range");
+
+	UT_ASSERTeq(pmem_unmap(addr, mlen), 0);
+
+	PMEMobjpool *pop = pmemobj_create(argv[2], "cache", PMEMOBJ_MIN_POOL,
+			0644);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create");
+	check_opens("pmemobj_create");
+
+	is_pmem = pmem_is_pmem(pop, PMEMOBJ_MIN_POOL);
+	UT_ASSERTeq(pmem_is_pmem(pop, PMEMOBJ_MIN_POOL), is_pmem);
+	UT_ASSERTeq(pmem_is_pmem((char *)pop + 4096, 4096), is_pmem);
+	check_opens("pool range");
+
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmem_is_pmem(pop, PMEMOBJ_MIN_POOL), 0);
+	check_opens("closed pool range");
+
+	DONE(NULL);
+}
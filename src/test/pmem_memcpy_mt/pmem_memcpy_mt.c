@@ -0,0 +1,118 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_memcpy_mt.c -- unit test for the multi-threaded copy functions
+ *
+ * usage: pmem_memcpy_mt file nthreads
+ */
+
+#include "unittest.h"
+
+#define LEN (20 * 1024 * 1024 + 777)	/* several stripes, unaligned end */
+#define DEST_OFF 13
+#define SRC_OFF 5
+#define SMALL_LEN 100
+
+/*
+ * check_range -- (internal) verify the written range both in the mapping
+ * and in the file
+ */
+static void
+check_range(int fd, char *base, const char *dest, const char *expected,
+	size_t len)
+{
+	UT_ASSERTeq(memcmp(dest, expected, len), 0);
+
+	char *buf = MALLOC(len);
+
+	LSEEK(fd, (off_t)(dest - base), SEEK_SET);
+	UT_ASSERTeq(READ(fd, buf, len), (ssize_t)len);
+	UT_ASSERTeq(memcmp(buf, expected, len), 0);
+
+	FREE(buf);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_memcpy_mt");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file nthreads", argv[0]);
+
+	unsigned nthreads = (unsigned)atoi(argv[2]);
+
+	int fd = OPEN(argv[1], O_RDWR);
+
+	size_t mapped_len;
+	char *base = pmem_map_file(argv[1], 0, 0, 0, &mapped_len, NULL);
+	if (base == NULL)
+		UT_FATAL("!could not map file: %s", argv[1]);
+	UT_ASSERT(mapped_len >= LEN + DEST_OFF);
+
+	char *src = MALLOC(LEN + SRC_OFF);
+	for (size_t i = 0; i < LEN + SRC_OFF; ++i)
+		src[i] = (char)(i % 251 + 1);
+
+	char *fill = MALLOC(LEN);
+	memset(fill, 0x5a, LEN);
+
+	char *dest = base + DEST_OFF;
+
+	memset(base, 0, LEN + DEST_OFF);
+	UT_ASSERTeq(pmem_memcpy_persist_mt(dest, src + SRC_OFF, LEN,
+			nthreads), dest);
+	check_range(fd, base, dest, src + SRC_OFF, LEN);
+
+	UT_ASSERTeq(pmem_memset_persist_mt(dest, 0x5a, LEN, nthreads), dest);
+	check_range(fd, base, dest, fill, LEN);
+
+	/* too short to be split between threads */
+	UT_ASSERTeq(pmem_memcpy_persist_mt(dest, src, SMALL_LEN, nthreads),
+			dest);
+	check_range(fd, base, dest, src, SMALL_LEN);
+
+	/* split depending on PMEM_MT_THRESHOLD */
+	UT_ASSERTeq(pmem_memcpy_persist(base, src, LEN), base);
+	check_range(fd, base, base, src, LEN);
+
+	UT_ASSERTeq(pmem_memset_persist(base, 0x5a, LEN), base);
+	check_range(fd, base, base, fill, LEN);
+
+	FREE(fill);
+	FREE(src);
+	UT_ASSERTeq(pmem_unmap(base, mapped_len), 0);
+	CLOSE(fd);
+
+	DONE(NULL);
+}
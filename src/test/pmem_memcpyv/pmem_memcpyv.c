@@ -0,0 +1,148 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_memcpyv.c -- unit test for the vectored flush/copy functions
+ *
+ * usage: pmem_memcpyv file
+ */
+
+#include "unittest.h"
+
+#define NVEC 100	/* more than one batch of flushed ranges */
+#define SMALL_LEN 40
+#define LARGE_LEN (64 * 1024)
+
+/*
+ * fill_vec -- (internal) fill the copy vector
+ *
+ * The ranges are not sorted by destination address, some of them share
+ * cache lines, one is empty and the last one is long enough to be
+ * copied using non-temporal stores.
+ */
+static void
+fill_vec(struct pmem_memcpy_vec *vec, char *dest, const char *src)
+{
+	for (size_t i = 0; i < NVEC - 2; ++i) {
+		size_t off = ((NVEC - i) * 37 + (i % 3) * 100) * 8;
+		vec[i].pmemdest = dest + off;
+		vec[i].src = src + off;
+		vec[i].len = SMALL_LEN;
+	}
+
+	vec[NVEC - 2].pmemdest = dest;
+	vec[NVEC - 2].src = src;
+	vec[NVEC - 2].len = 0;
+
+	vec[NVEC - 1].pmemdest = dest + LARGE_LEN + 13;
+	vec[NVEC - 1].src = src + LARGE_LEN + 13;
+	vec[NVEC - 1].len = LARGE_LEN;
+}
+
+/*
+ * check_vec -- (internal) verify the copied ranges both in the mapping
+ * and in the file
+ */
+static void
+check_vec(int fd, const struct pmem_memcpy_vec *vec, char *dest)
+{
+	char *buf = MALLOC(LARGE_LEN);
+
+	for (size_t i = 0; i < NVEC; ++i) {
+		const struct pmem_memcpy_vec *v = &vec[i];
+		UT_ASSERTeq(memcmp(v->pmemdest, v->src, v->len), 0);
+
+		off_t off = (off_t)((char *)v->pmemdest - dest);
+		LSEEK(fd, off, SEEK_SET);
+		UT_ASSERTeq(READ(fd, buf, v->len), (ssize_t)v->len);
+		UT_ASSERTeq(memcmp(buf, v->src, v->len), 0);
+	}
+
+	FREE(buf);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_memcpyv");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	int fd = OPEN(argv[1], O_RDWR);
+
+	size_t mapped_len;
+	char *dest = pmem_map_file(argv[1], 0, 0, 0, &mapped_len, NULL);
+	if (dest == NULL)
+		UT_FATAL("!could not map file: %s", argv[1]);
+	UT_ASSERT(mapped_len >= 3 * LARGE_LEN);
+
+	char *src = MALLOC(3 * LARGE_LEN);
+	for (size_t i = 0; i < 3 * LARGE_LEN; ++i)
+		src[i] = (char)(i % 251 + 1);
+
+	struct pmem_memcpy_vec vec[NVEC];
+	fill_vec(vec, dest, src);
+
+	memset(dest, 0, 3 * LARGE_LEN);
+	pmem_memcpyv_persist(vec, NVEC);
+	check_vec(fd, vec, dest);
+
+	memset(dest, 0, 3 * LARGE_LEN);
+	pmem_memcpyv_nodrain(vec, NVEC);
+	pmem_drain();
+	check_vec(fd, vec, dest);
+
+	/* the same ranges written with regular stores */
+	struct pmem_flush_vec fvec[NVEC];
+	memset(dest, 0, 3 * LARGE_LEN);
+	for (size_t i = 0; i < NVEC; ++i) {
+		memcpy(vec[i].pmemdest, vec[i].src, vec[i].len);
+		fvec[i].addr = vec[i].pmemdest;
+		fvec[i].len = vec[i].len;
+	}
+	pmem_persistv(fvec, NVEC);
+	check_vec(fd, vec, dest);
+
+	pmem_flushv(fvec, NVEC);
+	pmem_drain();
+
+	/* empty vectors */
+	pmem_memcpyv_persist(vec, 0);
+	pmem_persistv(fvec, 0);
+
+	FREE(src);
+	UT_ASSERTeq(pmem_unmap(dest, mapped_len), 0);
+	CLOSE(fd);
+
+	DONE(NULL);
+}
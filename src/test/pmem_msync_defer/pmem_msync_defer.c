@@ -0,0 +1,125 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_msync_defer.c -- unit test for the write-behind msync coalescer
+ *
+ * usage: pmem_msync_defer file1 file2
+ */
+
+#include "unittest.h"
+
+#define FILE_LEN (8 * 1024 * 1024)
+#define NWRITES 4096
+#define WRITE_LEN 100
+
+/*
+ * check_file -- (internal) verify the file contents match the mapping
+ */
+static void
+check_file(int fd, const char *dest)
+{
+	char *buf = MALLOC(FILE_LEN);
+
+	LSEEK(fd, 0, SEEK_SET);
+	UT_ASSERTeq(READ(fd, buf, FILE_LEN), FILE_LEN);
+	UT_ASSERTeq(memcmp(buf, dest, FILE_LEN), 0);
+
+	FREE(buf);
+}
+
+/*
+ * map_file -- (internal) map the whole file
+ */
+static char *
+map_file(const char *path)
+{
+	size_t mapped_len;
+	char *addr = pmem_map_file(path, 0, 0, 0, &mapped_len, NULL);
+	if (addr == NULL)
+		UT_FATAL("!could not map file: %s", path);
+	UT_ASSERTeq(mapped_len, FILE_LEN);
+
+	return addr;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_msync_defer");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file1 file2", argv[0]);
+
+	int fd = OPEN(argv[1], O_RDWR);
+	char *dest = map_file(argv[1]);
+
+	/* small scattered writes, several of them to the same pages */
+	for (size_t i = 0; i < NWRITES; ++i) {
+		size_t off = (i * 7919 * WRITE_LEN) % (FILE_LEN - WRITE_LEN);
+		memset(dest + off, (int)(i % 255 + 1), WRITE_LEN);
+		UT_ASSERTeq(pmem_msync(dest + off, WRITE_LEN), 0);
+	}
+	UT_ASSERTeq(pmem_msync_barrier(), 0);
+	check_file(fd, dest);
+
+	/* a range crossing the boundaries of several regions */
+	memset(dest + 4096 + 1, 0x5a, FILE_LEN - 2 * 4096);
+	UT_ASSERTeq(pmem_msync(dest + 4096 + 1, FILE_LEN - 2 * 4096), 0);
+	UT_ASSERTeq(pmem_msync_barrier(), 0);
+	check_file(fd, dest);
+
+	/* a barrier with nothing to sync */
+	UT_ASSERTeq(pmem_msync_barrier(), 0);
+
+	/* a mapping which goes away before its pages are synced */
+	char *other = map_file(argv[2]);
+	memset(other, 0xa5, FILE_LEN);
+	UT_ASSERTeq(pmem_msync(other, FILE_LEN), 0);
+	MUNMAP(other, FILE_LEN);
+	UT_ASSERTeq(pmem_msync_barrier(), 0);
+
+	/* pages left dirty are synced by pmem_unmap */
+	memset(dest, 0x3c, WRITE_LEN);
+	UT_ASSERTeq(pmem_msync(dest, WRITE_LEN), 0);
+	UT_ASSERTeq(pmem_unmap(dest, FILE_LEN), 0);
+
+	char buf[WRITE_LEN];
+	LSEEK(fd, 0, SEEK_SET);
+	UT_ASSERTeq(READ(fd, buf, WRITE_LEN), WRITE_LEN);
+	for (size_t i = 0; i < WRITE_LEN; ++i)
+		UT_ASSERTeq(buf[i], 0x3c);
+
+	CLOSE(fd);
+
+	DONE(NULL);
+}
@@ -1093,6 +1093,12 @@ pmemspoil_process_heap(struct pmemspoil *psp, struct pmemspoil_list *pfp,
 	struct heap_header *hdr = &hlayout->header;
 
 	PROCESS_BEGIN(psp, pfp) {
+		struct checksum_args checksum_args = {
+			.ptr = hdr,
+			.len = sizeof(*hdr),
+			.checksum = &hdr->checksum,
+		};
+
 		PROCESS_FIELD(hdr, signature, char);
 		PROCESS_FIELD(hdr, major, uint64_t);
 		PROCESS_FIELD(hdr, minor, uint64_t);
@@ -1102,6 +1108,8 @@ pmemspoil_process_heap(struct pmemspoil *psp, struct pmemspoil_list *pfp,
 		PROCESS_FIELD(hdr, reserved, char);
 		PROCESS_FIELD(hdr, checksum, uint64_t);
 
+		PROCESS_FUNC("checksum_gen", checksum_gen, checksum_args);
+
 		PROCESS(zone, ZID_TO_ZONE(hlayout, PROCESS_INDEX),
 			util_heap_max_zone(psp->size), struct zone *);
 
@@ -1135,6 +1143,7 @@ pmemspoil_process_sec_allocator(struct pmemspoil *psp,
 	PROCESS_BEGIN(psp, pfp) {
 		PROCESS(redo_log, &sec->redo[PROCESS_INDEX],
 			ALLOC_REDO_LOG_SIZE, struct redo_log *);
+		PROCESS_FIELD(sec, overflow, uint64_t);
 	} PROCESS_END
 
 	return PROCESS_RET;
@@ -1171,6 +1180,9 @@ pmemspoil_process_sec_tx(struct pmemspoil *psp,
 			&sec->undo_log[UNDO_SET], 1);
 		PROCESS_NAME("undo_free", vector,
 			&sec->undo_log[UNDO_FREE], 1);
+		PROCESS_FIELD(sec, redo_log, uint64_t);
+		PROCESS_FIELD(sec, arena, uint64_t);
+		PROCESS_FIELD(sec, arena_gen, uint64_t);
 	} PROCESS_END
 
 	return PROCESS_RET;
@@ -80,6 +80,16 @@ check_cpu_features(void)
 	} else {
 		UT_OUT("CLWB not supported");
 	}
+
+	if (is_cpu_avx2_present())
+		UT_OUT("AVX2 supported");
+	else
+		UT_OUT("AVX2 not supported");
+
+	if (is_cpu_avx512f_present())
+		UT_OUT("AVX512F supported");
+	else
+		UT_OUT("AVX512F not supported");
 }
 
 int
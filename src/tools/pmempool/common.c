@@ -1187,7 +1187,8 @@ util_heap_max_zone(size_t size)
 }
 
 /*
- * util_heap_get_bitmap_params -- return bitmap parameters of given block size
+ * util_heap_get_bitmap_params -- return bitmap parameters of a run with given
+ *	block size and number of chunks
  *
  * The function returns the following values:
  * - number of allocations
@@ -1195,13 +1196,17 @@ util_heap_max_zone(size_t size)
  * - initial value of last used entry
  */
 int
-util_heap_get_bitmap_params(uint64_t block_size, uint64_t *nallocsp,
-		uint64_t *nvalsp, uint64_t *last_valp)
+util_heap_get_bitmap_params(uint64_t block_size, uint32_t size_idx,
+		uint64_t *nallocsp, uint64_t *nvalsp, uint64_t *last_valp)
 {
-	assert(RUNSIZE / block_size <= UINT32_MAX);
-	uint32_t nallocs = (uint32_t)(RUNSIZE / block_size);
+	if (block_size == 0 || size_idx == 0 || size_idx > RUN_MAX_SIZE_IDX)
+		return -1;
+
+	/* the units that don't fit in the bitmap are not used */
+	uint64_t data_nallocs = RUN_DATA_SIZE(size_idx) / block_size;
+	uint32_t nallocs = data_nallocs > RUN_BITMAP_SIZE ?
+		RUN_BITMAP_SIZE : (uint32_t)data_nallocs;
 
-	assert(nallocs <= RUN_BITMAP_SIZE);
 	unsigned unused_bits = RUN_BITMAP_SIZE - nallocs;
 
 	unsigned unused_values = unused_bits / BITS_PER_VALUE;
@@ -1215,7 +1220,7 @@ util_heap_get_bitmap_params(uint64_t block_size, uint64_t *nallocsp,
 	uint64_t last_val = unused_bits ? (((1ULL << unused_bits) - 1ULL) <<
 				(BITS_PER_VALUE - unused_bits)) : 0;
 
-	if (nvals >= MAX_BITMAP_VALUES || nvals == 0)
+	if (nvals > MAX_BITMAP_VALUES || nvals == 0)
 		return -1;
 
 	if (nallocsp)
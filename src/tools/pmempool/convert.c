@@ -104,6 +104,22 @@ convert_v2_v3(void *poolset, void *addr)
 	return -1;
 }
 
+/*
+ * convert_v3_v4 -- (internal) converts the pool to the fourth major layout
+ *	version
+ *
+ * The fourth layout version adds fields to the lane sections: the overflow
+ * redo log of the allocator section, and the redo log and the undo arena of
+ * the transaction section. They are zeroed in the lanes of the older pools,
+ * which is their initial state, and the logs of the older version are still
+ * recovered, so only the version number has to be changed.
+ */
+static int
+convert_v3_v4(void *poolset, void *addr)
+{
+	return 0;
+}
+
 /*
  * Collection of pool converting functions. Each array index is used as a
  * source version.
@@ -112,6 +128,7 @@ static convert_func version_convert[] = {
 	NULL, /* from version 0 to version 1 - does not exist */
 	convert_v1_v2, /* from v1 to v2 */
 	convert_v2_v3, /* from v2 to v3 */
+	convert_v3_v4, /* from v3 to v4 */
 };
 
 /*
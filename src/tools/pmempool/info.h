@@ -58,9 +58,10 @@
 
 /*
  * The MAX_CLASS_STATS variable defines how many allocation classes can be
- * handled - it's equal to the maximum number of buckets.
+ * handled - there's one for each possible block size of a run, including
+ * the ones of user-defined classes, and one for the chunks.
  */
-#define MAX_CLASS_STATS (MAX_BUCKETS + 1)
+#define MAX_CLASS_STATS ((int)(RUNSIZE / ALLOC_BLOCK_SIZE) + 2)
 
 /*
  * pmempool_info_args -- structure for storing command line arguments
@@ -123,6 +124,7 @@ struct pmem_blk_stats {
 struct pmem_obj_class_stats {
 	uint64_t n_units;
 	uint64_t n_used;
+	uint64_t n_runs;
 };
 
 struct pmem_obj_zone_stats {
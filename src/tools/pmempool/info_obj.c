@@ -51,7 +51,7 @@
 
 #define PTR_TO_OFF(pop, ptr) ((uintptr_t)ptr - (uintptr_t)pop)
 
-#define DEFAULT_BUCKET MAX_BUCKETS
+#define DEFAULT_BUCKET (MAX_CLASS_STATS - 1)
 
 typedef void (*pvector_callback_fn)(struct pmem_info *pip, int v, int vnum,
 		void *ptr, size_t i);
@@ -119,6 +119,30 @@ lane_need_recovery_tx(struct pmem_info *pip,
 		set_cache = (range->offset && range->size);
 	}
 
+	/* the redo log is kept between transactions, but emptied */
+	int redo = 0;
+
+	if (section->redo_log != 0) {
+		struct tx_range *range = OFF_TO_PTR(pip->obj.pop,
+			section->redo_log);
+
+		redo = range->offset != 0;
+	}
+
+	/* any chunk may begin with a valid entry */
+	struct tx_arena *chunk;
+	int arena = 0;
+
+	for (off = section->arena; off != 0; off = chunk->next) {
+		chunk = OFF_TO_PTR(pip->obj.pop, off);
+		struct tx_arena_entry *e = (struct tx_arena_entry *)chunk->data;
+
+		if (section->arena_gen != 0 && e->gen == section->arena_gen) {
+			arena = 1;
+			break;
+		}
+	}
+
 	/*
 	 * The transaction section needs recovery
 	 * if state is not committed and
@@ -128,7 +152,7 @@ lane_need_recovery_tx(struct pmem_info *pip,
 		(!PVECTOR_EMPTY(section->undo_log[UNDO_ALLOC]) ||
 		!PVECTOR_EMPTY(section->undo_log[UNDO_FREE]) ||
 		!PVECTOR_EMPTY(section->undo_log[UNDO_SET]) ||
-		set_cache);
+		redo || set_cache || arena);
 }
 
 /*
@@ -178,22 +202,26 @@ heap_class_to_size(int class)
  * get_bitmap_size -- get number of used bits in chunk run's bitmap
  */
 static uint32_t
-get_bitmap_size(struct chunk_run *run)
+get_bitmap_size(struct chunk_run *run, uint32_t size_idx)
 {
-	uint64_t size = RUNSIZE / run->block_size;
-	assert(size <= UINT32_MAX);
-	return (uint32_t)size;
+	uint64_t nallocs = 0;
+	if (util_heap_get_bitmap_params(run->block_size, size_idx, &nallocs,
+			NULL, NULL))
+		return 0;
+
+	return (uint32_t)nallocs;
 }
 
 /*
  * get_bitmap_reserved -- get number of reserved blocks in chunk run
  */
 static int
-get_bitmap_reserved(struct chunk_run *run, uint32_t *reserved)
+get_bitmap_reserved(struct chunk_run *run, uint32_t size_idx,
+	uint32_t *reserved)
 {
 	uint64_t nvals = 0;
 	uint64_t last_val = 0;
-	if (util_heap_get_bitmap_params(run->block_size, NULL, &nvals,
+	if (util_heap_get_bitmap_params(run->block_size, size_idx, NULL, &nvals,
 			&last_val))
 		return -1;
 
@@ -286,6 +314,7 @@ info_obj_lane_alloc(int v, struct lane_section_layout *layout)
 	struct lane_alloc_layout *section =
 		(struct lane_alloc_layout *)layout;
 	info_obj_redo(v, &section->redo[0], ALLOC_REDO_LOG_SIZE);
+	outv_field(v, "Overflow Redo Log", "0x%016lx", section->overflow);
 }
 
 /*
@@ -436,6 +465,53 @@ set_entry_cache_cb(struct pmem_info *pip, int v, int vid,
 		outv_indent(v, -1);
 }
 
+/*
+ * info_obj_arena -- print valid entries of the undo arena
+ */
+static void
+info_obj_arena(struct pmem_info *pip, int v, struct lane_tx_layout *section)
+{
+	uint64_t gen = section->arena_gen;
+	size_t nentries = 0;
+	struct tx_arena *chunk;
+	struct tx_arena_entry *e;
+	uint64_t off;
+	uint64_t pos;
+
+	for (off = section->arena; off != 0; off = chunk->next) {
+		chunk = OFF_TO_PTR(pip->obj.pop, off);
+		for (pos = 0; pos + sizeof(*e) <= chunk->size;
+				pos += TX_ARENA_ENTRY_SIZE(e->size)) {
+			e = (struct tx_arena_entry *)(chunk->data + pos);
+			if (gen == 0 || e->gen != gen)
+				break;
+			nentries++;
+		}
+	}
+
+	outv_field(v, "Undo Arena - set", "%lu element%s", nentries,
+			nentries != 1 ? "s" : "");
+
+	outv_indent(v, 1);
+
+	size_t i = 0;
+	for (off = section->arena; off != 0; off = chunk->next) {
+		chunk = OFF_TO_PTR(pip->obj.pop, off);
+		for (pos = 0; pos + sizeof(*e) <= chunk->size;
+				pos += TX_ARENA_ENTRY_SIZE(e->size)) {
+			e = (struct tx_arena_entry *)(chunk->data + pos);
+			if (gen == 0 || e->gen != gen)
+				break;
+
+			outv(v, "%010zu: Offset: 0x%016lx Size: %s\n", i++,
+				e->offset,
+				out_get_size_str(e->size, pip->args.human));
+		}
+	}
+
+	outv_indent(v, -1);
+}
+
 /*
  * info_obj_lane_tx -- print transaction's lane section
  */
@@ -446,6 +522,7 @@ info_obj_lane_tx(struct pmem_info *pip, int v,
 	struct lane_tx_layout *section = (struct lane_tx_layout *)layout;
 
 	outv_field(v, "State", "%s", out_get_tx_state_str(section->state));
+	outv_field(v, "Redo Log", "0x%016lx", section->redo_log);
 
 	int vobj = v && (pip->args.obj.valloc || pip->args.obj.voobhdr);
 	info_obj_pvector(pip, v, vobj, &section->undo_log[UNDO_ALLOC],
@@ -456,6 +533,9 @@ info_obj_lane_tx(struct pmem_info *pip, int v,
 			"Undo Log - set", set_entry_cb);
 	info_obj_pvector(pip, v, v, &section->undo_log[UNDO_SET_CACHE],
 			"Undo Log - set cache", set_entry_cache_cb);
+	outv_field(v, "Undo Arena", "0x%016lx", section->arena);
+	outv_field(v, "Undo Arena Generation", "%lu", section->arena_gen);
+	info_obj_arena(pip, v, section);
 
 }
 
@@ -622,9 +702,10 @@ info_obj_object(struct pmem_info *pip, struct obj_header *objh,
  * info_obj_run_objects -- print information about objects from chunk run
  */
 static void
-info_obj_run_objects(struct pmem_info *pip, int v, struct chunk_run *run)
+info_obj_run_objects(struct pmem_info *pip, int v, struct chunk_run *run,
+	uint32_t size_idx)
 {
-	uint32_t bsize = get_bitmap_size(run);
+	uint32_t bsize = get_bitmap_size(run, size_idx);
 	uint32_t i = 0;
 	while (i < bsize) {
 		uint32_t nval = i / BITS_PER_VALUE;
@@ -653,9 +734,9 @@ info_obj_run_objects(struct pmem_info *pip, int v, struct chunk_run *run)
  * info_obj_run_bitmap -- print chunk run's bitmap
  */
 static void
-info_obj_run_bitmap(int v, struct chunk_run *run)
+info_obj_run_bitmap(int v, struct chunk_run *run, uint32_t size_idx)
 {
-	uint32_t bsize = get_bitmap_size(run);
+	uint32_t bsize = get_bitmap_size(run, size_idx);
 
 	if (outv_check(v) && outv_check(VERBOSE_MAX)) {
 		/* print all values from bitmap for higher verbosity */
@@ -732,20 +813,24 @@ info_obj_chunk(struct pmem_info *pip, uint64_t c,
 					out_get_size_str(run->block_size,
 						pip->args.human));
 
-			uint32_t units = get_bitmap_size(run);
+			uint32_t units = get_bitmap_size(run,
+					chunk_hdr->size_idx);
 			uint32_t used = 0;
-			if (get_bitmap_reserved(run,  &used)) {
+			if (get_bitmap_reserved(run, chunk_hdr->size_idx,
+					&used)) {
 				outv_field(v, "Bitmap", "[error]");
 			} else {
 				stats->class_stats[class].n_units += units;
 				stats->class_stats[class].n_used += used;
+				stats->class_stats[class].n_runs++;
 
 				outv_field(v, "Bitmap", "%u / %u", used, units);
 			}
 
-			info_obj_run_bitmap(v && pip->args.obj.vbitmap, run);
+			info_obj_run_bitmap(v && pip->args.obj.vbitmap, run,
+					chunk_hdr->size_idx);
 			info_obj_run_objects(pip, v && pip->args.obj.vobjects,
-					run);
+					run, chunk_hdr->size_idx);
 		} else {
 			outv_field(v, "Block size", "%s [invalid!]",
 					out_get_size_str(run->block_size,
@@ -966,6 +1051,9 @@ info_obj_stats_alloc_classes(struct pmem_info *pip, int v,
 		outv_nl(v);
 		outv_field(v, "Unit size", "%s", out_get_size_str(
 					class_size, pip->args.human));
+		if (class != DEFAULT_BUCKET)
+			outv_field(v, "Runs", "%lu",
+				stats->class_stats[class].n_runs);
 		outv_field(v, "Units", "%lu",
 				stats->class_stats[class].n_units);
 		outv_field(v, "Used units", "%lu [%s]",
@@ -1061,11 +1149,13 @@ info_obj_add_zone_stats(struct pmem_obj_zone_stats *total,
 			stats->size_chunks_type[type];
 	}
 
-	for (int class = 0; class < MAX_BUCKETS; class++) {
+	for (int class = 0; class < DEFAULT_BUCKET; class++) {
 		total->class_stats[class].n_units +=
 			stats->class_stats[class].n_units;
 		total->class_stats[class].n_used +=
 			stats->class_stats[class].n_used;
+		total->class_stats[class].n_runs +=
+			stats->class_stats[class].n_runs;
 	}
 }
 
@@ -115,6 +115,17 @@ __builtin_clzll(uint64_t val)
 		return 64;
 }
 
+__inline int
+__builtin_ctzll(uint64_t val)
+{
+	DWORD tz = 0;
+
+	if (BitScanForward64(&tz, val))
+		return (int)tz;
+	else
+		return 64;
+}
+
 __inline int
 __builtin_ffsll(long long val)
 {